@@ -0,0 +1,472 @@
+################################################################################
+# Python interface of the vimbaserver client library (libcamclient)
+###############################################################################
+#
+# libcamclient receives the frames of one camera port and decodes all wire
+# encodings (packed, tile, sparse, delta). Build it in tools/vimbaserver/v0.03
+# with "make libcamclient.so" or point CAMCLIENT_LIBRARY to it.
+#
+#   client = CamClient("localhost", 42001)
+#   client.set_option("encoding delta")
+#   image, info = client.receive()
+#
+# All cameras over one connection: connect to the multiplexed port (control
+# port + 100), set_option("subscribe all"), info["stream_id"] tells the
+# camera (see streams()).
+#
+# For a quick look, set_option("subscribe 0 preview") sends 8-bit frames
+# averaged over 4 x 4 pixels at 5 fps, see set_option("preview 8") and
+# set_option("preview_fps 2").
+#
+# The encoding is negotiated on connect (session()): packed, raw for formats
+# that cannot be packed. set_option("encoding tile") overrides it.
+# The server lowers the quality while the connection is too slow, see
+# set_option("latency 100") / set_option("adaptive off") and session()["quality"].
+#
+# UDP transport (<udp> of the camera in config.xml): any number of receivers
+# share one multicast stream, there are no options.
+#
+#   client = CamClient("239.255.42.1", 43001, udp=True)
+#   image, info = client.receive()
+#   client.udp_stats()["frames_incomplete"]
+#
+# On the camera host (<shm> of the camera in config.xml), frames are read in
+# place from shared memory:
+#
+#   reader = CamShmReader("DEV_1AB22C014125")
+#   image, info = reader.receive()
+#
+# Single frames on request from the control port (the newest one, "tile" or
+# "packed" to save bandwidth, "preview 4" for 8 bit):
+#
+#   control = CamControl("localhost", 42000)
+#   image, info = control.snapshot(0, "tile")
+#
+# The control port also sets features and starts/stops the acquisition, the
+# camera thread answers (up to 5 s). Events of subscribed cameras come along
+# with the answers:
+#
+#   value, generation = control.set(0, "ExposureTime", 2000)
+#   control.get("DEV_1AB22C014125", "ExposureTime")
+#   control.subscribe("all")
+#   control.stats(0)["dropped"]
+#   control.events()
+#
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation, either version 3 of the License, or (at your
+# option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program. If not, see <https://www.gnu.org/licenses/>.
+#
+###############################################################################
+
+import os
+import ctypes
+import numpy as np
+
+try:
+    from E320 import camprotocol
+except ImportError:
+    import camprotocol
+
+
+#
+# see camclient.h
+#
+class CamClientFrame(ctypes.Structure):
+    _fields_ = [
+        ("width", ctypes.c_uint32),
+        ("height", ctypes.c_uint32),
+        ("offset_x", ctypes.c_uint32),
+        ("offset_y", ctypes.c_uint32),
+        ("pixel_format", ctypes.c_uint32),
+        ("bytes_per_pixel", ctypes.c_uint32),
+        ("time_stamp", ctypes.c_uint64),
+        ("frame_id", ctypes.c_uint64),
+        ("wire_pixel_format", ctypes.c_uint32),
+        ("wire_size", ctypes.c_uint32),
+        ("data", ctypes.POINTER(ctypes.c_uint8)),
+        ("size", ctypes.c_uint64),
+        ("stream_id", ctypes.c_uint32),
+    ]
+
+
+class CamClientSession(ctypes.Structure):
+    _fields_ = [
+        ("protocol", ctypes.c_uint32),
+        ("server_capabilities", ctypes.c_uint32),
+        ("capabilities", ctypes.c_uint32),
+        ("encoding", ctypes.c_uint32),
+        ("delivery", ctypes.c_uint32),
+        ("frames_sent", ctypes.c_uint64),
+        ("frames_conflated", ctypes.c_uint64),
+        ("send_calls", ctypes.c_uint64),
+        ("zerocopy_fallbacks", ctypes.c_uint64),
+        ("ring_overwritten", ctypes.c_uint64),
+        ("ring_dropped", ctypes.c_uint64),
+        ("quality", ctypes.c_uint64),
+        ("link_rate", ctypes.c_uint64),
+        ("queue_delay_us", ctypes.c_uint64),
+    ]
+
+
+class CamClientUdpStats(ctypes.Structure):
+    _fields_ = [
+        ("datagrams_received", ctypes.c_uint64),
+        ("datagrams_lost", ctypes.c_uint64),
+        ("datagrams_late", ctypes.c_uint64),
+        ("datagrams_invalid", ctypes.c_uint64),
+        ("bytes_received", ctypes.c_uint64),
+        ("frames_complete", ctypes.c_uint64),
+        ("frames_incomplete", ctypes.c_uint64),
+    ]
+
+
+class CamShmFrame(ctypes.Structure):
+    _fields_ = [
+        ("width", ctypes.c_uint32),
+        ("height", ctypes.c_uint32),
+        ("offset_x", ctypes.c_uint32),
+        ("offset_y", ctypes.c_uint32),
+        ("pixel_format", ctypes.c_uint32),
+        ("bytes_per_pixel", ctypes.c_uint32),
+        ("time_stamp", ctypes.c_uint64),
+        ("frame_id", ctypes.c_uint64),
+        ("data", ctypes.POINTER(ctypes.c_uint8)),
+        ("size", ctypes.c_uint64),
+        ("sequence", ctypes.c_uint64),
+        ("slot", ctypes.c_void_p),
+        ("settings", ctypes.c_uint32),
+    ]
+
+
+class CamShmStats(ctypes.Structure):
+    _fields_ = [
+        ("frames", ctypes.c_uint64),
+        ("frames_missed", ctypes.c_uint64),
+        ("frames_torn", ctypes.c_uint64),
+        ("segments", ctypes.c_uint64),
+    ]
+
+
+def load_library():
+    path = os.environ.get("CAMCLIENT_LIBRARY")
+    if path is None:
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools",
+                            "vimbaserver", "v0.03", "libcamclient.so")
+    library = ctypes.CDLL(path)
+
+    library.camclient_open.restype = ctypes.c_void_p
+    library.camclient_open.argtypes = [ctypes.c_char_p, ctypes.c_int]
+    library.camclient_open_udp.restype = ctypes.c_void_p
+    library.camclient_open_udp.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p]
+    library.camclient_open_control.restype = ctypes.c_void_p
+    library.camclient_open_control.argtypes = [ctypes.c_char_p, ctypes.c_int]
+    library.camclient_close.restype = None
+    library.camclient_close.argtypes = [ctypes.c_void_p]
+    library.camclient_set_option.restype = ctypes.c_int
+    library.camclient_set_option.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    library.camclient_receive.restype = ctypes.c_int
+    library.camclient_receive.argtypes = [ctypes.c_void_p, ctypes.POINTER(CamClientFrame),
+                                          ctypes.c_int]
+    library.camclient_snapshot.restype = ctypes.c_int
+    library.camclient_snapshot.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                           ctypes.POINTER(CamClientFrame), ctypes.c_int]
+    library.camclient_command.restype = ctypes.c_int
+    library.camclient_command.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                          ctypes.POINTER(ctypes.c_char_p), ctypes.c_int]
+    library.camclient_get_events.restype = ctypes.c_char_p
+    library.camclient_get_events.argtypes = [ctypes.c_void_p]
+    library.camclient_get_error.restype = ctypes.c_char_p
+    library.camclient_get_error.argtypes = [ctypes.c_void_p]
+    library.camclient_get_session.restype = None
+    library.camclient_get_session.argtypes = [ctypes.c_void_p,
+                                              ctypes.POINTER(CamClientSession)]
+    library.camclient_get_metadata.restype = ctypes.c_char_p
+    library.camclient_get_metadata.argtypes = [ctypes.c_void_p]
+    library.camclient_get_bandwidth.restype = ctypes.c_char_p
+    library.camclient_get_bandwidth.argtypes = [ctypes.c_void_p]
+    library.camclient_get_udp_stats.restype = None
+    library.camclient_get_udp_stats.argtypes = [ctypes.c_void_p,
+                                                ctypes.POINTER(CamClientUdpStats)]
+
+    library.camshm_open.restype = ctypes.c_void_p
+    library.camshm_open.argtypes = [ctypes.c_char_p]
+    library.camshm_close.restype = None
+    library.camshm_close.argtypes = [ctypes.c_void_p]
+    library.camshm_receive.restype = ctypes.c_int
+    library.camshm_receive.argtypes = [ctypes.c_void_p, ctypes.POINTER(CamShmFrame), ctypes.c_int]
+    library.camshm_valid.restype = ctypes.c_int
+    library.camshm_valid.argtypes = [ctypes.c_void_p, ctypes.POINTER(CamShmFrame)]
+    library.camshm_get_stats.restype = None
+    library.camshm_get_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(CamShmStats)]
+    return library
+
+
+# USB cameras (v4l2 source): YUYV as (height, width, 2) bytes, MJPEG as the
+# bytes of the JPEG image
+PIXEL_FORMAT_YUV422_8 = 0x02100032
+PIXEL_FORMAT_MJPEG = 0x80000004
+
+
+# bytes of a frame (uint8 array) -> image; bit-packed and compressed formats:
+# the bytes as they are
+def frame_pixels(data, frame):
+    count = frame.width * frame.height
+    if frame.pixel_format == PIXEL_FORMAT_YUV422_8:
+        return data[:2 * count].reshape(frame.height, frame.width, 2)
+    if frame.bytes_per_pixel == 2:
+        return data[:2 * count].view(np.dtype('<u2')).reshape(frame.height, frame.width)
+    if frame.bytes_per_pixel == 1:
+        return data[:count].reshape(frame.height, frame.width)
+    return data
+
+
+# decoded frame -> (image, info)
+def frame_image(frame):
+    data = np.frombuffer(ctypes.string_at(frame.data, frame.size), dtype=np.uint8)
+    info = {
+        "stream_id": frame.stream_id,
+        "frame_id": frame.frame_id,
+        "time_stamp": frame.time_stamp,
+        "offset_x": frame.offset_x,
+        "offset_y": frame.offset_y,
+        "pixel_format": frame.pixel_format,
+        "wire_pixel_format": frame.wire_pixel_format,
+        "wire_size": frame.wire_size,
+    }
+    return frame_pixels(data, frame), info
+
+
+class CamClient:
+
+    # udp: host is the multicast group (None: datagrams sent to this host),
+    # joined on the local interface address
+    def __init__(self, host, port, library=None, udp=False, interface=None):
+        self.library = library if library is not None else load_library()
+        if udp:
+            self.handle = self.library.camclient_open_udp(
+                host.encode() if host else None, port,
+                interface.encode() if interface else None)
+        else:
+            self.handle = self.library.camclient_open(host.encode(), port)
+        if not self.handle:
+            raise ConnectionError("cannot connect to {}:{}".format(host, port))
+        self.udp = udp
+        self.frame = CamClientFrame()
+
+    def set_option(self, option):
+        if self.udp:
+            raise ValueError("no options over UDP")
+        if self.library.camclient_set_option(self.handle, option.encode()) != 0:
+            raise ConnectionError("connection lost")
+
+    # next frame as (2D array, info), None on timeout
+    def receive(self, timeout_ms=1000):
+        status = self.library.camclient_receive(self.handle, ctypes.byref(self.frame),
+                                                timeout_ms)
+        if status == 0:
+            return None
+        if status < 0:
+            raise ConnectionError("connection lost")
+
+        return frame_image(self.frame)
+
+    # handshake result and the last statistics of the server
+    def session(self):
+        session = CamClientSession()
+        self.library.camclient_get_session(self.handle, ctypes.byref(session))
+        return {name: getattr(session, name) for name, _ in session._fields_}
+
+    def metadata(self):
+        text = self.library.camclient_get_metadata(self.handle).decode(errors="replace")
+        return dict(line.partition(" ")[::2] for line in text.splitlines() if line)
+
+    # stream id -> camera name
+    def streams(self):
+        return camprotocol.parse_streams(self.library.camclient_get_metadata(self.handle))
+
+    # uplink per camera as last reported by the server, see camprotocol
+    def bandwidth(self):
+        return camprotocol.parse_bandwidth(self.library.camclient_get_bandwidth(self.handle))
+
+    # datagram and frame counters of the UDP transport
+    def udp_stats(self):
+        stats = CamClientUdpStats()
+        self.library.camclient_get_udp_stats(self.handle, ctypes.byref(stats))
+        return {name: getattr(stats, name) for name, _ in stats._fields_}
+
+    def close(self):
+        if self.handle:
+            self.library.camclient_close(self.handle)
+            self.handle = None
+
+    def __del__(self):
+        self.close()
+
+
+#
+# requests on the control port, see protocol.h
+#
+class CamControl:
+
+    def __init__(self, host, port, library=None):
+        self.library = library if library is not None else load_library()
+        self.handle = self.library.camclient_open_control(host.encode(), port)
+        if not self.handle:
+            raise ConnectionError("cannot connect to {}:{}".format(host, port))
+        self.frame = CamClientFrame()
+
+    # newest frame of a camera (index or id) as (2D array, info), None on
+    # timeout. options: "raw", "packed", "tile", "preview <n>"
+    def snapshot(self, camera, options="", timeout_ms=2000):
+        request = "{} {}".format(camera, options).strip()
+        status = self.library.camclient_snapshot(self.handle, request.encode(),
+                                                 ctypes.byref(self.frame), timeout_ms)
+        if status == 0:
+            return None
+        if status == -2:
+            error = self.library.camclient_get_error(self.handle)
+            raise ValueError(error.decode(errors="replace"))
+        if status < 0:
+            raise ConnectionError("connection lost")
+        return frame_image(self.frame)
+
+    # any request line, the answer text after "ok"
+    def command(self, request, timeout_ms=6000):
+        answer = ctypes.c_char_p()
+        status = self.library.camclient_command(self.handle, request.encode(),
+                                                ctypes.byref(answer), timeout_ms)
+        if status == 0:
+            raise TimeoutError(request)
+        if status == -2:
+            error = self.library.camclient_get_error(self.handle)
+            raise ValueError(error.decode(errors="replace"))
+        if status < 0:
+            raise ConnectionError("connection lost")
+        return answer.value.decode(errors="replace")
+
+    # {index: (camera id, state)}
+    def cameras(self):
+        words = self.command("cameras").split()
+        result = {}
+        for item in words[1:]:
+            index, name, state = item.split(":")
+            result[int(index)] = (name, state)
+        return result
+
+    # feature values are strings on the wire
+    def get(self, camera, feature):
+        return self.command("get {} {}".format(camera, feature))
+
+    # (value the camera took (it may round), settings generation): the
+    # frames with info["settings"] >= generation have the new value, see the
+    # "settings <n> frame <id>" event for the first one
+    def set(self, camera, feature, value):
+        words = self.command("set {} {} {}".format(camera, feature, value)).split()
+        return words[0], int(words[2])
+
+    def start(self, camera):
+        return self.command("start {}".format(camera))
+
+    def stop(self, camera):
+        return self.command("stop {}".format(camera))
+
+    # {"state": ..., "written": ..., "overwritten": ..., "dropped": ...}
+    def stats(self, camera):
+        words = self.command("stats {}".format(camera)).split()
+        result = {}
+        for key, value in zip(words[0::2], words[1::2]):
+            result[key] = int(value) if value.isdigit() else value
+        return result
+
+    # camera indices or ids, "all"
+    def subscribe(self, *cameras):
+        return int(self.command("subscribe " + " ".join(str(c) for c in cameras)))
+
+    def unsubscribe(self, *cameras):
+        return int(self.command("unsubscribe " + " ".join(str(c) for c in cameras)))
+
+    # [(camera index, text)] received since the last call
+    def events(self):
+        text = self.library.camclient_get_events(self.handle).decode(errors="replace")
+        result = []
+        for line in text.splitlines():
+            index, _, event = line.partition(" ")
+            result.append((int(index), event))
+        return result
+
+    def close(self):
+        if self.handle:
+            self.library.camclient_close(self.handle)
+            self.handle = None
+
+    def __del__(self):
+        self.close()
+
+
+#
+# frames of a camera in shared memory, see shm_ring.h
+#
+class CamShmReader:
+
+    # camera id, or the segment name ("/...")
+    def __init__(self, camera, library=None):
+        self.library = library if library is not None else load_library()
+        name = camera if camera.startswith("/") else "/vimbaserver_" + camera
+        self.handle = self.library.camshm_open(name.encode())
+        if not self.handle:
+            raise FileNotFoundError("no shared memory segment " + name)
+        self.frame = CamShmFrame()
+
+    # next frame as (2D array, info), None on timeout. copy=False: the array
+    # is the frame in shared memory, valid until the next receive if valid()
+    # still says so after it was used
+    def receive(self, timeout_ms=1000, copy=True):
+        while True:
+            if self.library.camshm_receive(self.handle, ctypes.byref(self.frame),
+                                           timeout_ms) != 1:
+                return None
+            frame = self.frame
+            data = np.ctypeslib.as_array(frame.data, shape=(frame.size,))
+            if copy:
+                data = data.copy()
+                # overwritten while it was copied: take the next one
+                if not self.valid():
+                    continue
+            break
+
+        info = {
+            "frame_id": frame.frame_id,
+            "time_stamp": frame.time_stamp,
+            "offset_x": frame.offset_x,
+            "offset_y": frame.offset_y,
+            "pixel_format": frame.pixel_format,
+            "settings": frame.settings,
+        }
+        return frame_pixels(data, frame), info
+
+    # the last frame wasn't overwritten yet
+    def valid(self):
+        return self.library.camshm_valid(self.handle, ctypes.byref(self.frame)) == 1
+
+    def stats(self):
+        stats = CamShmStats()
+        self.library.camshm_get_stats(self.handle, ctypes.byref(stats))
+        return {name: getattr(stats, name) for name, _ in stats._fields_}
+
+    def close(self):
+        if self.handle:
+            self.library.camshm_close(self.handle)
+            self.handle = None
+
+    def __del__(self):
+        self.close()
@@ -0,0 +1,178 @@
+################################################################################
+# Stream protocol of the vimbaserver
+###############################################################################
+#
+# Message framing and handshake, see protocol.h of the vimbaserver (v0.03):
+#
+#   client: preamble + HELLO(capabilities)
+#   server: preamble + WELCOME + METADATA, then FRAME/STATS/HEARTBEAT messages
+#
+# Every message starts with payload length (u32), type (u16), stream (u16).
+# The stream is the camera of a FRAME message: the multiplexed port of the
+# server (control port + 100) interleaves all subscribed cameras, e.g.
+#
+#   option("subscribe 0 2"), option("stream 2 decimation 4")
+#
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation, either version 3 of the License, or (at your
+# option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program. If not, see <https://www.gnu.org/licenses/>.
+#
+###############################################################################
+
+import struct
+
+PROTOCOL_MAGIC = b"CAMS"
+PROTOCOL_VERSION = 1
+PREAMBLE_LENGTH = 8
+MESSAGE_HEADER_LENGTH = 8
+FRAME_HEADER_LENGTH = 40
+
+MESSAGE_HELLO = 1
+MESSAGE_WELCOME = 2
+MESSAGE_OPTION = 3
+MESSAGE_METADATA = 4
+MESSAGE_FRAME = 5
+MESSAGE_STATS = 6
+MESSAGE_HEARTBEAT = 7
+MESSAGE_BANDWIDTH = 8
+
+CAPABILITY_PACKED = 1 << 0
+CAPABILITY_TILE = 1 << 1
+CAPABILITY_SPARSE = 1 << 2
+CAPABILITY_DELTA = 1 << 3
+CAPABILITY_GEOMETRY = 1 << 4
+CAPABILITY_DELIVERY = 1 << 5
+
+ENCODING_NAMES = ["raw", "packed", "tile", "sparse", "delta"]
+
+
+def preamble():
+    return PROTOCOL_MAGIC + struct.pack("<HH", PROTOCOL_VERSION, 0)
+
+
+def message(message_type, payload=b""):
+    return struct.pack("<IHH", len(payload), message_type, 0) + payload
+
+
+def hello(capabilities):
+    return preamble() + message(MESSAGE_HELLO, struct.pack("<I", capabilities))
+
+
+def option(line):
+    return message(MESSAGE_OPTION, line.encode())
+
+
+MUX_PORT_OFFSET = 100
+
+# UDP transport: datagram header, see protocol.h
+UDP_MAGIC = 0x554D4143
+UDP_HEADER_LENGTH = 32
+
+
+# -> dict, None if it isn't a datagram of the UDP transport
+def parse_udp_header(data):
+    if len(data) < UDP_HEADER_LENGTH:
+        return None
+    magic, stream, index, frame_id, message_length, count, length, sequence, offset = \
+        struct.unpack_from("<IHHQIHHII", data)
+    if magic != UDP_MAGIC:
+        return None
+    return {
+        "stream": stream,
+        "fragment_index": index,
+        "frame_id": frame_id,
+        "message_length": message_length,
+        "fragment_count": count,
+        "fragment_length": length,
+        "sequence": sequence,
+        "fragment_offset": offset,
+    }
+
+
+# (payload length, type, stream)
+def parse_message_header(data):
+    return struct.unpack("<IHH", data)
+
+
+# stream id -> camera name, from the "stream <id> <name>" lines of METADATA
+def parse_streams(payload):
+    streams = {}
+    for line in payload.decode(errors="replace").splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[0] == "stream":
+            streams[int(fields[1])] = fields[2]
+    return streams
+
+
+def parse_welcome(payload):
+    server_capabilities, capabilities, encoding, delivery = struct.unpack_from("<4I", payload)
+    return {
+        "server_capabilities": server_capabilities,
+        "capabilities": capabilities,
+        "encoding": ENCODING_NAMES[encoding] if encoding < len(ENCODING_NAMES) else encoding,
+        "delivery": "latest" if delivery == 1 else "lossless",
+    }
+
+
+def parse_metadata(payload):
+    metadata = {}
+    for line in payload.decode(errors="replace").splitlines():
+        key, _, value = line.partition(" ")
+        if key:
+            metadata[key] = value
+    return metadata
+
+
+QUALITY_NAMES = ["full", "packed", "compressed", "binned", "rate limited"]
+
+
+# older servers send the first six values only
+def parse_stats(payload):
+    keys = ["frames_sent", "frames_conflated", "send_calls", "zerocopy_fallbacks",
+            "ring_overwritten", "ring_dropped", "quality", "link_rate", "queue_delay_us"]
+    count = min(len(payload) // 8, len(keys))
+    return dict(zip(keys, struct.unpack_from("<{}Q".format(count), payload)))
+
+
+# stream id -> {"name", "rate", "throughput", "demand" (Mbit/s), "level"}
+def parse_bandwidth(payload):
+    streams = {}
+    for line in payload.decode(errors="replace").splitlines():
+        fields = line.split()
+        if len(fields) != 10:
+            continue
+        values = dict(zip(fields[2::2], fields[3::2]))
+        streams[int(fields[0])] = {
+            "name": fields[1],
+            "rate": float(values["rate"]),
+            "throughput": float(values["throughput"]),
+            "demand": float(values["demand"]),
+            "level": int(values["level"]),
+        }
+    return streams
+
+
+# frame header -> dict
+def parse_frame_header(data):
+    size, width, height, offset_x, offset_y, pixel_format, time_stamp, frame_id = \
+        struct.unpack_from("<6IQQ", data)
+    return {
+        "size": size,
+        "width": width,
+        "height": height,
+        "offset_x": offset_x,
+        "offset_y": offset_y,
+        "pixel_format": pixel_format,
+        "time_stamp": time_stamp,
+        "frame_id": frame_id,
+    }
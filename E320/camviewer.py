@@ -4,6 +4,11 @@
 #
 # Connects to a streaming server (vimbaserv.cpp) and displays images.
 #
+# Speaks the stream protocol of the vimbaserver (camprotocol.py): asks for
+# bit-packed frames and only the newest frame. Servers that don't answer the
+# handshake are read with the old 12-byte header (width, height, bytes per
+# pixel).
+#
 # GUI realized with PyQT5
 # Python multithreading to realize the network interface
 # Employs mutex to communicate safely between threads
@@ -33,6 +38,7 @@ import numpy as np
 import threading
 import time
 import socket
+import struct
 
 from PyQt5.QtWidgets import (
     QApplication,
@@ -47,6 +53,13 @@ from PyQt5.QtWidgets import (
 from PyQt5.QtGui import QColor, QPixmap, QImage
 from PyQt5.QtCore import Qt
 
+try:
+    from E320 import camprotocol
+    from E320.pixelformat import decode_image, pixel_format_bits
+except ImportError:
+    import camprotocol
+    from pixelformat import decode_image, pixel_format_bits
+
 #
 # There is an issue with using OpenCV (cv2) and PyQt simultaneously,
 # as they are both using Qt and not the same library. Thus, we are
@@ -69,6 +82,10 @@ NETWORK_SERVER = "192.168.0.8"
 
 SERVER_TIMEOUT = 3  # seconds
 
+# what this viewer decodes: raw and bit-packed frames, ROI options
+VIEWER_CAPABILITIES = (camprotocol.CAPABILITY_PACKED | camprotocol.CAPABILITY_GEOMETRY |
+                       camprotocol.CAPABILITY_DELIVERY)
+
 
 # Initial window size
 WINDOW_WIDTH = 1280
@@ -119,6 +136,43 @@ def socket_read(netsocket, length):
     return data
 
 
+#
+# old servers: width, height, bytes per pixel, then the 12 bit image
+#
+def read_legacy_image(netsocket, header):
+    width, height, length = struct.unpack("<3I", header)
+    imagebuffer = socket_read(netsocket, width * height * length)
+    nparr = np.frombuffer(imagebuffer, dtype=np.uint16)
+    return np.multiply(nparr.reshape(height, width), int(65535 / 4095)), len(imagebuffer)
+
+
+#
+# next FRAME message -> image scaled to 8 or 16 bit, other messages skipped
+#
+def read_protocol_image(netsocket):
+    while True:
+        length, message_type, stream = camprotocol.parse_message_header(
+            socket_read(netsocket, camprotocol.MESSAGE_HEADER_LENGTH)
+        )
+        payload = socket_read(netsocket, length)
+        if message_type == camprotocol.MESSAGE_STATS:
+            print("server statistics: ", camprotocol.parse_stats(payload))
+        if message_type != camprotocol.MESSAGE_FRAME:
+            continue
+
+        header = camprotocol.parse_frame_header(payload)
+        image = decode_image(
+            payload[camprotocol.FRAME_HEADER_LENGTH:],
+            header["width"],
+            header["height"],
+            header["pixel_format"],
+        )
+        bits = pixel_format_bits(header["pixel_format"])
+        if bits > 8:
+            image = np.left_shift(image.astype(np.uint16), 16 - bits)
+        return np.ascontiguousarray(image), len(payload)
+
+
 def camviewerNetworkThread(mainwindow):
     global network_port
     while True:
@@ -129,61 +183,49 @@ def camviewerNetworkThread(mainwindow):
 
         try:
             netsocket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            netsocket.settimeout(SERVER_TIMEOUT)
             hostip = socket.gethostbyname(NETWORK_SERVER)
             netsocket.connect((hostip, network_port))
             print("network connection established: ", hostip)
 
-            image_size = None
+            #####
+            # Handshake: the server answers with its preamble
+            netsocket.sendall(camprotocol.hello(VIEWER_CAPABILITIES))
+            preamble = socket_read(netsocket, camprotocol.PREAMBLE_LENGTH)
+            protocol = preamble.startswith(camprotocol.PROTOCOL_MAGIC)
+            if protocol:
+                netsocket.sendall(camprotocol.option("delivery latest"))
+                print("stream protocol, version ", struct.unpack_from("<H", preamble, 4)[0])
+            else:
+                print("legacy server")
+
             while True:
                 if testRunningCondition(mainwindow) is False:
                     netsocket.close()
                     return
 
                 loopcount = 20
+                data_size = 0
                 starttime = time.time() * 1000.0  # ms
                 for i in range(loopcount):
-                    #####
-                    # Read header
-                    header = socket_read(netsocket, 12)
-                    width = 0
-                    width += header[0] << 0
-                    width += header[1] << 8
-                    width += header[2] << 16
-                    width += header[3] << 24
-
-                    height = 0
-                    height += header[4] << 0
-                    height += header[5] << 8
-                    height += header[6] << 16
-                    height += header[7] << 24
-
-                    length = 0
-                    length += header[8] << 0
-                    length += header[9] << 8
-                    length += header[10] << 16
-                    length += header[11] << 24
-
-                    # print("image size: ", width, "\t", height, "\t", length)
-                    image_size = width * height * length
-
                     #####
                     # Read one image
-                    imagebuffer = socket_read(netsocket, image_size)
-
-                    # print(imagebuffer)
-                    #####
-                    # Convert image
-                    #  https://www.kernel.org/doc/html/v5.0/media/uapi/v4l/pixfmt-yuyv.html
-                    # The Cb/Cr components have only half the resolution.
-                    # Therefore, we need to rescale.
-                    nparr = np.frombuffer(imagebuffer, dtype=np.uint16)
-                    image = np.multiply(nparr.reshape(height, width), int(65535 / 4095))
-
-                    # print(image)
-
-                    qimage = QImage(
-                        image, image.shape[1], image.shape[0], QImage.Format_Grayscale16
-                    )
+                    if protocol:
+                        image, size = read_protocol_image(netsocket)
+                    elif preamble is not None:
+                        header = preamble + socket_read(netsocket, 4)
+                        preamble = None
+                        image, size = read_legacy_image(netsocket, header)
+                    else:
+                        image, size = read_legacy_image(netsocket, socket_read(netsocket, 12))
+                    data_size += size
+
+                    height, width = image.shape
+                    if image.dtype == np.uint8:
+                        qimage = QImage(image, width, height, width, QImage.Format_Grayscale8)
+                    else:
+                        qimage = QImage(image, width, height, 2 * width,
+                                        QImage.Format_Grayscale16)
                     pixmap = QPixmap(qimage)
                     mainwindow.label.setPixmap(pixmap)
 
@@ -201,7 +243,7 @@ def camviewerNetworkThread(mainwindow):
 
                 stoptime = time.time() * 1000.0  # ms
                 fps = float(loopcount * 1000) / float(stoptime - starttime)
-                print("Data: ", fps * image_size * 8 / 1e6, "MBit/s; FPS: ", fps)
+                print("Data: ", fps * data_size / loopcount * 8 / 1e6, "MBit/s; FPS: ", fps)
 
         except Exception as e:
             print("exception occured: ")
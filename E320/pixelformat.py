@@ -0,0 +1,133 @@
+################################################################################
+# Decoding of the image encodings sent by the vimbaserver
+###############################################################################
+#
+# The server sends Mono10/Mono12 either as 16 bit little endian words (raw)
+# or bit-packed (Mono10p/Mono12p, GenICam PFNC): pixels are packed LSB
+# first without any padding, 4 pixels in 5 bytes or 2 pixels in 3 bytes.
+#
+# Sparse frames (PIXEL_FORMAT_SPARSE) only carry the runs of pixels above a
+# threshold, all other pixels are set to the pedestal.
+#
+# decode_image() turns the image data into a 2D numpy array.
+#
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation, either version 3 of the License, or (at your
+# option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program. If not, see <https://www.gnu.org/licenses/>.
+#
+###############################################################################
+
+import numpy as np
+
+#
+# PFNC pixel formats (see encoding.h of the vimbaserver)
+#
+PIXEL_FORMAT_MONO8 = 0x01080001
+PIXEL_FORMAT_MONO10 = 0x01100003
+PIXEL_FORMAT_MONO12 = 0x01100005
+PIXEL_FORMAT_MONO14 = 0x01100025
+PIXEL_FORMAT_MONO16 = 0x01100007
+PIXEL_FORMAT_MONO10P = 0x010A0046
+PIXEL_FORMAT_MONO12P = 0x010C0047
+PIXEL_FORMAT_SPARSE = 0x80000002
+
+SPARSE_MAGIC = 0x31525053
+
+
+#
+# valid bits per pixel of the decoded image
+#
+def pixel_format_bits(pixel_format):
+    bits = {
+        PIXEL_FORMAT_MONO8: 8,
+        PIXEL_FORMAT_MONO10: 10,
+        PIXEL_FORMAT_MONO10P: 10,
+        PIXEL_FORMAT_MONO12: 12,
+        PIXEL_FORMAT_MONO12P: 12,
+        PIXEL_FORMAT_MONO14: 14,
+    }
+    return bits.get(pixel_format, 16)
+
+
+#
+# Mono10p: 4 pixels in 5 bytes
+#
+def unpack_mono10p(data, pixel_count):
+    groups = (pixel_count + 3) // 4
+    packed = np.zeros(groups * 5, dtype=np.uint8)
+    packed[:len(data)] = np.frombuffer(data, dtype=np.uint8)[:groups * 5]
+    b = packed.reshape(groups, 5).astype(np.uint16)
+
+    pixels = np.empty((groups, 4), dtype=np.uint16)
+    pixels[:, 0] = b[:, 0] | ((b[:, 1] & 0x03) << 8)
+    pixels[:, 1] = (b[:, 1] >> 2) | ((b[:, 2] & 0x0F) << 6)
+    pixels[:, 2] = (b[:, 2] >> 4) | ((b[:, 3] & 0x3F) << 4)
+    pixels[:, 3] = (b[:, 3] >> 6) | (b[:, 4] << 2)
+    return pixels.reshape(-1)[:pixel_count]
+
+
+#
+# Mono12p: 2 pixels in 3 bytes
+#
+def unpack_mono12p(data, pixel_count):
+    groups = (pixel_count + 1) // 2
+    packed = np.zeros(groups * 3, dtype=np.uint8)
+    packed[:len(data)] = np.frombuffer(data, dtype=np.uint8)[:groups * 3]
+    b = packed.reshape(groups, 3).astype(np.uint16)
+
+    pixels = np.empty((groups, 2), dtype=np.uint16)
+    pixels[:, 0] = b[:, 0] | ((b[:, 1] & 0x0F) << 8)
+    pixels[:, 1] = (b[:, 1] >> 4) | (b[:, 2] << 4)
+    return pixels.reshape(-1)[:pixel_count]
+
+
+#
+# sparse message (see sparse.h of the vimbaserver) -> 2D array
+#
+def decode_sparse(data):
+    header = np.frombuffer(data, dtype='<u4', count=7)
+    magic, pixel_format, width, height, pedestal, threshold, run_count = header
+    if magic != SPARSE_MAGIC:
+        raise ValueError("not a sparse frame")
+
+    dtype = np.uint8 if pixel_format == PIXEL_FORMAT_MONO8 else np.uint16
+    image = np.full(int(width) * int(height), pedestal, dtype=dtype)
+
+    runs = np.frombuffer(data, dtype='<u4', count=2 * int(run_count), offset=28)
+    values = np.frombuffer(data, dtype=np.dtype(dtype).newbyteorder('<'),
+                           offset=28 + 8 * int(run_count))
+    position = 0
+    for first, length in runs.reshape(-1, 2):
+        image[first:first + length] = values[position:position + length]
+        position += length
+    return image.reshape(height, width)
+
+
+#
+# image data -> 2D array (height, width)
+#
+def decode_image(data, width, height, pixel_format):
+    pixel_count = width * height
+
+    if pixel_format == PIXEL_FORMAT_SPARSE:
+        return decode_sparse(data)
+    elif pixel_format == PIXEL_FORMAT_MONO10P:
+        pixels = unpack_mono10p(data, pixel_count)
+    elif pixel_format == PIXEL_FORMAT_MONO12P:
+        pixels = unpack_mono12p(data, pixel_count)
+    elif pixel_format == PIXEL_FORMAT_MONO8:
+        pixels = np.frombuffer(data, dtype=np.uint8)[:pixel_count]
+    else:
+        pixels = np.frombuffer(data, dtype='<u2')[:pixel_count]
+
+    return pixels.reshape(height, width)
@@ -3,15 +3,31 @@
 
  Finds and resets the camera via libusb.
  Captures images from the camera via v4l.
- Converts YUV2 -> BGR using opencv
  Runs a simple TCP server to stream the images.
+
+ The images are sent as the camera delivers them, straight from the mmap'd
+ v4l buffers: raw YUYV (2 bytes per pixel, 1/3 less than BGR) or MJPEG
+ (no decoding at all). The conversion to BGR is done by the client
+ (camviewer.py).
+
+ Protocol: after connecting, the client sends one line with the format it
+ wants, "format yuyv\n" or "format mjpeg\n". Without a request within
+ CLIENT_REQUEST_TIMEOUT, the format of the command line is used:
+ 	./camserver [yuyv|mjpeg]		(default: yuyv)
+ Every image is preceded by a header of FRAME_HEADER_SIZE bytes (little
+ endian):
+ 	char		magic[4]	"CAMF"
+ 	uint32_t	format		v4l2 fourcc, "YUYV" or "MJPG"
+ 	uint16_t	width
+ 	uint16_t	height
+ 	uint32_t	size		bytes of the image that follow
  
  Context: we would like to stream uncompressed images from a raspberry 
  pi in the FACET tunnel to a control computer in the SLAC/FACET network 
  or even outside. The FACET control computers can be reached via an 
  ssh port tunnel.
  
- Compile with g++ camserv.cpp -I/usr/include/opencv4/ -lusb-1.0 -lv4l2 -lopencv_core -lopencv_highgui -lopencv_imgproc -lopencv_imgcodecs -o camserver -o camserver
+ Compile with g++ camserv.cpp -lusb-1.0 -lv4l2 -o camserver
  
  This program is free software: you can redistribute it and/or modify it
  under the terms of the GNU General Public License as published by the
@@ -60,11 +76,6 @@
 #include <linux/videodev2.h>
 #include <libv4l2.h>
 
-#include <opencv2/opencv.hpp>
-#include <opencv2/core.hpp>
-#include <opencv2/highgui.hpp>
-#include <opencv2/imgproc/imgproc.hpp>
-
 
 /*
    Camera parameters
@@ -86,6 +97,9 @@
 #define IMAGE_HORZ			PIXEL_WIDTH
 #define IMAGE_VERT			PIXEL_HEIGHT
 
+#define CLIENT_REQUEST_TIMEOUT		1	//timeout in seconds
+#define FRAME_HEADER_SIZE		16
+
 #define TIME_STRING_BUFFER_SIZE	32
 #define CRC_STRING_BUFFER_SIZE		8
 
@@ -99,14 +113,158 @@ struct CAM_DATA_BUFFER_STRUCT{
 };
 
 
+/*
+   Sets the image format and starts streaming: the kernel puts images into
+   the buffers. Returns the format the camera delivers.
+ */
+v4l2_pix_format start_capture(int fd, uint32_t pixelformat, CAM_DATA_BUFFER_STRUCT* buffers)
+{
+	unsigned int		i;
+	struct v4l2_buffer	buf;
+
+	/*
+	  Set the image format
+	 */
+	v4l2_format imageFormat;
+	memset(&imageFormat,0,sizeof(imageFormat));
+	imageFormat.type 			= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	imageFormat.fmt.pix.width  		= PIXEL_WIDTH;
+	imageFormat.fmt.pix.height 		= PIXEL_HEIGHT;
+	imageFormat.fmt.pix.pixelformat 	= pixelformat;
+	imageFormat.fmt.pix.field 		= V4L2_FIELD_NONE;
+	// tell the device you are using this format
+	if(ioctl(fd, VIDIOC_S_FMT, &imageFormat) < 0){
+		perror("Setting the image format failed");
+		throw -1;
+	}
+	if(imageFormat.fmt.pix.pixelformat != pixelformat){
+		printf("Image format not supported by the camera\n");
+		throw -1;
+	}
+
+	/*
+	  Request the buffers for the image
+	 */
+	struct v4l2_requestbuffers req = {0};
+	req.count	= BUFFER_COUNT;
+	req.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory	= V4L2_MEMORY_MMAP;
+	if(ioctl(fd, VIDIOC_REQBUFS, &req) < 0 || req.count != BUFFER_COUNT){
+		perror("Requesting image buffers failed");
+		throw -1;
+	}
+
+	/*
+	  Map the buffers:
+	  we store the information for every buffer in "buffers", but we use
+	  only one "buf" structure for passing the information to v4l
+	 */
+	for (i = 0; i < BUFFER_COUNT; i++) {
+		memset(&buf,0,sizeof(buf));
+		buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory      = V4L2_MEMORY_MMAP;
+		buf.index       = i;
+
+		if(ioctl(fd, VIDIOC_QUERYBUF, &buf) < 0){
+			perror("VIDIOC_QUERYBUF failed");
+			throw -1;
+		}
+		buffers[i].length = buf.length;
+		buffers[i].start = v4l2_mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+
+		if (buffers[i].start == MAP_FAILED) {
+			buffers[i].start	= NULL;
+			perror("Can not map this buffer.");
+			throw -1;
+		}
+	}
+
+	/*
+	  Put the buffers into the streaming queue
+	 */
+	for (i = 0; i < BUFFER_COUNT; i++) {
+		memset(&buf,0,sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = i;
+		if(ioctl(fd, VIDIOC_QBUF, &buf) < 0){
+			perror("Buffer queuing failed");
+			throw -1;
+		}
+	}
+	/*
+	  Activate streaming: the kernel puts images into the buffer
+	 */
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(ioctl(fd, VIDIOC_STREAMON, &type) < 0){
+		perror("Starting webcam streaming failed");
+		throw -1;
+	}
+	return imageFormat.fmt.pix;
+}
+
+
+/*
+   Stops streaming and releases the buffers (for a new image format)
+ */
+void stop_capture(int fd, CAM_DATA_BUFFER_STRUCT* buffers)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(ioctl(fd, VIDIOC_STREAMOFF, &type) < 0){
+		perror("Stopping webcam streaming failed");
+		throw -1;
+	}
+	for (unsigned int i = 0; i < BUFFER_COUNT; i++) {
+		if(buffers[i].start != NULL){
+			v4l2_munmap(buffers[i].start, buffers[i].length);
+		}
+		buffers[i].length	= 0;
+		buffers[i].start	= NULL;
+	}
+	struct v4l2_requestbuffers req = {0};
+	req.count	= 0;
+	req.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory	= V4L2_MEMORY_MMAP;
+	if(ioctl(fd, VIDIOC_REQBUFS, &req) < 0){
+		perror("Releasing image buffers failed");
+		throw -1;
+	}
+}
+
+
+/*
+   "yuyv" / "mjpeg" -> v4l2 fourcc, 0 if unknown
+ */
+uint32_t format_from_name(const char* name)
+{
+	if(strstr(name, "mjpeg") != NULL){
+		return V4L2_PIX_FMT_MJPEG;
+	}
+	if(strstr(name, "yuyv") != NULL){
+		return V4L2_PIX_FMT_YUYV;
+	}
+	return 0;
+}
+
+
 
 
 int main(int argc, char const *argv[])
 {
 	using namespace std;
 	using namespace std::chrono;
-	using namespace cv;
 
+	/*
+	  Format sent to clients that don't ask for one
+	 */
+	uint32_t			default_format	= V4L2_PIX_FMT_YUYV;
+	if(argc > 1){
+		default_format	= format_from_name(argv[1]);
+		if(default_format == 0){
+			printf("usage: %s [yuyv|mjpeg]\n", argv[0]);
+			return -1;
+		}
+	}
 	printf("Welcome. I hope you are having a great day.\n\n");
 	printf("\e[?25l");	//hide cursor
 	fflush(stdout);
@@ -239,89 +397,10 @@ int main(int argc, char const *argv[])
 				fmtdesc.index++;
 			}
 			/*
-			  Set the image format	
-			 */	
-			v4l2_format imageFormat;
-			imageFormat.type 			= V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			imageFormat.fmt.pix.width  		= PIXEL_WIDTH;
-			imageFormat.fmt.pix.height 		= PIXEL_HEIGHT;
-			imageFormat.fmt.pix.pixelformat 	= V4L2_PIX_FMT_YUYV;  // V4L2_PIX_FMT_MJPEG;
-			imageFormat.fmt.pix.field 		= V4L2_FIELD_NONE;
-			// tell the device you are using this format
-			if(ioctl(fd, VIDIOC_S_FMT, &imageFormat) < 0){
-				perror("Setting the image format failed");
-				throw -1;
-			}else{
-				//printf("image format set\n");
-				//fflush(stdout);
-
-			}
-			
-			/*
-			  Request the buffers for the image	
-			 */	
-			struct v4l2_requestbuffers req = {0};
-			req.count	= BUFFER_COUNT;
-			req.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			req.memory	= V4L2_MEMORY_MMAP;
-			if(ioctl(fd, VIDIOC_REQBUFS, &req) < 0){
-				perror("Requesting image buffers failed");
-				throw -1;
-			}else{
-				//printf("image buffers requested\n");
-				//fflush(stdout);
-			}
-				
-			
-			/*
-			  Map the buffers:
-			  we store the information for every buffer in "buffers", but we use
-			  only one "buf" structure for passing the information to v4l
+			  Start streaming in the default format, a client may ask for
+			  another one
 			 */
-
-			for (i = 0; i < BUFFER_COUNT; i++) {
-				memset(&buf,0,sizeof(buf));
-				buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-				buf.memory      = V4L2_MEMORY_MMAP;
-				buf.index       = i;
-
-				if(ioctl(fd, VIDIOC_QUERYBUF, &buf) < 0){
-					perror("VIDIOC_QUERYBUF failed");
-					throw -1;
-				}
-				buffers[i].length = buf.length;
-				//printf("Buffer length: %i\n",buffers[i].length);
-				buffers[i].start = v4l2_mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
-		    
-				if (buffers[i].start == MAP_FAILED) {
-					perror("Can not map this buffer.");
-					throw -1;
-				}
-			}	
-			//printf("Image buffer queried\n");
-			//fflush(stdout);
-
-			/*
-			  Put the buffers into the streaming queue	
-			 */	
-			for (i = 0; i < req.count; i++) {
-				memset(&buf,0,sizeof(buf));
-				buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-				buf.memory = V4L2_MEMORY_MMAP;
-				buf.index = i;
-				if(ioctl(fd, VIDIOC_QBUF, &buf) < 0){
-					perror("Buffer queuing failed");
-					throw -1;
-				}
-			}
-			/*
-			  Activate streaming: the kernel puts images into the buffer	
-			 */		
-			enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			if(ioctl(fd, VIDIOC_STREAMON, &type) < 0){
-				perror("Starting webcam streaming failed");
-				throw -1;
-			}
+			v4l2_pix_format	imageFormat	= start_capture(fd, default_format, buffers);
 
 			
 			/*************************************************************
@@ -391,72 +470,53 @@ int main(int argc, char const *argv[])
 				tv.tv_sec	= SERVER_SEND_TIMEOUT;
 				tv.tv_usec	= 0;
 				setsockopt(new_socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
-					
-					
-					
-				printf("start sending data...\n\n\n");
+
+				/*************************************************************
+				  Image format requested by the client (optional)
+				*/
+				tv.tv_sec	= CLIENT_REQUEST_TIMEOUT;
+				tv.tv_usec	= 0;
+				setsockopt(new_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+				uint32_t	client_format	= default_format;
+				valread		= recv(new_socket, in_buffer, TCP_BUFFER_SIZE - 1, 0);
+				if(valread > 0){
+					in_buffer[valread]	= 0;
+					if(format_from_name((const char*)in_buffer) != 0){
+						client_format	= format_from_name((const char*)in_buffer);
+					}
+				}
+				if(client_format != imageFormat.pixelformat){
+					stop_capture(fd, buffers);
+					imageFormat	= start_capture(fd, client_format, buffers);
+				}
+				const char*	format_name	= imageFormat.pixelformat == V4L2_PIX_FMT_MJPEG ? "MJPEG" : "YUYV";
+				// what the BGR images of the previous versions took
+				double		bgr_bits	= double(8*3*imageFormat.width*imageFormat.height);
+
+				printf("start sending %s data...\n\n\n", format_name);
 				while(true){
 					/*************************************************************
 						Data transmission loop
 					 */
 
 					auto millisec_since_epoch_start = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-					for (i = 0; i < req.count; i++){
-						//printf("loop: %i,%i\n", i, j);
-						//std::cout << std::flush;
+					uint64_t	bytes_sent	= 0;
+					for (j = 0; j < BUFFER_COUNT; j++){
 						memset(&buf,0,sizeof(buf));
 						buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 						buf.memory = V4L2_MEMORY_MMAP;
-						buf.index = i;
-
 
 						/*
 						   Wait until data are ready using the select statement
+						   https://man7.org/linux/man-pages/man2/select.2.html
 						 */
-
 						fd_set fds;
 						FD_ZERO(&fds);
 						FD_SET(fd, &fds);
-						/*
-						FD_ZERO()
-						      This macro clears (removes all file descriptors from) set.
-						      It should be employed as the first step in initializing a
-						      file descriptor set.
-
-						FD_SET()
-						      This macro adds the file descriptor fd to set.  Adding a
-						      file descriptor that is already present in the set is a
-						      no-op, and does not produce an error.
-						*/
 
 						// Set the timeout value
 						tv.tv_sec 	= 5;
 						tv.tv_usec	= 0;
-						/*
-						  Select: https://man7.org/linux/man-pages/man2/select.2.html
-						  
-						  int pselect(int nfds, fd_set *restrict readfds,
-							fd_set *restrict writefds, fd_set *restrict exceptfds,
-							const struct timespec *restrict timeout,
-							const sigset_t *restrict sigmask);
-						  
-						  readfds
-						      The file descriptors in this set are watched to see if
-						      they are ready for reading.  A file descriptor is ready
-						      for reading if a read operation will not block; in
-						      particular, a file descriptor is also ready on end-of-
-						      file.
-
-						      After select() has returned, readfds will be cleared of
-						      all file descriptors except for those that are ready for
-						      reading.
-						  
-						  
-						  nfds	This argument should be set to the highest-numbered file
-							descriptor in any of the three sets, plus 1.
-						  
-						  
-						 */
 						if(select(fd+1, &fds, NULL, NULL, &tv) == -1){
 						    perror("Error while waiting for file descriptor to get ready for read");
 						    throw -1;
@@ -469,32 +529,35 @@ int main(int argc, char const *argv[])
 						    perror("Dequeuing buffer failed");
 						    throw -1;
 						}
-						
+						i	= buf.index;
+
 						/*
-						 Convert the image
-						*/	
-						
-
-						cv::Mat cvimage = cv::Mat(PIXEL_HEIGHT, PIXEL_WIDTH, CV_8UC2, buffers[i].start);
-						cv::Mat cvimgBGR;
-						cv::cvtColor(cvimage, cvimgBGR, cv::COLOR_YUV2BGR_YUY2);
-						//cv::imwrite("test.png", cvimgBGR); 
-						//printf("buffer size: %li %li", cvimgBGR.total(), cvimgBGR.elemSize());
-						//std::cout << std::flush;
-						if(cvimgBGR.total() != (PIXEL_HEIGHT * PIXEL_WIDTH)){
-							perror("Picture size wrong");
-							throw -1;							
+						 Send the image as it is: header, then the buffer of the
+						 camera (YUYV: 2 bytes per pixel; MJPEG: the JPEG file)
+						*/
+						if(imageFormat.pixelformat == V4L2_PIX_FMT_YUYV && buf.bytesused != imageFormat.width * imageFormat.height * 2){
+							printf("Picture size wrong\n");
+							throw -1;
 						}
-						if(cvimgBGR.elemSize() != 3){
-							perror("Not a color picture");
-							throw -1;							
+						uint8_t		header[FRAME_HEADER_SIZE];
+						uint16_t	width		= imageFormat.width;
+						uint16_t	height		= imageFormat.height;
+						uint32_t	size		= buf.bytesused;
+						memcpy(header, "CAMF", 4);
+						memcpy(header + 4, &imageFormat.pixelformat, 4);
+						memcpy(header + 8, &width, 2);
+						memcpy(header + 10, &height, 2);
+						memcpy(header + 12, &size, 4);
+						if(send(new_socket, header, FRAME_HEADER_SIZE, MSG_MORE) != FRAME_HEADER_SIZE){
+							perror("Socket send error");
+							throw -1;
 						}
-						ssize_t total_length	= (cvimgBGR.total() * cvimgBGR.elemSize());
-						ssize_t sent_length	= send(new_socket, cvimgBGR.data, total_length, 0);
-						if(sent_length != total_length){
+						ssize_t sent_length	= send(new_socket, buffers[i].start, size, 0);
+						if(sent_length != ssize_t(size)){
 							perror("Socket send error");
 							throw -1;
 						}
+						bytes_sent	+= FRAME_HEADER_SIZE + size;
 
 						/*
 						 Queue the buffer again
@@ -510,9 +573,10 @@ int main(int argc, char const *argv[])
 
 					}
 					auto millisec_since_epoch_stop  = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-					// 8 bit per byte, 3 byte per pixel, 1000 ms per second, 1000*1000 bit per Mbit
+					// 8 bit per byte, 1000 ms per second, 1000*1000 bit per Mbit
 					double	FPS		= double(BUFFER_COUNT*1000)/double(millisec_since_epoch_stop - millisec_since_epoch_start);
-					double	data_rate	= FPS*double(8*3*PIXEL_WIDTH*PIXEL_HEIGHT)/(1000.0*1000.0);
+					double	data_rate	= double(8*bytes_sent)/double(millisec_since_epoch_stop - millisec_since_epoch_start)/1000.0;
+					double	bgr_rate	= FPS*bgr_bits/(1000.0*1000.0);
 
 					printf("\e[?25l");	//hide cursor
 					printf("\033[F");	//move one line up
@@ -521,8 +585,7 @@ int main(int argc, char const *argv[])
 					now			= chrono::system_clock::now();
 					now_time		= chrono::system_clock::to_time_t(now);
 				
-					printf("%s data rate: %f MBit/s;   FPS: %f\n", strtok(ctime(&now_time),"\n"), data_rate, FPS);
-					//std::cout << "Parameters: " << BUFFER_COUNT << " " << PIXEL_WIDTH << " " << PIXEL_HEIGHT << " " << float(millisec_since_epoch_stop - millisec_since_epoch_start) << endl;
+					printf("%s %s data rate: %f MBit/s (BGR: %f MBit/s, %.1f%%);   FPS: %f\n", strtok(ctime(&now_time),"\n"), format_name, data_rate, bgr_rate, 100.0*data_rate/bgr_rate, FPS);
 					std::cout << std::flush;
 
 
@@ -539,7 +602,11 @@ int main(int argc, char const *argv[])
 
 			if(buffers != NULL){
 				for (i = 0; i < BUFFER_COUNT; i++) {
-					v4l2_munmap(buffers[i].start, buffers[i].length);
+					if(buffers[i].start != NULL){
+						v4l2_munmap(buffers[i].start, buffers[i].length);
+					}
+					buffers[i].length	= 0;
+					buffers[i].start	= NULL;
 				}
 
 			}
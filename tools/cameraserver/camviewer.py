@@ -3,6 +3,8 @@
 ###############################################################################
 #
 # Connects to a streaming server (camserv.cpp) and displays the images.
+# The server sends the images of the camera as they are (YUYV or MJPEG),
+# the conversion to RGB is done here.
 #
 # GUI realized with PyQT5
 # Python multithreading to realize the network interface
@@ -33,6 +35,7 @@ import numpy as np
 import threading
 import time
 import socket
+import struct
 
 from PyQt5.QtWidgets	import QApplication, QWidget, QSizePolicy, QFrame, QLabel, QScrollArea, QDesktopWidget
 from PyQt5.QtGui		import QColor, QPixmap, QImage
@@ -40,7 +43,8 @@ from PyQt5.QtGui		import QColor, QPixmap, QImage
 #
 # There is an issue with using OpenCV (cv2) and PyQt simultaneously,
 # as they are both using Qt and not the same library. Thus, we are
-# trying to avoid that. OpenCV is now only used in the C++ server code.
+# trying to avoid that: YUYV is converted with numpy, MJPEG is decoded
+# by Qt.
 #
 #https://stackoverflow.com/questions/52337870/python-opencv-error-current-thread-is-not-the-objects-thread
 #https://github.com/opencv/opencv-python/issues/386
@@ -65,8 +69,13 @@ PIXEL_HEIGHT	= 1080
 WINDOW_WIDTH	= 1366
 WINDOW_HEIGHT	= 768
 
-#Image is an OpenCV BGR integer array (8-bit)
-IMAGE_SIZE	= 3*PIXEL_WIDTH*PIXEL_HEIGHT
+# Format requested from the server: "yuyv" (2 bytes per pixel) or "mjpeg"
+IMAGE_FORMAT	= "yuyv"
+
+# Header of every image: "CAMF", v4l2 fourcc, width, height, size of the image
+FRAME_HEADER		= struct.Struct("<4sIHHI")
+FOURCC_YUYV			= 0x56595559
+FOURCC_MJPEG		= 0x47504A4D
 
 #https://www6.slac.stanford.edu/about/logo-resources
 SLAC_color	= "#8c1515"
@@ -93,6 +102,33 @@ def showEmptyImage(mainwindow):
 	mainwindow.label.setPixmap(pixmap)
 
 
+def receiveData(netsocket, length):
+	data			= b''
+	tcpreadstart	= time.time()
+	while(len(data) < length):
+		if((time.time()-tcpreadstart) > SERVER_TIMEOUT):
+			raise ValueError("connection timed out")
+		chunk		= netsocket.recv(length - len(data))
+		if(len(chunk) == 0):
+			raise ValueError("connection closed")
+		data 		+= chunk
+	return data
+
+#
+# YUYV -> RGB (ITU-R BT.601, as cv2.COLOR_YUV2BGR_YUY2)
+#  https://www.kernel.org/doc/html/v5.0/media/uapi/v4l/pixfmt-yuyv.html
+# The Cb/Cr components have only half the resolution. Therefore, we need to rescale.
+#
+def yuyvToRGB(data, width, height):
+	yuyv			= np.frombuffer(data, dtype=np.uint8).reshape(height, width//2, 4).astype(np.int32)
+	y				= yuyv[:,:,0::2].reshape(height, width) - 16
+	u				= np.repeat(yuyv[:,:,1] - 128, 2, axis=1)
+	v				= np.repeat(yuyv[:,:,3] - 128, 2, axis=1)
+	r				= (298*y + 409*v + 128) >> 8
+	g				= (298*y - 100*u - 208*v + 128) >> 8
+	b				= (298*y + 516*u + 128) >> 8
+	return np.clip(np.dstack((r, g, b)), 0, 255).astype(np.uint8)
+
 def camviewerNetworkThread(mainwindow):
 	while(True):
 		netsocket	= None
@@ -104,6 +140,7 @@ def camviewerNetworkThread(mainwindow):
 			netsocket		= socket.socket(socket.AF_INET, socket.SOCK_STREAM)
 			hostip			= socket.gethostbyname(NETWORK_SERVER)
 			netsocket.connect((hostip, NETWORK_PORT))
+			netsocket.sendall(("format " + IMAGE_FORMAT + "\n").encode())
 			print ("network connection established: ", hostip)
 
 			while(True):
@@ -112,41 +149,38 @@ def camviewerNetworkThread(mainwindow):
 					return
 			
 				loopcount	= 20
+				bytecount	= 0
 				starttime	= time.time()*1000.0 #ms
 				for i in range(loopcount):
 					#####
 					# Read one image
-					data		= b''
-					tcpreadstart	= time.time()
-					while(True):	
-						now			= time.time()
-						if((now-tcpreadstart) > SERVER_TIMEOUT):
-							raise ValueError("connection timed out")
-						readlength	= IMAGE_SIZE - len(data) 
-						if(readlength == 0):
-							break
-						if(readlength < 0):
-							print("error reading data")
-							sys.exit()
-						data 		+= netsocket.recv(readlength)
+					header		= receiveData(netsocket, FRAME_HEADER.size)
+					magic, fourcc, width, height, size	= FRAME_HEADER.unpack(header)
+					if(magic != b'CAMF'):
+						raise ValueError("wrong frame header")
+					data		= receiveData(netsocket, size)
+					bytecount	+= FRAME_HEADER.size + size
 					#####
 					# Convert image
-					#  https://www.kernel.org/doc/html/v5.0/media/uapi/v4l/pixfmt-yuyv.html
-					# The Cb/Cr components have only half the resolution. Therefore, we need to rescale.
-					nparr			= np.frombuffer(data, dtype=np.uint8)
-					bgr_image		= nparr.reshape(PIXEL_HEIGHT,PIXEL_WIDTH,3)
-					rgb_image		= bgr_image[:,:,::-1].copy()
-
-					qimage 			= QImage(rgb_image, rgb_image.shape[1],
-										rgb_image.shape[0], QImage.Format_RGB888)
-					pixmap 			= QPixmap(qimage) 
+					if(fourcc == FOURCC_MJPEG):
+						pixmap		= QPixmap()
+						if(pixmap.loadFromData(data, "JPG") == False):
+							print("corrupt JPEG image")
+							continue
+					elif(fourcc == FOURCC_YUYV):
+						rgb_image	= yuyvToRGB(data, width, height)
+						qimage 		= QImage(rgb_image, rgb_image.shape[1],
+										rgb_image.shape[0], 3*rgb_image.shape[1], QImage.Format_RGB888)
+						pixmap 		= QPixmap(qimage) 
+					else:
+						raise ValueError("unknown image format")
 					mainwindow.label.setPixmap(pixmap)
 
 
 
 				stoptime	= time.time()*1000.0 #ms
 				fps		= float(loopcount*1000)/float(stoptime-starttime)
-				print("Data: ", fps*IMAGE_SIZE*8/1e6 , "MBit/s; FPS: ", fps)
+				print("Data: ", bytecount*8/1e3/(stoptime-starttime) , "MBit/s; FPS: ", fps)
 
 
 		except Exception as e:
@@ -0,0 +1,263 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include	"bandwidth.h"
+
+#include	<math.h>
+
+#include	<sstream>
+#include	<iomanip>
+#include	<algorithm>
+
+// smoothing of the measured rates (weight of the last interval)
+#define	BANDWIDTH_SMOOTHING			0.3
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CBandwidthScheduler::CBandwidthScheduler(){
+	this->link_rate			= 0;
+	this->allocation_time	= steady_clock::now();
+}
+
+/*****************************************************************************/
+// setup
+/*****************************************************************************/
+void CBandwidthScheduler::set_link_rate(double link_rate){
+	lock_guard<mutex>	lock(scheduler_mutex);
+	this->link_rate		= link_rate;
+}
+
+void CBandwidthScheduler::add_stream(int stream_id, const string name, double weight, double min_rate, double max_rate){
+	lock_guard<mutex>	lock(scheduler_mutex);
+	CBandwidthStream&	stream	= get_stream(stream_id);
+	stream.name			= name;
+	stream.weight		= weight > 0 ? weight : 1;
+	stream.min_rate		= min_rate;
+	stream.max_rate		= max_rate;
+}
+
+CBandwidthStream& CBandwidthScheduler::get_stream(int stream_id){
+
+	auto	item	= streams.find(stream_id);
+	if(item != streams.end()){
+		return	item->second;
+	}
+	CBandwidthStream&	stream	= streams[stream_id];
+	stream.name				= to_string(stream_id);
+	stream.weight			= 1;
+	stream.min_rate			= 0;
+	stream.max_rate			= 0;
+	stream.rate				= 0;
+	stream.tokens			= 0;
+	stream.refill_time		= steady_clock::now();
+	stream.offered_bytes	= 0;
+	stream.sent_bytes		= 0;
+	stream.demand			= 0;
+	stream.throughput		= 0;
+	stream.level			= 0;
+	stream.over_count		= 0;
+	stream.restore_count	= 0;
+	for(int level = 0; level < BANDWIDTH_DEGRADE_MAX; level++){
+		stream.level_demand[level]	= 0;
+	}
+	// new streams get a share at once
+	if(link_rate > 0){
+		allocate();
+	}
+	return	stream;
+}
+
+/*****************************************************************************/
+// senders
+/*****************************************************************************/
+void CBandwidthScheduler::offer(int stream_id, size_t bytes){
+	lock_guard<mutex>	lock(scheduler_mutex);
+	update(steady_clock::now());
+	get_stream(stream_id).offered_bytes	+= bytes;
+}
+
+bool CBandwidthScheduler::acquire(int stream_id, size_t bytes){
+	lock_guard<mutex>	lock(scheduler_mutex);
+	auto				current_time	= steady_clock::now();
+	update(current_time);
+
+	CBandwidthStream&	stream	= get_stream(stream_id);
+	if(link_rate > 0){
+		refill(stream, current_time);
+		if(stream.tokens <= 0){
+			return	false;
+		}
+		stream.tokens	-= bytes;
+	}
+	stream.sent_bytes	+= bytes;
+	return	true;
+}
+
+int CBandwidthScheduler::get_wait_ms(int stream_id){
+	lock_guard<mutex>	lock(scheduler_mutex);
+	CBandwidthStream&	stream	= get_stream(stream_id);
+	if(link_rate <= 0 or stream.tokens > 0 or stream.rate <= 0){
+		return	1;
+	}
+	return	int(ceil(-stream.tokens / stream.rate * 1000)) + 1;
+}
+
+int CBandwidthScheduler::get_level(int stream_id){
+	lock_guard<mutex>	lock(scheduler_mutex);
+	return	get_stream(stream_id).level;
+}
+
+/*****************************************************************************/
+// statistics
+/*****************************************************************************/
+string CBandwidthScheduler::get_status(){
+	lock_guard<mutex>	lock(scheduler_mutex);
+
+	stringstream	status;
+	status << fixed << setprecision(1);
+	for(auto& item : streams){
+		CBandwidthStream&	stream	= item.second;
+		status << item.first << " " << stream.name;
+		status << " rate " << stream.rate * 8e-6 << " throughput " << stream.throughput * 8e-6;
+		status << " demand " << stream.demand * 8e-6 << " level " << stream.level << "\n";
+	}
+	return	status.str();
+}
+
+/*****************************************************************************/
+// token bucket
+/*****************************************************************************/
+void CBandwidthScheduler::refill(CBandwidthStream& stream, time_point<steady_clock> current_time){
+	double	elapsed		= duration<double>(current_time - stream.refill_time).count();
+	stream.refill_time	= current_time;
+	stream.tokens		= min(stream.tokens + stream.rate * elapsed, stream.rate * BANDWIDTH_BURST_MS / 1000);
+}
+
+/*****************************************************************************/
+// once per interval: measure, allocate, adapt
+/*****************************************************************************/
+void CBandwidthScheduler::update(time_point<steady_clock> current_time){
+
+	double	elapsed		= duration<double>(current_time - allocation_time).count();
+	if(elapsed < BANDWIDTH_INTERVAL_MS / 1000.0){
+		return;
+	}
+	allocation_time		= current_time;
+
+	for(auto& item : streams){
+		CBandwidthStream&	stream	= item.second;
+		stream.demand		+= BANDWIDTH_SMOOTHING * (stream.offered_bytes / elapsed - stream.demand);
+		stream.throughput	+= BANDWIDTH_SMOOTHING * (stream.sent_bytes / elapsed - stream.throughput);
+		stream.offered_bytes	= 0;
+		stream.sent_bytes		= 0;
+	}
+	if(link_rate <= 0){
+		return;
+	}
+	// buckets are filled at the old rate up to now
+	for(auto& item : streams){
+		refill(item.second, current_time);
+	}
+	allocate();
+	adapt_levels();
+}
+
+// weighted max-min fairness (water filling)
+void CBandwidthScheduler::allocate(){
+
+	// upper limit of a stream: its demand, at most the maximum rate
+	map<int, double>	limit;
+	double				remaining	= link_rate;
+	for(auto& item : streams){
+		CBandwidthStream&	stream	= item.second;
+		limit[item.first]	= stream.max_rate > 0 ? min(stream.demand, stream.max_rate) : stream.demand;
+		stream.rate			= min(stream.min_rate, limit[item.first]);
+		remaining			-= stream.rate;
+	}
+
+	// share the rest by weight, first up to the demand, then what is left
+	// up to the maximum rate
+	for(int pass = 0; pass < 2; pass++){
+		if(pass == 1){
+			for(auto& item : streams){
+				limit[item.first]	= item.second.max_rate > 0 ? item.second.max_rate : link_rate;
+			}
+		}
+		while(remaining > 1){
+			double	weights		= 0;
+			for(auto& item : streams){
+				if(item.second.rate < limit[item.first]){
+					weights		+= item.second.weight;
+				}
+			}
+			if(weights <= 0){
+				break;
+			}
+			double	share		= remaining / weights;
+			for(auto& item : streams){
+				CBandwidthStream&	stream	= item.second;
+				if(stream.rate >= limit[item.first]){
+					continue;
+				}
+				double	given	= min(share * stream.weight, limit[item.first] - stream.rate);
+				stream.rate		+= given;
+				remaining		-= given;
+			}
+		}
+	}
+}
+
+// one stream at a time: the lowest weight of those above their rate is
+// degraded, streams whose rate covers the demand before the last step are
+// restored
+void CBandwidthScheduler::adapt_levels(){
+
+	CBandwidthStream*	degrade		= NULL;
+	for(auto& item : streams){
+		CBandwidthStream&	stream	= item.second;
+
+		stream.over_count	= stream.demand > 1.1 * stream.rate ? stream.over_count + 1 : 0;
+		if(stream.over_count >= BANDWIDTH_DEGRADE_HOLD and stream.level < BANDWIDTH_DEGRADE_MAX){
+			if(degrade == NULL or stream.weight < degrade->weight){
+				degrade		= &stream;
+			}
+		}
+
+		if(stream.level > 0 and stream.rate > 1.1 * stream.level_demand[stream.level - 1]){
+			stream.restore_count++;
+		}else{
+			stream.restore_count	= 0;
+		}
+		if(stream.restore_count >= BANDWIDTH_RESTORE_HOLD){
+			stream.level--;
+			stream.restore_count	= 0;
+			stream.over_count		= 0;
+		}
+	}
+
+	if(degrade != NULL){
+		degrade->level_demand[degrade->level]	= degrade->demand;
+		degrade->level++;
+		// the others wait for the effect
+		for(auto& item : streams){
+			item.second.over_count	= 0;
+		}
+	}
+}
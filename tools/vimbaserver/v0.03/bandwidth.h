@@ -0,0 +1,138 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __BANDWIDTH_H__
+#define __BANDWIDTH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// multi-threading
+#include <mutex>
+
+// containers
+#include <map>
+#include <string>
+#include <vector>
+
+// time
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+
+/*****************************************************************************/
+// CBandwidthScheduler
+/*****************************************************************************/
+//
+//	shares the uplink between the camera streams. Every server sending
+//	frames of a camera (its own server and the multiplexed one) asks the
+//	scheduler first, such that the sum over all clients is shaped.
+//
+//	Every BANDWIDTH_INTERVAL_MS the link rate is split by weighted max-min
+//	fairness over the measured demand: each stream gets its minimum rate
+//	(or its demand, if smaller) first, the rest is shared by weight, no
+//	stream above its maximum rate. What the streams don't use is handed out
+//	by weight as well, so an idle link is not wasted. Each stream sends from
+//	a token bucket filled at its rate; a frame may take the bucket into
+//	debt, the next one waits until it is paid off.
+//
+//	A stream that keeps wanting more than its rate is degraded, the one with
+//	the lowest weight first, one step at a time (see CCamServer): 1 lossless
+//	compression, 2 and 3 decimation by 2 and 4. It is restored when its rate
+//	covers the demand it had before.
+//
+//	Rates are in bytes per second, 0 for no limit.
+//
+
+// allocation interval
+#define	BANDWIDTH_INTERVAL_MS		100
+// bucket size: the stream may send this long at its rate in one go
+#define	BANDWIDTH_BURST_MS			50
+// steps of degradation
+#define	BANDWIDTH_DEGRADE_MAX		3
+// intervals the demand has to exceed (fit) the rate before the stream is
+// degraded (restored)
+#define	BANDWIDTH_DEGRADE_HOLD		10
+#define	BANDWIDTH_RESTORE_HOLD		30
+
+struct	CBandwidthStream{
+	string						name;
+	double						weight;
+	double						min_rate;
+	double						max_rate;
+
+	// allocated rate, token bucket
+	double						rate;
+	double						tokens;
+	time_point<steady_clock>	refill_time;
+
+	// bytes offered / sent in this interval, smoothed rates
+	uint64_t					offered_bytes;
+	uint64_t					sent_bytes;
+	double						demand;
+	double						throughput;
+
+	// degradation step, demand before each step
+	int							level;
+	double						level_demand[BANDWIDTH_DEGRADE_MAX];
+	int							over_count;
+	int							restore_count;
+};
+
+class	CBandwidthScheduler{
+
+	public:
+	// constructor
+	CBandwidthScheduler();
+
+	// setup, before the servers start: total rate of the link (0: the
+	// streams are measured but not shaped), one entry per camera
+	void					set_link_rate(double link_rate);
+	void					add_stream(int stream_id, const string name, double weight, double min_rate, double max_rate);
+
+	// a frame of bytes was queued for a client of the stream
+	void					offer(int stream_id, size_t bytes);
+	// true if a frame of bytes may be sent now, the bytes are taken from
+	// the bucket. false: try again in get_wait_ms()
+	bool					acquire(int stream_id, size_t bytes);
+	int						get_wait_ms(int stream_id);
+
+	// 0 .. BANDWIDTH_DEGRADE_MAX
+	int						get_level(int stream_id);
+
+	// one line per stream: id, name, rate, throughput, demand (Mbit/s),
+	// level
+	string					get_status();
+
+	private:
+	mutex					scheduler_mutex;
+	double					link_rate;
+	map<int, CBandwidthStream>	streams;
+	time_point<steady_clock>	allocation_time;
+
+	// called with the mutex held; streams not set up get weight 1
+	CBandwidthStream&		get_stream(int stream_id);
+	void					update(time_point<steady_clock> current_time);
+	void					allocate();
+	void					adapt_levels();
+	void					refill(CBandwidthStream& stream, time_point<steady_clock> current_time);
+};
+
+/*****************************************************************************/
+#endif
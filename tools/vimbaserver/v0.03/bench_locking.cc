@@ -0,0 +1,228 @@
+/********************************************************************************
+ * Benchmark: vimba locking model with several cameras
+ *
+ *	- "global":		every call on any camera takes one mutex (v0.03 before,
+ *					CVimba::access_mutex)
+ *	- "camera":		calls on a camera take the mutex of that camera, only
+ *					system-wide calls (camera list) take the global one
+ *
+ * Synthetic backend, no vimba needed: each camera has a frame thread that
+ * gives every frame back to the camera (QueueFrame, a few us) at the frame
+ * rate, and a control thread that writes and reads features, which blocks
+ * on the device for a while (USB control transfer, ~ms). One more thread
+ * updates the camera list now and then. The calls sleep while they hold the
+ * lock, as the vimba calls do while they wait for the device.
+ *
+ * The numbers: how long a call waited for its lock (p50, p99, max), in us.
+ * With the global lock, QueueFrame waits behind the feature writes of all
+ * other cameras.
+ *
+ * Compile:
+ * make bench_locking
+ *
+ * Run:
+ * ./bench_locking [-c <cameras>] [-f <fps>] [-w <feature writes/s>]
+ *				   [-t <seconds>]
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright Sebastian Meuren, 2022
+ *
+ ********************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// time
+#include <chrono>
+
+// multi-threading
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+using namespace std;
+using namespace std::chrono;
+
+// time a call holds the lock (device round trip)
+#define	COST_QUEUE_FRAME		microseconds(5)
+#define	COST_FEATURE_WRITE		microseconds(2000)
+#define	COST_FEATURE_READ		microseconds(500)
+#define	COST_CAMERA_LIST		microseconds(20000)
+
+// camera list updates per second
+#define	CAMERA_LIST_RATE		1
+
+/*****************************************************************************/
+// synthetic vimba
+/*****************************************************************************/
+// the locks as CVimba / CVimbaCamera take them
+struct	CSyntheticVimba{
+	bool				per_camera;
+	mutex				system_mutex;
+	vector<mutex>		camera_mutex;
+
+	CSyntheticVimba(int cameras, bool per_camera) : camera_mutex(cameras){
+		this->per_camera	= per_camera;
+	}
+
+	mutex&				camera_lock(int camera)		{ return per_camera ? camera_mutex[camera] : system_mutex; };
+	mutex&				system_lock()				{ return system_mutex; };
+};
+
+// waiting times of one kind of call, us
+struct	CLatencies{
+	vector<double>		wait_us;
+
+	void				add(const CLatencies& other){
+		wait_us.insert(wait_us.end(), other.wait_us.begin(), other.wait_us.end());
+	}
+	double				percentile(double p){
+		if(wait_us.empty() == true){
+			return	0;
+		}
+		size_t	index	= min(wait_us.size() - 1, size_t(p * wait_us.size()));
+		nth_element(wait_us.begin(), wait_us.begin() + index, wait_us.end());
+		return	wait_us[index];
+	}
+	double				maximum(){
+		return	wait_us.empty() ? 0 : *max_element(wait_us.begin(), wait_us.end());
+	}
+};
+
+// takes the lock, holds it for the cost of the call; returns the wait
+static double	call(mutex& lock, microseconds cost){
+	auto	start	= steady_clock::now();
+	lock_guard<mutex>	guard(lock);
+	auto	locked	= steady_clock::now();
+	this_thread::sleep_for(cost);
+	return	duration<double, micro>(locked - start).count();
+}
+
+/*****************************************************************************/
+// threads
+/*****************************************************************************/
+static void	frame_thread(CSyntheticVimba* vimba, int camera, double fps, atomic<bool>* running, CLatencies* result){
+	auto	period	= duration<double>(1.0 / fps);
+	auto	next	= steady_clock::now();
+	while(*running){
+		result->wait_us.push_back(call(vimba->camera_lock(camera), COST_QUEUE_FRAME));
+		next	+= duration_cast<steady_clock::duration>(period);
+		this_thread::sleep_until(next);
+	}
+}
+
+static void	control_thread(CSyntheticVimba* vimba, int camera, double writes, atomic<bool>* running, CLatencies* result){
+	auto	period	= duration<double>(1.0 / writes);
+	// the cameras don't write at the same time
+	auto	next	= steady_clock::now() + duration_cast<steady_clock::duration>(period * camera / vimba->camera_mutex.size());
+	while(*running){
+		this_thread::sleep_until(next);
+		// write, read back
+		result->wait_us.push_back(call(vimba->camera_lock(camera), COST_FEATURE_WRITE));
+		result->wait_us.push_back(call(vimba->camera_lock(camera), COST_FEATURE_READ));
+		next	+= duration_cast<steady_clock::duration>(period);
+	}
+}
+
+static void	system_thread(CSyntheticVimba* vimba, atomic<bool>* running, CLatencies* result){
+	auto	next	= steady_clock::now();
+	while(*running){
+		next	+= duration_cast<steady_clock::duration>(duration<double>(1.0 / CAMERA_LIST_RATE));
+		this_thread::sleep_until(next);
+		result->wait_us.push_back(call(vimba->system_lock(), COST_CAMERA_LIST));
+	}
+}
+
+/*****************************************************************************/
+// one run
+/*****************************************************************************/
+void	run(bool per_camera, int cameras, double fps, double writes, double seconds){
+
+	CSyntheticVimba		vimba(cameras, per_camera);
+	atomic<bool>		running(true);
+	vector<CLatencies>	frames(cameras);
+	vector<CLatencies>	controls(cameras);
+	CLatencies			system;
+	vector<thread>		threads;
+
+	for(int camera = 0; camera < cameras; camera++){
+		threads.emplace_back(frame_thread, &vimba, camera, fps, &running, &frames[camera]);
+		threads.emplace_back(control_thread, &vimba, camera, writes, &running, &controls[camera]);
+	}
+	threads.emplace_back(system_thread, &vimba, &running, &system);
+
+	this_thread::sleep_for(duration<double>(seconds));
+	running		= false;
+	for(thread& item : threads){
+		item.join();
+	}
+
+	CLatencies		all_frames;
+	CLatencies		all_controls;
+	for(int camera = 0; camera < cameras; camera++){
+		all_frames.add(frames[camera]);
+		all_controls.add(controls[camera]);
+	}
+	// frames that came in time: QueueFrame didn't wait longer than a frame
+	double			period_us	= 1e6 / fps;
+	size_t			late		= count_if(all_frames.wait_us.begin(), all_frames.wait_us.end(), [period_us](double wait){ return wait > period_us; });
+
+	cout << fixed << setprecision(1);
+	cout << setw(8) << (per_camera ? "camera" : "global");
+	cout << setw(10) << all_frames.percentile(0.5) << setw(10) << all_frames.percentile(0.99) << setw(10) << all_frames.maximum();
+	cout << setw(10) << late;
+	cout << setw(10) << all_controls.percentile(0.5) << setw(10) << all_controls.percentile(0.99);
+	cout << setw(10) << system.maximum() << endl;
+}
+
+/*****************************************************************************/
+// main
+/*****************************************************************************/
+int main(int argc, char* argv[]){
+
+	int			cameras		= 4;
+	double		fps			= 100;
+	double		writes		= 20;
+	double		seconds		= 5;
+
+	for(int i = 1; i < argc; i++){
+		string	arg		= argv[i];
+		if(arg == "-c" and i + 1 < argc){
+			cameras		= atoi(argv[++i]);
+		}else if(arg == "-f" and i + 1 < argc){
+			fps			= atof(argv[++i]);
+		}else if(arg == "-w" and i + 1 < argc){
+			writes		= atof(argv[++i]);
+		}else if(arg == "-t" and i + 1 < argc){
+			seconds		= atof(argv[++i]);
+		}else{
+			cerr << "usage: see bench_locking.cc" << endl;
+			return	-1;
+		}
+	}
+
+	cout << "bench_locking: " << cameras << " cameras, " << fps << " fps, " << writes << " feature writes/s per camera, " << seconds << " s" << endl;
+	cout << "lock wait in us" << endl;
+	cout << setw(8) << "lock" << setw(10) << "frame p50" << setw(10) << "p99" << setw(10) << "max" << setw(10) << "late";
+	cout << setw(10) << "feat p50" << setw(10) << "p99" << setw(10) << "list max" << endl;
+	run(false, cameras, fps, writes, seconds);
+	run(true, cameras, fps, writes, seconds);
+	return	0;
+}
@@ -0,0 +1,312 @@
+/********************************************************************************
+ * Benchmark: frame transmission modes of the camera server
+ *
+ *	- "send x2":	header and image in two send() calls (v0.03 before)
+ *	- "sendmsg":	header and image gathered into one sendmsg() call
+ *	- "zerocopy":	sendmsg() with MSG_ZEROCOPY, the buffer is reused only
+ *					after the kernel reported the completion
+ *
+ * Frame sizes: Mono10 images transmitted with 16 bits per pixel, 2-4 MB.
+ *
+ * Compile:
+ * make bench_send
+ *
+ * Run:
+ * ./bench_send							loopback (sink runs in a thread)
+ * ./bench_send -s <port>				sink only, e.g. on the control computer
+ * ./bench_send -c <host> <port>		send to a remote sink
+ *
+ * Note: on loopback the kernel always falls back to copying for zero-copy
+ * sends ("fallbacks" column), only a real NIC shows the gain.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+ * for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright Sebastian Meuren, 2022
+ *
+ ********************************************************************************/ 
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+
+// time
+#include <chrono>
+
+// multi-threading
+#include <thread>
+
+#include "transmit.h"
+
+using namespace std;
+using namespace std::chrono;
+
+#define	BENCH_HEADER_LENGTH		40
+#define	BENCH_BUFFER_COUNT		4
+#define	BENCH_DURATION			2s
+
+/*****************************************************************************/
+// sink: read and discard everything
+/*****************************************************************************/
+void	sink_main(int port, bool once){
+
+	int		server_socket	= socket(AF_INET, SOCK_STREAM, 0);
+	int		opt				= 1;
+	setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+	struct	sockaddr_in	address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family			= AF_INET;
+	address.sin_addr.s_addr		= INADDR_ANY;
+	address.sin_port 			= htons(port);
+	if(bind(server_socket, (struct sockaddr*)&address, sizeof(address)) < 0 or listen(server_socket, 1) < 0){
+		perror("sink: bind/listen failed");
+		exit(-1);
+	}
+
+	vector<uint8_t>		buffer(1 << 20);
+	while(true){
+		int		client_socket	= accept(server_socket, NULL, NULL);
+		if(client_socket < 0){
+			continue;
+		}
+		while(recv(client_socket, buffer.data(), buffer.size(), 0) > 0){
+		}
+		close(client_socket);
+		if(once == true){
+			break;
+		}
+	}
+	close(server_socket);
+}
+
+/*****************************************************************************/
+// connect to the sink
+/*****************************************************************************/
+int		connect_sink(string host, int port){
+
+	struct	addrinfo	hints;
+	struct	addrinfo*	result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family		= AF_INET;
+	hints.ai_socktype	= SOCK_STREAM;
+	if(getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &result) != 0){
+		perror("getaddrinfo failed");
+		return	-1;
+	}
+	int		client_socket	= socket(AF_INET, SOCK_STREAM, 0);
+	for(int attempt = 0; attempt < 50; attempt++){
+		if(connect(client_socket, result->ai_addr, result->ai_addrlen) == 0){
+			freeaddrinfo(result);
+			return	client_socket;
+		}
+		this_thread::sleep_for(20ms);
+	}
+	freeaddrinfo(result);
+	perror("connect failed");
+	close(client_socket);
+	return	-1;
+}
+
+/*****************************************************************************/
+// wait until the socket is writable or has an error pending
+/*****************************************************************************/
+void	wait_socket(int client_socket){
+	struct	pollfd	pfd;
+	pfd.fd			= client_socket;
+	pfd.events		= POLLOUT;
+	poll(&pfd, 1, 100);
+}
+
+/*****************************************************************************/
+// one benchmark run
+/*****************************************************************************/
+struct	CBenchResult{
+	uint64_t	frames;
+	uint64_t	calls;
+	uint64_t	fallbacks;
+	double		seconds;
+	double		cpu_seconds;
+};
+
+double	thread_cpu_seconds(){
+	struct	rusage	usage;
+	getrusage(RUSAGE_THREAD, &usage);
+	return	usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 1e-6*(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+CBenchResult	run_mode(string host, int port, string mode, size_t frame_size){
+
+	CBenchResult	result	= {0, 0, 0, 0.0, 0.0};
+
+	int		client_socket	= connect_sink(host, port);
+	if(client_socket < 0){
+		exit(-1);
+	}
+
+	bool	zerocopy		= (mode == "zerocopy");
+	if(zerocopy == true and enable_zerocopy(client_socket) == false){
+		close(client_socket);
+		return	result;
+	}
+
+	// frame buffers, as the server ring
+	vector<vector<uint8_t>>		buffers(BENCH_BUFFER_COUNT, vector<uint8_t>(frame_size, 0x55));
+	uint8_t						header[BENCH_HEADER_LENGTH]	= {0};
+
+	// zero-copy: last sendmsg call that used a buffer
+	vector<int64_t>				buffer_last_call(BENCH_BUFFER_COUNT, -1);
+	int64_t						completed			= -1;
+	uint32_t					next_call			= 0;
+
+	double	cpu_start	= thread_cpu_seconds();
+	auto	start		= steady_clock::now();
+	while(steady_clock::now() - start < BENCH_DURATION){
+		int			index	= result.frames % BENCH_BUFFER_COUNT;
+		uint8_t*	data	= buffers[index].data();
+
+		if(mode == "send x2"){
+			// the old way: two blocking send() calls
+			if(send(client_socket, header, BENCH_HEADER_LENGTH, MSG_NOSIGNAL) != BENCH_HEADER_LENGTH){
+				perror("send header");
+				break;
+			}
+			result.calls++;
+			size_t	sent	= 0;
+			while(sent < frame_size){
+				ssize_t	sent_length	= send(client_socket, data + sent, frame_size - sent, MSG_NOSIGNAL);
+				if(sent_length < 0){
+					perror("send data");
+					break;
+				}
+				sent	+= sent_length;
+				result.calls++;
+			}
+		}else{
+			// zero-copy: the buffer must not be touched before the kernel is done
+			while(zerocopy == true and buffer_last_call[index] > completed){
+				uint32_t	first;
+				uint32_t	last;
+				bool		copied;
+				int			status	= read_zerocopy_completion(client_socket, first, last, copied);
+				if(status == 1){
+					completed			= last;
+					if(copied == true){
+						result.fallbacks	+= last - first + 1;
+					}
+				}else{
+					wait_socket(client_socket);
+				}
+			}
+
+			struct	iovec	iov[2];
+			iov[0].iov_base		= header;
+			iov[0].iov_len		= BENCH_HEADER_LENGTH;
+			iov[1].iov_base		= data;
+			iov[1].iov_len		= frame_size;
+			int		iovcnt		= 2;
+			while(iovcnt > 0){
+				ssize_t	sent_length	= send_iov(client_socket, iov, iovcnt, zerocopy);
+				if(sent_length < 0){
+					if(errno == EAGAIN or errno == ENOBUFS){
+						wait_socket(client_socket);
+						continue;
+					}
+					perror("sendmsg");
+					break;
+				}
+				result.calls++;
+				if(zerocopy == true){
+					buffer_last_call[index]	= next_call++;
+				}
+				iovcnt	= advance_iov(iov, iovcnt, sent_length);
+			}
+		}
+		result.frames++;
+	}
+	result.seconds		= duration_cast<duration<double>>(steady_clock::now() - start).count();
+	result.cpu_seconds	= thread_cpu_seconds() - cpu_start;
+
+	close(client_socket);
+	return	result;
+}
+
+/*****************************************************************************/
+// main
+/*****************************************************************************/
+int main(int argc, char const *argv[]){
+
+	string	host	= "127.0.0.1";
+	int		port	= 42900;
+
+	if(argc == 3 and string(argv[1]) == "-s"){
+		port		= atoi(argv[2]);
+		cout	<< "sink listening on port " << port << endl;
+		sink_main(port, false);
+		return	0;
+	}
+
+	thread	sink_thread;
+	if(argc == 4 and string(argv[1]) == "-c"){
+		host		= argv[2];
+		port		= atoi(argv[3]);
+	}else{
+		sink_thread	= thread(sink_main, port, false);
+		sink_thread.detach();
+	}
+
+	// Mono10 frames, 2 bytes per pixel
+	vector<pair<string, size_t>>	frame_sizes;
+	frame_sizes.push_back(make_pair(string("1024x1024 Mono10"), size_t(1024*1024*2)));
+	frame_sizes.push_back(make_pair(string("1456x1088 Mono10"), size_t(1456*1088*2)));
+	frame_sizes.push_back(make_pair(string("2048x1024 Mono10"), size_t(2048*1024*2)));
+
+	vector<string>	modes	= {"send x2", "sendmsg", "zerocopy"};
+
+	cout	<< "sending to " << host << ":" << port << endl << endl;
+	cout	<< left << setw(20) << "frame" << setw(12) << "mode" << right;
+	cout	<< setw(12) << "MB/s" << setw(10) << "FPS" << setw(14) << "calls/frame" << setw(14) << "cpu us/frame" << setw(12) << "fallbacks" << endl;
+
+	for(auto& frame_size : frame_sizes){
+		for(auto& mode : modes){
+			CBenchResult	result	= run_mode(host, port, mode, frame_size.second);
+			if(result.frames == 0){
+				cout	<< left << setw(20) << frame_size.first << setw(12) << mode << "not supported" << endl;
+				continue;
+			}
+			double	mbytes	= double(result.frames) * (frame_size.second + BENCH_HEADER_LENGTH) / 1e6;
+			cout	<< left << setw(20) << frame_size.first << setw(12) << mode << right << fixed << setprecision(1);
+			cout	<< setw(12) << mbytes / result.seconds;
+			cout	<< setw(10) << result.frames / result.seconds;
+			cout	<< setw(14) << double(result.calls) / result.frames;
+			cout	<< setw(14) << 1e6 * result.cpu_seconds / result.frames;
+			cout	<< setw(12) << result.fallbacks << endl;
+		}
+	}
+
+	return	0;
+}
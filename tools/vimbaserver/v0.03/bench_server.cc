@@ -0,0 +1,302 @@
+/********************************************************************************
+ * Benchmark: the whole streaming path with synthetic cameras
+ *
+ *	- every camera is a CSyntheticSource (synthetic_source.h) run by the
+ *	  camera thread of the server (camera_streaming_main), with its camera
+ *	  server on port <base> + 1 + index
+ *	- receivers (libcamclient, camclient_open) connect to every camera port
+ *	  and decode the frames
+ *
+ * No camera and no vimba needed: runs on any Linux box. The frame time
+ * stamps are steady_clock ns of the generator, the latency is measured from
+ * the trigger to the decoded frame in the receiver.
+ *
+ * The numbers per camera: frames generated (camera), received frames per
+ * second and wire rate, latency (p50, p99, max), frame ids the receiver
+ * didn't see (lost triggers and frames the server dropped), and the ring
+ * counters of the server.
+ *
+ * The camera threads write their logs (<id>.log) to the current directory.
+ *
+ * Compile:
+ * make bench_server
+ *
+ * Run:
+ * ./bench_server [-c <cameras>] [-s <width> <height>] [-p Mono8|Mono10|Mono12|Mono16]
+ *				  [-f <fps>] [-j <jitter us>] [-d <drop rate>] [-r <receivers>]
+ *				  [-e <option>] [-t <seconds>] [-b <base port>]
+ *
+ *	-e		option line of the receivers, e.g. "encoding tile"
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright Sebastian Meuren, 2022
+ *
+ ********************************************************************************/
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// time
+#include <chrono>
+
+// multi-threading
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "global.h"
+#include "frame_feed.h"
+#include "latest_frame.h"
+#include "camera_control.h"
+#include "camera_source.h"
+#include "synthetic_source.h"
+#include "bandwidth.h"
+#include "encoding.h"
+#include "camclient.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/*****************************************************************************/
+// what the server would take from main.cc
+/*****************************************************************************/
+#include "pugixml.hpp"
+pugi::xml_document 			xmlconfig;
+mutex						xmlconfig_mutex;
+CBandwidthScheduler			global_bandwidth;
+
+// all cameras alike
+static CSyntheticConfig		synthetic;
+
+CCameraSource*	create_camera_source(string cameraID, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log){
+	return	new CSyntheticSource(synthetic, framering, settings, control, log);
+}
+
+void	camera_streaming_main(string cameraID, int server_port, int stream_id, CFrameFeed* feed, CLatestFrame* latest, CCameraControl* control);
+
+/*****************************************************************************/
+// receiver
+/*****************************************************************************/
+struct	CReceived{
+	uint64_t			frames;
+	uint64_t			bytes;
+	uint64_t			missing;
+	vector<double>		latency_us;
+
+	CReceived(){ frames = 0; bytes = 0; missing = 0; };
+};
+
+static void	receiver(int port, string option, atomic<bool>* measuring, atomic<bool>* running, CReceived* result){
+
+	void*	client	= NULL;
+	while(client == NULL and *running){
+		client	= camclient_open("127.0.0.1", port);
+		if(client == NULL){
+			this_thread::sleep_for(100ms);
+		}
+	}
+	if(client == NULL){
+		return;
+	}
+	if(option.empty() == false){
+		camclient_set_option(client, option.c_str());
+	}
+
+	camclient_frame		frame;
+	uint64_t			last_id		= 0;
+	bool				first		= true;
+	while(*running){
+		int		status	= camclient_receive(client, &frame, 200);
+		if(status < 0){
+			break;
+		}
+		if(status == 0 or *measuring == false){
+			continue;
+		}
+		uint64_t	now		= duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+		result->frames++;
+		result->bytes	+= frame.wire_size;
+		result->latency_us.push_back(now > frame.time_stamp ? (now - frame.time_stamp) * 1e-3 : 0);
+		if(first == false and frame.frame_id > last_id + 1){
+			result->missing		+= frame.frame_id - last_id - 1;
+		}
+		first		= false;
+		last_id		= frame.frame_id;
+	}
+	camclient_close(client);
+}
+
+static double	percentile(vector<double>& values, double p){
+	if(values.empty() == true){
+		return	0;
+	}
+	size_t	index	= min(values.size() - 1, size_t(p * values.size()));
+	nth_element(values.begin(), values.begin() + index, values.end());
+	return	values[index];
+}
+
+// answer of the camera thread, empty if there is none
+static string	command(CCameraControl* control, const string& name){
+	static uint64_t		next_id		= 1;
+	CControlCommand		request;
+	request.id			= next_id++;
+	request.name		= name;
+	control->push(request);
+	auto	deadline	= steady_clock::now() + 2s;
+	while(steady_clock::now() < deadline){
+		CControlReply	reply;
+		while(control->pop_reply(reply) == true){
+			if(reply.id == request.id){
+				return	reply.text;
+			}
+		}
+		this_thread::sleep_for(10ms);
+	}
+	return	"";
+}
+
+// a number of the stats answer, "... <key> <value> ..."
+static uint64_t	stats_value(const string& stats, const string& key){
+	stringstream	words(stats);
+	string			word;
+	while(words >> word){
+		if(word == key){
+			uint64_t	value	= 0;
+			words >> value;
+			return	value;
+		}
+	}
+	return	0;
+}
+
+/*****************************************************************************/
+// main
+/*****************************************************************************/
+int main(int argc, char* argv[]){
+
+	int			cameras		= 2;
+	int			receivers	= 1;
+	double		seconds		= 5;
+	int			base_port	= 47000;
+	string		option;
+	string		format		= "Mono12";
+
+	for(int i = 1; i < argc; i++){
+		string	arg		= argv[i];
+		if(arg == "-c" and i + 1 < argc){
+			cameras				= atoi(argv[++i]);
+		}else if(arg == "-s" and i + 2 < argc){
+			synthetic.width		= atoi(argv[++i]);
+			synthetic.height	= atoi(argv[++i]);
+		}else if(arg == "-p" and i + 1 < argc){
+			format				= argv[++i];
+		}else if(arg == "-f" and i + 1 < argc){
+			synthetic.fps		= atof(argv[++i]);
+		}else if(arg == "-j" and i + 1 < argc){
+			synthetic.jitter_us	= atof(argv[++i]);
+		}else if(arg == "-d" and i + 1 < argc){
+			synthetic.drop		= atof(argv[++i]);
+		}else if(arg == "-r" and i + 1 < argc){
+			receivers			= atoi(argv[++i]);
+		}else if(arg == "-e" and i + 1 < argc){
+			option				= argv[++i];
+		}else if(arg == "-t" and i + 1 < argc){
+			seconds				= atof(argv[++i]);
+		}else if(arg == "-b" and i + 1 < argc){
+			base_port			= atoi(argv[++i]);
+		}else{
+			cerr << "usage: see bench_server.cc" << endl;
+			return	-1;
+		}
+	}
+	synthetic.pixel_format	= format == "Mono8" ? PIXEL_FORMAT_MONO8 : format == "Mono10" ? PIXEL_FORMAT_MONO10 : format == "Mono16" ? PIXEL_FORMAT_MONO16 : PIXEL_FORMAT_MONO12;
+
+	cout << "bench_server: " << cameras << " cameras " << synthetic.width << " x " << synthetic.height << " " << format;
+	cout << ", " << synthetic.fps << " fps, jitter " << synthetic.jitter_us << " us, drop " << synthetic.drop;
+	cout << ", " << receivers << " receivers per camera" << (option.empty() ? "" : ", " + option) << ", " << seconds << " s" << endl;
+
+	// cameras
+	vector<CCameraControl*>		controls;
+	for(int camera = 0; camera < cameras; camera++){
+		string			camID		= "SIM_" + to_string(camera);
+		CCameraControl*	control		= new CCameraControl();
+		controls.push_back(control);
+		global_bandwidth.add_stream(camera, camID, 1.0, 0, 0);
+		thread(camera_streaming_main, camID, base_port + 1 + camera, camera, new CFrameFeed(FRAME_FEED_LENGTH), new CLatestFrame(), control).detach();
+	}
+
+	// receivers, counting starts when all cameras acquire
+	atomic<bool>				measuring(false);
+	atomic<bool>				running(true);
+	vector<CReceived>			results(cameras * receivers);
+	vector<thread>				threads;
+	for(int camera = 0; camera < cameras; camera++){
+		for(int r = 0; r < receivers; r++){
+			threads.emplace_back(receiver, base_port + 1 + camera, option, &measuring, &running, &results[camera * receivers + r]);
+		}
+	}
+	for(int camera = 0; camera < cameras; camera++){
+		while(controls[camera]->get_state() != CAMERA_STATE_ACQUIRING){
+			this_thread::sleep_for(10ms);
+		}
+	}
+	this_thread::sleep_for(500ms);
+
+	vector<string>		before(cameras);
+	for(int camera = 0; camera < cameras; camera++){
+		before[camera]	= command(controls[camera], "stats");
+	}
+	measuring	= true;
+	this_thread::sleep_for(duration<double>(seconds));
+	measuring	= false;
+	vector<string>		after(cameras);
+	for(int camera = 0; camera < cameras; camera++){
+		after[camera]	= command(controls[camera], "stats");
+	}
+	running		= false;
+	for(thread& item : threads){
+		item.join();
+	}
+
+	cout << fixed << setprecision(1);
+	cout << setw(8) << "camera" << setw(10) << "gen fps" << setw(10) << "rx fps" << setw(10) << "MB/s";
+	cout << setw(10) << "lat p50" << setw(10) << "p99" << setw(10) << "max" << setw(10) << "missing";
+	cout << setw(12) << "overwritten" << setw(10) << "dropped" << endl;
+	for(int camera = 0; camera < cameras; camera++){
+		uint64_t	generated	= stats_value(after[camera], "written") + stats_value(after[camera], "dropped") - stats_value(before[camera], "written") - stats_value(before[camera], "dropped");
+		for(int r = 0; r < receivers; r++){
+			CReceived&	result	= results[camera * receivers + r];
+			cout << setw(8) << camera << setw(10) << generated / seconds << setw(10) << result.frames / seconds;
+			cout << setw(10) << result.bytes / seconds / 1e6;
+			cout << setw(10) << percentile(result.latency_us, 0.5) << setw(10) << percentile(result.latency_us, 0.99);
+			cout << setw(10) << (result.latency_us.empty() ? 0 : *max_element(result.latency_us.begin(), result.latency_us.end()));
+			cout << setw(10) << result.missing;
+			cout << setw(12) << stats_value(after[camera], "overwritten") - stats_value(before[camera], "overwritten");
+			cout << setw(10) << stats_value(after[camera], "dropped") - stats_value(before[camera], "dropped") << endl;
+		}
+	}
+	cout << "latency in us, trigger to decoded frame" << endl;
+	cout.flush();
+
+	// the camera threads don't end
+	_exit(0);
+}
@@ -0,0 +1,961 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include	"camclient.h"
+#include	"encoding.h"
+#include	"tile_codec.h"
+#include	"sparse.h"
+#include	"protocol.h"
+
+#include	<errno.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<poll.h>
+#include	<netdb.h>
+#include	<sys/socket.h>
+#include	<netinet/in.h>
+#include	<netinet/tcp.h>
+#include	<arpa/inet.h>
+
+#include	<string>
+#include	<sstream>
+#include	<deque>
+#include	<map>
+#include	<vector>
+#include	<chrono>
+
+using namespace std;
+using namespace std::chrono;
+
+/*****************************************************************************/
+// little endian helpers
+/*****************************************************************************/
+static inline uint32_t	get_uint32(const uint8_t* buffer){
+	return	uint32_t(buffer[0]) | (uint32_t(buffer[1]) << 8) | (uint32_t(buffer[2]) << 16) | (uint32_t(buffer[3]) << 24);
+}
+
+static inline uint16_t	get_uint16(const uint8_t* buffer){
+	return	uint16_t(buffer[0]) | (uint16_t(buffer[1]) << 8);
+}
+
+static inline uint64_t	get_uint64(const uint8_t* buffer){
+	return	uint64_t(get_uint32(buffer)) | (uint64_t(get_uint32(buffer + 4)) << 32);
+}
+
+static inline void	put_uint16(string& buffer, uint16_t value){
+	buffer.push_back(char(value & 0xFF));
+	buffer.push_back(char(value >> 8));
+}
+
+static inline void	put_uint32(string& buffer, uint32_t value){
+	put_uint16(buffer, value & 0xFFFF);
+	put_uint16(buffer, value >> 16);
+}
+
+// milliseconds left until the deadline, at least 0
+static inline int	remaining_ms(time_point<steady_clock> deadline){
+	auto	remaining	= duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+	return	remaining > 0 ? int(remaining) : 0;
+}
+
+/*****************************************************************************/
+// CStreamDecoder
+/*****************************************************************************/
+// decoder state of one stream (camera)
+struct	CStreamDecoder{
+	bool				delta_mode;
+
+	// last decoded image, delta mode: the decoded frames as references
+	vector<uint8_t>		image;
+	deque<pair<uint64_t, vector<uint8_t>>>	history;
+};
+
+/*****************************************************************************/
+// CUdpStream
+/*****************************************************************************/
+// a frame message being put together from datagrams
+struct	CUdpPartialFrame{
+	vector<uint8_t>		message;
+	vector<bool>		received;
+	uint32_t			missing;
+	// length of all fragments but the last one
+	uint32_t			stride;
+};
+
+// UDP receiver state of one stream (sender)
+struct	CUdpStream{
+	// key: frame id
+	map<uint64_t, CUdpPartialFrame>	frames;
+	// frames up to this one are done (delivered or dropped)
+	bool				frame_known;
+	uint64_t			last_frame_id;
+	bool				sequence_known;
+	uint32_t			next_sequence;
+};
+
+/*****************************************************************************/
+// CCamConnection
+/*****************************************************************************/
+class	CCamConnection{
+
+	public:
+	int					client_socket;
+	// encoding set for all streams, new streams start with it
+	bool				delta_mode;
+
+	// handshake result, statistics and metadata sent by the server
+	struct camclient_session	session;
+	string				metadata;
+	string				bandwidth;
+
+	// control port: answer of the last request (without "ok"), reason of
+	// the last refusal, events received since they were fetched
+	bool				control;
+	string				answer;
+	string				error;
+	string				events;
+	string				events_fetched;
+
+	// received data
+	uint8_t				header[CAM_FRAME_HEADER_LENGTH];
+	uint16_t			stream_id;
+	vector<uint8_t>		payload;
+
+	// key: stream id
+	map<uint16_t, CStreamDecoder>	decoders;
+
+	// UDP transport: streams by id, datagrams of the last recvmmsg call not
+	// handled yet
+	bool				udp;
+	map<uint16_t, CUdpStream>	udp_streams;
+	struct camclient_udp_stats	udp_stats;
+	vector<vector<uint8_t>>	datagrams;
+	vector<uint32_t>	datagram_lengths;
+	int					datagram_count;
+	int					datagram_next;
+
+	bool				send_all(const string data);
+	bool				send_option(const string line);
+	// option for the stream of a frame, unscoped for legacy servers
+	bool				send_stream_option(uint16_t stream_id, const string line);
+	void				set_encoding(const string line);
+	bool				read_exactly(uint8_t* buffer, size_t length);
+	// a text line (control port), false on timeout or connection loss
+	bool				read_line(string& line, time_point<steady_clock> deadline);
+	// control port: sends a request, reads its answer line (events are
+	// collected): 1 answer, 0 timeout, -1 connection lost
+	int					request(const string line, string& answer_line, int timeout_ms);
+	bool				handshake();
+	int					read_message();
+	void				handle_message(uint16_t type, const string& data);
+	// UDP: 1 frame header and payload complete, 0 nothing (yet), -1 error
+	int					read_datagrams();
+	int					handle_datagram(const uint8_t* datagram, uint32_t length);
+	int					decode(struct camclient_frame* frame);
+};
+
+bool CCamConnection::send_all(const string data){
+	size_t		sent		= 0;
+	while(sent < data.length()){
+		ssize_t		count	= send(client_socket, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+		if(count <= 0){
+			return	false;
+		}
+		sent	+= count;
+	}
+	return	true;
+}
+
+// OPTION message, or an option line for legacy servers
+bool CCamConnection::send_option(const string line){
+	if(session.protocol == CAM_PROTOCOL_LEGACY){
+		return	send_all(line + "\n");
+	}
+	string		message;
+	put_uint32(message, line.length());
+	put_uint16(message, CAM_MESSAGE_OPTION);
+	put_uint16(message, 0);
+	return	send_all(message + line);
+}
+
+bool CCamConnection::send_stream_option(uint16_t stream_id, const string line){
+	if(session.protocol == CAM_PROTOCOL_LEGACY){
+		return	send_option(line);
+	}
+	return	send_option("stream " + to_string(stream_id) + " " + line);
+}
+
+// keeps track of delta mode: "[stream <id>] encoding <name>"
+void CCamConnection::set_encoding(const string line){
+
+	stringstream	line_stream(line);
+	string			name;
+	int				scope		= -1;
+	line_stream		>> name;
+	if(name == "stream"){
+		line_stream		>> scope >> name;
+	}
+	if(name != "encoding"){
+		return;
+	}
+	string			encoding;
+	line_stream		>> encoding;
+
+	for(auto& item : decoders){
+		if(scope < 0 or item.first == scope){
+			item.second.delta_mode	= encoding == "delta";
+			item.second.history.clear();
+		}
+	}
+	if(scope < 0){
+		delta_mode	= encoding == "delta";
+	}
+}
+
+bool CCamConnection::read_exactly(uint8_t* buffer, size_t length){
+	while(length > 0){
+		ssize_t		count	= recv(client_socket, buffer, length, MSG_WAITALL);
+		if(count <= 0){
+			return	false;
+		}
+		buffer	+= count;
+		length	-= count;
+	}
+	return	true;
+}
+
+bool CCamConnection::read_line(string& line, time_point<steady_clock> deadline){
+	line.clear();
+	while(true){
+		struct pollfd	poll_fd;
+		poll_fd.fd			= client_socket;
+		poll_fd.events		= POLLIN;
+		poll_fd.revents		= 0;
+		if(poll(&poll_fd, 1, remaining_ms(deadline)) <= 0){
+			return	false;
+		}
+		char		character;
+		if(recv(client_socket, &character, 1, 0) != 1){
+			return	false;
+		}
+		if(character == '\n'){
+			return	true;
+		}
+		line	+= character;
+	}
+}
+
+int CCamConnection::request(const string line, string& answer_line, int timeout_ms){
+
+	auto		deadline	= steady_clock::now() + milliseconds(timeout_ms);
+	if(send_all(line + "\n") == false){
+		return	-1;
+	}
+	while(true){
+		if(read_line(answer_line, deadline) == false){
+			return	steady_clock::now() < deadline ? -1 : 0;
+		}
+		if(answer_line.compare(0, strlen(CAM_CONTROL_EVENT) + 1, string(CAM_CONTROL_EVENT) + " ") != 0){
+			return	1;
+		}
+		events	+= answer_line.substr(strlen(CAM_CONTROL_EVENT) + 1) + "\n";
+	}
+}
+
+// preamble and HELLO, the server answers with its preamble. Anything else
+// (or nothing in time) is a legacy server. false if the connection is lost.
+bool CCamConnection::handshake(){
+
+	string		hello		= CAM_PROTOCOL_MAGIC;
+	put_uint16(hello, CAM_PROTOCOL_VERSION);
+	put_uint16(hello, 0);
+	put_uint32(hello, CAM_HELLO_LENGTH);
+	put_uint16(hello, CAM_MESSAGE_HELLO);
+	put_uint16(hello, 0);
+	put_uint32(hello, CAM_CAPABILITY_ALL);
+	if(send_all(hello) == false){
+		return	false;
+	}
+
+	// peek, such that the data of a legacy server stays in the socket
+	auto		deadline	= steady_clock::now() + milliseconds(CAM_PROTOCOL_HANDSHAKE_TIMEOUT_MS);
+	uint8_t		preamble[CAM_PROTOCOL_PREAMBLE_LENGTH];
+	while(true){
+		struct pollfd	poll_fd;
+		poll_fd.fd			= client_socket;
+		poll_fd.events		= POLLIN;
+		poll_fd.revents		= 0;
+		int		status		= poll(&poll_fd, 1, remaining_ms(deadline));
+		if(status < 0){
+			return	false;
+		}
+		if(status == 0){
+			return	true;
+		}
+		ssize_t		count	= recv(client_socket, preamble, sizeof(preamble), MSG_PEEK);
+		if(count <= 0){
+			return	false;
+		}
+		if(memcmp(preamble, CAM_PROTOCOL_MAGIC, min(size_t(count), strlen(CAM_PROTOCOL_MAGIC))) != 0){
+			return	true;
+		}
+		if(count == CAM_PROTOCOL_PREAMBLE_LENGTH){
+			break;
+		}
+		// the rest of the preamble is on its way
+		if(remaining_ms(deadline) == 0){
+			return	true;
+		}
+		usleep(1000);
+	}
+	if(read_exactly(preamble, sizeof(preamble)) == false){
+		return	false;
+	}
+
+	// WELCOME and METADATA come first
+	session.protocol	= CAM_PROTOCOL_VERSION;
+	while(session.server_capabilities == 0 or metadata.empty()){
+		if(read_message() < 0){
+			return	false;
+		}
+	}
+	return	true;
+}
+
+// 1 frame header and payload read, 0 other message (handled), -1 connection
+// lost or broken stream
+int CCamConnection::read_message(){
+
+	uint8_t		message_header[CAM_MESSAGE_HEADER_LENGTH];
+	if(read_exactly(message_header, sizeof(message_header)) == false){
+		return	-1;
+	}
+	uint32_t	length		= get_uint32(message_header);
+	uint16_t	type		= message_header[4] | (message_header[5] << 8);
+	stream_id				= message_header[6] | (message_header[7] << 8);
+
+	if(type == CAM_MESSAGE_FRAME){
+		if(length < CAM_FRAME_HEADER_LENGTH or read_exactly(header, CAM_FRAME_HEADER_LENGTH) == false){
+			return	-1;
+		}
+		payload.resize(length - CAM_FRAME_HEADER_LENGTH);
+		return	read_exactly(payload.data(), payload.size()) ? 1 : -1;
+	}
+
+	string		data(length, '\0');
+	if(read_exactly((uint8_t*)&data[0], length) == false){
+		return	-1;
+	}
+	handle_message(type, data);
+	return	0;
+}
+
+// all datagrams waiting in the socket, until a frame is complete
+int CCamConnection::read_datagrams(){
+
+	while(true){
+		if(datagram_next == datagram_count){
+			struct mmsghdr		messages[CAMCLIENT_UDP_BATCH];
+			struct iovec		iov[CAMCLIENT_UDP_BATCH];
+			memset(messages, 0, sizeof(messages));
+			for(int i = 0; i < CAMCLIENT_UDP_BATCH; i++){
+				iov[i].iov_base					= datagrams[i].data();
+				iov[i].iov_len					= datagrams[i].size();
+				messages[i].msg_hdr.msg_iov		= &iov[i];
+				messages[i].msg_hdr.msg_iovlen	= 1;
+			}
+			int		count	= recvmmsg(client_socket, messages, CAMCLIENT_UDP_BATCH, MSG_DONTWAIT, NULL);
+			if(count < 0){
+				return	(errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR) ? 0 : -1;
+			}
+			for(int i = 0; i < count; i++){
+				datagram_lengths[i]		= messages[i].msg_len;
+			}
+			datagram_count	= count;
+			datagram_next	= 0;
+		}
+		while(datagram_next < datagram_count){
+			int		index	= datagram_next++;
+			if(handle_datagram(datagrams[index].data(), datagram_lengths[index]) == 1){
+				return	1;
+			}
+		}
+	}
+}
+
+// puts the fragment in place; a complete frame drops the older ones that
+// are still missing datagrams
+int CCamConnection::handle_datagram(const uint8_t* datagram, uint32_t length){
+
+	if(length < CAM_UDP_HEADER_LENGTH or get_uint32(datagram) != CAM_UDP_MAGIC){
+		udp_stats.datagrams_invalid++;
+		return	0;
+	}
+	uint16_t	stream			= get_uint16(datagram + 4);
+	uint16_t	index			= get_uint16(datagram + 6);
+	uint64_t	frame_id		= get_uint64(datagram + 8);
+	uint32_t	message_length	= get_uint32(datagram + 16);
+	uint16_t	count			= get_uint16(datagram + 20);
+	uint16_t	fragment_length	= get_uint16(datagram + 22);
+	uint32_t	sequence		= get_uint32(datagram + 24);
+	uint32_t	offset			= get_uint32(datagram + 28);
+	if(fragment_length != length - CAM_UDP_HEADER_LENGTH or fragment_length == 0 or index >= count or uint64_t(offset) + fragment_length > message_length){
+		udp_stats.datagrams_invalid++;
+		return	0;
+	}
+	// no more than count datagrams can carry, checked before the message is
+	// allocated
+	uint64_t	max_fragment	= CAM_UDP_MAX_MTU - CAM_UDP_IP_OVERHEAD - CAM_UDP_HEADER_LENGTH;
+	if(message_length > CAMCLIENT_UDP_MAX_MESSAGE or message_length > count * max_fragment){
+		udp_stats.datagrams_invalid++;
+		return	0;
+	}
+	// fragments of one length (the stride) at index * stride, the last one
+	// ends the message: count different indices cover it without overlap
+	bool		last			= index == count - 1;
+	uint32_t	stride			= last ? (index > 0 ? offset / index : message_length) : fragment_length;
+	if(uint64_t(index) * stride != offset or (last == true and uint64_t(offset) + fragment_length != message_length) or uint64_t(count - 1) * stride >= message_length or uint64_t(count) * stride < message_length){
+		udp_stats.datagrams_invalid++;
+		return	0;
+	}
+	udp_stats.datagrams_received++;
+	udp_stats.bytes_received	+= length;
+
+	// gaps in the sequence are lost datagrams until they show up late; a
+	// large step back is a restarted sender
+	CUdpStream&		state		= udp_streams[stream];
+	int32_t			gap			= sequence - state.next_sequence;
+	if(state.sequence_known == true and gap < 0 and gap > -65536){
+		udp_stats.datagrams_late++;
+		if(udp_stats.datagrams_lost > 0){
+			udp_stats.datagrams_lost--;
+		}
+	}else{
+		if(state.sequence_known == true){
+			udp_stats.datagrams_lost	+= max(gap, 0);
+		}
+		state.next_sequence		= sequence + 1;
+		state.sequence_known	= true;
+	}
+
+	// late fragment of a frame that is done, or a restarted camera
+	if(state.frame_known == true and int64_t(frame_id - state.last_frame_id) <= 0){
+		if(state.last_frame_id - frame_id < CAMCLIENT_UDP_RESTART){
+			return	0;
+		}
+		udp_stats.frames_incomplete	+= state.frames.size();
+		state.frames.clear();
+		state.frame_known	= false;
+	}
+
+	auto	item	= state.frames.find(frame_id);
+	if(item == state.frames.end()){
+		if(state.frames.size() >= CAMCLIENT_UDP_FRAMES){
+			state.last_frame_id		= state.frames.begin()->first;
+			state.frame_known		= true;
+			state.frames.erase(state.frames.begin());
+			udp_stats.frames_incomplete++;
+			if(int64_t(frame_id - state.last_frame_id) <= 0){
+				return	0;
+			}
+		}
+		CUdpPartialFrame&	frame	= state.frames[frame_id];
+		frame.message.resize(message_length);
+		frame.received.assign(count, false);
+		frame.missing		= count;
+		frame.stride		= stride;
+		item				= state.frames.find(frame_id);
+	}
+	CUdpPartialFrame&	frame	= item->second;
+	if(frame.message.size() != message_length or frame.received.size() != count or frame.stride != stride){
+		udp_stats.datagrams_invalid++;
+		return	0;
+	}
+	if(frame.received[index] == false){
+		memcpy(frame.message.data() + offset, datagram + CAM_UDP_HEADER_LENGTH, fragment_length);
+		frame.received[index]	= true;
+		frame.missing--;
+	}
+	if(frame.missing > 0){
+		return	0;
+	}
+
+	// complete: the older frames won't be any more
+	vector<uint8_t>		message;
+	message.swap(frame.message);
+	while(state.frames.begin()->first != frame_id){
+		state.frames.erase(state.frames.begin());
+		udp_stats.frames_incomplete++;
+	}
+	state.frames.erase(state.frames.begin());
+	state.last_frame_id		= frame_id;
+	state.frame_known		= true;
+
+	if(message.size() < CAM_MESSAGE_HEADER_LENGTH + CAM_FRAME_HEADER_LENGTH or get_uint16(message.data() + 4) != CAM_MESSAGE_FRAME or get_uint32(message.data()) != message.size() - CAM_MESSAGE_HEADER_LENGTH){
+		udp_stats.datagrams_invalid++;
+		return	0;
+	}
+	udp_stats.frames_complete++;
+	stream_id	= get_uint16(message.data() + 6);
+	memcpy(header, message.data() + CAM_MESSAGE_HEADER_LENGTH, CAM_FRAME_HEADER_LENGTH);
+	payload.assign(message.begin() + CAM_MESSAGE_HEADER_LENGTH + CAM_FRAME_HEADER_LENGTH, message.end());
+	return	1;
+}
+
+// unknown messages are skipped
+void CCamConnection::handle_message(uint16_t type, const string& data){
+
+	const uint8_t*	buffer	= (const uint8_t*)data.data();
+	switch(type){
+		case	CAM_MESSAGE_WELCOME:
+			if(data.length() >= CAM_WELCOME_LENGTH){
+				session.server_capabilities		= get_uint32(buffer);
+				session.capabilities			= get_uint32(buffer + 4);
+				session.encoding				= get_uint32(buffer + 8);
+				session.delivery				= get_uint32(buffer + 12);
+				delta_mode						= session.encoding == ENCODING_DELTA;
+				decoders.clear();
+			}
+			break;
+		case	CAM_MESSAGE_METADATA:
+			metadata	= data;
+			break;
+		case	CAM_MESSAGE_BANDWIDTH:
+			bandwidth	= data;
+			break;
+		case	CAM_MESSAGE_STATS:
+			if(data.length() >= CAM_STATS_MIN_LENGTH){
+				session.frames_sent				= get_uint64(buffer);
+				session.frames_conflated		= get_uint64(buffer + 8);
+				session.send_calls				= get_uint64(buffer + 16);
+				session.zerocopy_fallbacks		= get_uint64(buffer + 24);
+				session.ring_overwritten		= get_uint64(buffer + 32);
+				session.ring_dropped			= get_uint64(buffer + 40);
+			}
+			if(data.length() >= CAM_STATS_LENGTH){
+				session.quality					= get_uint64(buffer + 48);
+				session.link_rate				= get_uint64(buffer + 56);
+				session.queue_delay_us			= get_uint64(buffer + 64);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+// 1 decoded, 0 not decodable (skipped), the image ends up in image or in
+// the history of the stream
+int CCamConnection::decode(struct camclient_frame* frame){
+
+	if(decoders.count(stream_id) == 0){
+		decoders[stream_id].delta_mode	= delta_mode;
+	}
+	CStreamDecoder&		decoder		= decoders[stream_id];
+	auto&				history		= decoder.history;
+
+	frame->stream_id			= stream_id;
+	frame->width				= get_uint32(header + 4);
+	frame->height				= get_uint32(header + 8);
+	frame->offset_x				= get_uint32(header + 12);
+	frame->offset_y				= get_uint32(header + 16);
+	frame->wire_pixel_format	= get_uint32(header + 20);
+	frame->time_stamp			= get_uint64(header + 24);
+	frame->frame_id				= get_uint64(header + 32);
+	frame->wire_size			= payload.size();
+
+	uint32_t	pixel_format	= frame->wire_pixel_format;
+	uint32_t	width			= frame->width;
+	uint32_t	height			= frame->height;
+	size_t		pixel_count		= size_t(width) * height;
+	vector<uint8_t>		decoded;
+	bool		ok				= true;
+
+	switch(frame->wire_pixel_format){
+		case	PIXEL_FORMAT_MONO10P:
+		case	PIXEL_FORMAT_MONO12P:{
+			int		bits	= pixel_format_bits(pixel_format);
+			ok				= payload.size() >= packed_size(pixel_count, bits);
+			if(ok){
+				decoded.resize(pixel_count * 2);
+				unpack_pixels(payload.data(), (uint16_t*)decoded.data(), pixel_count, bits);
+				pixel_format	= bits == 10 ? PIXEL_FORMAT_MONO10 : PIXEL_FORMAT_MONO12;
+			}
+			break;
+		}
+		case	PIXEL_FORMAT_TILE_CODEC:
+			ok	= tile_decompress(payload.data(), payload.size(), decoded, pixel_format, width, height);
+			break;
+
+		case	PIXEL_FORMAT_SPARSE:
+			ok	= sparse_decode(payload.data(), payload.size(), decoded, pixel_format, width, height);
+			break;
+
+		case	PIXEL_FORMAT_DELTA:{
+			ok	= payload.size() >= DELTA_HEADER_LENGTH and get_uint32(payload.data()) == DELTA_MAGIC;
+			if(ok){
+				uint64_t	reference_id	= get_uint64(payload.data() + 8);
+				const vector<uint8_t>*	reference	= NULL;
+				for(auto& item : history){
+					if(item.first == reference_id){
+						reference	= &item.second;
+					}
+				}
+				ok	= reference != NULL and tile_decompress(payload.data() + DELTA_HEADER_LENGTH, payload.size() - DELTA_HEADER_LENGTH, decoded, pixel_format, width, height, reference->data(), reference->size());
+			}
+			break;
+		}
+		default:
+			decoded.swap(payload);
+			break;
+	}
+
+	if(ok == false or width != frame->width or height != frame->height){
+		// lost the reference (or corrupt): ask for a key frame
+		if(decoder.delta_mode){
+			send_stream_option(stream_id, "key");
+		}
+		return	0;
+	}
+
+	frame->pixel_format			= pixel_format;
+	frame->bytes_per_pixel		= pixel_format_bytes(pixel_format);
+	frame->size					= decoded.size();
+
+	if(decoder.delta_mode){
+		history.push_back(make_pair(frame->frame_id, vector<uint8_t>()));
+		history.back().second.swap(decoded);
+		if(history.size() > CAMCLIENT_HISTORY){
+			history.pop_front();
+		}
+		frame->data		= history.back().second.data();
+		send_stream_option(stream_id, "ack " + to_string(frame->frame_id));
+	}else{
+		decoder.image.swap(decoded);
+		frame->data		= decoder.image.data();
+	}
+	return	1;
+}
+
+/*****************************************************************************/
+// C interface
+/*****************************************************************************/
+extern "C" {
+
+// TCP connection, -1 if it failed
+static int	connect_tcp(const char* host, int port){
+
+	struct addrinfo		hints;
+	struct addrinfo*	result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family		= AF_UNSPEC;
+	hints.ai_socktype	= SOCK_STREAM;
+
+	if(getaddrinfo(host, to_string(port).c_str(), &hints, &result) != 0){
+		return	-1;
+	}
+	int		client_socket	= -1;
+	for(struct addrinfo* address = result; address != NULL; address = address->ai_next){
+		client_socket	= socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if(client_socket < 0){
+			continue;
+		}
+		if(connect(client_socket, address->ai_addr, address->ai_addrlen) == 0){
+			break;
+		}
+		close(client_socket);
+		client_socket	= -1;
+	}
+	freeaddrinfo(result);
+	if(client_socket < 0){
+		return	-1;
+	}
+
+	// acknowledgements go out at once
+	int		flag	= 1;
+	setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+	return	client_socket;
+}
+
+void*	camclient_open(const char* host, int port){
+
+	int		client_socket	= connect_tcp(host, port);
+	if(client_socket < 0){
+		return	NULL;
+	}
+
+	CCamConnection*		connection	= new CCamConnection();
+	connection->client_socket		= client_socket;
+	connection->delta_mode			= false;
+	connection->stream_id			= 0;
+	memset(&connection->session, 0, sizeof(connection->session));
+	connection->session.protocol	= CAM_PROTOCOL_LEGACY;
+	connection->udp					= false;
+	connection->control				= false;
+	memset(&connection->udp_stats, 0, sizeof(connection->udp_stats));
+
+	if(connection->handshake() == false){
+		camclient_close(connection);
+		return	NULL;
+	}
+	return	connection;
+}
+
+void*	camclient_open_udp(const char* address, int port, const char* interface){
+
+	struct in_addr		group;
+	group.s_addr		= htonl(INADDR_ANY);
+	if(address != NULL and address[0] != '\0' and inet_pton(AF_INET, address, &group) != 1){
+		return	NULL;
+	}
+	bool	multicast	= IN_MULTICAST(ntohl(group.s_addr));
+
+	int		client_socket	= socket(AF_INET, SOCK_DGRAM, 0);
+	if(client_socket < 0){
+		return	NULL;
+	}
+	// several receivers of a group on one machine
+	int		flag		= 1;
+	setsockopt(client_socket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+	int		buffer_size	= CAMCLIENT_UDP_BUFFER;
+	setsockopt(client_socket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+	// bound to the group, such that other groups on the port stay out
+	struct sockaddr_in	local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family		= AF_INET;
+	local.sin_port			= htons(port);
+	local.sin_addr			= multicast ? group : in_addr{htonl(INADDR_ANY)};
+	bool	ok				= bind(client_socket, (struct sockaddr*)&local, sizeof(local)) == 0;
+
+	if(ok and multicast){
+		struct ip_mreq	membership;
+		membership.imr_multiaddr			= group;
+		membership.imr_interface.s_addr		= htonl(INADDR_ANY);
+		if(interface != NULL and interface[0] != '\0'){
+			ok	= inet_pton(AF_INET, interface, &membership.imr_interface) == 1;
+		}
+		ok	= ok and setsockopt(client_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == 0;
+	}
+	if(ok == false){
+		close(client_socket);
+		return	NULL;
+	}
+
+	CCamConnection*		connection	= new CCamConnection();
+	connection->client_socket		= client_socket;
+	connection->delta_mode			= false;
+	connection->stream_id			= 0;
+	memset(&connection->session, 0, sizeof(connection->session));
+	connection->session.protocol	= CAM_PROTOCOL_VERSION;
+	connection->metadata			= "transport udp\n";
+	connection->udp					= true;
+	connection->control				= false;
+	memset(&connection->udp_stats, 0, sizeof(connection->udp_stats));
+	connection->datagrams.assign(CAMCLIENT_UDP_BATCH, vector<uint8_t>(CAM_UDP_MAX_MTU));
+	connection->datagram_lengths.assign(CAMCLIENT_UDP_BATCH, 0);
+	connection->datagram_count		= 0;
+	connection->datagram_next		= 0;
+	return	connection;
+}
+
+void*	camclient_open_control(const char* host, int port){
+
+	int		client_socket	= connect_tcp(host, port);
+	if(client_socket < 0){
+		return	NULL;
+	}
+
+	// no handshake: text lines, frames come as FRAME messages
+	CCamConnection*		connection	= new CCamConnection();
+	connection->client_socket		= client_socket;
+	connection->delta_mode			= false;
+	connection->stream_id			= 0;
+	memset(&connection->session, 0, sizeof(connection->session));
+	connection->session.protocol	= CAM_PROTOCOL_VERSION;
+	connection->udp					= false;
+	connection->control				= true;
+	memset(&connection->udp_stats, 0, sizeof(connection->udp_stats));
+	return	connection;
+}
+
+void	camclient_close(void* client){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	if(connection != NULL){
+		close(connection->client_socket);
+		delete	connection;
+	}
+}
+
+int		camclient_set_option(void* client, const char* option){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	string				line		= option;
+
+	if(connection->udp == true or connection->control == true){
+		return	-1;
+	}
+	connection->set_encoding(line);
+	return	connection->send_option(line) ? 0 : -1;
+}
+
+int		camclient_receive(void* client, struct camclient_frame* frame, int timeout_ms){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	auto				deadline	= steady_clock::now() + milliseconds(timeout_ms);
+
+	while(true){
+		// datagrams of the last call first
+		if(connection->udp == true){
+			int		status	= connection->read_datagrams();
+			if(status < 0){
+				return	-1;
+			}
+			if(status == 1 and connection->decode(frame) == 1){
+				return	1;
+			}
+			if(status == 1){
+				continue;
+			}
+		}
+
+		struct pollfd	poll_fd;
+		poll_fd.fd			= connection->client_socket;
+		poll_fd.events		= POLLIN;
+		poll_fd.revents		= 0;
+
+		int		status		= poll(&poll_fd, 1, remaining_ms(deadline));
+		if(status == 0){
+			return	0;
+		}
+		if(status < 0){
+			return	-1;
+		}
+
+		if(connection->udp == true){
+			continue;
+		}else if(connection->session.protocol == CAM_PROTOCOL_LEGACY){
+			if(connection->read_exactly(connection->header, CAM_FRAME_HEADER_LENGTH) == false){
+				return	-1;
+			}
+			connection->payload.resize(get_uint32(connection->header));
+			if(connection->read_exactly(connection->payload.data(), connection->payload.size()) == false){
+				return	-1;
+			}
+		}else{
+			// statistics, heartbeats, ... in between
+			status	= connection->read_message();
+			if(status < 0){
+				return	-1;
+			}
+			if(status == 0){
+				continue;
+			}
+		}
+		if(connection->decode(frame) == 1){
+			return	1;
+		}
+	}
+}
+
+int		camclient_snapshot(void* client, const char* request, struct camclient_frame* frame, int timeout_ms){
+	CCamConnection*		connection	= (CCamConnection*)client;
+
+	if(connection->control == false){
+		return	-1;
+	}
+	// "snapshot <camera> <length>" and the FRAME message, or "error ..."
+	string		line;
+	int			status	= connection->request(string(CAM_CONTROL_SNAPSHOT) + " " + request, line, timeout_ms);
+	if(status != 1){
+		return	status;
+	}
+	stringstream	line_stream(line);
+	string			answer;
+	line_stream		>> answer;
+	if(answer != CAM_CONTROL_SNAPSHOT){
+		connection->error	= answer == CAM_CONTROL_ERROR ? line.substr(min(line.length(), answer.length() + 1)) : line;
+		return	-2;
+	}
+	if(connection->read_message() != 1){
+		return	-1;
+	}
+	if(connection->decode(frame) != 1){
+		connection->error	= "frame not decodable";
+		return	-2;
+	}
+	return	1;
+}
+
+int		camclient_command(void* client, const char* request, const char** answer, int timeout_ms){
+	CCamConnection*		connection	= (CCamConnection*)client;
+
+	if(connection->control == false){
+		return	-1;
+	}
+	string		line;
+	int			status	= connection->request(request, line, timeout_ms);
+	if(status != 1){
+		return	status;
+	}
+	stringstream	line_stream(line);
+	string			word;
+	line_stream		>> word;
+	string			rest	= line.substr(min(line.length(), word.length() + 1));
+	if(word != CAM_CONTROL_OK){
+		connection->error	= word == CAM_CONTROL_ERROR ? rest : line;
+		return	-2;
+	}
+	connection->answer	= rest;
+	if(answer != NULL){
+		*answer		= connection->answer.c_str();
+	}
+	return	1;
+}
+
+const char*	camclient_get_events(void* client){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	connection->events_fetched.swap(connection->events);
+	connection->events.clear();
+	return	connection->events_fetched.c_str();
+}
+
+const char*	camclient_get_error(void* client){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	return	connection->error.c_str();
+}
+
+void	camclient_get_session(void* client, struct camclient_session* session){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	*session	= connection->session;
+}
+
+const char*	camclient_get_metadata(void* client){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	return	connection->metadata.c_str();
+}
+
+const char*	camclient_get_bandwidth(void* client){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	return	connection->bandwidth.c_str();
+}
+
+void	camclient_get_udp_stats(void* client, struct camclient_udp_stats* stats){
+	CCamConnection*		connection	= (CCamConnection*)client;
+	*stats	= connection->udp_stats;
+}
+
+}
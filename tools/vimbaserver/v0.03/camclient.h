@@ -0,0 +1,170 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __CAMCLIENT_H__
+#define __CAMCLIENT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*****************************************************************************/
+// Client library (libcamclient)
+/*****************************************************************************/
+//
+//	connects to one camera port of the vimbaserver, receives the frames and
+//	decodes every wire encoding (packed, tile, sparse, delta) back to Mono8
+//	or 16 bit pixels. In delta mode, decoded frames are acknowledged and
+//	kept as references.
+//
+//	On the multiplexed port, "subscribe <id>" selects the cameras (see
+//	"stream" lines of the metadata), frames carry their stream id and each
+//	stream is decoded on its own.
+//
+//	The library speaks the stream protocol (protocol.h): the server picks
+//	the fastest encoding both sides support. Servers that don't answer the
+//	handshake are served as before (legacy framing, raw frames).
+//
+//	camclient_open_udp receives the UDP transport of a server instead (see
+//	protocol.h): the datagrams are put together to frames, frames with a
+//	missing datagram are dropped and counted (camclient_get_udp_stats).
+//
+//	camclient_open_control connects to the control port instead: requests
+//	(camclient_command, see ctr_server.h) and frames one at a time
+//	(camclient_snapshot), the newest frame of a camera in any encoding (see
+//	protocol.h).
+//
+//	Plain C interface, such that it can be used from python (ctypes, see
+//	E320/camclient.py).
+//
+
+// frames kept as delta references
+#define	CAMCLIENT_HISTORY			16
+
+// UDP: frames put together at the same time per stream (reordering), the
+// oldest one is dropped if another one starts; datagrams per recvmmsg call;
+// socket receive buffer
+#define	CAMCLIENT_UDP_FRAMES		4
+#define	CAMCLIENT_UDP_BATCH			16
+#define	CAMCLIENT_UDP_BUFFER		(8*1024*1024)
+// a frame id this far behind the last one: the camera restarted
+#define	CAMCLIENT_UDP_RESTART		64
+// largest frame message put together from datagrams (bytes), longer ones
+// are invalid
+#define	CAMCLIENT_UDP_MAX_MESSAGE	(256*1024*1024)
+
+extern "C" {
+
+// decoded frame, data is valid until the next camclient_receive call
+struct	camclient_frame{
+	uint32_t		width;
+	uint32_t		height;
+	uint32_t		offset_x;
+	uint32_t		offset_y;
+	// pixel format of the decoded image (Mono8..Mono16, YUV422_8, MJPEG)
+	uint32_t		pixel_format;
+	// 0: data isn't a pixel array (e.g. MJPEG)
+	uint32_t		bytes_per_pixel;
+	uint64_t		time_stamp;
+	uint64_t		frame_id;
+	// pixel format and size on the wire
+	uint32_t		wire_pixel_format;
+	uint32_t		wire_size;
+	const uint8_t*	data;
+	uint64_t		size;
+	// camera the frame belongs to
+	uint32_t		stream_id;
+};
+
+// result of the handshake and the last STATS message of the server
+struct	camclient_session{
+	// CAM_PROTOCOL_LEGACY or CAM_PROTOCOL_VERSION
+	uint32_t		protocol;
+	uint32_t		server_capabilities;
+	uint32_t		capabilities;
+	uint32_t		encoding;
+	uint32_t		delivery;
+	uint64_t		frames_sent;
+	uint64_t		frames_conflated;
+	uint64_t		send_calls;
+	uint64_t		zerocopy_fallbacks;
+	uint64_t		ring_overwritten;
+	uint64_t		ring_dropped;
+	// adaptive quality: QUALITY_* level (see camserver.h), link rate
+	// estimated by the server (bytes/s), delay of the queued data (us)
+	uint64_t		quality;
+	uint64_t		link_rate;
+	uint64_t		queue_delay_us;
+};
+
+// UDP receiver statistics
+struct	camclient_udp_stats{
+	uint64_t		datagrams_received;
+	// gaps in the sequence of the senders, late: out of order / duplicate
+	uint64_t		datagrams_lost;
+	uint64_t		datagrams_late;
+	uint64_t		datagrams_invalid;
+	uint64_t		bytes_received;
+	uint64_t		frames_complete;
+	// dropped, at least one datagram was missing
+	uint64_t		frames_incomplete;
+};
+
+// NULL if the connection failed
+void*	camclient_open(const char* host, int port);
+// UDP: address is a multicast group (joined on the local interface address
+// "interface", NULL for the default) or NULL for datagrams sent to this host
+void*	camclient_open_udp(const char* address, int port, const char* interface);
+// control port of the server, for camclient_snapshot only
+void*	camclient_open_control(const char* host, int port);
+void	camclient_close(void* client);
+
+// sends an option line (without newline), e.g. "encoding delta" or
+// "stream 1 encoding delta", 0 on success (-1 for UDP: no back channel)
+int		camclient_set_option(void* client, const char* option);
+
+// waits for the next frame: 1 frame received, 0 timeout, -1 connection lost
+int		camclient_receive(void* client, struct camclient_frame* frame, int timeout_ms);
+
+// control port: the newest frame of a camera, request "<camera>
+// [raw|packed|tile] [preview <n>]" (camera: index or id). 1 frame received,
+// 0 timeout, -1 connection lost, -2 refused (see camclient_get_error)
+int		camclient_snapshot(void* client, const char* request, struct camclient_frame* frame, int timeout_ms);
+// control port: a request line, e.g. "get 0 ExposureTime"; *answer: the
+// answer without "ok", valid until the next call. Return values as above.
+int		camclient_command(void* client, const char* request, const char** answer, int timeout_ms);
+const char*	camclient_get_error(void* client);
+// control port: events of subscribed cameras that arrived with the answers
+// since the last call, "<camera index> <text>" lines
+const char*	camclient_get_events(void* client);
+
+// handshake result and server statistics
+void	camclient_get_session(void* client, struct camclient_session* session);
+
+// METADATA of the server, "<key> <value>" lines (empty for legacy servers)
+const char*	camclient_get_metadata(void* client);
+
+// last BANDWIDTH message: uplink rate, throughput and demand per camera
+const char*	camclient_get_bandwidth(void* client);
+
+// UDP: datagram and frame counters (zero for TCP connections)
+void	camclient_get_udp_stats(void* client, struct camclient_udp_stats* stats);
+
+}
+
+/*****************************************************************************/
+#endif
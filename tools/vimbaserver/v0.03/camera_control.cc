@@ -0,0 +1,222 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+
+#include	"camera_control.h"
+
+#include	<errno.h>
+#include	<stdio.h>
+#include	<unistd.h>
+#include	<sys/eventfd.h>
+
+/*****************************************************************************/
+// state names
+/*****************************************************************************/
+const char*	camera_state_name(int state){
+	switch(state){
+		case	CAMERA_STATE_SEARCHING:		return	"searching";
+		case	CAMERA_STATE_OPENING:		return	"opening";
+		case	CAMERA_STATE_ACQUIRING:		return	"acquiring";
+		case	CAMERA_STATE_STOPPED:		return	"stopped";
+		case	CAMERA_STATE_ERROR:			return	"error";
+		default:							return	"unknown";
+	}
+}
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CCameraControl::CCameraControl(){
+
+	this->state				= CAMERA_STATE_SEARCHING;
+
+	this->notify_pending	= false;
+	this->notify_fd			= eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(this->notify_fd < 0){
+		perror("CCameraControl eventfd failed");
+		throw -1;
+	}
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CCameraControl::~CCameraControl(){
+	close(notify_fd);
+}
+
+/*****************************************************************************/
+// control server -> camera thread
+/*****************************************************************************/
+void CCameraControl::push(const CControlCommand& command){
+
+	function<void()>	wakeup_copy;
+	{
+		lock_guard<mutex>	lock(command_mutex);
+		commands.push_back(command);
+		wakeup_copy	= wakeup;
+	}
+	command_condition.notify_one();
+	if(wakeup_copy){
+		wakeup_copy();
+	}
+}
+
+bool CCameraControl::pop(CControlCommand& command){
+
+	lock_guard<mutex>	lock(command_mutex);
+	if(commands.empty() == true){
+		return	false;
+	}
+	command		= commands.front();
+	commands.pop_front();
+	return	true;
+}
+
+bool CCameraControl::wait_command(CControlCommand& command, microseconds timeout){
+
+	unique_lock<mutex>	lock(command_mutex);
+	if(command_condition.wait_for(lock, timeout, [this]{ return commands.empty() == false; }) == false){
+		return	false;
+	}
+	command		= commands.front();
+	commands.pop_front();
+	return	true;
+}
+
+void CCameraControl::set_wakeup(function<void()> wakeup){
+	lock_guard<mutex>	lock(command_mutex);
+	this->wakeup	= wakeup;
+}
+
+/*****************************************************************************/
+// camera thread -> control server
+/*****************************************************************************/
+void CCameraControl::reply(const CControlCommand& command, bool ok, const string text){
+
+	CControlReply		answer;
+	answer.id			= command.id;
+	answer.ok			= ok;
+	answer.text			= text;
+	push_reply(answer);
+}
+
+void CCameraControl::post_event(const string text){
+
+	CControlReply		event;
+	event.id			= 0;
+	event.ok			= true;
+	event.text			= text;
+	push_reply(event);
+}
+
+void CCameraControl::set_state(int state){
+	if(this->state.exchange(state) != state){
+		post_event(string("state ") + camera_state_name(state));
+	}
+}
+
+void CCameraControl::push_reply(const CControlReply& reply){
+
+	{
+		lock_guard<mutex>	lock(reply_mutex);
+		replies.push_back(reply);
+	}
+	// wake up the control server, once
+	if(notify_pending.exchange(true) == false){
+		uint64_t	count	= 1;
+		if(write(notify_fd, &count, sizeof(count)) < 0){
+			perror("CCameraControl notify failed");
+		}
+	}
+}
+
+bool CCameraControl::pop_reply(CControlReply& reply){
+
+	lock_guard<mutex>	lock(reply_mutex);
+	if(replies.empty() == true){
+		return	false;
+	}
+	reply		= replies.front();
+	replies.pop_front();
+	return	true;
+}
+
+void CCameraControl::clear_notify(){
+
+	uint64_t	count;
+	notify_pending	= false;
+	if(read(notify_fd, &count, sizeof(count)) < 0 and errno != EAGAIN){
+		perror("CCameraControl clear notify failed");
+	}
+}
+
+/*****************************************************************************/
+// CSettingsGeneration
+/*****************************************************************************/
+CSettingsGeneration::CSettingsGeneration(){
+	this->current			= 0;
+	this->latest			= 0;
+	this->last_frame_id		= 0;
+}
+
+uint32_t CSettingsGeneration::begin_at_time(uint64_t time_stamp){
+	lock_guard<mutex>	lock(access_mutex);
+	// supersedes the changes that didn't reach a frame yet (after a restart
+	// the frame ids may start over)
+	if(time_stamp == 0){
+		pending.clear();
+	}
+	latest++;
+	pending.push_back({latest, true, time_stamp});
+	return	latest;
+}
+
+uint32_t CSettingsGeneration::begin_after_margin(){
+	lock_guard<mutex>	lock(access_mutex);
+	latest++;
+	pending.push_back({latest, false, last_frame_id + SETTINGS_FRAME_MARGIN + 1});
+	return	latest;
+}
+
+uint32_t CSettingsGeneration::tag(uint64_t time_stamp, uint64_t frame_id, bool& first){
+	lock_guard<mutex>	lock(access_mutex);
+	first			= false;
+	// several changes can take effect with the same frame
+	while(pending.empty() == false){
+		CPending&	next	= pending.front();
+		if((next.by_time == true and time_stamp < next.start) or (next.by_time == false and frame_id < next.start)){
+			break;
+		}
+		current		= next.generation;
+		first		= true;
+		pending.pop_front();
+	}
+	last_frame_id	= frame_id;
+	return	current;
+}
+
+uint32_t CSettingsGeneration::get_latest(){
+	lock_guard<mutex>	lock(access_mutex);
+	return	latest;
+}
+
+uint32_t CSettingsGeneration::get_current(){
+	lock_guard<mutex>	lock(access_mutex);
+	return	current;
+}
@@ -0,0 +1,192 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+#ifndef __CAMERA_CONTROL_H__
+#define __CAMERA_CONTROL_H__
+
+#include <stdint.h>
+
+// multi-threading
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// containers
+#include <deque>
+#include <string>
+#include <vector>
+
+// time
+#include <chrono>
+
+
+using namespace std;
+using namespace std::chrono;
+
+/*****************************************************************************/
+// Camera states
+/*****************************************************************************/
+#define	CAMERA_STATE_SEARCHING		0		// waiting for vimba to find it
+#define	CAMERA_STATE_OPENING		1		// reset, configuration
+#define	CAMERA_STATE_ACQUIRING		2
+#define	CAMERA_STATE_STOPPED		3		// open, acquisition stopped
+#define	CAMERA_STATE_ERROR			4		// waiting before the next attempt
+
+const char*	camera_state_name(int state);
+
+// frames that may still have the old settings after a feature write, for
+// cameras without a clock latch (exposing, in transfer)
+#define	SETTINGS_FRAME_MARGIN		2
+
+/*****************************************************************************/
+// CControlCommand / CControlReply
+/*****************************************************************************/
+//
+//	a control port request for one camera, and its answer. id: given by the
+//	control server, such that the answer finds its request (client and tag)
+//
+struct	CControlCommand{
+	uint64_t			id;
+	// get, set, start, stop, stats
+	string				name;
+	vector<string>		args;
+};
+
+struct	CControlReply{
+	// 0: event of the camera, sent to the subscribed clients
+	uint64_t			id;
+	bool				ok;
+	string				text;
+};
+
+/*****************************************************************************/
+// CCameraControl
+/*****************************************************************************/
+//
+//	command queue between the control server and one camera thread. The
+//	control server pushes commands, the camera thread takes them whenever it
+//	wakes up and answers each one; answers and events go back through a
+//	second queue that wakes the control server (eventfd in its event loop).
+//
+//	The camera thread either waits for commands (wait_command) or, while it
+//	waits for frames, gets woken by set_wakeup's function.
+//
+class	CCameraControl{
+
+	public:
+	// constructor
+	CCameraControl();
+	// destructor
+	~CCameraControl();
+
+	// control server: queue a command, wakes the camera thread
+	void					push(const CControlCommand& command);
+	// control server: next answer or event, false if there is none
+	bool					pop_reply(CControlReply& reply);
+	// control server: readable when answers arrived, call clear_notify()
+	// before taking them
+	int						get_notify_fd()			{ return notify_fd; };
+	void					clear_notify();
+
+	// camera thread: next command, false if there is none
+	bool					pop(CControlCommand& command);
+	// camera thread: as pop, but waits until the timeout is over
+	bool					wait_command(CControlCommand& command, microseconds timeout);
+	// camera thread: called for every new command, e.g. to interrupt a wait
+	// for frames. Reset with an empty function.
+	void					set_wakeup(function<void()> wakeup);
+	// camera thread: answer a command
+	void					reply(const CControlCommand& command, bool ok, const string text);
+	// camera thread: state change or other event for the subscribers
+	void					post_event(const string text);
+
+	// state of the camera thread, an event on every change
+	void					set_state(int state);
+	int						get_state()				{ return state; };
+
+	private:
+	mutex					command_mutex;
+	condition_variable		command_condition;
+	deque<CControlCommand>	commands;
+	function<void()>		wakeup;
+
+	mutex					reply_mutex;
+	deque<CControlReply>	replies;
+
+	atomic<int>				state;
+
+	// wakes up the control server, only written once until it is cleared
+	int						notify_fd;
+	atomic<bool>			notify_pending;
+
+	void					push_reply(const CControlReply& reply);
+};
+
+/*****************************************************************************/
+// CSettingsGeneration
+/*****************************************************************************/
+//
+//	counts the feature changes of a camera: every frame is tagged with the
+//	generation of the settings it was acquired with (CFrameSlot::settings).
+//
+//	A feature written during the acquisition takes effect with the next
+//	exposure, the frames in flight still have the old settings. The camera
+//	thread latches the camera clock after the write, the first frame with a
+//	later time stamp gets the new generation. Cameras that can't latch their
+//	clock skip SETTINGS_FRAME_MARGIN frames after the last one received.
+//	After a restart of the acquisition, every frame is new.
+//
+//	The camera thread starts generations, the frame callback tags frames.
+//
+class	CSettingsGeneration{
+
+	public:
+	CSettingsGeneration();
+
+	// camera thread: the next generation, for frames with time stamp >=
+	// time_stamp (0: all frames from now on)
+	uint32_t				begin_at_time(uint64_t time_stamp);
+	// camera thread: the next generation, for frames after the next
+	// SETTINGS_FRAME_MARGIN ones
+	uint32_t				begin_after_margin();
+
+	// frame callback: generation of a frame, first: the frame starts it
+	uint32_t				tag(uint64_t time_stamp, uint64_t frame_id, bool& first);
+
+	// newest generation, it may not have a frame yet
+	uint32_t				get_latest();
+	// generation of the last frame
+	uint32_t				get_current();
+
+	private:
+	struct	CPending{
+		uint32_t			generation;
+		bool				by_time;
+		// time stamp or frame id of the first frame
+		uint64_t			start;
+	};
+
+	mutex					access_mutex;
+	uint32_t				current;
+	uint32_t				latest;
+	deque<CPending>			pending;
+	uint64_t				last_frame_id;
+};
+/*****************************************************************************/
+#endif
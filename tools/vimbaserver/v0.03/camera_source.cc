@@ -0,0 +1,52 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include	"camera_source.h"
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CCameraSource::CCameraSource(CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log) : log(log){
+	this->framering		= framering;
+	this->settings		= settings;
+	this->control		= control;
+}
+
+/*****************************************************************************/
+// slot for a new frame
+/*****************************************************************************/
+CFrameSlot*	CCameraSource::begin_frame(size_t buffer_size, uint64_t time_stamp, uint64_t frame_id){
+
+	// also for frames the ring drops
+	bool			first			= false;
+	uint32_t		generation		= settings->tag(time_stamp, frame_id, first);
+	if(first == true){
+		control->post_event("settings " + to_string(generation) + " frame " + to_string(frame_id));
+	}
+
+	// no slot available: the frame is counted as dropped by the ring
+	CFrameSlot*		slot	= framering->begin_write(buffer_size);
+	if(slot == NULL){
+		return	NULL;
+	}
+	slot->time_stamp	= time_stamp;
+	slot->frame_id		= frame_id;
+	slot->settings		= generation;
+	return	slot;
+}
@@ -0,0 +1,113 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __CAMERA_SOURCE_H__
+#define __CAMERA_SOURCE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <ostream>
+#include <functional>
+
+// time
+#include <chrono>
+
+// server ring the frames go to
+#include "frame_ring.h"
+// settings generations, commands
+#include "camera_control.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/*****************************************************************************/
+// CCameraSource
+/*****************************************************************************/
+//
+//	where the camera thread gets its frames from: a vimba camera
+//	(vimba_source.h), a V4L2 device or a simulator (synthetic_source.h).
+//	The camera thread (camera_streaming_main) drives the source, the source
+//	copies the frames into the server ring (begin_frame, commit_frame), the
+//	camera server reads them from there.
+//
+//	Sequence: open, start_stream, start_acquisition, process_frames until
+//	an error; then close and open again. A feature the source doesn't take
+//	during the acquisition is written between stop_stream and start_stream.
+//
+//	All calls throw -1 on errors. Only the camera thread calls them, except
+//	wakeup.
+//
+class	CCameraSource{
+
+	public:
+	// the ring and the state of the camera thread the source delivers to
+	CCameraSource(CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log);
+	virtual ~CCameraSource(){};
+
+	// find and open the camera, apply its configuration. rest: waits
+	// while the camera thread answers commands (instead of sleeping)
+	virtual void			open(function<void(steady_clock::duration)> rest) = 0;
+	virtual void			close() = 0;
+
+	// buffers for the current payload, capture engine
+	virtual void			start_stream() = 0;
+	virtual void			stop_stream() = 0;
+	// the current settings need other buffers than the stream has
+	virtual bool			payload_changed() = 0;
+	virtual void			start_acquisition() = 0;
+	virtual void			stop_acquisition() = 0;
+
+	// the work between frames (vimba: give the frames back to the camera),
+	// returns after the timeout or a wakeup; the frames that came in
+	virtual int				process_frames(microseconds timeout) = 0;
+	// any thread: process_frames returns early
+	virtual void			wakeup() = 0;
+
+	// features as text
+	virtual string			get_feature(const string& name) = 0;
+	virtual void			set_feature(const string& name, const string& value) = 0;
+	// false if the acquisition has to be stopped to write it
+	virtual bool			is_feature_writable(const string& name) = 0;
+	// buffer size of the stream
+	virtual size_t			get_payload_size() = 0;
+	// now on the clock of the frame time stamps, 0 if unknown
+	virtual uint64_t		latch_timestamp() = 0;
+
+	ostream&				get_log()			{ return log; };
+
+	protected:
+	CFrameRing*				framering;
+	CSettingsGeneration*	settings;
+	CCameraControl*			control;
+	ostream&				log;
+
+	// a slot for the frame, tagged with its settings generation (the first
+	// frame of a generation is an event); NULL if the ring drops the frame.
+	// Fill the image and frame geometry, then commit_frame.
+	CFrameSlot*				begin_frame(size_t buffer_size, uint64_t time_stamp, uint64_t frame_id);
+	void					commit_frame(CFrameSlot* slot)		{ framering->commit_write(slot); };
+};
+
+// the source of a camera as configured in config.xml, defined by the
+// program (main.cc); NULL if there is none
+CCameraSource*	create_camera_source(string cameraID, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log);
+
+/*****************************************************************************/
+#endif
@@ -17,25 +17,28 @@
 //
 /*****************************************************************************/ 
 
+
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <cstring>
+
+
+// server-side frame buffer, slots handed on to the multiplexed server
+#include "frame_ring.h"
+#include "frame_feed.h"
+#include "latest_frame.h"
 
+// commands of the control server
+#include "camera_control.h"
 
-// thread-save queue
-#include "queue.h"
+// where the frames come from: vimba, simulator, ...
+#include "camera_source.h"
 
 // small helper functions
 #include "tools.h"
 
-// vimba include files
-#include "VimbaCPP/Include/VimbaCPP.h"
-#include "Common/StreamSystemInfo.h"
-#include "Common/ErrorCodeToMessage.h"
-
 using namespace std;
-using namespace AVT;
-using namespace VmbAPI;
 using namespace std::chrono;
 
 
@@ -49,11 +52,10 @@ using 	CMyCamServer		= CCamServer<CAM_SERVER_QUEUE_LENGTH>;
 
 
 #include	"global.h"
-/*****************************************************************************/
-// vimba
-/*****************************************************************************/
-#include "vimba.h"
-extern	CVimba		global_vimba;
+
+// uplink shared by all camera servers
+#include "bandwidth.h"
+extern	CBandwidthScheduler		global_bandwidth;
 
 /*****************************************************************************/
 // xml parsing: config file
@@ -64,90 +66,146 @@ extern mutex				xmlconfig_mutex;
 
 
 /*****************************************************************************/
-// callback: camera provides a new frame
+// control commands
 /*****************************************************************************/
-class FrameObserver : public IFrameObserver{
-	public:
-		// constructor
-		FrameObserver (CameraPtr apicamera, CQueue<FramePtr>* framequeue);
-		// destructor
-		~FrameObserver ();
-		// callback
-		void	FrameReceived (const FramePtr frame);
-	
-	private:
-		// camera which is sending the frames
-		CameraPtr 			apicamera;
-		// queue to which we should return the received frames
-		CQueue<FramePtr>*	framequeue;
-		
-};
-
-/***********************************************/
-// constructor
-/***********************************************/
-FrameObserver::FrameObserver (CameraPtr apicamera, CQueue<FramePtr>* framequeue) : IFrameObserver (apicamera){ 
-	this->apicamera 	= apicamera;
-	this->framequeue	= framequeue;
-}
+// source: NULL while the camera isn't open, only "stats" can be answered then
+void	answer_command(CCameraControl* control, const CControlCommand& command, CCameraSource* source, CFrameRing& framering, CSettingsGeneration& settings){
+
+	int		state	= control->get_state();
+	if(command.name == "stats"){
+		stringstream	answer;
+		answer	<< "state " << camera_state_name(state) << " written " << framering.get_written();
+		answer	<< " overwritten " << framering.get_overwritten() << " dropped " << framering.get_dropped();
+		answer	<< " settings " << settings.get_current();
+		control->reply(command, true, answer.str());
+		return;
+	}
+	if(source == NULL){
+		control->reply(command, false, string("camera ") + camera_state_name(state));
+		return;
+	}
 
-/***********************************************/
-// destructor
-/***********************************************/
-FrameObserver::~FrameObserver(){ 
-	//cout << "FrameObserver deleted" << endl;
+	// set while the stream is torn down: the camera thread starts over
+	bool	stream_down		= false;
+	try{
+		if(command.name == "get"){
+			control->reply(command, true, source->get_feature(command.args[0]));
+		}else if(command.name == "set"){
+			string		feature		= command.args[0];
+			bool		acquiring	= state == CAMERA_STATE_ACQUIRING;
+			// the camera locks e.g. binning and the pixel format while it
+			// acquires: stop, write, set up new frames, start again
+			bool		restart		= acquiring and source->is_feature_writable(feature) == false;
+			bool		written		= false;
+			if(restart == false){
+				source->set_feature(feature, command.args[1]);
+				written		= true;
+				restart		= acquiring and source->payload_changed();
+			}
+			uint32_t	generation;
+			if(restart == true){
+				auto	restart_begin	= steady_clock::now();
+				source->stop_acquisition();
+				stream_down	= true;
+				source->stop_stream();
+				try{
+					if(written == false){
+						source->set_feature(feature, command.args[1]);
+						written		= true;
+					}
+				}catch(...){
+					// restart with the old settings
+				}
+				source->start_stream();
+				stream_down	= false;
+				generation	= settings.begin_at_time(0);
+				try{
+					source->start_acquisition();
+				}catch(...){
+					control->set_state(CAMERA_STATE_STOPPED);
+					throw	-1;
+				}
+				source->get_log() << "reconfiguration for " << feature << ": " << duration<double, milli>(steady_clock::now() - restart_begin).count() << " ms" << endl;
+			}else if(acquiring == true){
+				// the frames in flight keep the old settings
+				uint64_t		now		= source->latch_timestamp();
+				generation	= now > 0 ? settings.begin_at_time(now) : settings.begin_after_margin();
+			}else{
+				generation	= settings.begin_at_time(0);
+			}
+			if(written == false){
+				control->reply(command, false, "set failed");
+				return;
+			}
+			// the camera may have rounded the value
+			string		value	= source->get_feature(feature);
+			string		text	= value + " settings " + to_string(generation) + (restart ? " restarted" : "");
+			control->reply(command, true, text);
+			control->post_event("set " + feature + " " + text);
+		}else if(command.name == "start"){
+			if(state != CAMERA_STATE_ACQUIRING){
+				// a feature written meanwhile changed the payload
+				if(source->payload_changed() == true){
+					stream_down	= true;
+					source->stop_stream();
+					source->start_stream();
+					stream_down	= false;
+				}
+				source->start_acquisition();
+				control->set_state(CAMERA_STATE_ACQUIRING);
+			}
+			control->reply(command, true, camera_state_name(control->get_state()));
+		}else if(command.name == "stop"){
+			if(state == CAMERA_STATE_ACQUIRING){
+				source->stop_acquisition();
+				control->set_state(CAMERA_STATE_STOPPED);
+			}
+			control->reply(command, true, camera_state_name(control->get_state()));
+		}else{
+			control->reply(command, false, "unknown command " + command.name);
+		}
+	}catch(...){
+		control->reply(command, false, command.name + " failed");
+		// no frames announced: the camera thread starts over
+		if(stream_down == true){
+			throw	-1;
+		}
+	}
 }
 
+// instead of sleeping: answers the commands that come in meanwhile
+void	rest_serving_commands(CCameraControl* control, CFrameRing& framering, CSettingsGeneration& settings, steady_clock::duration time){
 
-/***********************************************/
-// callback: camera provides a new frame
-/***********************************************/
-// Frame callback notifies about incoming frames
-void FrameObserver::FrameReceived (const FramePtr frame)
-{
-
-	// put the frame into the queue
-	//cout	<< "callback: new frame" << endl;
-	VmbUint64_t		frameid;
-	frame->GetFrameID(frameid);
-	cout	 << get_current_date_time_string() << " FrameObserver: new frame " << frameid  << endl;
-
-	framequeue->push(frame);
-	//apicamera->QueueFrame(frame);
+	auto			deadline	= steady_clock::now() + time;
+	CControlCommand	command;
+	while(true){
+		auto	remaining	= deadline - steady_clock::now();
+		if(remaining <= steady_clock::duration::zero()){
+			break;
+		}
+		if(control->wait_command(command, duration_cast<microseconds>(remaining)) == true){
+			answer_command(control, command, NULL, framering, settings);
+		}
+	}
 }
 
 
-/*****************************************************************************/
-// frame class: overloaded destructor to make sure frames get deleted
-/*****************************************************************************/
-class MyFrame : public Frame{
-	public:
-	MyFrame(VmbInt64_t framesize) : Frame(framesize){};
-	~MyFrame() {
-	//cout << "Frame deleted" << endl;
-	};
-};
-
-
 /*****************************************************************************/
 // Camera streaming thread main function
 /*****************************************************************************/
-void	camera_streaming_main(string cameraID, int server_port){
-
-	// camera we are working with
-	CameraPtr	apicamera;
+// stream_id: index of the camera, feed: to the multiplexed server, latest:
+// newest frame for the control server, control: its commands
+void	camera_streaming_main(string cameraID, int server_port, int stream_id, CFrameFeed* feed, CLatestFrame* latest, CCameraControl* control){
 
-	// frame-pointer queue
-	CQueue<FramePtr>				callback_to_server_framequeue;
-	CQueue<FramePtr>				server_return_framequeue;
+	// images for the server
+	CFrameRing						framering(SERVER_RING_SLOTS);
 
-	// for streaming data
-	vector<IFrameObserverPtr>		fobserver_list;
-	vector<FramePtr>				frame_list;
+	// generation of the settings the frames were acquired with
+	CSettingsGeneration				settings;
 
 
 	// wait time after an error was encountered
-	auto		error_timeout	= seconds(3s);
+	auto		error_timeout	= seconds(CAMERA_ERROR_TIMEOUT_S);
 
 	// open a file for "cout" logging
 	string		outputfile_name	= cameraID + ".log";
@@ -159,29 +217,21 @@ void	camera_streaming_main(string cameraID, int server_port){
 	outputfile.open(outputfile_name, ios::app | ios::out);
 
 	/***********************************************/
-	// feature list
+	// camera source
 	/***********************************************/
-	// vimba string		vimba data type		short (for user interface)
-	//
-	//
-	vector<pair<string,string>> 	featurelist;
-	
-	featurelist.push_back(make_pair(string("PixelFormat"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("ExposureTime"), string("double")));
-	featurelist.push_back(make_pair(string("Gain"), string("double")));
-	featurelist.push_back(make_pair(string("DeviceLinkSpeed"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("DeviceLinkThroughputLimit"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("AcquisitionFrameRate"), string("double")));
-	featurelist.push_back(make_pair(string("Height"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("Width"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("BinningHorizontal"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("BinningVertical"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("PayloadSize"), string("VmbInt64_t")));
-	featurelist.push_back(make_pair(string("LineSelector"), string("enum")));
-	featurelist.push_back(make_pair(string("LineMode"), string("enum")));
-	featurelist.push_back(make_pair(string("TriggerSource"), string("enum")));
-	featurelist.push_back(make_pair(string("TriggerMode"), string("enum")));
-	
+	CCameraSource*	source		= create_camera_source(cameraID, &framering, &settings, control, outputfile);
+	if(source == NULL){
+		outputfile << "no camera source for " << cameraID << endl;
+		control->set_state(CAMERA_STATE_ERROR);
+		return;
+	}
+	// waits of the source answer the commands; the time is left out of the
+	// startup time
+	steady_clock::duration	rested;
+	auto			rest		= [control, &framering, &settings, &rested](steady_clock::duration time){
+		rest_serving_commands(control, framering, settings, time);
+		rested	+= time;
+	};
 
 	/***********************************************/
 	// start server thread
@@ -189,7 +239,51 @@ void	camera_streaming_main(string cameraID, int server_port){
 	
 	// create a new server
 	string			namestring	= "camserver_" + cameraID;
-	CMyCamServer*	camserver	= new CMyCamServer(server_port, namestring, &callback_to_server_framequeue, &server_return_framequeue);
+	CMyCamServer*	camserver	= new CMyCamServer(server_port, namestring, &framering, stream_id);
+	camserver->set_feed(feed);
+	camserver->set_latest(latest);
+	camserver->set_bandwidth(&global_bandwidth);
+
+	// optional UDP transport of this camera (multicast group)
+	CUdpSender*		udpsender	= NULL;
+	xmlconfig_mutex.lock();
+	for (pugi::xml_node xmlcamera : xmlconfig.child("config").children("camera"))
+	{
+		pugi::xml_node	udp		= xmlcamera.child("udp");
+		if(cameraID != xmlcamera.attribute("id").as_string() or udp.empty()){
+			continue;
+		}
+		string	encoding		= udp.attribute("encoding").as_string("raw");
+		CStreamOptions			options;
+		options.encoding		= encoding == "packed" ? ENCODING_PACKED : encoding == "tile" ? ENCODING_TILE : ENCODING_RAW;
+		options.threshold		= SPARSE_DEFAULT_THRESHOLD;
+		options.geometry		= GEOMETRY_FULL;
+		try{
+			udpsender	= new CUdpSender(udp.attribute("address").as_string(), udp.attribute("port").as_int(server_port + UDP_PORT_OFFSET),
+								udp.attribute("rate_mbit").as_double(0.0) * 1e6 / 8, udp.attribute("mtu").as_int(1500),
+								udp.attribute("ttl").as_int(1), udp.attribute("interface").as_string());
+			camserver->set_udp(udpsender, options);
+			outputfile << "udp transport: " << udpsender->get_status() << ", encoding " << encoding << endl;
+		}catch(...){
+			outputfile << "ERROR setting up the udp transport" << endl;
+		}
+	}
+	// optional shared-memory ring for processes on this host
+	CShmRing*		shmring		= NULL;
+	for (pugi::xml_node xmlcamera : xmlconfig.child("config").children("camera"))
+	{
+		pugi::xml_node	shm		= xmlcamera.child("shm");
+		if(cameraID != xmlcamera.attribute("id").as_string() or shm.empty()){
+			continue;
+		}
+		string	shmname		= shm.attribute("name").as_string((SHM_NAME_PREFIX + cameraID).c_str());
+		// mode: octal, as for chmod
+		mode_t	shmmode		= strtol(shm.attribute("mode").as_string("0600"), NULL, 8);
+		shmring			= new CShmRing(shmname, shm.attribute("slots").as_int(SHM_RING_SLOTS), shmmode & 0666);
+		camserver->set_shm(shmring);
+		outputfile << "shared memory: " << shmname << endl;
+	}
+	xmlconfig_mutex.unlock();
 	// start the thread
 	thread			camserver_thread(&CMyCamServer::execute, camserver);
 	
@@ -200,271 +294,21 @@ void	camera_streaming_main(string cameraID, int server_port){
 	while(true){
 		// make sure current stream is written to file
 		outputfile.flush();		
-		/***********************************************/
-		// find camera
-		/***********************************************/
-		while(true){
-			try{
-				outputfile << "trying to open camera: " << cameraID << " " << get_current_date_time_string() << endl;
-				apicamera	= global_vimba.get_apicamera_by_id(cameraID);	
-			}catch(...){
-				outputfile << "vimba get_apicamera_by_id failed" << endl;
-				this_thread::sleep_for(error_timeout);
-				continue;
-			}
-			break;
-		}
-		// high-level vimba camera access
-		CVimbaCamera	camera(&global_vimba);
-		/***********************************************/
-		// close camera
-		/***********************************************/
+		control->set_state(CAMERA_STATE_SEARCHING);
 		try{
-			camera.close();
-		}catch(...){
-			outputfile << "error closing camera" << endl;
-			this_thread::sleep_for(error_timeout);
-			continue;
-		}
-		/***********************************************/
-		// open camera
-		/***********************************************/
-		try{			
-			// open the camera for access
-			camera.open(apicamera);
-		}catch(...){
-			outputfile << "error opening camera" << endl;
-			this_thread::sleep_for(error_timeout);
-			continue;
-		}
-		/***********************************************/
-		// reset camera
-		/***********************************************/
-		try{
-			VmbErrorType    err;
-			FeaturePtr		vimba_feature;
-
-			// get the feature
-			err 		= apicamera->GetFeatureByName("DeviceReset", vimba_feature);
-			if(err != VmbErrorSuccess){
-				perror ("DeviceReset failed: GetFeatureByName");
-				throw -1;
-			}
-			
-			// run command
-			err			= vimba_feature->RunCommand();
-			if(err != VmbErrorSuccess){
-				perror ("DeviceReset failed: RunCommand");
-				throw -1;
-			}
-		}catch(...){
-			outputfile << "error reseting camera" << endl;
-			this_thread::sleep_for(error_timeout);
-			continue;
-		}
-		this_thread::sleep_for(5s);
-
-
-		/***********************************************/
-		// find camera
-		/***********************************************/
-		while(true){
-			try{
-				outputfile << "trying to open camera: " << cameraID << " " << get_current_date_time_string() << endl;
-				apicamera	= global_vimba.get_apicamera_by_id(cameraID);	
-			}catch(...){
-				outputfile << "vimba get_apicamera_by_id failed" << endl;
-				this_thread::sleep_for(error_timeout);
-				continue;
-			}
-			break;
-		}
-
-		/***********************************************/
-		// open camera
-		/***********************************************/
-		try{			
-			// open the camera for access
-			camera.open(apicamera);
-		}catch(...){
-			outputfile << "error opening camera" << endl;
-			this_thread::sleep_for(error_timeout);
-			continue;
-		}
-
-
-		try{
-
 			/***********************************************/
-			// xml parsing
+			// find, open and configure the camera
 			/***********************************************/
-			outputfile << endl;
-			outputfile << "parse config file for camera default values" << endl;
-			xmlconfig_mutex.lock();
-			int	i = 0;
-			for (pugi::xml_node xmlcamera : xmlconfig.child("config").children("camera"))
-			{
-				if(cameraID == xmlcamera.attribute("id").as_string()){
-					outputfile << "camera config information found: " << endl;
-					outputfile << endl;
-					for (pugi::xml_node default_setting : xmlcamera.children("default_setting"))
-					{	
-						string	attribute		= default_setting.attribute("name").as_string();
-						string	value			= default_setting.attribute("value").as_string(); 
-						string	method			= default_setting.attribute("method").as_string();
-						string	comment			= default_setting.attribute("comment").as_string(); 
-
-						if(method == "VmbInt64_t"){
-							stringstream		convert;
-							VmbInt64_t			intvalue;
-												convert		<< value;
-												convert		>> intvalue;
-
-							try{			
-								//camera.open(apicamera, VmbAccessModeConfig);
-								camera.set_feature_value(attribute, intvalue);
-								attribute.resize(40,' ');
-								outputfile << "successful set " << attribute << " to " << intvalue << " " << comment << endl;
-							}catch(...){
-								attribute.resize(40,' ');
-								outputfile << "ERROR setting  " << attribute << " to " << intvalue << " " << value << " " << comment << endl;
-							}
-						}else if(method == "double"){
-							stringstream		convert;
-							double				doublevalue;
-												convert		<< value;
-												convert		>> doublevalue;
-
-							try{			
-								//camera.open(apicamera, VmbAccessModeConfig);
-								camera.set_feature_value_double(attribute, doublevalue);
-								attribute.resize(40,' ');
-								outputfile << "successful set " << attribute << " to " << doublevalue << " " << comment << endl;
-							}catch(...){
-								attribute.resize(40,' ');
-								outputfile << "ERROR setting  " << attribute << " to " << doublevalue << " " << comment << endl;
-							}
-						}else if(method == "enum"){
-							try{			
-								camera.set_feature_value_enum(attribute, value);
-								attribute.resize(40,' ');
-								outputfile << "successful set " << attribute << " to " << value << " " << comment << endl;
-							}catch(...){
-								attribute.resize(40,' ');
-								outputfile << "ERROR setting  " << attribute << " to " << value << " " << comment << endl;
-							}
-						}else{
-							outputfile << "method unknown: " << method << endl;
-						}
-					}
-				}
-			}
-			xmlconfig_mutex.unlock();	
-
-			/***********************************************/
-			// retrieve basic camera info
-			/***********************************************/
-			try{			
-				camera.get_info();
-				outputfile	<< endl;
-				outputfile	<< "===== camera " << camera.get_camID() << " =====" << endl;		
-				outputfile << endl;		
-			}catch(...){
-				outputfile << "error get_info" << endl;
-				throw	-1;
-			}
-			/***********************************************/
-			// get & print current camera parameters
-			/***********************************************/
-			for(auto item : featurelist){
-				try{
-					string	printstring	= item.first + ":";			
-					printstring.resize(40,' ');
-					outputfile << printstring;
-					if(item.second == "VmbInt64_t"){
-						VmbInt64_t	value	= camera.get_feature_value(item.first);
-						outputfile << value << endl;
-					}else if(item.second == "double"){
-						double		value	= camera.get_feature_value_double(item.first);
-						outputfile << value << endl;
-					}else if(item.second == "enum"){
-						string		value	= camera.get_feature_value_enum(item.first);
-						outputfile << value << endl;
-					}
-				}catch(...){
-					outputfile << "error reading " << camera.get_feature_value(item.first) << endl;
-					throw	-1;
-				}
-			}
-			outputfile << endl;	
-
+			// startup time: open, configuration, frames
+			auto	startup_begin	= steady_clock::now();
+			rested					= steady_clock::duration::zero();
+			source->open(rest);
 
 			/***********************************************/
 			// prepare streaming of data
 			/***********************************************/
-
-			// get current payload size
-			VmbInt64_t	payload_size	= 0;
-			try{			
-				//camera.open(apicamera);
-				payload_size	=	camera.get_feature_value("PayloadSize");
-						
-			}catch(...){
-				outputfile << "error reading PayloadSize" << endl;
-				throw	-1;
-			}
-
-			// clear the old frame queue
-			while(true){
-				if(server_return_framequeue.is_empty() == true){
-					break;
-				}
-				// queue is not empty, remove one frame
-				FramePtr		frame			= server_return_framequeue.pop();
-			}				
-
-			// create new frames
-			try{
-				for (int i = 0; i < NUMBER_OF_FRAMES_IN_BUFFER; i++){
-					FramePtr			frame		= FramePtr(new MyFrame(payload_size));
-					IFrameObserverPtr	observer	= IFrameObserverPtr(new FrameObserver(apicamera, &callback_to_server_framequeue));
-
-					frame_list.push_back(frame);
-					fobserver_list.push_back(observer);
-				}
-			}catch(...){
-				outputfile << "error reading PayloadSize" << endl;
-				throw	-1;
-			}
-			
-			// register observer, announce frames
-			try{
-				for (int i = 0; i < NUMBER_OF_FRAMES_IN_BUFFER; i++){
-					frame_list[i]->RegisterObserver(fobserver_list[i]);
-					camera.announce_frame(frame_list[i]);
-				}
-			}catch(...){
-				outputfile << "error RegisterObserver / announce_frame" << endl;
-				throw	-1;
-			}
-			
-			// start the capture engine
-			try{
-				camera.start_capture();
-			}catch(...){
-				outputfile << "error start_capture" << endl;
-				throw	-1;
-			}
-
-			// queue frames
-			try{
-				for (int i = 0; i < NUMBER_OF_FRAMES_IN_BUFFER; i++){
-					camera.queue_frame(frame_list[i]);	
-				}
-			}catch(...){
-				outputfile << "error queue_frame" << endl;
-				throw	-1;
-			}
+			// frames, capture engine
+			source->start_stream();
 
 			/***********************************************/
 			// start data acquisition
@@ -474,8 +318,16 @@ void	camera_streaming_main(string cameraID, int server_port){
 			auto	timeout_start			= system_clock::now();
 			int		framecounter			= 0;
 
+			// print the ring statistics every once in a while
+			auto	stats_interval			= seconds(10s);
+			auto	stats_time				= system_clock::now();
+
 			try{
-				camera.run_command("AcquisitionStart"); 			
+				// the configuration may have changed since the last frame
+				settings.begin_at_time(0);
+				source->start_acquisition();
+				control->set_state(CAMERA_STATE_ACQUIRING);
+				outputfile	<< "startup: " << duration<double, milli>(steady_clock::now() - startup_begin - rested).count() << " ms" << endl;
 				outputfile	<< endl << "===== start " << get_current_date_time_string() << " =====" << endl;
 			}catch(...){
 				outputfile << "error AcquisitionStart" << endl;
@@ -485,6 +337,10 @@ void	camera_streaming_main(string cameraID, int server_port){
 			/***********************************************/
 			// acquisition main loop
 			/***********************************************/
+			// a command interrupts the wait for frames
+			control->set_wakeup([source]{
+				source->wakeup();
+			});
 			try{
 				while(true){
 					// test for timeout
@@ -494,35 +350,35 @@ void	camera_streaming_main(string cameraID, int server_port){
 						// time elapsed
 						//break;
 					}
-					// process frames
-					while(true){
-						if(server_return_framequeue.is_empty() == true){
-							break;
-						}
-						// queue is not empty, process frames
-						FramePtr		frame			= server_return_framequeue.pop();
-						// re-queue the frame to the camera
-						VmbUint64_t		frameid;
-						frame->GetFrameID(frameid);
-						cout	 << get_current_date_time_string() << " camera_thread: queue frame again " << frameid  << endl;
-						apicamera->QueueFrame(frame);
-						framecounter++;			
-					}				
-								
-					// sleep brievly 
-					this_thread::sleep_for(1ms);
+					// process frames: sleep until a frame is returned
+					framecounter	+= source->process_frames(milliseconds(FRAME_QUEUE_TIMEOUT_MS));
+
+					// control commands
+					CControlCommand		command;
+					while(control->pop(command) == true){
+						answer_command(control, command, source, framering, settings);
+					}
+
+					if(current_time - stats_time > stats_interval){
+						stats_time	= current_time;
+						outputfile	<< get_current_date_time_string() << " ring: written " << framering.get_written();
+						outputfile	<< " overwritten " << framering.get_overwritten() << " dropped " << framering.get_dropped() << endl;
+						outputfile.flush();
+					}
 				}
 			}catch(...){
 				outputfile << "error during acquisition loop" << endl;
+				control->set_wakeup(nullptr);
 				throw	-1;
 			}
+			control->set_wakeup(nullptr);
 			/***********************************************/
 			// end of data acquisition
 			/***********************************************/
 			try{
-				camera.run_command("AcquisitionStop");
+				source->stop_acquisition();
 				outputfile	<< "captured " << double(framecounter)/double(acquisition_time) << " FPS" << endl;
-				outputfile	<< "data speed: " << 8.0 * double(payload_size * framecounter) / (acquisition_time * 1000 * 1000) << " MBit / s" << endl;
+				outputfile	<< "data speed: " << 8.0 * double(source->get_payload_size() * framecounter) / (acquisition_time * 1000 * 1000) << " MBit / s" << endl;
 				outputfile << "===== stop " << get_current_date_time_string() << " =====" << endl << endl;
 			}catch(...){
 				outputfile << "error AcquisitionStop" << endl;
@@ -530,57 +386,12 @@ void	camera_streaming_main(string cameraID, int server_port){
 			}			
 
 			// clean up after the acquisition
-			try{
-				camera.end_capture();
-				camera.flush_queue();
-				camera.revoke_all_frames();
-			}catch(...){
-				outputfile << "error cleaning up after acquisition" << endl;
-				throw	-1;
-			}
-			
-			// unregister observers
-			try{
-				for (int i = 0; i < NUMBER_OF_FRAMES_IN_BUFFER; i++){
-					frame_list[i]->UnregisterObserver();
-				}
-			}catch(...){
-				outputfile << "error UnregisterObserver" << endl;
-				throw	-1;
-			}
-
-			// empty the frame list
-			try{
-				while(true){
-					if(frame_list.empty() == true){
-						break;
-					}
-					FramePtr	frame	= frame_list.back();
-					frame_list.pop_back();
-				}
-			}catch(...){
-				outputfile << "error emtpying frame_list" << endl;
-				throw	-1;
-			}
-			
-			// empty the observer list
-			try{
-				while(true){
-					if(fobserver_list.empty() == true){
-						break;
-					}
-					IFrameObserverPtr	observer	= fobserver_list.back();
-					fobserver_list.pop_back();
-				}
-			}catch(...){
-				outputfile << "error emtpying fobserver_list" << endl;
-				throw	-1;
-			}
+			source->stop_stream();
 			/***********************************************/
 			// close camera
 			/***********************************************/
 			try{
-				camera.close();
+				source->close();
 			}catch(...){
 				outputfile << "error closing camera" << endl;
 				throw	-1;
@@ -590,16 +401,15 @@ void	camera_streaming_main(string cameraID, int server_port){
 			/***********************************************/
 			// error occured
 			/***********************************************/
+			control->set_state(CAMERA_STATE_ERROR);
 			try{
-				camera.close();
+				source->close();
 			}catch(...){
 				outputfile << "error closing camera" << endl;
-				this_thread::sleep_for(error_timeout);
+				rest_serving_commands(control, framering, settings, error_timeout);
 			}
-			this_thread::sleep_for(error_timeout);
+			rest_serving_commands(control, framering, settings, error_timeout);
 			/***********************************************/
 		}
 	}
 }
-
-
@@ -22,8 +22,47 @@
 
 #include "global.h"
 
+// server-side frame buffer, slots handed on to the multiplexed server
+#include "frame_ring.h"
+#include "frame_feed.h"
+
+// gathered / zero-copy send
+#include "transmit.h"
+
+// wire encodings
+#include "encoding.h"
+#include "tile_codec.h"
+#include "sparse.h"
+
+// ROI, decimation, binning
+#include "geometry.h"
+
+// handshake and message framing
+#include "protocol.h"
+
+// uplink shared between the cameras
+#include "bandwidth.h"
+
+// frames to a multicast group
+#include "udp_sender.h"
+
+// frames to processes on the camera host
+#include "shm_ring.h"
+#include "latest_frame.h"
+
+// 8-bit preview frames
+#include "preview.h"
+
 // string
 #include <string>
+#include <cstring>
+
+// containers
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
 
 // time
 #include <chrono>
@@ -35,6 +74,298 @@ using namespace std::chrono;
 #ifndef __CAMSERVER_H__
 #define __CAMSERVER_H__
 
+// maximum length of an option line (or message) sent by a client
+#define	CAM_CLIENT_LINE_LENGTH		256
+
+/*****************************************************************************/
+// CStreamOptions
+/*****************************************************************************/
+//
+// how a client wants its frames to be encoded. Clients with equal options
+// share the encoded frames.
+//
+struct CStreamOptions{
+	int							encoding;
+	// ENCODING_SPARSE: pixels above pedestal + threshold are sent
+	uint32_t					threshold;
+	// part of the frame, applied before the encoding
+	CGeometry					geometry;
+
+	// the threshold only matters for sparse frames
+	bool	operator<(const CStreamOptions& other) const{
+		if(geometry < other.geometry or other.geometry < geometry){
+			return	geometry < other.geometry;
+		}
+		if(encoding != other.encoding){
+			return	encoding < other.encoding;
+		}
+		return	encoding == ENCODING_SPARSE and threshold < other.threshold;
+	};
+};
+
+/*****************************************************************************/
+// CCamFrame
+/*****************************************************************************/
+//
+// a frame taken from the server ring, encoded for one set of stream options.
+// It is shared by reference between all clients using these options
+// (shared_ptr) and the ring slot is released as soon as the last client is
+// done with it.
+//
+// Protocol messages without image (WELCOME, STATS, ...) are queued as
+// CCamFrame as well, such that they keep their place in the stream.
+//
+// stream_id: the camera, sent in the message header
+//
+class CCamFrame{
+	public:
+		CCamFrame(shared_ptr<CFrameSlot> slot, int stream_id, const CStreamOptions& options, CTileCodec* codec);
+		// delta frame for one client, raw if the difference doesn't compress
+		CCamFrame(shared_ptr<CFrameSlot> slot, int stream_id, CTileCodec* codec, const vector<uint8_t>& reference, uint64_t reference_id);
+		// protocol message, optionally with the server preamble in front
+		CCamFrame(uint16_t type, const string& payload, bool preamble);
+
+		// message header + frame header (see set_header), legacy clients
+		// skip the message header; and image data (payload)
+		uint8_t					header[CAM_MESSAGE_HEADER_LENGTH + CAM_FRAME_HEADER_LENGTH];
+		uint32_t				header_length;
+		uint16_t				type;
+		uint16_t				stream_id;
+		const uint8_t*			data;
+		uint32_t				buffer_size;
+		uint32_t				pixel_format;
+		uint64_t				frame_id;
+
+	private:
+		shared_ptr<CFrameSlot>	slot;
+
+		// encoded image, empty for ENCODING_RAW
+		vector<uint8_t>			encoded;
+
+		void	set_header();
+		void	set_message_header(int offset, uint32_t payload_length);
+};
+
+/*****************************************************************************/
+// delivery policy
+/*****************************************************************************/
+//
+// lossless: every frame is queued, a client with a full queue holds the
+// frames back for the TCP clients of the stream (backpressure, see
+// CCamStream); snapshots, shared memory and the UDP receivers go on
+// latest: one waiting frame that is replaced by each new one (display
+// clients), the replaced frames are released at once
+//
+#define	DELIVERY_LOSSLESS			0
+#define	DELIVERY_LATEST				1
+
+/*****************************************************************************/
+// CDeltaState
+/*****************************************************************************/
+//
+// delta encoding of one subscription: raw copies of the frames sent since the
+// last acknowledgement, the acknowledged frame is the next reference
+//
+struct CDeltaState{
+	shared_ptr<vector<uint8_t>>		reference;
+	uint64_t						reference_id;
+	deque<pair<uint64_t, shared_ptr<vector<uint8_t>>>>	pending;
+
+	uint32_t						frames_since_key;
+	bool							key_requested;
+};
+
+/*****************************************************************************/
+// CFrameCache
+/*****************************************************************************/
+//
+// everything derived from one ring frame while it is handed to the clients:
+// the frame cut to each geometry in use, the encoded frames and the raw
+// copies for delta clients (which outlive the slot)
+//
+struct CFrameCache{
+	shared_ptr<CFrameSlot>							slot;
+	int												stream_id;
+	map<CGeometry, shared_ptr<CFrameSlot>>			views;
+	map<CStreamOptions, shared_ptr<CCamFrame>>		camframes;
+	map<CGeometry, shared_ptr<vector<uint8_t>>>		snapshots;
+};
+
+/*****************************************************************************/
+// CZeroCopyPending
+/*****************************************************************************/
+//
+// frames touched by one MSG_ZEROCOPY sendmsg call, they are kept alive until
+// the kernel reports that this call is done
+//
+struct CZeroCopyPending{
+	uint32_t						sequence;
+	vector<shared_ptr<CCamFrame>>	frames;
+};
+
+// a dropped client with zero-copy calls in flight: the socket is shut down
+// but stays open, the frames are released by the completions or when the
+// socket is finally closed
+struct CZeroCopyDropped{
+	deque<CZeroCopyPending>			pending;
+	time_point<steady_clock>		drop_time;
+};
+
+/*****************************************************************************/
+// CSubscription
+/*****************************************************************************/
+//
+// one stream (camera) received by a client: its options, delivery policy and
+// the frames waiting for their turn on the connection
+//
+struct CSubscription{
+	CStreamOptions				options;
+	int							delivery;
+	CDeltaState					delta;
+
+	// frames not yet handed to the connection
+	deque<shared_ptr<CCamFrame>>	waiting;
+	// deficit round robin: bytes the stream may still send in this turn
+	size_t						deficit;
+
+	// lossless: holding back the stream since, zero if not
+	time_point<steady_clock>	blocked_since;
+
+	// preview frames per second (0: all), the next one is due at
+	double						preview_fps;
+	time_point<steady_clock>	preview_due;
+
+	// statistics
+	uint64_t					frames_sent;
+	uint64_t					frames_conflated;
+};
+
+/*****************************************************************************/
+// CAdaptiveState
+/*****************************************************************************/
+//
+// adaptive quality of one connection. Every ADAPTIVE_INTERVAL_MS the rate at
+// which the client takes the data (bytes written minus the socket send
+// queue, SIOCOUTQ) and the delay of the data queued for it are estimated.
+// The rate only counts while the socket was backlogged, otherwise it is a
+// lower bound. A delay above the target for ADAPTIVE_DOWN_HOLD intervals
+// lowers the quality by one level, a delay below a quarter of the target for
+// ADAPTIVE_UP_HOLD intervals raises it again if the link rate covers what
+// the higher level needed before (or after ADAPTIVE_PROBE_HOLD intervals,
+// to find out). Each level includes the ones before it; levels the client
+// can't decode are skipped.
+//
+#define	QUALITY_FULL				0
+#define	QUALITY_PACKED				1
+#define	QUALITY_COMPRESSED			2
+#define	QUALITY_BINNED				3
+// latest delivery: no new frame while the send queue is above the target
+#define	QUALITY_RATE_LIMITED		4
+#define	QUALITY_LEVELS				5
+
+#define	ADAPTIVE_INTERVAL_MS		100
+#define	ADAPTIVE_DOWN_HOLD			5
+#define	ADAPTIVE_UP_HOLD			20
+#define	ADAPTIVE_PROBE_HOLD			100
+// weight of the last interval in the smoothed rates
+#define	ADAPTIVE_SMOOTHING			0.3
+
+struct CAdaptiveState{
+	bool						enabled;
+	int							quality;
+	uint32_t					target_latency_ms;
+
+	// bytes handed to the socket / to the connection since connect
+	uint64_t					bytes_written;
+	uint64_t					offered_bytes;
+	// at the last estimate
+	uint64_t					last_delivered;
+	uint64_t					last_offered;
+	int							last_send_queue;
+	time_point<steady_clock>	estimate_time;
+
+	// bytes per second, seconds
+	double						link_rate;
+	double						offered_rate;
+	double						queue_delay;
+
+	int							over_count;
+	int							under_count;
+	// offered rate before the quality was lowered from each level
+	double						level_demand[QUALITY_LEVELS];
+};
+
+/*****************************************************************************/
+// CCamClient
+/*****************************************************************************/
+//
+// state of one connected viewer: its own frame queue and send cursor, such
+// that a slow client never stalls the others. The frames of all its
+// subscriptions share the connection, the streams take turns (schedule).
+//
+struct CCamClient{
+	int							socket;
+	string						ip;
+
+	// messages and frames handed to the connection, the first one might be
+	// partially sent
+	deque<shared_ptr<CCamFrame>>	frame_queue;
+	// send cursor: bytes of the first frame (header + data) already sent
+	size_t						sent_bytes;
+	// socket is watched for EPOLLOUT
+	bool						want_write;
+
+	// CAM_PROTOCOL_UNKNOWN until the client sent the preamble (or not),
+	// no frames before the handshake is done
+	int							protocol;
+	bool						handshake_done;
+	time_point<steady_clock>	connect_time;
+	// capabilities both sides have
+	uint32_t					capabilities;
+
+	// streams received, key: stream id; options given without stream
+	// apply to all of them and to later subscriptions (defaults)
+	map<int, CSubscription>		subscriptions;
+	CSubscription				defaults;
+	// the stream whose turn it is, its quantum is added at the first look
+	int							turn;
+	bool						turn_new;
+
+	// incomplete option line (or message) received from the client
+	string						recv_buffer;
+
+	CAdaptiveState				adaptive;
+
+	// zero-copy: sequence number of the next sendmsg call, calls not yet
+	// completed by the kernel
+	bool						zerocopy;
+	uint32_t					zerocopy_next;
+	deque<CZeroCopyPending>		zerocopy_pending;
+
+	// statistics
+	uint64_t					frames_sent;
+	uint64_t					send_calls;
+	uint64_t					zerocopy_copied;
+};
+
+/*****************************************************************************/
+// CCamStream
+/*****************************************************************************/
+//
+// one camera served by a CCamServer
+//
+struct CCamStream{
+	string						name;
+	CFrameSource*				source;
+	// frames taken from the source, not yet sent to the TCP clients: the
+	// other outputs don't wait for them. At most CAM_STREAM_BACKLOG_LENGTH,
+	// the oldest one is lost if a lossless client holds them longer.
+	deque<shared_ptr<CFrameSlot>>	backlog;
+	uint64_t					backlog_overwritten;
+	// a lossless subscriber is holding back the TCP clients
+	bool						held;
+};
+
 /*****************************************************************************/
 // CCamServer
 /*****************************************************************************/
@@ -43,24 +374,322 @@ using namespace std::chrono;
 template <int queue_length>
 class CCamServer : public CServer<CCamServer<queue_length>, queue_length>{
 	public:
-		CCamServer(int port, const string name, CQueue<FramePtr>* callback_to_server, CQueue<FramePtr>* server_return);
-		void main();
+		// one camera, every client receives it
+		CCamServer(int port, const string name, CFrameSource* source, int stream_id = 0);
+		// multiplexed: cameras are added with add_stream, clients subscribe
+		CCamServer(int port, const string name);
+		~CCamServer();
+
+		// before the event loop starts: a camera of the multiplexed server
+		void	add_stream(int stream_id, const string name, CFrameSource* source);
+
+		// event hooks called by CServer::execute
+		void	on_start();
+		void	on_connect(int client_socket, const string client_ip);
+		void	on_readable(int client_socket);
+		void	on_writable(int client_socket);
+		void	on_hangup(int client_socket);
+		void	on_error(int client_socket);
+		void	on_poll();
+
+		// TRANSMIT_MODE_COPY or TRANSMIT_MODE_ZEROCOPY for new clients
+		void	set_transmit_mode(int transmit_mode){ this->transmit_mode = transmit_mode; };
+		// frames taken from the source are handed on to the multiplexed server
+		void	set_feed(CFrameFeed* feed){ this->feed = feed; };
+		// frames are sent as the scheduler allows, streams it degrades are
+		// compressed / decimated
+		void	set_bandwidth(CBandwidthScheduler* bandwidth){ this->bandwidth = bandwidth; };
+		// every frame is sent over UDP as well, encoded with these options
+		// (no delta encoding, UDP has no back channel)
+		bool	set_udp(CUdpSender* udp, const CStreamOptions& options);
+		// every frame is published in shared memory as well (camera host)
+		void	set_shm(CShmRing* shm){ this->shm = shm; };
+		// the newest frame is kept for snapshot requests (control server)
+		void	set_latest(CLatestFrame* latest){ this->latest = latest; };
 		
 		int						port;
-		CQueue<FramePtr>*		callback_to_server_framequeue;
-		CQueue<FramePtr>*		server_return_framequeue;
+
+	private:
+		// connected clients, key: socket
+		map<int, CCamClient>	clients;
+		// dropped clients the kernel still sends frames for, key: socket
+		map<int, CZeroCopyDropped>	dropped;
+		// cameras, key: stream id
+		map<int, CCamStream>	streams;
+		bool					multiplexed;
+		CFrameFeed*				feed;
+		CBandwidthScheduler*	bandwidth;
+		// frames wait for the bandwidth scheduler (or the send queue of a
+		// rate limited client), retried in on_poll
+		bool					throttled;
+		CUdpSender*				udp;
+		CStreamOptions			udp_options;
+		CShmRing*				shm;
+		CLatestFrame*			latest;
+
+		int						transmit_mode;
+
+		// started when the first client asks for tile compression
+		CTileCodec*				codec;
+		time_point<steady_clock>	stats_time;
+		time_point<steady_clock>	heartbeat_time;
+
+		// hand new frames of a stream to its subscribers
+		void	distribute_frames(int stream_id);
+		// one frame to the TCP clients of the stream
+		void	send_to_clients(int stream_id, shared_ptr<CFrameSlot> slot);
+		// true if a lossless subscriber can't take another frame
+		bool	lossless_blocked(int stream_id);
+		// queue a frame according to the delivery policy of the subscription
+		void	deliver(CSubscription& subscription, shared_ptr<CCamFrame> camframe);
+		// hands waiting frames to the connection, the streams take turns
+		void	schedule(CCamClient& client);
+
+		// the frame cut to a geometry, the full frame if that fails
+		shared_ptr<CFrameSlot>	get_view(CFrameCache& cache, const CGeometry& geometry);
+		// frame encoded for a set of options, shared between clients
+		shared_ptr<CCamFrame>	shared_frame(CFrameCache& cache, const CStreamOptions& options);
+		// delta encoding: key or delta frame for one subscription
+		shared_ptr<CCamFrame>	delta_frame(CSubscription& subscription, const CStreamOptions& options, CFrameCache& cache);
+		// options of a stream the bandwidth scheduler degraded
+		CStreamOptions			degraded_options(const CStreamOptions& options, int level);
+
+		// adaptive quality: estimates link rate and queue delay of a client,
+		// changes its quality level
+		void					update_adaptive(CCamClient& client, time_point<steady_clock> current_time);
+		// next lower (step 1) or higher (step -1) level the client decodes,
+		// the same level if there is none
+		int						next_quality(CCamClient& client, int quality, int step);
+		// options of a client at its quality level
+		CStreamOptions			adaptive_options(CCamClient& client, const CStreamOptions& options);
+		// rate limited: the send queue holds more than the target latency
+		bool					rate_limited(CCamClient& client);
+
+		// tells protocol clients from legacy clients by the preamble
+		void	detect_protocol(CCamClient& client);
+		// splits the received data into option lines / messages, false if
+		// the client has to be dropped
+		bool	read_lines(CCamClient& client);
+		bool	read_messages(CCamClient& client);
+		// answers HELLO: common capabilities, cheapest common encoding
+		bool	negotiate(CCamClient& client, uint32_t capabilities);
+		// queues a protocol message, false on socket error
+		bool	send_message(CCamClient& client, uint16_t type, const string& payload, bool preamble = false);
+		// STATS to protocol clients, HEARTBEAT to the idle ones, BANDWIDTH
+		// with the heartbeat
+		void	send_status(bool stats, bool heartbeat);
+
+		// handles one option line sent by a client
+		void	apply_option(CCamClient& client, const string line);
+		// option of one subscription (or the defaults), false if invalid
+		bool	set_stream_option(CCamClient& client, CSubscription& subscription, const string& name, const vector<string>& values);
+		bool	set_encoding(CSubscription& subscription, int encoding);
+		// subscribe / unsubscribe: stream ids or "all"
+		void	subscribe(CCamClient& client, const vector<string>& values, bool add);
+
+		// send as much as possible without blocking, false on socket error
+		bool	flush_client(CCamClient& client);
+		void	drop_client(int client_socket);
+		// reads the completions of dropped clients, closes their sockets
+		// when all calls are done or the timeout is over
+		void	reap_dropped(time_point<steady_clock> current_time);
+		// closes the socket at once (reset), the kernel lets go of the frames
+		void	close_dropped(int client_socket);
 		
 };
 
+/******************************************************************************
+ * Shared frame
+ *****************************************************************************/
+
+/*********************
+ * Constructor
+ *********************/
+// encodes the image. Images that can't be encoded are sent raw.
+inline
+CCamFrame::CCamFrame(shared_ptr<CFrameSlot> slot, int stream_id, const CStreamOptions& options, CTileCodec* codec){
+	this->slot				= slot;
+	this->type				= CAM_MESSAGE_FRAME;
+	this->stream_id			= stream_id;
+	this->data				= slot->data.data();
+	this->buffer_size		= slot->buffer_size;
+	this->pixel_format		= slot->pixel_format;
+	this->frame_id			= slot->frame_id;
+
+	size_t		pixel_count		= size_t(slot->width) * slot->height;
+	int			encoding		= options.encoding;
+	int			bytes_per_pixel	= pixel_format_bits(pixel_format) > 8 ? 2 : 1;
+
+	// bit-packing: only for Mono10/12 delivered with 16 bits per pixel
+	if(encoding == ENCODING_PACKED and packed_pixel_format(pixel_format) != 0 and slot->buffer_size >= 2*pixel_count){
+		int		bits			= pixel_format_bits(pixel_format);
+		encoded.resize(packed_size(pixel_count, bits));
+		pack_pixels((const uint16_t*)slot->data.data(), encoded.data(), pixel_count, bits);
+
+		this->data			= encoded.data();
+		this->buffer_size	= encoded.size();
+		this->pixel_format	= packed_pixel_format(pixel_format);
+	}
+
+	// tile compression, on the worker pool
+	if(encoding == ENCODING_TILE and codec != NULL and slot->buffer_size >= pixel_count * bytes_per_pixel){
+		if(codec->compress(slot->data.data(), pixel_format, slot->width, slot->height, encoded) == true){
+			this->data			= encoded.data();
+			this->buffer_size	= encoded.size();
+			this->pixel_format	= PIXEL_FORMAT_TILE_CODEC;
+		}
+	}
+
+	// pixels above threshold, dense if that is smaller
+	if(encoding == ENCODING_SPARSE and slot->buffer_size >= pixel_count * bytes_per_pixel){
+		if(sparse_encode(slot->data.data(), pixel_format, slot->width, slot->height, options.threshold, encoded) == true){
+			this->data			= encoded.data();
+			this->buffer_size	= encoded.size();
+			this->pixel_format	= PIXEL_FORMAT_SPARSE;
+		}
+	}
+
+	set_header();
+}
+
+// difference to the reference, which has to be a raw frame of the same
+// format and size
+inline
+CCamFrame::CCamFrame(shared_ptr<CFrameSlot> slot, int stream_id, CTileCodec* codec, const vector<uint8_t>& reference, uint64_t reference_id){
+	this->slot				= slot;
+	this->type				= CAM_MESSAGE_FRAME;
+	this->stream_id			= stream_id;
+	this->data				= slot->data.data();
+	this->buffer_size		= slot->buffer_size;
+	this->pixel_format		= slot->pixel_format;
+	this->frame_id			= slot->frame_id;
+
+	vector<uint8_t>		message;
+	if(reference.size() == slot->buffer_size and codec->compress(slot->data.data(), pixel_format, slot->width, slot->height, message, reference.data()) == true){
+		encoded.resize(DELTA_HEADER_LENGTH + message.size());
+		int32_to_buffer(encoded.data(), 0, DELTA_MAGIC);
+		int32_to_buffer(encoded.data(), 4, 0);
+		int64_to_buffer(encoded.data(), 8, reference_id);
+		memcpy(encoded.data() + DELTA_HEADER_LENGTH, message.data(), message.size());
+
+		this->data			= encoded.data();
+		this->buffer_size	= encoded.size();
+		this->pixel_format	= PIXEL_FORMAT_DELTA;
+	}
+
+	set_header();
+}
+
+// the payload is kept in "encoded"
+inline
+CCamFrame::CCamFrame(uint16_t type, const string& payload, bool preamble){
+	this->type				= type;
+	this->stream_id			= 0;
+	this->pixel_format		= 0;
+	this->frame_id			= 0;
+	this->encoded.assign(payload.begin(), payload.end());
+	this->data				= encoded.data();
+	this->buffer_size		= encoded.size();
+
+	int		offset			= 0;
+	if(preamble == true){
+		memcpy(header, CAM_PROTOCOL_MAGIC, 4);
+		int16_to_buffer(header, 4, CAM_PROTOCOL_VERSION);
+		int16_to_buffer(header, 6, 0);
+		offset				= CAM_PROTOCOL_PREAMBLE_LENGTH;
+	}
+	set_message_header(offset, buffer_size);
+	this->header_length		= offset + CAM_MESSAGE_HEADER_LENGTH;
+}
+
+/*********************
+ * Header
+ *********************/
+// message header, then the frame header: size, width, height, offset x/y,
+// pixel format, time stamp, frame id
+inline
+void CCamFrame::set_header(){
+	set_message_header(0, CAM_FRAME_HEADER_LENGTH + buffer_size);
+
+	uint8_t*	frame_header	= header + CAM_MESSAGE_HEADER_LENGTH;
+	int32_to_buffer(frame_header,0, buffer_size);
+	int32_to_buffer(frame_header,4, slot->width);
+	int32_to_buffer(frame_header,8, slot->height);
+	int32_to_buffer(frame_header,12, slot->offset_x);
+	int32_to_buffer(frame_header,16, slot->offset_y);
+	int32_to_buffer(frame_header,20, pixel_format);
+	int64_to_buffer(frame_header,24, slot->time_stamp);
+	int64_to_buffer(frame_header,32, frame_id);
+	header_length	= CAM_MESSAGE_HEADER_LENGTH + CAM_FRAME_HEADER_LENGTH;
+}
+
+// payload length, type, stream
+inline
+void CCamFrame::set_message_header(int offset, uint32_t payload_length){
+	int32_to_buffer(header, offset + 0, payload_length);
+	int16_to_buffer(header, offset + 4, type);
+	int16_to_buffer(header, offset + 6, stream_id);
+}
+
+
 /******************************************************************************
  * Data streaming server
  *****************************************************************************/
 /*
- * The server provides a queue that is filled with new images by the vimba
- * callback function executed in a different thread. This callback function
- * is doing all the active part (creating new images, delete old ones, etc.)
- * The main loop of the server just streams data via tcp/ip as soon as they
- * are available.
+ * The vimba callback function, executed in a different thread, copies every
+ * new image into the server ring and returns the vimba frame to the camera
+ * right away. The event loop of the server takes the filled slots, hands
+ * them to all connected clients and streams them via tcp/ip as soon as the
+ * client socket is ready.
+ *
+ * The multiplexed server (add_stream) serves all cameras of the vimbaserver
+ * on one port: a client subscribes to the cameras it wants, their frames
+ * are interleaved on its connection (stream id in the message header). The
+ * streams of a client take turns by bytes (deficit round robin), such that
+ * a camera with large frames can't starve one with small frames. A camera
+ * server with a single camera subscribes every client to it.
+ *
+ * Protocol clients (protocol.h) send options as OPTION messages, legacy
+ * clients as option lines "<name> <value>\n", at any time:
+ *	encoding raw|packed|tile|sparse|delta
+ *					wire encoding, packed: Mono10/12 bit-packed,
+ *					tile: lossless compression (tile_codec.h),
+ *					sparse: pixels above threshold (sparse.h)
+ *					delta: difference to the last acknowledged frame
+ *	threshold <n>	sparse: threshold above the pedestal
+ *	roi <x> <y> <w> <h>	part of the frame (0 0 0 0: full frame)
+ *	decimation <n>	every n-th pixel and row
+ *	binning <n>		average of n x n pixels
+ *	preview <n>|off	8-bit preview: average of n x n pixels through a
+ *					display lookup table (preview.h), after the options above
+ *	preview_fps <fps>	preview frames per second, 0: all
+ *	delivery lossless|latest
+ *					lossless: every frame, a slow client slows down the
+ *					TCP clients of the stream (frames wait in its backlog,
+ *					the oldest are overwritten there); latest: only the
+ *					newest frame
+ *	ack <id>		delta: frame <id> was decoded
+ *	key				delta: the next frame has to be a key frame
+ *	subscribe <id>... | all [preview]
+ *	unsubscribe <id>... | all
+ *					streams to receive, see METADATA for the ids;
+ *					preview: the preview of these streams (the preview
+ *					options given before, PREVIEW_DEFAULT_* otherwise)
+ *	stream <id> <option>
+ *					option for one stream only, options without stream
+ *					apply to all streams (ack/key: the only stream)
+ *	adaptive on|off	quality lowered while the connection is too slow for
+ *					the target latency (see CAdaptiveState)
+ *	latency <ms>	target latency
+ *
+ * With set_udp, every frame also goes to a UDP address (multicast group),
+ * encoded once for all receivers there (see CUdpSender).
+ *
+ * With set_shm, every frame is copied into a shared-memory ring that local
+ * processes read in place (see shm_ring.h).
+ *
+ * With set_latest, the newest frame stays referenced for snapshot requests
+ * on the control port (see latest_frame.h).
  *
  */
 
@@ -68,207 +697,1539 @@ class CCamServer : public CServer<CCamServer<queue_length>, queue_length>{
 /*********************
  * Constructor
  *********************/
+// the source is filled by the camera callback, read from here
 template <int queue_length>
-CCamServer<queue_length>::CCamServer(int port, const string name, CQueue<FramePtr>* callback_to_server_framequeue, CQueue<FramePtr>* server_return_framequeue) : CServer<CCamServer<queue_length>, queue_length>(port, name){
+CCamServer<queue_length>::CCamServer(int port, const string name, CFrameSource* source, int stream_id) : CCamServer(port, name){
+	add_stream(stream_id, name, source);
+	this->multiplexed						= false;
+}
+
+template <int queue_length>
+CCamServer<queue_length>::CCamServer(int port, const string name) : CServer<CCamServer<queue_length>, queue_length>(port, name){
 	this->port								= port;
+	this->multiplexed						= true;
+	this->feed								= NULL;
+	this->bandwidth							= NULL;
+	this->throttled							= false;
+	this->udp								= NULL;
+	this->shm								= NULL;
+	this->latest							= NULL;
+
+	this->transmit_mode						= CAM_SERVER_TRANSMIT_MODE;
+
+	this->codec								= NULL;
+	this->stats_time						= steady_clock::now();
+	this->heartbeat_time					= steady_clock::now();
+}
+
+/*********************
+ * Destructor
+ *********************/
+// disconnect all clients, which releases their slots
+template <int queue_length>
+CCamServer<queue_length>::~CCamServer(){
+	while(clients.empty() == false){
+		drop_client(clients.begin()->first);
+	}
+	while(dropped.empty() == false){
+		close_dropped(dropped.begin()->first);
+	}
+	delete	codec;
+}
+
+/*************************************************/
+// Add a camera
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::add_stream(int stream_id, const string name, CFrameSource* source){
+	CCamStream		stream;
+	stream.name		= name;
+	stream.source	= source;
+	stream.backlog_overwritten	= 0;
+	stream.held		= false;
+	streams[stream_id]	= stream;
+}
 
-	// frame queue: read from here
-	this->callback_to_server_framequeue		= callback_to_server_framequeue;
+/*************************************************/
+// UDP transport
+/*************************************************/
+template <int queue_length>
+bool CCamServer<queue_length>::set_udp(CUdpSender* udp, const CStreamOptions& options){
 
-	// frame queue: return here
-	this->server_return_framequeue			= server_return_framequeue;
+	if(options.encoding == ENCODING_DELTA){
+		cout << "CCamServer: no delta encoding over UDP" << endl;
+		return	false;
+	}
+	if(options.encoding == ENCODING_TILE and codec == NULL){
+		codec	= new CTileCodec(TILE_CODEC_WORKER_THREADS);
+	}
+	this->udp			= udp;
+	this->udp_options	= options;
+	return	true;
+}
 
+/*************************************************/
+// Event loop started
+/*************************************************/
+// wake up whenever a camera committed new frames
+template <int queue_length>
+void CCamServer<queue_length>::on_start(){
+	for(auto& item : streams){
+		this->watch_client(item.second.source->get_notify_fd(), false);
+	}
 }
 
 /*************************************************/
-// Server main loop
+// New client
 /*************************************************/
 template <int queue_length>
-void CCamServer<queue_length>::main(){
+void CCamServer<queue_length>::on_connect(int client_socket, const string client_ip){
 
+	// all socket operations are non-blocking from now on
+	int	flags	= fcntl(client_socket, F_GETFL, 0);
+	fcntl(client_socket, F_SETFL, flags | O_NONBLOCK);
 
-	string	server_name			= ((CServer<CCamServer<queue_length>, queue_length>*)this)->get_server_name();
+	CCamClient		client;
+	client.socket			= client_socket;
+	client.ip				= client_ip;
+	client.sent_bytes		= 0;
+	client.want_write		= false;
+	client.protocol			= CAM_PROTOCOL_UNKNOWN;
+	client.handshake_done	= false;
+	client.connect_time		= steady_clock::now();
+	client.capabilities		= 0;
+	client.turn				= 0;
+	client.turn_new			= true;
+	client.zerocopy			= false;
+	client.zerocopy_next	= 0;
+	client.frames_sent		= 0;
+	client.send_calls		= 0;
+	client.zerocopy_copied	= 0;
 
+	CAdaptiveState&	adaptive	= client.adaptive;
+	adaptive.enabled			= CAM_CLIENT_ADAPTIVE;
+	adaptive.quality			= QUALITY_FULL;
+	adaptive.target_latency_ms	= CAM_CLIENT_TARGET_LATENCY_MS;
+	adaptive.bytes_written		= 0;
+	adaptive.offered_bytes		= 0;
+	adaptive.last_delivered		= 0;
+	adaptive.last_offered		= 0;
+	adaptive.last_send_queue	= 0;
+	adaptive.estimate_time		= client.connect_time;
+	adaptive.link_rate			= 0;
+	adaptive.offered_rate		= 0;
+	adaptive.queue_delay		= 0;
+	adaptive.over_count			= 0;
+	adaptive.under_count		= 0;
+	for(int level = 0; level < QUALITY_LEVELS; level++){
+		adaptive.level_demand[level]	= 0;
+	}
 
-	//global.stdout_lock.lock();
-	cout << "CCamServer: main loop started "  << "\t" << server_name << endl;
-	//global.stdout_lock.unlock();
+	// falls back to copying if the kernel doesn't support it
+	if(transmit_mode == TRANSMIT_MODE_ZEROCOPY){
+		client.zerocopy		= enable_zerocopy(client_socket);
+	}
 
+	CSubscription&	defaults	= client.defaults;
+	defaults.options.encoding	= ENCODING_RAW;
+	defaults.options.threshold	= SPARSE_DEFAULT_THRESHOLD;
+	defaults.options.geometry	= GEOMETRY_FULL;
+	defaults.delivery			= CAM_CLIENT_DELIVERY;
+	defaults.delta.reference_id		= 0;
+	defaults.delta.frames_since_key	= 0;
+	defaults.delta.key_requested	= true;
+	defaults.deficit			= 0;
+	defaults.blocked_since		= time_point<steady_clock>();
+	defaults.preview_fps		= PREVIEW_DEFAULT_FPS;
+	defaults.preview_due		= time_point<steady_clock>();
+	defaults.frames_sent		= 0;
+	defaults.frames_conflated	= 0;
 
-	// clear the frame queue
-	/*
-	while(true){
-		if(callback_to_server_framequeue->is_empty() == true){
+	// a single camera: nothing to choose
+	if(multiplexed == false){
+		client.subscriptions[streams.begin()->first]	= defaults;
+	}
+
+	clients[client_socket]	= client;
+	this->watch_client(client_socket, false);
+
+	cout << "CCamServer: client " << client_ip << " connected, " << clients.size() << " client(s) " << this->get_server_name() << endl;
+}
+
+/*************************************************/
+// Client sent data
+/*************************************************/
+// option lines from the client, or the client closed the connection
+template <int queue_length>
+void CCamServer<queue_length>::on_readable(int client_socket){
+
+	for(auto& item : streams){
+		CFrameSource*	source	= item.second.source;
+		if(client_socket == source->get_notify_fd()){
+			// clear first, such that no notification gets lost
+			source->clear_notify();
+			distribute_frames(item.first);
+			return;
+		}
+	}
+
+	uint8_t		recv_buffer[CAM_CLIENT_LINE_LENGTH];
+	ssize_t		receive_count	= recv(client_socket, recv_buffer, sizeof(recv_buffer), MSG_DONTWAIT);
+
+	if(receive_count == 0){
+		drop_client(client_socket);
+		return;
+	}else if(receive_count < 0){
+		if(errno != EAGAIN and errno != EWOULDBLOCK and errno != EINTR){
+			drop_client(client_socket);
+		}
+		return;
+	}
+
+	auto	item	= clients.find(client_socket);
+	if(item == clients.end()){
+		return;
+	}
+	CCamClient&		client	= item->second;
+	client.recv_buffer.append((char*)recv_buffer, receive_count);
+
+	if(client.protocol == CAM_PROTOCOL_UNKNOWN){
+		detect_protocol(client);
+	}
+	bool	ok	= true;
+	if(client.protocol == CAM_PROTOCOL_LEGACY){
+		ok	= read_lines(client);
+	}else if(client.protocol == CAM_PROTOCOL_VERSION){
+		ok	= read_messages(client);
+	}
+	if(ok == false){
+		drop_client(client_socket);
+	}
+}
+
+/*************************************************/
+// Protocol or legacy client
+/*************************************************/
+// anything that doesn't start like the preamble is an option line
+template <int queue_length>
+void CCamServer<queue_length>::detect_protocol(CCamClient& client){
+
+	const string	magic		= CAM_PROTOCOL_MAGIC;
+	size_t			length		= min(client.recv_buffer.length(), magic.length());
+	if(client.recv_buffer.compare(0, length, magic, 0, length) != 0){
+		client.protocol			= CAM_PROTOCOL_LEGACY;
+		client.handshake_done	= true;
+		cout << "CCamServer: legacy client " << client.ip << endl;
+		return;
+	}
+	if(client.recv_buffer.length() < CAM_PROTOCOL_PREAMBLE_LENGTH){
+		return;
+	}
+	// newer clients fall back to our version (see WELCOME)
+	client.recv_buffer.erase(0, CAM_PROTOCOL_PREAMBLE_LENGTH);
+	client.protocol		= CAM_PROTOCOL_VERSION;
+}
+
+/*************************************************/
+// Legacy client: option lines
+/*************************************************/
+template <int queue_length>
+bool CCamServer<queue_length>::read_lines(CCamClient& client){
+
+	size_t	line_end;
+	while((line_end = client.recv_buffer.find('\n')) != string::npos){
+		string	line	= client.recv_buffer.substr(0, line_end);
+		client.recv_buffer.erase(0, line_end + 1);
+		apply_option(client, line);
+	}
+	if(client.recv_buffer.length() > CAM_CLIENT_LINE_LENGTH){
+		cout << "CCamServer: option line too long, closing " << client.ip << endl;
+		return	false;
+	}
+	return	true;
+}
+
+/*************************************************/
+// Protocol client: messages
+/*************************************************/
+template <int queue_length>
+bool CCamServer<queue_length>::read_messages(CCamClient& client){
+
+	while(client.recv_buffer.length() >= CAM_MESSAGE_HEADER_LENGTH){
+		const uint8_t*	header		= (const uint8_t*)client.recv_buffer.data();
+		uint32_t		length		= buffer_to_int32(header, 0);
+		uint16_t		type		= buffer_to_int16(header, 4);
+		if(length > CAM_CLIENT_LINE_LENGTH){
+			cout << "CCamServer: message too long, closing " << client.ip << endl;
+			return	false;
+		}
+		if(client.recv_buffer.length() < CAM_MESSAGE_HEADER_LENGTH + length){
 			break;
 		}
-		// queue is not empty, remove one frame
-		cout	<< "return frame" << endl;
-		FramePtr		frame			= callback_to_server_framequeue->pop();
-		server_return_framequeue->push(frame);
-	}				
-	*/
-
-	
-	/*************************************************/
-	// main loop
-	/*************************************************/
-	bool	stop_streaming	= false;
-	while(true){
-		/*************************************************/
-		// send frames via tcp/ip
-		/*************************************************/
-		cout	<< "waiting for new frame" << endl;
-		while(true){
-			if(callback_to_server_framequeue->is_empty() == false){
+		string			payload		= client.recv_buffer.substr(CAM_MESSAGE_HEADER_LENGTH, length);
+		client.recv_buffer.erase(0, CAM_MESSAGE_HEADER_LENGTH + length);
+
+		switch(type){
+			case	CAM_MESSAGE_HELLO:{
+				// only once, the answer starts with the preamble
+				if(client.handshake_done == true){
+					break;
+				}
+				uint32_t	capabilities	= 0;
+				if(payload.length() >= CAM_HELLO_LENGTH){
+					capabilities	= buffer_to_int32((const uint8_t*)payload.data(), 0);
+				}
+				if(negotiate(client, capabilities) == false){
+					return	false;
+				}
 				break;
 			}
-			// sleep brievly 
-			this_thread::sleep_for(1ms);
-		}	
-
-		// take the next frame from the queue
-		FramePtr		frame			= callback_to_server_framequeue->pop();
-		VmbUint64_t		frameid;
-		frame->GetFrameID(frameid);
-		cout	 << get_current_date_time_string() << " camserver: new frame " << frameid  << endl;
-
-		/*************************************************/
-		// process new frame
-		/*************************************************/
-		VmbErrorType    err;
-		VmbUint32_t		buffer_size		= 0;
-
-		VmbUint32_t		width			= 0;
-		VmbUint32_t		height			= 0;
-		VmbUint32_t		offset_x		= 0;
-		VmbUint32_t		offset_y		= 0;
-		
-		VmbUint32_t		pixel_format	= 0;
+			case	CAM_MESSAGE_OPTION:
+				apply_option(client, payload);
+				break;
+			case	CAM_MESSAGE_HEARTBEAT:
+				break;
+			default:
+				cout << "CCamServer: unknown message " << type << " from " << client.ip << endl;
+				break;
+		}
+	}
+	return	true;
+}
 
-		VmbUint64_t		time_stamp		= 0;
-		VmbUint64_t		frame_id		= 0;
+/*************************************************/
+// Capability exchange
+/*************************************************/
+// the first encoding of CAM_SERVER_ENCODING_PREFERENCE both sides support,
+// raw if there is none. Packed frames of a format that cannot be packed go
+// out raw (CCamFrame)
+template <int queue_length>
+bool CCamServer<queue_length>::negotiate(CCamClient& client, uint32_t capabilities){
 
-		VmbUchar_t*		data			= NULL;
-		try{
-			err					= frame->GetBufferSize(buffer_size);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetBufferSize error");
-				throw -1;
-			}
+	client.capabilities		= capabilities & CAM_CAPABILITY_ALL;
 
-			err					= frame->GetWidth(width);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetWidth error");
-				throw -1;
-			}
+	int		encoding		= ENCODING_RAW;
+	for(int preferred : CAM_SERVER_ENCODING_PREFERENCE){
+		if((encoding_capability(preferred) & client.capabilities) != 0){
+			encoding	= preferred;
+			break;
+		}
+	}
+	set_encoding(client.defaults, encoding);
+	for(auto& item : client.subscriptions){
+		set_encoding(item.second, encoding);
+	}
 
-			err					= frame->GetHeight(height);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetHeight error");
-				throw -1;
-			}
+	uint8_t		welcome[CAM_WELCOME_LENGTH];
+	int32_to_buffer(welcome, 0, CAM_CAPABILITY_ALL);
+	int32_to_buffer(welcome, 4, client.capabilities);
+	int32_to_buffer(welcome, 8, encoding);
+	int32_to_buffer(welcome, 12, client.defaults.delivery);
 
-			err					= frame->GetOffsetX(offset_x);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetOffsetX error");
-				throw -1;
-			}
+	stringstream	metadata;
+	metadata << "server " << this->get_server_name() << "\n";
+	metadata << "port " << port << "\n";
+	metadata << "protocol " << CAM_PROTOCOL_VERSION << "\n";
+	for(auto& item : streams){
+		metadata << "stream " << item.first << " " << item.second.name << "\n";
+	}
+	if(streams.empty() == false){
+		metadata << "ring_slots " << streams.begin()->second.source->get_slot_count() << "\n";
+	}
+	metadata << "preview " << PREVIEW_DEFAULT_FACTOR << " " << PREVIEW_DEFAULT_FPS << "\n";
 
-			err					= frame->GetOffsetY(offset_y);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetOffsetY error");
-				throw -1;
-			}
+	client.handshake_done	= true;
+	cout << "CCamServer: " << client.ip << " protocol " << CAM_PROTOCOL_VERSION << ", capabilities 0x" << hex << client.capabilities << dec << ", encoding " << encoding << endl;
 
-			err					= frame->GetPixelFormat((VmbPixelFormatType&)pixel_format);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetPixelFormat error");
-				throw -1;
-			}
+	return	send_message(client, CAM_MESSAGE_WELCOME, string((char*)welcome, sizeof(welcome)), true) and send_message(client, CAM_MESSAGE_METADATA, metadata.str());
+}
 
-			err					= frame->GetFrameID(frame_id);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetFrameID error");
-				throw -1;
-			}
+/*************************************************/
+// Queue a protocol message
+/*************************************************/
+template <int queue_length>
+bool CCamServer<queue_length>::send_message(CCamClient& client, uint16_t type, const string& payload, bool preamble){
+	client.frame_queue.push_back(make_shared<CCamFrame>(type, payload, preamble));
+	return	flush_client(client);
+}
 
-			err					= frame->GetTimestamp(time_stamp);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetTimeStamp error");
-				throw -1;
-			}
+/*************************************************/
+// Statistics and heartbeat messages
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::send_status(bool stats, bool heartbeat){
 
-			err					= frame->GetImage(data);
-			if(err != VmbErrorSuccess){
-				perror("MyObserver GetImage error");
-				throw -1;
+	vector<int>		broken_clients;
+	for(auto& item : clients){
+		CCamClient&		client	= item.second;
+		if(client.protocol != CAM_PROTOCOL_VERSION or client.handshake_done == false){
+			continue;
+		}
+		bool	ok	= true;
+		if(stats == true){
+			// sums over the subscribed streams
+			uint64_t	frames_conflated	= 0;
+			uint64_t	overwritten			= 0;
+			uint64_t	dropped				= 0;
+			for(auto& subscription : client.subscriptions){
+				CFrameSource*	source	= streams[subscription.first].source;
+				frames_conflated	+= subscription.second.frames_conflated;
+				overwritten			+= source->get_overwritten() + streams[subscription.first].backlog_overwritten;
+				dropped				+= source->get_dropped();
 			}
+			uint8_t		payload[CAM_STATS_LENGTH];
+			int64_to_buffer(payload, 0, client.frames_sent);
+			int64_to_buffer(payload, 8, frames_conflated);
+			int64_to_buffer(payload, 16, client.send_calls);
+			int64_to_buffer(payload, 24, client.zerocopy_copied);
+			int64_to_buffer(payload, 32, overwritten);
+			int64_to_buffer(payload, 40, dropped);
+			int64_to_buffer(payload, 48, client.adaptive.quality);
+			int64_to_buffer(payload, 56, client.adaptive.link_rate);
+			int64_to_buffer(payload, 64, client.adaptive.queue_delay * 1e6);
+			ok	= send_message(client, CAM_MESSAGE_STATS, string((char*)payload, sizeof(payload)));
+		}else if(heartbeat == true and client.frame_queue.empty()){
+			ok	= send_message(client, CAM_MESSAGE_HEARTBEAT, "");
+		}
+		if(ok == true and heartbeat == true and bandwidth != NULL){
+			ok	= send_message(client, CAM_MESSAGE_BANDWIDTH, bandwidth->get_status());
+		}
+		if(ok == false){
+			broken_clients.push_back(client.socket);
+		}
+	}
+	for(int client_socket : broken_clients){
+		drop_client(client_socket);
+	}
+}
+
+/*************************************************/
+// Client option
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::apply_option(CCamClient& client, const string line){
+
+	stringstream	line_stream(line);
+	vector<string>	words;
+	string			word;
+	while(line_stream >> word){
+		words.push_back(word);
+	}
+	if(words.empty()){
+		return;
+	}
+
+	// "stream <id> <option>": only for this subscription
+	CSubscription*	subscription	= NULL;
+	if(words[0] == "stream"){
+		int		stream_id	= -1;
+		try{
+			stream_id	= words.size() > 2 ? stoi(words[1]) : -1;
 		}catch(...){
-			data	= NULL;
-		}			
-		/*************************************************/
-		// send the image we just got
-		/*************************************************/
-		if(data != NULL){
-			int	bytesperpixel	= int(buffer_size / (height*width));
-		
-			int	client_socket	= ((CServer<CCamServer<queue_length>, queue_length>*)this)->get_client_socket();
-			try{
-				// assemble header: width, height, bytes per pixel
-				const size_t	header_length	= 40;
-				uint8_t			header[header_length];
-				ssize_t			sent_length;	
-
-				int32_to_buffer(header,0, buffer_size);
-				int32_to_buffer(header,4, width);
-				int32_to_buffer(header,8, height);
-				int32_to_buffer(header,12, offset_x);
-				int32_to_buffer(header,16, offset_y);
-				int32_to_buffer(header,20, pixel_format);
-				int64_to_buffer(header,24, time_stamp);
-				int64_to_buffer(header,32, frame_id);
-
-				// send header			
-				sent_length	=	send(client_socket, header, header_length, 0);
-				if(sent_length != header_length){
-					cerr	<< "socket error: " << client_socket << "\t" << port << endl;
-					perror("Socket send error: header");
-					throw -1;
-				}			
-				
-				// send data
-				sent_length	=	send(client_socket, data, buffer_size, 0);
-				if(sent_length != buffer_size){
-					cerr	<< "socket error: " << client_socket << "\t" << port << endl;
-					perror("Socket send error: data");
-					throw -1;
-				}			
+		}
+		auto	item	= client.subscriptions.find(stream_id);
+		if(item == client.subscriptions.end()){
+			cout << "CCamServer: " << client.ip << " not subscribed: " << line << endl;
+			return;
+		}
+		subscription	= &item->second;
+		words.erase(words.begin(), words.begin() + 2);
+	}
+	string			name	= words[0];
+	vector<string>	values(words.begin() + 1, words.end());
+	string			value	= values.empty() ? "" : values[0];
 
-			}catch(...){
-				/*************************************************/
-				// stop the server
-				/*************************************************/
-				//global.stdout_lock.lock();
-				cout << "CCamServer send error, stop streaming " << server_name << endl;
-				//global.stdout_lock.unlock();
-
-				stop_streaming	= true;
-				/*************************************************/
-			}	
-		}
-		/*************************************************/
-		// return frame
-		/*************************************************/
-		// return the frame, such that it can be filled with new data
-
-		frame->GetFrameID(frameid);
-		cout	 << get_current_date_time_string() << " camserver: return frame " << frameid  << endl;
-		server_return_framequeue->push(frame);
-		/*************************************************/
-		if(stop_streaming == true){
-			break;
+	if(name == "subscribe" or name == "unsubscribe"){
+		subscribe(client, values, name == "subscribe");
+		return;
+	}
+
+	// the connection, not a stream
+	if(name == "adaptive"){
+		if(value != "on" and value != "off"){
+			cout << "CCamServer: invalid adaptive " << value << " from " << client.ip << endl;
+			return;
 		}
-	}//main loop
+		client.adaptive.enabled		= value == "on";
+		client.adaptive.quality		= QUALITY_FULL;
+		client.adaptive.over_count	= 0;
+		client.adaptive.under_count	= 0;
+		cout << "CCamServer: " << client.ip << " set " << line << endl;
+		return;
+	}
+	if(name == "latency"){
+		uint32_t	latency	= 0;
+		try{
+			latency	= stoul(value);
+		}catch(...){
+		}
+		if(latency == 0){
+			cout << "CCamServer: invalid latency " << value << " from " << client.ip << endl;
+			return;
+		}
+		client.adaptive.target_latency_ms	= latency;
+		cout << "CCamServer: " << client.ip << " set " << line << endl;
+		return;
+	}
+
+	// delta encoding refers to one stream, the only one if none is given
+	if(name == "ack" or name == "key"){
+		if(subscription == NULL and client.subscriptions.size() == 1){
+			subscription	= &client.subscriptions.begin()->second;
+		}
+		if(subscription == NULL){
+			return;
+		}
+		CDeltaState&	delta	= subscription->delta;
+		// the client decoded this frame, it can be a reference
+		if(name == "ack"){
+			uint64_t	frame_id	= strtoull(value.c_str(), NULL, 10);
+			while(delta.pending.empty() == false and delta.pending.front().first <= frame_id){
+				if(delta.pending.front().first == frame_id){
+					delta.reference		= delta.pending.front().second;
+					delta.reference_id	= frame_id;
+				}
+				delta.pending.pop_front();
+			}
+		// the client lost its reference
+		}else{
+			delta.key_requested	= true;
+		}
+		return;
+	}
+
+	if(subscription != NULL){
+		if(set_stream_option(client, *subscription, name, values) == false){
+			return;
+		}
+	}else{
+		// checked on the defaults first, so invalid options are reported once
+		if(set_stream_option(client, client.defaults, name, values) == false){
+			return;
+		}
+		for(auto& item : client.subscriptions){
+			set_stream_option(client, item.second, name, values);
+		}
+	}
+	cout << "CCamServer: " << client.ip << " set " << line << endl;
+}
+
+template <int queue_length>
+bool CCamServer<queue_length>::set_stream_option(CCamClient& client, CSubscription& subscription, const string& name, const vector<string>& values){
+
+	string		value	= values.empty() ? "" : values[0];
+
+	if(name == "encoding"){
+		int		encoding	= -1;
+		if(value == "raw"){
+			encoding	= ENCODING_RAW;
+		}else if(value == "packed"){
+			encoding	= ENCODING_PACKED;
+		}else if(value == "tile"){
+			encoding	= ENCODING_TILE;
+		}else if(value == "sparse"){
+			encoding	= ENCODING_SPARSE;
+		}else if(value == "delta"){
+			encoding	= ENCODING_DELTA;
+		}
+		if(set_encoding(subscription, encoding) == false){
+			cout << "CCamServer: unknown encoding " << value << " from " << client.ip << endl;
+			return	false;
+		}
+	}else if(name == "threshold"){
+		try{
+			subscription.options.threshold	= stoul(value);
+		}catch(...){
+			cout << "CCamServer: invalid threshold " << value << " from " << client.ip << endl;
+			return	false;
+		}
+	}else if(name == "roi"){
+		CGeometry	geometry	= subscription.options.geometry;
+		try{
+			if(values.size() < 4){
+				throw	-1;
+			}
+			geometry.roi_x			= stoul(values[0]);
+			geometry.roi_y			= stoul(values[1]);
+			geometry.roi_width		= stoul(values[2]);
+			geometry.roi_height		= stoul(values[3]);
+		}catch(...){
+			cout << "CCamServer: invalid roi from " << client.ip << endl;
+			return	false;
+		}
+		subscription.options.geometry	= geometry;
+	}else if(name == "delivery"){
+		if(value == "lossless"){
+			subscription.delivery		= DELIVERY_LOSSLESS;
+		}else if(value == "latest"){
+			subscription.delivery		= DELIVERY_LATEST;
+			subscription.blocked_since	= time_point<steady_clock>();
+		}else{
+			cout << "CCamServer: unknown delivery " << value << " from " << client.ip << endl;
+			return	false;
+		}
+	}else if(name == "decimation" or name == "binning"){
+		uint32_t	factor;
+		try{
+			factor	= stoul(value);
+		}catch(...){
+			cout << "CCamServer: invalid " << name << " " << value << " from " << client.ip << endl;
+			return	false;
+		}
+		if(factor < 1 or factor > CAM_CLIENT_MAX_FACTOR){
+			cout << "CCamServer: invalid " << name << " " << value << " from " << client.ip << endl;
+			return	false;
+		}
+		if(name == "decimation"){
+			subscription.options.geometry.decimation	= factor;
+		}else{
+			subscription.options.geometry.binning		= factor;
+		}
+	}else if(name == "preview"){
+		uint32_t	factor	= 0;
+		if(value != "off"){
+			try{
+				factor	= stoul(value);
+			}catch(...){
+			}
+			if(factor < 1 or factor > PREVIEW_MAX_FACTOR){
+				cout << "CCamServer: invalid preview " << value << " from " << client.ip << endl;
+				return	false;
+			}
+		}
+		subscription.options.geometry.preview	= factor;
+	}else if(name == "preview_fps"){
+		double		fps		= -1;
+		try{
+			fps		= stod(value);
+		}catch(...){
+		}
+		if(fps < 0){
+			cout << "CCamServer: invalid preview_fps " << value << " from " << client.ip << endl;
+			return	false;
+		}
+		subscription.preview_fps	= fps;
+	}else{
+		cout << "CCamServer: unknown option " << name << " from " << client.ip << endl;
+		return	false;
+	}
+	return	true;
+}
+
+// starts the tile codec when it is needed for the first time
+template <int queue_length>
+bool CCamServer<queue_length>::set_encoding(CSubscription& subscription, int encoding){
+
+	switch(encoding){
+		case	ENCODING_RAW:
+		case	ENCODING_PACKED:
+		case	ENCODING_SPARSE:
+			break;
+		case	ENCODING_TILE:
+		case	ENCODING_DELTA:
+			if(codec == NULL){
+				codec	= new CTileCodec(TILE_CODEC_WORKER_THREADS);
+			}
+			break;
+		default:
+			return	false;
+	}
+	subscription.options.encoding		= encoding;
+	if(encoding == ENCODING_DELTA){
+		subscription.delta.reference.reset();
+		subscription.delta.pending.clear();
+		subscription.delta.key_requested	= true;
+	}
+	return	true;
+}
+
+/*************************************************/
+// Subscriptions
+/*************************************************/
+// new subscriptions start with the options given without stream
+template <int queue_length>
+void CCamServer<queue_length>::subscribe(CCamClient& client, const vector<string>& values, bool add){
+
+	vector<int>		stream_ids;
+	bool			preview		= false;
+	for(const string& value : values){
+		if(value == "preview"){
+			preview		= true;
+			continue;
+		}
+		if(value == "all"){
+			for(auto& item : streams){
+				stream_ids.push_back(item.first);
+			}
+			continue;
+		}
+		int		stream_id	= -1;
+		try{
+			stream_id	= stoi(value);
+		}catch(...){
+		}
+		if(streams.count(stream_id) == 0){
+			cout << "CCamServer: unknown stream " << value << " from " << client.ip << endl;
+			continue;
+		}
+		stream_ids.push_back(stream_id);
+	}
+
+	for(int stream_id : stream_ids){
+		if(add == false){
+			// frames already on the connection are still sent
+			client.subscriptions.erase(stream_id);
+		}else if(client.subscriptions.count(stream_id) == 0){
+			CSubscription&	subscription	= client.subscriptions[stream_id];
+			subscription					= client.defaults;
+			subscription.delta.reference.reset();
+			subscription.delta.pending.clear();
+			subscription.delta.key_requested	= true;
+		}
+		// the stream switches to its preview (and stays there)
+		if(add == true and preview == true){
+			uint32_t&	factor	= client.subscriptions[stream_id].options.geometry.preview;
+			factor		= client.defaults.options.geometry.preview > 0 ? client.defaults.options.geometry.preview : PREVIEW_DEFAULT_FACTOR;
+		}
+		cout << "CCamServer: " << client.ip << (add ? " subscribed " : " unsubscribed ") << stream_id << (add and preview ? " (preview)" : "") << endl;
+	}
+}
+
+/*************************************************/
+// Client socket ready for writing
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::on_writable(int client_socket){
+
+	auto	item	= clients.find(client_socket);
+	if(item == clients.end()){
+		return;
+	}
+	if(flush_client(item->second) == false){
+		drop_client(client_socket);
+	}
+}
+
+/*************************************************/
+// Client socket error
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::on_hangup(int client_socket){
+	drop_client(client_socket);
+}
+
+/*************************************************/
+// Client socket error queue
+/*************************************************/
+// zero-copy completions are reported via EPOLLERR as well
+template <int queue_length>
+void CCamServer<queue_length>::on_error(int client_socket){
+
+	auto	item	= clients.find(client_socket);
+	if(item == clients.end()){
+		return;
+	}
+	CCamClient&		client	= item->second;
+
+	while(true){
+		uint32_t	first;
+		uint32_t	last;
+		bool		copied;
+		int			status	= read_zerocopy_completion(client_socket, first, last, copied);
+		if(status < 0){
+			perror("CCamServer socket error");
+			drop_client(client_socket);
+			return;
+		}
+		if(status == 0){
+			break;
+		}
+		if(copied == true){
+			client.zerocopy_copied	+= last - first + 1;
+		}
+		// calls complete in order: release their frames
+		while(client.zerocopy_pending.empty() == false and int32_t(client.zerocopy_pending.front().sequence - last) <= 0){
+			client.zerocopy_pending.pop_front();
+		}
+	}
+
+	// a pending socket error that is not a completion
+	int			socket_error		= 0;
+	socklen_t	socket_error_size	= sizeof(socket_error);
+	getsockopt(client_socket, SOL_SOCKET, SO_ERROR, &socket_error, &socket_error_size);
+	if(socket_error != 0){
+		drop_client(client_socket);
+	}
+}
+
+/*************************************************/
+// Periodic work
+/*************************************************/
+// called after every epoll_wait: ends the handshake of silent clients,
+// adapts the quality of the clients, resumes distributing held back frames,
+// drops stalled lossless clients, sends heartbeats and statistics once per
+// interval
+template <int queue_length>
+void CCamServer<queue_length>::on_poll(){
+
+	auto	current_time	= steady_clock::now();
+	// lowered again below while there is something to wait for
+	this->poll_timeout		= SERVER_POLL_TIMEOUT;
+
+	for(auto& item : clients){
+		CCamClient&		client	= item.second;
+		// no preamble: legacy client
+		if(client.protocol == CAM_PROTOCOL_UNKNOWN and current_time - client.connect_time > milliseconds(CAM_PROTOCOL_HANDSHAKE_TIMEOUT_MS)){
+			client.protocol			= CAM_PROTOCOL_LEGACY;
+			client.handshake_done	= true;
+			cout << "CCamServer: legacy client " << client.ip << endl;
+		}
+		// estimates once per interval, also while no frames arrive
+		if(client.adaptive.enabled == true){
+			update_adaptive(client, current_time);
+			this->poll_timeout	= min(this->poll_timeout, ADAPTIVE_INTERVAL_MS);
+		}
+	}
+
+	// the bandwidth scheduler has new tokens, or the send queue of a rate
+	// limited client got shorter
+	if(throttled == true){
+		throttled			= false;
+		vector<int>		broken_clients;
+		for(auto& item : clients){
+			if(flush_client(item.second) == false){
+				broken_clients.push_back(item.first);
+			}
+		}
+		for(int client_socket : broken_clients){
+			drop_client(client_socket);
+		}
+	}
+
+	bool	frames_held		= false;
+	for(auto& item : streams){
+		frames_held		= frames_held or item.second.held;
+	}
+	if(frames_held == true){
+		vector<int>		stalled_clients;
+		for(auto& item : clients){
+			CCamClient&		client	= item.second;
+			for(auto& subscription : client.subscriptions){
+				time_point<steady_clock>	blocked_since	= subscription.second.blocked_since;
+				if(blocked_since != time_point<steady_clock>() and current_time - blocked_since > seconds(CAM_CLIENT_STALL_TIMEOUT_S)){
+					cout << "CCamServer: lossless client " << client.ip << " stalled, closing" << endl;
+					stalled_clients.push_back(client.socket);
+					break;
+				}
+			}
+		}
+		for(int client_socket : stalled_clients){
+			drop_client(client_socket);
+		}
+		for(auto& item : streams){
+			if(item.second.held == true){
+				distribute_frames(item.first);
+			}
+		}
+	}
+
+	if(dropped.empty() == false){
+		reap_dropped(current_time);
+	}
+
+	bool	heartbeat	= current_time - heartbeat_time >= seconds(CAM_SERVER_HEARTBEAT_S);
+	if(heartbeat == true){
+		heartbeat_time	= current_time;
+	}
+	bool	stats		= current_time - stats_time >= seconds(CAM_SERVER_STATS_INTERVAL_S);
+	if(stats == true){
+		stats_time		= current_time;
+	}
+	if(heartbeat == true or stats == true){
+		send_status(stats, heartbeat);
+	}
+	if(stats == false){
+		return;
+	}
+
+	if(udp != NULL){
+		cout << get_current_date_time_string() << " " << this->get_server_name() << " " << udp->get_status() << endl;
+	}
+	if(shm != NULL){
+		cout << get_current_date_time_string() << " " << this->get_server_name() << " " << shm->get_status() << endl;
+	}
+	if(bandwidth != NULL and multiplexed == true){
+		cout << get_current_date_time_string() << " bandwidth (Mbit/s):" << endl << bandwidth->get_status();
+	}
+	if(codec != NULL and codec->get_frames() > 0){
+		cout << get_current_date_time_string() << " " << this->get_server_name() << " tile codec: frames " << codec->get_frames();
+		cout << " ratio " << codec->get_ratio() << " MB/s per core " << codec->get_mb_per_core_second();
+		cout << " latency " << codec->get_mean_latency_ms() << " ms (max " << codec->get_max_latency_ms() << " ms)" << endl;
+	}
+}
+
+/*************************************************/
+// Distribute new frames
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::distribute_frames(int stream_id){
+
+	CCamStream&		stream	= streams[stream_id];
+	size_t			backlog_length	= max(1, min(CAM_STREAM_BACKLOG_LENGTH, stream.source->get_slot_count() / 4));
+	while(true){
+		// take the next frame from the ring
+		shared_ptr<CFrameSlot>	slot		= stream.source->pop();
+		if(slot == NULL){
+			break;
+		}
+
+		cout	 << get_current_date_time_string() << " camserver: new frame " << slot->frame_id  << endl;
+
+		// the multiplexed server shares the slot, it doesn't wait for the
+		// TCP clients of this one
+		if(feed != NULL){
+			feed->push(slot);
+		}
+
+		// neither do snapshots, the readers of the shared memory and the UDP
+		// receivers
+		if(latest != NULL){
+			latest->update(slot);
+		}
+		if(shm != NULL){
+			shm->publish(*slot);
+		}
+		if(udp != NULL){
+			CFrameCache		cache;
+			cache.slot		= slot;
+			cache.stream_id	= stream_id;
+			shared_ptr<CCamFrame>	camframe	= shared_frame(cache, udp_options);
+			CUdpFrame		udp_frame;
+			udp_frame.owner				= camframe;
+			udp_frame.header			= camframe->header;
+			udp_frame.header_length		= camframe->header_length;
+			udp_frame.data				= camframe->data;
+			udp_frame.size				= camframe->buffer_size;
+			udp_frame.stream_id			= camframe->stream_id;
+			udp_frame.frame_id			= camframe->frame_id;
+			udp->push(udp_frame);
+		}
+
+		stream.backlog.push_back(slot);
+		if(stream.backlog.size() > backlog_length){
+			stream.backlog.pop_front();
+			stream.backlog_overwritten++;
+		}
+	}
+
+	// backpressure: the frames wait in the backlog until the lossless
+	// clients caught up (on_poll tries again)
+	while(stream.backlog.empty() == false){
+		stream.held		= lossless_blocked(stream_id);
+		if(stream.held == true){
+			return;
+		}
+		shared_ptr<CFrameSlot>	slot	= stream.backlog.front();
+		stream.backlog.pop_front();
+		send_to_clients(stream_id, slot);
+	}
+	stream.held		= false;
+}
+
+/*************************************************/
+// Send a frame to the TCP clients
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::send_to_clients(int stream_id, shared_ptr<CFrameSlot> slot){
+
+	// shared frames, one per set of stream options in use: the slot is
+	// released when the last reference is gone
+	CFrameCache		cache;
+	time_point<steady_clock>	frame_time	= steady_clock::now();
+	cache.slot		= slot;
+	cache.stream_id	= stream_id;
+	int				level	= bandwidth != NULL ? bandwidth->get_level(stream_id) : 0;
+
+	vector<int>		broken_clients;
+	for(auto& item : clients){
+		CCamClient&		client	= item.second;
+
+		// still in the handshake
+		if(client.handshake_done == false){
+			continue;
+		}
+		auto	subscription	= client.subscriptions.find(stream_id);
+		if(subscription == client.subscriptions.end()){
+			continue;
+		}
+		// previews at their own rate, due times on a fixed grid
+		if(subscription->second.options.geometry.preview > 0 and subscription->second.preview_fps > 0){
+			time_point<steady_clock>&	due			= subscription->second.preview_due;
+			auto						interval	= duration_cast<steady_clock::duration>(duration<double>(1.0 / subscription->second.preview_fps));
+			if(frame_time < due){
+				continue;
+			}
+			due		= max(due + interval, frame_time - interval);
+		}
+		CStreamOptions	options		= adaptive_options(client, degraded_options(subscription->second.options, level));
+		shared_ptr<CCamFrame>	camframe;
+		if(options.encoding == ENCODING_DELTA){
+			camframe	= delta_frame(subscription->second, options, cache);
+		}else{
+			camframe	= shared_frame(cache, options);
+		}
+		deliver(subscription->second, camframe);
+		// what the client would take at its quality level
+		client.adaptive.offered_bytes	+= camframe->header_length + camframe->buffer_size;
+
+		if(flush_client(client) == false){
+			broken_clients.push_back(client.socket);
+		}
+	}
+	for(int client_socket : broken_clients){
+		drop_client(client_socket);
+	}
+}
+
+/*************************************************/
+// Backpressure
+/*************************************************/
+// only the subscribers of the stream count, other streams go on
+template <int queue_length>
+bool CCamServer<queue_length>::lossless_blocked(int stream_id){
+
+	bool	blocked		= false;
+	for(auto& item : clients){
+		auto	found	= item.second.subscriptions.find(stream_id);
+		if(found == item.second.subscriptions.end()){
+			continue;
+		}
+		CSubscription&	subscription	= found->second;
+		if(subscription.delivery == DELIVERY_LOSSLESS and subscription.waiting.size() >= CAM_CLIENT_QUEUE_LENGTH){
+			if(subscription.blocked_since == time_point<steady_clock>()){
+				subscription.blocked_since	= steady_clock::now();
+			}
+			blocked		= true;
+		}
+	}
+	return	blocked;
+}
+
+/*************************************************/
+// Queue a frame for a subscription
+/*************************************************/
+// latest: the waiting frame is replaced, frames already handed to the
+// connection stay. Delta frames refer to the acknowledged frame, so
+// replacing them is fine.
+template <int queue_length>
+void CCamServer<queue_length>::deliver(CSubscription& subscription, shared_ptr<CCamFrame> camframe){
+
+	if(subscription.delivery == DELIVERY_LATEST){
+		subscription.frames_conflated	+= subscription.waiting.size();
+		subscription.waiting.clear();
+	}
+	subscription.waiting.push_back(camframe);
+	if(bandwidth != NULL){
+		bandwidth->offer(camframe->stream_id, camframe->header_length + camframe->buffer_size);
+	}
+}
+
+/*************************************************/
+// Degraded stream
+/*************************************************/
+// step 1: lossless compression instead of raw / packed frames, 2 and 3:
+// decimation by 2 and 4 on top of what the client asked for
+template <int queue_length>
+CStreamOptions CCamServer<queue_length>::degraded_options(const CStreamOptions& options, int level){
+
+	CStreamOptions		degraded	= options;
+	if(level >= 1 and (options.encoding == ENCODING_RAW or options.encoding == ENCODING_PACKED)){
+		if(codec == NULL){
+			codec	= new CTileCodec(TILE_CODEC_WORKER_THREADS);
+		}
+		degraded.encoding	= ENCODING_TILE;
+	}
+	if(level >= 2){
+		uint32_t	factor			= level == 2 ? 2 : 4;
+		degraded.geometry.decimation	= min<uint32_t>(max<uint32_t>(options.geometry.decimation, 1) * factor, CAM_CLIENT_MAX_FACTOR);
+	}
+	return	degraded;
+}
+
+/*************************************************/
+// Adaptive quality
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::update_adaptive(CCamClient& client, time_point<steady_clock> current_time){
+
+	CAdaptiveState&		adaptive	= client.adaptive;
+	double				elapsed		= duration<double>(current_time - adaptive.estimate_time).count();
+	if(elapsed < ADAPTIVE_INTERVAL_MS / 1000.0){
+		return;
+	}
+	adaptive.estimate_time		= current_time;
+
+	int		send_queue			= max(get_send_queue(client.socket), 0);
+	// handed to the connection, not yet to the socket
+	size_t	unsent				= 0;
+	for(auto& camframe : client.frame_queue){
+		unsent					+= camframe->header_length + camframe->buffer_size;
+	}
+	unsent						-= min(unsent, client.sent_bytes);
+
+	// taken by the client in this interval; SIOCOUTQ may count more than
+	// this connection wrote, and the count never goes back
+	uint64_t	delivered		= adaptive.bytes_written - min<uint64_t>(adaptive.bytes_written, send_queue);
+	delivered					= max(delivered, adaptive.last_delivered);
+	double		rate			= (delivered - adaptive.last_delivered) / elapsed;
+	double		offered			= (adaptive.offered_bytes - adaptive.last_offered) / elapsed;
+	adaptive.last_delivered		= delivered;
+	adaptive.last_offered		= adaptive.offered_bytes;
+
+	// the client took what it could only if data was waiting all the time
+	if(send_queue > 0 and adaptive.last_send_queue > 0){
+		adaptive.link_rate		+= ADAPTIVE_SMOOTHING * (rate - adaptive.link_rate);
+	}else{
+		adaptive.link_rate		= max(adaptive.link_rate, rate);
+	}
+	adaptive.last_send_queue	= send_queue;
+	adaptive.offered_rate		+= ADAPTIVE_SMOOTHING * (offered - adaptive.offered_rate);
+	adaptive.queue_delay		= adaptive.link_rate > 0 ? (send_queue + unsent) / adaptive.link_rate : 0;
+
+	double		target			= adaptive.target_latency_ms / 1000.0;
+	adaptive.over_count			= adaptive.queue_delay > target ? adaptive.over_count + 1 : 0;
+	adaptive.under_count		= adaptive.queue_delay < target / 4 ? adaptive.under_count + 1 : 0;
+
+	int			quality			= adaptive.quality;
+	if(adaptive.over_count >= ADAPTIVE_DOWN_HOLD){
+		adaptive.level_demand[quality]	= adaptive.offered_rate;
+		adaptive.quality		= next_quality(client, quality, 1);
+		adaptive.over_count		= 0;
+		adaptive.under_count	= 0;
+	}else if(adaptive.under_count >= ADAPTIVE_UP_HOLD and quality > QUALITY_FULL){
+		int		higher			= next_quality(client, quality, -1);
+		if(adaptive.link_rate > 1.2 * adaptive.level_demand[higher] or adaptive.under_count >= ADAPTIVE_PROBE_HOLD){
+			adaptive.quality		= higher;
+			adaptive.over_count		= 0;
+			adaptive.under_count	= 0;
+		}
+	}
+	if(adaptive.quality != quality){
+		cout << get_current_date_time_string() << " CCamServer: " << client.ip << " quality " << quality << " -> " << adaptive.quality;
+		cout << ", link " << adaptive.link_rate * 8e-6 << " Mbit/s, delay " << int(adaptive.queue_delay * 1000) << " ms" << endl;
+	}
+}
+
+template <int queue_length>
+int CCamServer<queue_length>::next_quality(CCamClient& client, int quality, int step){
+
+	for(int level = quality + step; level >= QUALITY_FULL and level < QUALITY_LEVELS; level += step){
+		switch(level){
+			case	QUALITY_PACKED:
+				if((client.capabilities & CAM_CAPABILITY_PACKED) != 0){
+					return	level;
+				}
+				break;
+			case	QUALITY_COMPRESSED:
+				if((client.capabilities & CAM_CAPABILITY_TILE) != 0){
+					return	level;
+				}
+				break;
+			case	QUALITY_BINNED:
+				if((client.capabilities & CAM_CAPABILITY_GEOMETRY) != 0){
+					return	level;
+				}
+				break;
+			default:
+				return	level;
+		}
+	}
+	return	quality;
+}
+
+// raw frames bit-packed, then tile compressed, then binned 2x2 on top of
+// what the client asked for
+template <int queue_length>
+CStreamOptions CCamServer<queue_length>::adaptive_options(CCamClient& client, const CStreamOptions& options){
+
+	CStreamOptions		adapted		= options;
+	int					quality		= client.adaptive.quality;
+	if(quality >= QUALITY_PACKED and adapted.encoding == ENCODING_RAW and (client.capabilities & CAM_CAPABILITY_PACKED) != 0){
+		adapted.encoding	= ENCODING_PACKED;
+	}
+	if(quality >= QUALITY_COMPRESSED and (adapted.encoding == ENCODING_RAW or adapted.encoding == ENCODING_PACKED) and (client.capabilities & CAM_CAPABILITY_TILE) != 0){
+		if(codec == NULL){
+			codec	= new CTileCodec(TILE_CODEC_WORKER_THREADS);
+		}
+		adapted.encoding	= ENCODING_TILE;
+	}
+	if(quality >= QUALITY_BINNED and (client.capabilities & CAM_CAPABILITY_GEOMETRY) != 0){
+		adapted.geometry.binning	= min<uint32_t>(max<uint32_t>(options.geometry.binning, 1) * 2, CAM_CLIENT_MAX_FACTOR);
+	}
+	return	adapted;
+}
+
+template <int queue_length>
+bool CCamServer<queue_length>::rate_limited(CCamClient& client){
+
+	CAdaptiveState&		adaptive	= client.adaptive;
+	if(adaptive.enabled == false or adaptive.quality < QUALITY_RATE_LIMITED or adaptive.link_rate <= 0){
+		return	false;
+	}
+	return	get_send_queue(client.socket) > adaptive.link_rate * adaptive.target_latency_ms / 1000;
+}
+
+/*************************************************/
+// Interleave the streams of a client
+/*************************************************/
+// deficit round robin: each turn adds CAM_CLIENT_QUANTUM bytes to the budget
+// of the stream, it sends frames while they fit, then the next stream with
+// waiting frames follows. Frames are handed to the connection while it holds
+// less than CAM_CLIENT_WIRE_BYTES (at least one frame), such that a new
+// frame of a small stream doesn't queue behind many large ones. Latest
+// streams have one frame at most on the connection, the others wait in the
+// subscription where they can still be replaced. Streams the bandwidth
+// scheduler holds back skip their turn, as do latest streams of a rate
+// limited client while its send queue is too long.
+template <int queue_length>
+void CCamServer<queue_length>::schedule(CCamClient& client){
+
+	bool		limited			= rate_limited(client);
+	size_t		wire_frames		= 0;
+	size_t		wire_bytes		= 0;
+	set<int>	wire_streams;
+	// streams waiting for the bandwidth scheduler
+	set<int>	throttled_streams;
+	for(auto& camframe : client.frame_queue){
+		if(camframe->type == CAM_MESSAGE_FRAME){
+			wire_frames++;
+			wire_bytes	+= camframe->header_length + camframe->buffer_size;
+			wire_streams.insert(camframe->stream_id);
+		}
+	}
+
+	while(wire_frames == 0 or wire_bytes < CAM_CLIENT_WIRE_BYTES){
+		// the stream whose turn it is, or the next one with waiting frames
+		auto	item		= client.subscriptions.lower_bound(client.turn);
+		size_t	visited		= 0;
+		while(visited < client.subscriptions.size()){
+			if(item == client.subscriptions.end()){
+				item	= client.subscriptions.begin();
+			}
+			bool	waiting		= item->second.waiting.empty() == false;
+			bool	conflated	= item->second.delivery == DELIVERY_LATEST and wire_streams.count(item->first) > 0;
+			bool	paced		= limited == true and item->second.delivery == DELIVERY_LATEST;
+			if(waiting == true and conflated == false and paced == true){
+				// newer frames replace the waiting one meanwhile
+				throttled			= true;
+				this->poll_timeout	= min<int>(this->poll_timeout, max<int>(client.adaptive.target_latency_ms / 10, 1));
+			}
+			if(waiting == true and conflated == false and paced == false and throttled_streams.count(item->first) == 0){
+				break;
+			}
+			item++;
+			visited++;
+		}
+		if(visited == client.subscriptions.size()){
+			return;
+		}
+		if(item->first != client.turn){
+			client.turn			= item->first;
+			client.turn_new		= true;
+		}
+
+		CSubscription&	subscription	= item->second;
+		if(client.turn_new == true){
+			subscription.deficit	+= CAM_CLIENT_QUANTUM;
+			client.turn_new			= false;
+		}
+
+		shared_ptr<CCamFrame>	camframe	= subscription.waiting.front();
+		size_t					size		= camframe->header_length + camframe->buffer_size;
+		if(size <= subscription.deficit and bandwidth != NULL and bandwidth->acquire(item->first, size) == false){
+			// on_poll tries again when the bucket is refilled
+			throttled_streams.insert(item->first);
+			throttled				= true;
+			this->poll_timeout		= min(this->poll_timeout, bandwidth->get_wait_ms(item->first));
+			// no budget saved up while waiting
+			subscription.deficit	= min(subscription.deficit, max<size_t>(size, CAM_CLIENT_QUANTUM));
+		}else if(size <= subscription.deficit){
+			subscription.deficit	-= size;
+			subscription.waiting.pop_front();
+			subscription.blocked_since	= time_point<steady_clock>();
+			client.frame_queue.push_back(camframe);
+			wire_frames++;
+			wire_bytes	+= size;
+			wire_streams.insert(item->first);
+			// an idle stream doesn't save up its budget
+			if(subscription.waiting.empty() == false){
+				continue;
+			}
+			subscription.deficit	= 0;
+		}
+		// next stream
+		client.turn			= item->first + 1;
+		client.turn_new		= true;
+	}
+}
+
+/*************************************************/
+// Frame cut to a geometry
+/*************************************************/
+template <int queue_length>
+shared_ptr<CFrameSlot> CCamServer<queue_length>::get_view(CFrameCache& cache, const CGeometry& geometry){
+
+	if(geometry.is_full()){
+		return	cache.slot;
+	}
+	shared_ptr<CFrameSlot>&		view	= cache.views[geometry];
+	if(view == NULL){
+		view	= make_shared<CFrameSlot>();
+		if(apply_geometry(*cache.slot, geometry, *view) == false){
+			view	= cache.slot;
+		}
+	}
+	return	view;
+}
+
+/*************************************************/
+// Shared encoded frame
+/*************************************************/
+template <int queue_length>
+shared_ptr<CCamFrame> CCamServer<queue_length>::shared_frame(CFrameCache& cache, const CStreamOptions& options){
+
+	shared_ptr<CCamFrame>&	camframe	= cache.camframes[options];
+	if(camframe == NULL){
+		camframe	= make_shared<CCamFrame>(get_view(cache, options.geometry), cache.stream_id, options, codec);
+	}
+	return	camframe;
+}
+
+/*************************************************/
+// Delta frame for one subscription
+/*************************************************/
+// a key frame (tile compressed, shared with other key frames) if there is no
+// usable reference, the difference to the acknowledged frame otherwise. The
+// raw frame is kept until the client acknowledges it or it's too old.
+template <int queue_length>
+shared_ptr<CCamFrame> CCamServer<queue_length>::delta_frame(CSubscription& subscription, const CStreamOptions& options, CFrameCache& cache){
+
+	CDeltaState&			delta		= subscription.delta;
+	shared_ptr<CFrameSlot>	view		= get_view(cache, options.geometry);
+	shared_ptr<CCamFrame>	camframe;
+
+	bool	key_frame	= delta.key_requested or delta.reference == NULL or delta.reference->size() != view->buffer_size or delta.frames_since_key >= DELTA_KEY_FRAME_INTERVAL;
+	if(key_frame == false){
+		camframe	= make_shared<CCamFrame>(view, cache.stream_id, codec, *delta.reference, delta.reference_id);
+	}
+	if(camframe == NULL or camframe->pixel_format != PIXEL_FORMAT_DELTA){
+		CStreamOptions		key_options	= options;
+		key_options.encoding			= ENCODING_TILE;
+		camframe					= shared_frame(cache, key_options);
+		delta.frames_since_key		= 0;
+		delta.key_requested			= false;
+	}else{
+		delta.frames_since_key++;
+	}
+
+	shared_ptr<vector<uint8_t>>&	snapshot	= cache.snapshots[options.geometry];
+	if(snapshot == NULL){
+		snapshot	= make_shared<vector<uint8_t>>(view->data.begin(), view->data.begin() + view->buffer_size);
+	}
+	delta.pending.push_back(make_pair(view->frame_id, snapshot));
+	if(delta.pending.size() > DELTA_MAX_PENDING){
+		delta.pending.pop_front();
+	}
+	return	camframe;
+}
+
+/*************************************************/
+// Send pending data to a client
+/*************************************************/
+// header and image data of as many frames as possible go out in one
+// sendmsg call, a partial write continues at the send cursor
+template <int queue_length>
+bool CCamServer<queue_length>::flush_client(CCamClient& client){
+
+	while(true){
+		// frames of the subscriptions take their turn
+		schedule(client);
+		if(client.frame_queue.empty() == true){
+			break;
+		}
+
+		// gather: continue where we stopped, header first, then the data
+		struct	iovec	iov[TRANSMIT_MAX_IOV];
+		int				iovcnt		= 0;
+		size_t			skip		= client.sent_bytes;
+		size_t			frames		= 0;
+		// legacy clients get no message header
+		size_t			prefix		= client.protocol == CAM_PROTOCOL_LEGACY ? CAM_MESSAGE_HEADER_LENGTH : 0;
+
+		for(auto& camframe : client.frame_queue){
+			if(iovcnt + 2 > TRANSMIT_MAX_IOV){
+				break;
+			}
+			size_t	header_length	= camframe->header_length - prefix;
+			if(skip < header_length){
+				iov[iovcnt].iov_base	= camframe->header + prefix + skip;
+				iov[iovcnt].iov_len		= header_length - skip;
+				iovcnt++;
+				skip					= 0;
+			}else{
+				skip					-= header_length;
+			}
+			iov[iovcnt].iov_base		= (void*)(camframe->data + skip);
+			iov[iovcnt].iov_len			= camframe->buffer_size - skip;
+			iovcnt++;
+			skip						= 0;
+			frames++;
+		}
+
+		ssize_t		sent_length	= send_iov(client.socket, iov, iovcnt, client.zerocopy);
+		if(sent_length < 0){
+			// socket buffer full (or too much zero-copy data in flight):
+			// continue when the socket gets writable / completions arrive
+			if(errno == EAGAIN or errno == EWOULDBLOCK or (client.zerocopy == true and errno == ENOBUFS)){
+				if(client.want_write == false){
+					client.want_write	= true;
+					this->watch_client(client.socket, true);
+				}
+				return	true;
+			}
+			cerr	<< "socket error: " << client.socket << "\t" << port << endl;
+			perror("Socket send error");
+			return	false;
+		}
+		client.send_calls++;
+		client.adaptive.bytes_written	+= sent_length;
+
+		// zero-copy: the kernel still reads from these frames
+		if(client.zerocopy == true){
+			CZeroCopyPending	pending;
+			pending.sequence	= client.zerocopy_next++;
+			pending.frames.assign(client.frame_queue.begin(), client.frame_queue.begin() + frames);
+			client.zerocopy_pending.push_back(move(pending));
+		}
+
+		// advance the send cursor, release the frames that are done
+		client.sent_bytes	+= sent_length;
+		while(client.frame_queue.empty() == false){
+			size_t	total	= client.frame_queue.front()->header_length - prefix + client.frame_queue.front()->buffer_size;
+			if(client.sent_bytes < total){
+				break;
+			}
+			client.sent_bytes	-= total;
+			if(client.frame_queue.front()->type == CAM_MESSAGE_FRAME){
+				client.frames_sent++;
+				auto	subscription	= client.subscriptions.find(client.frame_queue.front()->stream_id);
+				if(subscription != client.subscriptions.end()){
+					subscription->second.frames_sent++;
+				}
+			}
+			client.frame_queue.pop_front();
+		}
+	}
+
+	// nothing left to send
+	if(client.want_write == true){
+		client.want_write	= false;
+		this->watch_client(client.socket, false);
+	}
+	return	true;
+}
+
+/*************************************************/
+// Disconnect a client
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::drop_client(int client_socket){
+
+	auto	item	= clients.find(client_socket);
+	if(item == clients.end()){
+		return;
+	}
+	CCamClient&		client	= item->second;
+	uint64_t		frames_conflated	= 0;
+	for(auto& subscription : client.subscriptions){
+		frames_conflated	+= subscription.second.frames_conflated;
+	}
+	cout << "=== " << this->get_server_name() << " closed " << client.ip << " ===" << "\tsent: " << client.frames_sent << "\tconflated: " << frames_conflated;
+	cout << "\tsend calls: " << client.send_calls << "\tzero-copy fallbacks: " << client.zerocopy_copied << "\tquality: " << client.adaptive.quality << endl;
+
+	this->unwatch_client(client_socket);
+	if(client.zerocopy_pending.empty() == true){
+		close(client_socket);
+	}else{
+		// the kernel may still read the frames of zero-copy calls: the
+		// queued data goes out, the socket stays open for the completions
+		shutdown(client_socket, SHUT_WR);
+		CZeroCopyDropped&	entry	= dropped[client_socket];
+		entry.pending			= move(client.zerocopy_pending);
+		entry.drop_time			= steady_clock::now();
+	}
+
+	// releases all slots still queued for this client
+	clients.erase(item);
+}
+
+/*************************************************/
+// Dropped zero-copy clients
+/*************************************************/
+template <int queue_length>
+void CCamServer<queue_length>::reap_dropped(time_point<steady_clock> current_time){
+
+	// all calls complete / an error or the timeout
+	vector<int>		finished;
+	vector<int>		expired;
+	for(auto& item : dropped){
+		CZeroCopyDropped&	entry	= item.second;
+		int					status	= 1;
+		while(entry.pending.empty() == false){
+			uint32_t	first;
+			uint32_t	last;
+			bool		copied;
+			status	= read_zerocopy_completion(item.first, first, last, copied);
+			if(status <= 0){
+				break;
+			}
+			while(entry.pending.empty() == false and int32_t(entry.pending.front().sequence - last) <= 0){
+				entry.pending.pop_front();
+			}
+		}
+		if(entry.pending.empty() == true){
+			finished.push_back(item.first);
+		}else if(status < 0){
+			expired.push_back(item.first);
+		}else if(current_time - entry.drop_time > seconds(CAM_CLIENT_CLOSE_TIMEOUT_S)){
+			cout << "CCamServer: zero-copy sends of a dropped client not complete after " << CAM_CLIENT_CLOSE_TIMEOUT_S << " s, resetting" << endl;
+			expired.push_back(item.first);
+		}
+	}
+	for(int client_socket : finished){
+		close(client_socket);
+		dropped.erase(client_socket);
+	}
+	for(int client_socket : expired){
+		close_dropped(client_socket);
+	}
+	if(dropped.empty() == false){
+		this->poll_timeout	= min(this->poll_timeout, CAM_CLIENT_CLOSE_POLL_MS);
+	}
+}
+
+// SO_LINGER 0: close discards the send queue and resets the connection,
+// afterwards the kernel holds none of the frames
+template <int queue_length>
+void CCamServer<queue_length>::close_dropped(int client_socket){
+
+	struct	linger	reset;
+	reset.l_onoff	= 1;
+	reset.l_linger	= 0;
+	setsockopt(client_socket, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+	close(client_socket);
+
+	dropped.erase(client_socket);
 }
 
 
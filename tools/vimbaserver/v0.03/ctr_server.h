@@ -22,97 +22,620 @@
 
 #include "tools.h"
 
+// encoded frames (CCamFrame), stream options
+#include "camserver.h"
+
+// newest frame of each camera
+#include "latest_frame.h"
+
+// command queues to the camera threads
+#include "camera_control.h"
+
+// maximum length of a request line
 #define	CONTR_BUFFER_SIZE 1024
 
 /******************************************************************************
  * Control Server
  *****************************************************************************/
+/*
+ * Event driven like the camera servers: any number of clients, non-blocking
+ * sockets, each request line is answered as soon as its answer is there.
+ * The requests are text lines (see protocol.h):
+ *
+ *	cameras						index, id and state of every camera
+ *	get <camera> <feature>		value of a vimba feature
+ *	set <camera> <feature> <value>
+ *								writes it while the camera acquires, the
+ *								answer is the value read back and the new
+ *								settings generation: "<value> settings <n>
+ *								[restarted]"
+ *	start <camera>				acquisition start / stop
+ *	stop <camera>
+ *	stats <camera>				state, frame counters and settings generation
+ *	subscribe <camera>... | all	events of these cameras (state changes,
+ *	unsubscribe <camera>... | all	features set by any client)
+ *	snapshot <camera> ...		newest frame, see protocol.h
+ *
+ * camera: index or camera id. get, set, start, stop and stats go to the
+ * command queue of the camera thread (CCameraControl) and are answered
+ * when the thread took care of them, so the answers of different cameras
+ * can come in any order: a request line may start with "#<tag>", the answer
+ * starts with the same tag then. Commands the camera thread doesn't answer
+ * within CONTROL_COMMAND_TIMEOUT_MS get an error.
+ *
+ * Snapshots are taken from the CLatestFrame cache the camera server keeps up
+ * to date, and only encoded and copied here. A snapshot never keeps a slot
+ * of the camera ring: however slowly a client reads, the camera goes on.
+ */
+
+// camera known to the control server
+struct CControlCamera{
+	string				name;
+	CLatestFrame*		latest;
+	CCameraControl*		control;
+};
+
+// data queued for a client: text, then the image of frame (if any)
+struct CControlOutput{
+	string					text;
+	shared_ptr<CCamFrame>	frame;
+};
+
+// connected client
+struct CControlClient{
+	int						socket;
+	string					ip;
+	// unique for the lifetime of the server (sockets are reused)
+	uint64_t				serial;
+
+	// received, not a complete line yet
+	string					input;
+	// sent_bytes: of the first output
+	deque<CControlOutput>	output;
+	size_t					sent_bytes;
+	size_t					queued_bytes;
+	bool					want_write;
+	// socket error, dropped by drop_broken_clients
+	bool					broken;
+
+	// cameras whose events the client gets
+	set<int>				subscriptions;
+};
+
+// command waiting for the answer of a camera thread
+struct CControlPending{
+	uint64_t				client_serial;
+	int						client_socket;
+	string					tag;
+	time_point<steady_clock>	deadline;
+};
+
 template <int queue_length>
 class CControlServer : public CServer<CControlServer<queue_length>, queue_length>{
 	public:
 		CControlServer(int port, const string name);
-		void main();
+		~CControlServer();
+
+		// camera for requests, call before the server is started
+		void add_camera(int camera_index, const string name, CLatestFrame* latest, CCameraControl* control);
+
+		// event hooks, see server.h
+		void	on_start();
+		void	on_connect(int client_socket, const string client_ip);
+		void	on_readable(int client_socket);
+		void	on_writable(int client_socket);
+		void	on_hangup(int client_socket);
+		void	on_poll();
+
+	private:
+		// key: camera index
+		map<int, CControlCamera>	cameras;
+		// key: socket
+		map<int, CControlClient>	clients;
+		uint64_t					next_serial;
+		// key: command id
+		map<uint64_t, CControlPending>	pending;
+		uint64_t					next_command;
+
+		// started with the first tile compressed snapshot
+		CTileCodec*					codec;
+
+		// camera by index or id, cameras.end() if there is none
+		typename map<int, CControlCamera>::iterator		find_camera(const string name);
+
+		// one request line
+		void						execute_line(CControlClient& client, const string line);
+		// answers and events of a camera thread
+		void						handle_replies(int camera_index);
+		// snapshot request: the encoded frame, NULL and the reason if there
+		// is none
+		shared_ptr<CCamFrame>		snapshot(const string line, string& error);
+
+		// queue a line (tag in front) / an image, the client is marked
+		// broken on socket error
+		void						send_line(CControlClient& client, const string tag, const string line);
+		void						send_frame(CControlClient& client, const string tag, shared_ptr<CCamFrame> camframe);
+		// send as much as possible without blocking, false on socket error
+		bool						flush_client(CControlClient& client);
+		void						drop_client(int client_socket);
+		void						drop_broken_clients();
 };
 
 template <int queue_length>
 CControlServer<queue_length>::CControlServer(int port, const string name) : CServer<CControlServer<queue_length>, queue_length>(port, name){
+	this->codec			= NULL;
+	this->next_serial	= 1;
+	this->next_command	= 1;
+	// command timeouts are tested in on_poll
+	this->poll_timeout	= CONTROL_POLL_TIMEOUT_MS;
 	cout	<< "CControlServer constructed" << endl;
 }
 
+template <int queue_length>
+CControlServer<queue_length>::~CControlServer(){
+	while(clients.empty() == false){
+		drop_client(clients.begin()->first);
+	}
+	delete	codec;
+}
 
+template <int queue_length>
+void CControlServer<queue_length>::add_camera(int camera_index, const string name, CLatestFrame* latest, CCameraControl* control){
+	CControlCamera		camera;
+	camera.name			= name;
+	camera.latest		= latest;
+	camera.control		= control;
+	cameras[camera_index]	= camera;
+}
 
 template <int queue_length>
-void CControlServer<queue_length>::main(){
-	uint8_t 	recv_buffer[CONTR_BUFFER_SIZE] 		= {0};
+typename map<int, CControlCamera>::iterator CControlServer<queue_length>::find_camera(const string name){
+	for(auto item = cameras.begin(); item != cameras.end(); item++){
+		if(name == item->second.name or name == to_string(item->first)){
+			return	item;
+		}
+	}
+	return	cameras.end();
+}
 
-	bool		restart_status						= true;
 
-	int 		socket_status;
-	socklen_t	socket_status_size					= sizeof(socket_status);
+/*************************************************/
+// Event loop
+/*************************************************/
+// answers of the camera threads wake up the event loop
+template <int queue_length>
+void CControlServer<queue_length>::on_start(){
+	for(auto& item : cameras){
+		this->watch_client(item.second.control->get_notify_fd(), false);
+	}
+}
 
-	while(true){
-		// send command promt	
-		cout << "control server main" << endl;
+template <int queue_length>
+void CControlServer<queue_length>::on_connect(int client_socket, const string client_ip){
 
-		//const string	welcome	= "camserver>";
-		//send(this->client_socket, welcome.data(), welcome.length(), 0);
+	// all socket operations are non-blocking from now on
+	int	flags	= fcntl(client_socket, F_GETFL, 0);
+	fcntl(client_socket, F_SETFL, flags | O_NONBLOCK);
 
+	CControlClient		client;
+	client.socket		= client_socket;
+	client.ip			= client_ip;
+	client.serial		= next_serial++;
+	client.sent_bytes	= 0;
+	client.queued_bytes	= 0;
+	client.want_write	= false;
+	client.broken		= false;
+	clients[client_socket]	= client;
+
+	this->watch_client(client_socket, false);
+}
+
+template <int queue_length>
+void CControlServer<queue_length>::on_readable(int client_socket){
+
+	for(auto& item : cameras){
+		CCameraControl*		control	= item.second.control;
+		if(client_socket == control->get_notify_fd()){
+			// clear first, such that no notification gets lost
+			control->clear_notify();
+			handle_replies(item.first);
+			return;
+		}
+	}
+
+	auto	item	= clients.find(client_socket);
+	if(item == clients.end()){
+		return;
+	}
+	CControlClient&		client	= item->second;
+
+	char		recv_buffer[CONTR_BUFFER_SIZE];
+	ssize_t		receive_count	= recv(client_socket, recv_buffer, sizeof(recv_buffer), MSG_DONTWAIT);
+	if(receive_count == 0){
+		drop_client(client_socket);
+		return;
+	}else if(receive_count < 0){
+		if(errno != EAGAIN and errno != EWOULDBLOCK and errno != EINTR){
+			drop_client(client_socket);
+		}
+		return;
+	}
+	client.input.append(recv_buffer, receive_count);
+
+	// complete lines
+	size_t		end;
+	while((end = client.input.find('\n')) != string::npos){
+		string	line	= client.input.substr(0, end);
+		client.input.erase(0, end + 1);
+		if(line.empty() == false and line.back() == '\r'){
+			line.pop_back();
+		}
+		execute_line(client, line);
+		if(client.broken == true){
+			break;
+		}
+	}
+	if(client.input.length() > CONTR_BUFFER_SIZE){
+		client.input.clear();
+		send_line(client, "", string(CAM_CONTROL_ERROR) + " line too long");
+	}
+	drop_broken_clients();
+}
+
+template <int queue_length>
+void CControlServer<queue_length>::on_writable(int client_socket){
+	auto	item	= clients.find(client_socket);
+	if(item != clients.end() and flush_client(item->second) == false){
+		drop_client(client_socket);
+	}
+}
+
+template <int queue_length>
+void CControlServer<queue_length>::on_hangup(int client_socket){
+	drop_client(client_socket);
+}
+
+// commands the camera threads didn't answer in time
+template <int queue_length>
+void CControlServer<queue_length>::on_poll(){
+
+	time_point<steady_clock>	current_time	= steady_clock::now();
+	for(auto item = pending.begin(); item != pending.end();){
+		if(current_time < item->second.deadline){
+			item++;
+			continue;
+		}
+		auto	client	= clients.find(item->second.client_socket);
+		if(client != clients.end() and client->second.serial == item->second.client_serial){
+			send_line(client->second, item->second.tag, string(CAM_CONTROL_ERROR) + " timeout");
+		}
+		item	= pending.erase(item);
+	}
+	drop_broken_clients();
+}
+
+
+/*************************************************/
+// Requests
+/*************************************************/
+template <int queue_length>
+void CControlServer<queue_length>::execute_line(CControlClient& client, const string line){
 
-		/*****************************************************/
-		// read message from remote client
-		/*****************************************************/
-		int	buffer_pos		= 0;
-		while(true){
-			this_thread::sleep_for(10ms);
-			int		client_socket	= ((CServer<CControlServer<queue_length>, queue_length>*)this)->get_client_socket();
+	stringstream	line_stream(line);
+	string			tag;
+	string			command;
+	line_stream		>> command;
+	if(command.empty() == false and command[0] == '#'){
+		tag		= command;
+		command.clear();
+		line_stream		>> command;
+	}
+	if(command.empty() == true){
+		return;
+	}
+	vector<string>	args;
+	string			word;
+	while(line_stream >> word){
+		args.push_back(word);
+	}
+	cout << "CControlServer: " << client.ip << " " << line << endl;
 
-			// test if we are still running
-			int	status	= this->get_status();
-			if(status != SERVER_STATUS_RUNNING){
+	if(command == "cameras"){
+		string	answer	= string(CAM_CONTROL_OK) + " " + to_string(cameras.size());
+		for(auto& item : cameras){
+			answer	+= " " + to_string(item.first) + ":" + item.second.name + ":" + camera_state_name(item.second.control->get_state());
+		}
+		send_line(client, tag, answer);
+
+	}else if(command == CAM_CONTROL_SNAPSHOT){
+		// the request without the tag
+		string					request		= command;
+		for(string& arg : args){
+			request		+= " " + arg;
+		}
+		// tested first: a client that doesn't read costs no copy / encoding
+		if(client.queued_bytes > CONTROL_MAX_OUTPUT){
+			send_line(client, tag, string(CAM_CONTROL_ERROR) + " output queue full");
+			return;
+		}
+		string					error;
+		shared_ptr<CCamFrame>	camframe	= snapshot(request, error);
+		if(camframe == NULL){
+			send_line(client, tag, string(CAM_CONTROL_ERROR) + " " + error);
+		}else{
+			send_frame(client, tag, camframe);
+		}
+
+	}else if(command == "subscribe" or command == "unsubscribe"){
+		vector<int>		indices;
+		for(string& name : args){
+			if(name == "all"){
+				for(auto& item : cameras){
+					indices.push_back(item.first);
+				}
+				continue;
+			}
+			auto	camera	= find_camera(name);
+			if(camera == cameras.end()){
+				send_line(client, tag, string(CAM_CONTROL_ERROR) + " unknown camera " + name);
 				return;
 			}
-			
-			// read from the server
-			ssize_t receive_count	= 0;
-			receive_count			= recv(client_socket, &recv_buffer[buffer_pos], CONTR_BUFFER_SIZE-buffer_pos, MSG_DONTWAIT);
-			if(receive_count > 0){
-				cout << "received: " << receive_count << endl;
-				buffer_pos	+= (receive_count-1);
-				if(recv_buffer[buffer_pos] == '\n'){
-					recv_buffer[buffer_pos] = 0;
-					break;
+			indices.push_back(camera->first);
+		}
+		for(int index : indices){
+			if(command == "subscribe"){
+				client.subscriptions.insert(index);
+			}else{
+				client.subscriptions.erase(index);
+			}
+		}
+		send_line(client, tag, string(CAM_CONTROL_OK) + " " + to_string(client.subscriptions.size()));
+
+	}else if(command == "get" or command == "set" or command == "start" or command == "stop" or command == "stats"){
+		size_t	arg_count	= command == "get" ? 2 : command == "set" ? 3 : 1;
+		if(args.size() != arg_count){
+			send_line(client, tag, string(CAM_CONTROL_ERROR) + " " + command + " needs " + to_string(arg_count) + " argument(s)");
+			return;
+		}
+		auto	camera	= find_camera(args[0]);
+		if(camera == cameras.end()){
+			send_line(client, tag, string(CAM_CONTROL_ERROR) + " unknown camera " + args[0]);
+			return;
+		}
+		// answered by the camera thread
+		CControlCommand		request;
+		request.id			= next_command++;
+		request.name		= command;
+		request.args.assign(args.begin() + 1, args.end());
+
+		CControlPending		waiting;
+		waiting.client_serial	= client.serial;
+		waiting.client_socket	= client.socket;
+		waiting.tag				= tag;
+		waiting.deadline		= steady_clock::now() + milliseconds(CONTROL_COMMAND_TIMEOUT_MS);
+		pending[request.id]		= waiting;
+		camera->second.control->push(request);
+
+	}else{
+		send_line(client, tag, string(CAM_CONTROL_ERROR) + " unknown command " + command);
+	}
+}
+
+/*************************************************/
+// Answers of a camera thread
+/*************************************************/
+template <int queue_length>
+void CControlServer<queue_length>::handle_replies(int camera_index){
+
+	CCameraControl*		control		= cameras[camera_index].control;
+	CControlReply		reply;
+	while(control->pop_reply(reply) == true){
+		// event: to the subscribers
+		if(reply.id == 0){
+			for(auto& item : clients){
+				if(item.second.subscriptions.count(camera_index) > 0){
+					send_line(item.second, "", string(CAM_CONTROL_EVENT) + " " + to_string(camera_index) + " " + reply.text);
 				}
-			}// received new data
-		}// receive command loop
-
-		/*****************************************************/
-		// send message to remote client
-		/*****************************************************/
-		while(true){
-			this_thread::sleep_for(10ms);
-			int		client_socket	= ((CServer<CControlServer<queue_length>, queue_length>*)this)->get_client_socket();
-
-			// test if we are still running
-			int	status	= this->get_status();
-			if(status != SERVER_STATUS_RUNNING){
-				return;
 			}
-			
-			// test socket status
-			//getsockopt(client_socket, SOL_SOCKET, SO_ERROR, &socket_status, &socket_status_size);
-			//cout	<< "socket: " << socket_status << endl;
-			//sleep(1);
-			
-			// test if we got a message from main to send to remote client
-			string	message		= buffer_to_string((char*)recv_buffer, buffer_pos) + "\n";
+			continue;
+		}
+		// answer: the client may be gone, or the command timed out
+		auto	waiting	= pending.find(reply.id);
+		if(waiting == pending.end()){
+			continue;
+		}
+		auto	client	= clients.find(waiting->second.client_socket);
+		if(client != clients.end() and client->second.serial == waiting->second.client_serial){
+			string	text	= string(reply.ok ? CAM_CONTROL_OK : CAM_CONTROL_ERROR) + (reply.text.empty() ? "" : " " + reply.text);
+			send_line(client->second, waiting->second.tag, text);
+		}
+		pending.erase(waiting);
+	}
+	drop_broken_clients();
+}
 
-			send(client_socket, message.data(), message.length(), 0);
+/*********************
+ * Snapshot
+ *********************/
+// "snapshot <camera> [raw|packed|tile] [preview <n>]", camera: index or id
+template <int queue_length>
+shared_ptr<CCamFrame> CControlServer<queue_length>::snapshot(const string line, string& error){
 
-			break;
+	stringstream	line_stream(line);
+	string			command;
+	string			camera_name;
+	line_stream		>> command >> camera_name;
+
+	auto	camera	= find_camera(camera_name);
+	if(camera == cameras.end()){
+		error	= "unknown camera " + camera_name;
+		return	NULL;
+	}
+
+	CStreamOptions		options;
+	options.encoding	= ENCODING_RAW;
+	options.threshold	= SPARSE_DEFAULT_THRESHOLD;
+	options.geometry	= GEOMETRY_FULL;
+	string				word;
+	while(line_stream >> word){
+		if(word == "raw"){
+			options.encoding	= ENCODING_RAW;
+		}else if(word == "packed"){
+			options.encoding	= ENCODING_PACKED;
+		}else if(word == "tile"){
+			options.encoding	= ENCODING_TILE;
+		}else if(word == "preview"){
+			// the factor is required, a preview is never the full frame
+			int		factor	= 0;
+			if(not (line_stream >> factor) or factor < 1 or factor > PREVIEW_MAX_FACTOR){
+				error	= "invalid preview factor";
+				return	NULL;
+			}
+			options.geometry.preview	= factor;
+		}else{
+			error	= "unknown option " + word;
+			return	NULL;
+		}
+	}
+
+	shared_ptr<CFrameSlot>	slot	= camera->second.latest->get();
+	if(slot == NULL){
+		error	= "no frame from camera " + camera->second.name;
+		return	NULL;
+	}
+	// a frame of its own: the ring slot goes back at once (previews are one)
+	shared_ptr<CFrameSlot>	frame	= make_shared<CFrameSlot>();
+	if(options.geometry.is_full() == false){
+		if(apply_geometry(*slot, options.geometry, *frame) == false){
+			error	= "preview not supported for this frame";
+			return	NULL;
+		}
+	}else{
+		frame->data.assign(slot->data.begin(), slot->data.begin() + slot->buffer_size);
+		frame->buffer_size		= slot->buffer_size;
+		frame->width			= slot->width;
+		frame->height			= slot->height;
+		frame->offset_x			= slot->offset_x;
+		frame->offset_y			= slot->offset_y;
+		frame->pixel_format		= slot->pixel_format;
+		frame->time_stamp		= slot->time_stamp;
+		frame->frame_id			= slot->frame_id;
+		frame->settings			= slot->settings;
+	}
+	slot.reset();
+	if(options.encoding == ENCODING_TILE and codec == NULL){
+		codec	= new CTileCodec(TILE_CODEC_WORKER_THREADS);
+	}
+	return	make_shared<CCamFrame>(frame, camera->first, options, codec);
+}
+
+/*************************************************/
+// Output
+/*************************************************/
+template <int queue_length>
+void CControlServer<queue_length>::send_line(CControlClient& client, const string tag, const string line){
+	if(client.broken == true){
+		return;
+	}
+	CControlOutput		output;
+	output.text			= (tag.empty() ? "" : tag + " ") + line + "\n";
+	client.queued_bytes	+= output.text.length();
+	client.output.push_back(output);
+	client.broken		= flush_client(client) == false;
+}
+
+// "snapshot <camera> <length>", then the FRAME message: the image is sent
+// from the encoded frame (a copy of the ring slot, see snapshot)
+template <int queue_length>
+void CControlServer<queue_length>::send_frame(CControlClient& client, const string tag, shared_ptr<CCamFrame> camframe){
+	if(client.broken == true){
+		return;
+	}
+	CControlOutput		output;
+	output.text			= (tag.empty() ? "" : tag + " ") + CAM_CONTROL_SNAPSHOT + " " + to_string(camframe->stream_id) + " " + to_string(camframe->header_length + camframe->buffer_size) + "\n";
+	output.text.append((const char*)camframe->header, camframe->header_length);
+	output.frame		= camframe;
+	client.queued_bytes	+= output.text.length() + camframe->buffer_size;
+	client.output.push_back(output);
+	cout << "CControlServer: snapshot of camera " << camframe->stream_id << ", frame " << camframe->frame_id << ", " << camframe->buffer_size << " bytes" << endl;
+	client.broken		= flush_client(client) == false;
+}
+
+template <int queue_length>
+bool CControlServer<queue_length>::flush_client(CControlClient& client){
+
+	while(client.output.empty() == false){
+		CControlOutput&		output	= client.output.front();
+		size_t				length	= output.text.length() + (output.frame != NULL ? output.frame->buffer_size : 0);
+
+		// text first, then the image
+		const uint8_t*		data;
+		size_t				remaining;
+		if(client.sent_bytes < output.text.length()){
+			data		= (const uint8_t*)output.text.data() + client.sent_bytes;
+			remaining	= output.text.length() - client.sent_bytes;
+		}else{
+			size_t		offset	= client.sent_bytes - output.text.length();
+			data		= output.frame->data + offset;
+			remaining	= output.frame->buffer_size - offset;
 		}
 
-		
-	}//main loop
+		ssize_t		count	= send(client.socket, data, remaining, MSG_NOSIGNAL);
+		if(count < 0){
+			if(errno == EAGAIN or errno == EWOULDBLOCK){
+				// continue when the socket gets writable
+				if(client.want_write == false){
+					client.want_write	= true;
+					this->watch_client(client.socket, true);
+				}
+				return	true;
+			}
+			if(errno == EINTR){
+				continue;
+			}
+			perror("CControlServer send error");
+			return	false;
+		}
+		client.sent_bytes	+= count;
+		if(client.sent_bytes == length){
+			client.queued_bytes	-= length;
+			client.sent_bytes	= 0;
+			client.output.pop_front();
+		}
+	}
+	if(client.want_write == true){
+		client.want_write	= false;
+		this->watch_client(client.socket, false);
+	}
+	return	true;
+}
+
+template <int queue_length>
+void CControlServer<queue_length>::drop_client(int client_socket){
+
+	auto	item	= clients.find(client_socket);
+	if(item == clients.end()){
+		return;
+	}
+	cout << "=== " << this->get_server_name() << " closed " << item->second.ip << " ===" << endl;
+
+	this->unwatch_client(client_socket);
+	close(client_socket);
+	// answers still on their way are dropped (serial)
+	clients.erase(item);
+}
+
+template <int queue_length>
+void CControlServer<queue_length>::drop_broken_clients(){
+	vector<int>		broken_clients;
+	for(auto& item : clients){
+		if(item.second.broken == true){
+			broken_clients.push_back(item.first);
+		}
+	}
+	for(int client_socket : broken_clients){
+		drop_client(client_socket);
+	}
 }
 
 #endif
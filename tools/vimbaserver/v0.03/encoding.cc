@@ -0,0 +1,347 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include <string.h>
+
+#include "encoding.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	ENCODING_X86
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define	ENCODING_NEON
+#endif
+
+/*
+ * Bit packing (PFNC Mono10p / Mono12p): the pixels form a little-endian bit
+ * stream, i.e. 4 Mono10 pixels are the 40-bit word p0 | p1<<10 | p2<<20 |
+ * p3<<30 and 2 Mono12 pixels are the 24-bit word p0 | p1<<12.
+ *
+ * All SIMD kernels work the same way: pairs of pixels are merged in 32-bit
+ * lanes, then (Mono10) pairs of pairs in 64-bit lanes, and the lanes are
+ * written with overlapping stores. The kernels stop early enough that the
+ * overlapping stores never write past the end of the output, the rest is
+ * done by the scalar code.
+ */
+
+/*****************************************************************************/
+// pixel format information
+/*****************************************************************************/
+int		pixel_format_bits(uint32_t pixel_format){
+
+	switch(pixel_format){
+		case	PIXEL_FORMAT_MONO8:		return	8;
+		case	PIXEL_FORMAT_MONO10:	return	10;
+		case	PIXEL_FORMAT_MONO12:	return	12;
+		case	PIXEL_FORMAT_MONO14:	return	14;
+		case	PIXEL_FORMAT_MONO16:	return	16;
+		case	PIXEL_FORMAT_MONO10P:	return	10;
+		case	PIXEL_FORMAT_MONO12P:	return	12;
+	}
+	return	0;
+}
+
+int		pixel_format_bytes(uint32_t pixel_format){
+
+	switch(pixel_format){
+		case	PIXEL_FORMAT_MONO8:		return	1;
+		case	PIXEL_FORMAT_MONO10:
+		case	PIXEL_FORMAT_MONO12:
+		case	PIXEL_FORMAT_MONO14:
+		case	PIXEL_FORMAT_MONO16:
+		case	PIXEL_FORMAT_YUV422_8:	return	2;
+	}
+	return	0;
+}
+
+uint32_t	packed_pixel_format(uint32_t pixel_format){
+
+	switch(pixel_format){
+		case	PIXEL_FORMAT_MONO10:	return	PIXEL_FORMAT_MONO10P;
+		case	PIXEL_FORMAT_MONO12:	return	PIXEL_FORMAT_MONO12P;
+	}
+	return	0;
+}
+
+size_t	packed_size(size_t pixel_count, int bits){
+	return	(pixel_count * bits + 7) / 8;
+}
+
+/*****************************************************************************/
+// scalar kernels
+/*****************************************************************************/
+// packs the pixels [first, pixel_count), first must be a multiple of the
+// group size (4 for Mono10, 2 for Mono12)
+static void	pack_scalar(const uint16_t* src, uint8_t* dst, size_t first, size_t pixel_count, int bits){
+
+	uint32_t	mask		= (1u << bits) - 1;
+	uint64_t	bitbuffer	= 0;
+	int			bitcount	= 0;
+	size_t		out			= first * bits / 8;
+
+	for(size_t i = first; i < pixel_count; i++){
+		bitbuffer	|= uint64_t(src[i] & mask) << bitcount;
+		bitcount	+= bits;
+		while(bitcount >= 8){
+			dst[out++]	= bitbuffer & 0xFF;
+			bitbuffer	>>= 8;
+			bitcount	-= 8;
+		}
+	}
+	if(bitcount > 0){
+		dst[out]	= bitbuffer & 0xFF;
+	}
+}
+
+static void	unpack_scalar(const uint8_t* src, uint16_t* dst, size_t pixel_count, int bits){
+
+	uint32_t	mask		= (1u << bits) - 1;
+	uint64_t	bitbuffer	= 0;
+	int			bitcount	= 0;
+	size_t		in			= 0;
+
+	for(size_t i = 0; i < pixel_count; i++){
+		while(bitcount < bits){
+			bitbuffer	|= uint64_t(src[in++]) << bitcount;
+			bitcount	+= 8;
+		}
+		dst[i]		= bitbuffer & mask;
+		bitbuffer	>>= bits;
+		bitcount	-= bits;
+	}
+}
+
+/*****************************************************************************/
+// x86 kernels
+/*****************************************************************************/
+#ifdef ENCODING_X86
+
+// Mono10, SSE2: 8 pixels -> 10 bytes
+static size_t	pack10_sse2(const uint16_t* src, uint8_t* dst, size_t pixel_count){
+
+	const __m128i	mask10		= _mm_set1_epi16(0x3FF);
+	const __m128i	mult		= _mm_set1_epi32(0x04000001);		// (1, 1024)
+	const __m128i	mask32		= _mm_set1_epi64x(0xFFFFFFFF);
+
+	size_t	i	= 0;
+	// the last store writes 8 bytes at offset 5
+	for(; i + 8 + 4 <= pixel_count; i += 8){
+		__m128i	p	= _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i)), mask10);
+		// 32-bit lanes: p0 | p1<<10
+		__m128i	q	= _mm_madd_epi16(p, mult);
+		// 64-bit lanes: q0 | q1<<20
+		__m128i	r	= _mm_or_si128(_mm_and_si128(q, mask32), _mm_slli_epi64(_mm_srli_epi64(q, 32), 20));
+
+		uint8_t*	out	= dst + i / 4 * 5;
+		_mm_storel_epi64((__m128i*)out, r);
+		_mm_storel_epi64((__m128i*)(out + 5), _mm_srli_si128(r, 8));
+	}
+	return	i;
+}
+
+// Mono12, SSE2: 8 pixels -> 12 bytes
+static size_t	pack12_sse2(const uint16_t* src, uint8_t* dst, size_t pixel_count){
+
+	const __m128i	mask12		= _mm_set1_epi16(0xFFF);
+	const __m128i	mult		= _mm_set1_epi32(0x10000001);		// (1, 4096)
+
+	size_t	i	= 0;
+	// the last store writes 4 bytes at offset 9
+	for(; i + 8 + 2 <= pixel_count; i += 8){
+		__m128i	p	= _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i)), mask12);
+		// 32-bit lanes: p0 | p1<<12
+		__m128i	q	= _mm_madd_epi16(p, mult);
+
+		uint8_t*	out	= dst + i / 2 * 3;
+		for(int lane = 0; lane < 4; lane++){
+			uint32_t	word	= _mm_cvtsi128_si32(q);
+			memcpy(out + 3*lane, &word, 4);
+			q					= _mm_srli_si128(q, 4);
+		}
+	}
+	return	i;
+}
+
+// Mono10, AVX2: 16 pixels -> 20 bytes
+__attribute__((target("avx2")))
+static size_t	pack10_avx2(const uint16_t* src, uint8_t* dst, size_t pixel_count){
+
+	const __m256i	mask10		= _mm256_set1_epi16(0x3FF);
+	const __m256i	mult		= _mm256_set1_epi32(0x04000001);
+	const __m256i	mask32		= _mm256_set1_epi64x(0xFFFFFFFF);
+	// compact the two 40-bit words of each 128-bit half into 10 bytes
+	const __m256i	compact		= _mm256_setr_epi8(0,1,2,3,4,8,9,10,11,12,-1,-1,-1,-1,-1,-1,
+												   0,1,2,3,4,8,9,10,11,12,-1,-1,-1,-1,-1,-1);
+
+	size_t	i	= 0;
+	// the last store writes 16 bytes at offset 10
+	for(; i + 16 + 8 <= pixel_count; i += 16){
+		__m256i	p	= _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(src + i)), mask10);
+		__m256i	q	= _mm256_madd_epi16(p, mult);
+		__m256i	r	= _mm256_or_si256(_mm256_and_si256(q, mask32), _mm256_slli_epi64(_mm256_srli_epi64(q, 32), 20));
+		r			= _mm256_shuffle_epi8(r, compact);
+
+		uint8_t*	out	= dst + i / 4 * 5;
+		_mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(r));
+		_mm_storeu_si128((__m128i*)(out + 10), _mm256_extracti128_si256(r, 1));
+	}
+	return	i;
+}
+
+// Mono12, AVX2: 16 pixels -> 24 bytes
+__attribute__((target("avx2")))
+static size_t	pack12_avx2(const uint16_t* src, uint8_t* dst, size_t pixel_count){
+
+	const __m256i	mask12		= _mm256_set1_epi16(0xFFF);
+	const __m256i	mult		= _mm256_set1_epi32(0x10000001);
+	// compact the four 24-bit words of each 128-bit half into 12 bytes
+	const __m256i	compact		= _mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+												   0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+
+	size_t	i	= 0;
+	// the last store writes 16 bytes at offset 12
+	for(; i + 16 + 6 <= pixel_count; i += 16){
+		__m256i	p	= _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(src + i)), mask12);
+		__m256i	q	= _mm256_madd_epi16(p, mult);
+		q			= _mm256_shuffle_epi8(q, compact);
+
+		uint8_t*	out	= dst + i / 2 * 3;
+		_mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(q));
+		_mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(q, 1));
+	}
+	return	i;
+}
+
+#endif
+
+/*****************************************************************************/
+// ARM kernels
+/*****************************************************************************/
+#ifdef ENCODING_NEON
+
+// Mono10, NEON: 8 pixels -> 10 bytes
+static size_t	pack10_neon(const uint16_t* src, uint8_t* dst, size_t pixel_count){
+
+	const uint16x8_t	mask10	= vdupq_n_u16(0x3FF);
+	const uint32x4_t	mask16	= vdupq_n_u32(0xFFFF);
+	const uint64x2_t	mask32	= vdupq_n_u64(0xFFFFFFFF);
+
+	size_t	i	= 0;
+	for(; i + 8 + 4 <= pixel_count; i += 8){
+		uint16x8_t	p	= vandq_u16(vld1q_u16(src + i), mask10);
+		// 32-bit lanes: p0 | p1<<10
+		uint32x4_t	x	= vreinterpretq_u32_u16(p);
+		uint32x4_t	q	= vorrq_u32(vandq_u32(x, mask16), vshlq_n_u32(vshrq_n_u32(x, 16), 10));
+		// 64-bit lanes: q0 | q1<<20
+		uint64x2_t	y	= vreinterpretq_u64_u32(q);
+		uint64x2_t	r	= vorrq_u64(vandq_u64(y, mask32), vshlq_n_u64(vshrq_n_u64(y, 32), 20));
+
+		uint8_t*	out	= dst + i / 4 * 5;
+		vst1_u8(out, vreinterpret_u8_u64(vget_low_u64(r)));
+		vst1_u8(out + 5, vreinterpret_u8_u64(vget_high_u64(r)));
+	}
+	return	i;
+}
+
+// Mono12, NEON: 8 pixels -> 12 bytes
+static size_t	pack12_neon(const uint16_t* src, uint8_t* dst, size_t pixel_count){
+
+	const uint16x8_t	mask12	= vdupq_n_u16(0xFFF);
+	const uint32x4_t	mask16	= vdupq_n_u32(0xFFFF);
+	// compact the four 24-bit words into 12 bytes
+	const uint8_t		compact_table[16]	= {0,1,2,4,5,6,8,9,10,12,13,14,255,255,255,255};
+	const uint8x16_t	compact	= vld1q_u8(compact_table);
+
+	size_t	i	= 0;
+	for(; i + 8 <= pixel_count; i += 8){
+		uint16x8_t	p	= vandq_u16(vld1q_u16(src + i), mask12);
+		uint32x4_t	x	= vreinterpretq_u32_u16(p);
+		uint32x4_t	q	= vorrq_u32(vandq_u32(x, mask16), vshlq_n_u32(vshrq_n_u32(x, 16), 12));
+		uint8x16_t	r	= vqtbl1q_u8(vreinterpretq_u8_u32(q), compact);
+
+		uint8_t*	out	= dst + i / 2 * 3;
+		vst1_u8(out, vget_low_u8(r));
+		uint32_t	word	= vgetq_lane_u32(vreinterpretq_u32_u8(r), 2);
+		memcpy(out + 8, &word, 4);
+	}
+	return	i;
+}
+
+#endif
+
+/*****************************************************************************/
+// pack
+/*****************************************************************************/
+void	pack_pixels(const uint16_t* src, uint8_t* dst, size_t pixel_count, int bits){
+
+	size_t	done	= 0;
+
+#ifdef ENCODING_X86
+	static const bool	have_avx2	= __builtin_cpu_supports("avx2");
+	if(bits == 10){
+		done	= have_avx2 ? pack10_avx2(src, dst, pixel_count) : pack10_sse2(src, dst, pixel_count);
+	}else if(bits == 12){
+		done	= have_avx2 ? pack12_avx2(src, dst, pixel_count) : pack12_sse2(src, dst, pixel_count);
+	}
+#endif
+#ifdef ENCODING_NEON
+	if(bits == 10){
+		done	= pack10_neon(src, dst, pixel_count);
+	}else if(bits == 12){
+		done	= pack12_neon(src, dst, pixel_count);
+	}
+#endif
+
+	pack_scalar(src, dst, done, pixel_count, bits);
+}
+
+/*****************************************************************************/
+// unpack
+/*****************************************************************************/
+void	unpack_pixels(const uint8_t* src, uint16_t* dst, size_t pixel_count, int bits){
+
+	size_t	i	= 0;
+
+	// fast path: one 64-bit load per group of pixels, stop before the load
+	// could read past the end
+	if(bits == 10){
+		for(; i + 4 <= pixel_count and (i / 4 * 5 + 8) <= packed_size(pixel_count, bits); i += 4){
+			uint64_t	word;
+			memcpy(&word, src + i / 4 * 5, 8);
+			dst[i+0]	= (word >>  0) & 0x3FF;
+			dst[i+1]	= (word >> 10) & 0x3FF;
+			dst[i+2]	= (word >> 20) & 0x3FF;
+			dst[i+3]	= (word >> 30) & 0x3FF;
+		}
+	}else if(bits == 12){
+		for(; i + 2 <= pixel_count and (i / 2 * 3 + 4) <= packed_size(pixel_count, bits); i += 2){
+			uint32_t	word;
+			memcpy(&word, src + i / 2 * 3, 4);
+			dst[i+0]	= (word >>  0) & 0xFFF;
+			dst[i+1]	= (word >> 12) & 0xFFF;
+		}
+	}
+
+	unpack_scalar(src + i * bits / 8, dst + i, pixel_count - i, bits);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,80 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __ENCODING_H__
+#define __ENCODING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*****************************************************************************/
+// Pixel formats (GenICam PFNC, as used by vimba)
+/*****************************************************************************/
+#define	PIXEL_FORMAT_MONO8			0x01080001
+#define	PIXEL_FORMAT_MONO10			0x01100003
+#define	PIXEL_FORMAT_MONO12			0x01100005
+#define	PIXEL_FORMAT_MONO14			0x01100025
+#define	PIXEL_FORMAT_MONO16			0x01100007
+
+// bit-packed, LSB first: Mono10p 4 pixels in 5 bytes, Mono12p 2 in 3 bytes
+#define	PIXEL_FORMAT_MONO10P		0x010A0046
+#define	PIXEL_FORMAT_MONO12P		0x010C0047
+
+// colour and compressed images of USB cameras (v4l2_source.h), always sent
+// raw: YUYV (PFNC YUV422_8), custom: a JPEG image per frame (MJPEG)
+#define	PIXEL_FORMAT_YUV422_8		0x02100032
+#define	PIXEL_FORMAT_MJPEG			0x80000004
+
+// custom (bit 31 set): compressed frame message, see tile_codec.h
+#define	PIXEL_FORMAT_TILE_CODEC		0x80000001
+// custom: pixels above threshold, see sparse.h
+#define	PIXEL_FORMAT_SPARSE			0x80000002
+// custom: difference to an acknowledged frame, see tile_codec.h
+#define	PIXEL_FORMAT_DELTA			0x80000003
+
+/*****************************************************************************/
+// Wire encodings (per client)
+/*****************************************************************************/
+#define	ENCODING_RAW				0		// as delivered by the camera
+#define	ENCODING_PACKED				1		// Mono10/Mono12 bit-packed
+#define	ENCODING_TILE				2		// lossless tile compression
+#define	ENCODING_SPARSE				3		// pixels above threshold
+#define	ENCODING_DELTA				4		// difference to the acknowledged frame
+
+
+// bits per pixel of the valid data, 0 if the format is unknown
+int		pixel_format_bits(uint32_t pixel_format);
+
+// bytes per pixel of an image, 0 for bit-packed and compressed formats
+int		pixel_format_bytes(uint32_t pixel_format);
+
+// bit-packed counterpart of an unpacked format, 0 if there is none
+uint32_t	packed_pixel_format(uint32_t pixel_format);
+
+// number of bytes of "pixel_count" packed pixels
+size_t	packed_size(size_t pixel_count, int bits);
+
+// packs 16-bit pixels (bits = 10 or 12), dst needs packed_size() bytes.
+// Uses AVX2/SSE2 or NEON if available.
+void	pack_pixels(const uint16_t* src, uint8_t* dst, size_t pixel_count, int bits);
+
+// unpacks to 16-bit pixels
+void	unpack_pixels(const uint8_t* src, uint16_t* dst, size_t pixel_count, int bits);
+
+/*****************************************************************************/
+#endif
@@ -0,0 +1,105 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+
+#include	"frame_feed.h"
+
+#include	<errno.h>
+#include	<stdio.h>
+#include	<unistd.h>
+#include	<sys/eventfd.h>
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CFrameFeed::CFrameFeed(int length){
+
+	this->length			= length;
+	this->overwritten		= 0;
+
+	this->notify_pending	= false;
+	this->notify_fd			= eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(this->notify_fd < 0){
+		perror("CFrameFeed eventfd failed");
+		throw -1;
+	}
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CFrameFeed::~CFrameFeed(){
+	close(notify_fd);
+}
+
+/*****************************************************************************/
+// writer: add a slot
+/*****************************************************************************/
+void CFrameFeed::push(shared_ptr<CFrameSlot> slot){
+
+	{
+		lock_guard<mutex>	lock(feed_mutex);
+		if(int(slots.size()) >= length){
+			// the oldest frame goes back to the ring
+			slots.pop_front();
+			overwritten++;
+		}
+		slots.push_back(slot);
+	}
+
+	// wake up the reader
+	if(notify_pending.exchange(true) == false){
+		uint64_t	one		= 1;
+		if(write(notify_fd, &one, sizeof(one)) < 0){
+			perror("CFrameFeed notify failed");
+		}
+	}
+}
+
+/*****************************************************************************/
+// reader: clear the notification
+/*****************************************************************************/
+void CFrameFeed::clear_notify(){
+
+	uint64_t	count;
+	notify_pending	= false;
+	if(read(notify_fd, &count, sizeof(count)) < 0 and errno != EAGAIN){
+		perror("CFrameFeed clear notify failed");
+	}
+}
+
+/*****************************************************************************/
+// reader: take the oldest slot
+/*****************************************************************************/
+shared_ptr<CFrameSlot> CFrameFeed::pop(){
+
+	lock_guard<mutex>	lock(feed_mutex);
+	if(slots.empty() == true){
+		return	NULL;
+	}
+	shared_ptr<CFrameSlot>	slot	= slots.front();
+	slots.pop_front();
+	return	slot;
+}
+
+/*****************************************************************************/
+// statistics
+/*****************************************************************************/
+uint64_t CFrameFeed::get_overwritten(){
+	return	overwritten;
+}
@@ -0,0 +1,83 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+#ifndef __FRAME_FEED_H__
+#define __FRAME_FEED_H__
+
+#include <stdint.h>
+
+// multi-threading
+#include <mutex>
+#include <atomic>
+
+// containers
+#include <deque>
+#include <memory>
+
+// frame slots, CFrameSource
+#include "frame_ring.h"
+
+
+using namespace std;
+
+/*****************************************************************************/
+// CFrameFeed
+/*****************************************************************************/
+//
+//	hands the slots taken from a camera ring on to another server thread
+//	(the multiplexed stream server) without copying: the slot goes back to
+//	the ring when both servers are done with it.
+//
+//	The feed is short, a reader that doesn't keep up loses the oldest
+//	frames (overwritten) instead of holding the ring.
+//
+class	CFrameFeed : public CFrameSource{
+
+	public:
+	// constructor
+	CFrameFeed(int length);
+	// destructor
+	~CFrameFeed();
+
+	// writer: adds a slot, replaces the oldest one if the feed is full
+	void					push(shared_ptr<CFrameSlot> slot);
+
+	// reader: see CFrameSource
+	shared_ptr<CFrameSlot>	pop();
+	int						get_notify_fd()			{ return notify_fd; };
+	void					clear_notify();
+
+	// statistics
+	uint64_t				get_overwritten();
+	uint64_t				get_dropped()			{ return 0; };
+	int						get_slot_count()		{ return length; };
+
+	private:
+	int						length;
+
+	mutex					feed_mutex;
+	deque<shared_ptr<CFrameSlot>>	slots;
+
+	atomic<uint64_t>		overwritten;
+
+	// wakes up the reader, only written once until it is cleared
+	int						notify_fd;
+	atomic<bool>			notify_pending;
+};
+/*****************************************************************************/
+#endif
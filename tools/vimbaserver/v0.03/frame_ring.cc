@@ -0,0 +1,190 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+
+#include	"frame_ring.h"
+
+#include	<errno.h>
+#include	<unistd.h>
+#include	<sys/eventfd.h>
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CFrameRing::CFrameRing(int slot_count) : slots(slot_count), free_slots(slot_count), ready_slots(slot_count){
+
+	this->slot_count	= slot_count;
+	this->written		= 0;
+	this->overwritten	= 0;
+	this->dropped		= 0;
+
+	for(int i = 0; i < slot_count; i++){
+		free_slots.push(i);
+	}
+
+	this->notify_pending	= false;
+	this->notify_fd			= eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(this->notify_fd < 0){
+		perror("CFrameRing eventfd failed");
+		throw -1;
+	}
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CFrameRing::~CFrameRing(){
+	close(notify_fd);
+}
+
+/*****************************************************************************/
+// preallocate the slots
+/*****************************************************************************/
+//
+// called before the camera starts writing. Slots which are currently being
+// sent are resized by the writer if needed.
+//
+void CFrameRing::allocate(size_t payload_size){
+
+	vector<int>		free_list;
+	int				index;
+
+	while(free_slots.try_pop(index) == true){
+		slots[index].data.resize(payload_size);
+		free_list.push_back(index);
+	}
+	for(int i : free_list){
+		free_slots.push(i);
+	}
+}
+
+/*****************************************************************************/
+// writer: get a free slot
+/*****************************************************************************/
+CFrameSlot* CFrameRing::begin_write(size_t buffer_size){
+
+	int		index	= -1;
+
+	if(free_slots.try_pop(index) == false){
+		if(ready_slots.try_pop(index) == true){
+			// the sender is behind: reuse the oldest frame that wasn't taken yet
+			overwritten++;
+		}else{
+			// all slots are being sent
+			dropped++;
+			return	NULL;
+		}
+	}
+
+	// only the writer touches the slot now
+	CFrameSlot*		slot	= &slots[index];
+	if(slot->data.size() < buffer_size){
+		slot->data.resize(buffer_size);
+	}
+	slot->buffer_size	= buffer_size;
+	return	slot;
+}
+
+/*****************************************************************************/
+// writer: slot is filled
+/*****************************************************************************/
+void CFrameRing::commit_write(CFrameSlot* slot){
+
+	ready_slots.push(slot_index(slot));
+	written++;
+
+	// wake up the reader
+	if(notify_pending.exchange(true) == false){
+		uint64_t	one		= 1;
+		if(write(notify_fd, &one, sizeof(one)) < 0){
+			perror("CFrameRing notify failed");
+		}
+	}
+}
+
+/*****************************************************************************/
+// reader: clear the notification
+/*****************************************************************************/
+void CFrameRing::clear_notify(){
+
+	uint64_t	count;
+	notify_pending	= false;
+	if(read(notify_fd, &count, sizeof(count)) < 0 and errno != EAGAIN){
+		perror("CFrameRing clear notify failed");
+	}
+}
+
+/*****************************************************************************/
+// reader: take the oldest filled slot
+/*****************************************************************************/
+shared_ptr<CFrameSlot> CFrameRing::pop(){
+
+	int		index;
+	if(ready_slots.try_pop(index) == false){
+		return	shared_ptr<CFrameSlot>();
+	}
+	return	take(index);
+}
+
+shared_ptr<CFrameSlot> CFrameRing::pop_wait(chrono::microseconds timeout){
+
+	int		index;
+	if(ready_slots.pop_wait(index, timeout) == false){
+		return	shared_ptr<CFrameSlot>();
+	}
+	return	take(index);
+}
+
+/*****************************************************************************/
+// hand out a slot
+/*****************************************************************************/
+// give the slot back to the ring when the last reference is gone
+shared_ptr<CFrameSlot> CFrameRing::take(int index){
+	return	shared_ptr<CFrameSlot>(&slots[index], [this, index](CFrameSlot*){ this->release(index); });
+}
+
+/*****************************************************************************/
+// return a slot
+/*****************************************************************************/
+void CFrameRing::release(int index){
+	free_slots.push(index);
+}
+
+/*****************************************************************************/
+// slot pointer to index
+/*****************************************************************************/
+int CFrameRing::slot_index(CFrameSlot* slot){
+	return	int(slot - &slots[0]);
+}
+
+/*****************************************************************************/
+// statistics
+/*****************************************************************************/
+uint64_t CFrameRing::get_written(){
+	return	written.load();
+}
+
+uint64_t CFrameRing::get_overwritten(){
+	return	overwritten.load();
+}
+
+uint64_t CFrameRing::get_dropped(){
+	return	dropped.load();
+}
+
+/*****************************************************************************/
@@ -0,0 +1,166 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+#ifndef __FRAME_RING_H__
+#define __FRAME_RING_H__
+
+#include <stdint.h>
+
+// multi-threading
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// containers
+#include <vector>
+#include <deque>
+#include <memory>
+
+// lock-free queues
+#include "queue.h"
+
+
+using namespace std;
+
+/*****************************************************************************/
+// CFrameSlot
+/*****************************************************************************/
+//
+//	one preallocated image buffer of the ring plus the frame information
+//	that is needed to send it
+//
+class	CFrameSlot{
+
+	public:
+	// image data, buffer_size bytes are valid
+	vector<uint8_t>		data;
+	uint32_t			buffer_size;
+
+	uint32_t			width;
+	uint32_t			height;
+	uint32_t			offset_x;
+	uint32_t			offset_y;
+	uint32_t			pixel_format;
+
+	uint64_t			time_stamp;
+	uint64_t			frame_id;
+	// generation of the camera settings (camera_control.h)
+	uint32_t			settings;
+};
+
+/*****************************************************************************/
+// CFrameSource
+/*****************************************************************************/
+//
+//	what a camera server reads its frames from: the ring filled by the camera
+//	callback, or a feed of slots handed on by another server (frame_feed.h)
+//
+class	CFrameSource{
+
+	public:
+	virtual ~CFrameSource(){};
+
+	// takes the oldest frame, NULL if there is none
+	virtual shared_ptr<CFrameSlot>	pop() = 0;
+
+	// readable when new frames arrived, call clear_notify() before taking
+	// the frames
+	virtual int						get_notify_fd() = 0;
+	virtual void					clear_notify() = 0;
+
+	// frames lost before they were taken
+	virtual uint64_t				get_overwritten() = 0;
+	virtual uint64_t				get_dropped() = 0;
+	// frames the source can hold
+	virtual int						get_slot_count() = 0;
+};
+
+/*****************************************************************************/
+// CFrameRing
+/*****************************************************************************/
+//
+//	server-owned ring of frame slots. The camera callback copies every frame
+//	into a free slot and gives the vimba frame back to the camera at once,
+//	the camera server takes the slots in order and sends them. 
+//
+//	If the sender is too slow, the writer overwrites the oldest frame that
+//	hasn't been taken yet (overwritten). If all slots are being sent, the new
+//	frame is lost (dropped).
+//
+//	Free and filled slot indices are kept in lock-free queues, nobody has to
+//	poll: the reader either sleeps in pop_wait or watches get_notify_fd()
+//	(an eventfd) in its event loop.
+//
+
+class	CFrameRing : public CFrameSource{
+
+	public:
+	// constructor
+	CFrameRing(int slot_count);
+	// destructor
+	~CFrameRing();
+
+	// preallocate all free slots for the given payload size
+	void					allocate(size_t payload_size);
+
+	// writer: get a slot to fill, NULL if none is available
+	CFrameSlot*				begin_write(size_t buffer_size);
+
+	// writer: the slot is filled and can be sent
+	void					commit_write(CFrameSlot* slot);
+
+	// reader: takes the oldest filled slot, NULL if there is none. The slot
+	// is returned to the ring when the last shared_ptr is gone.
+	shared_ptr<CFrameSlot>	pop();
+
+	// reader: as pop, but waits for a frame until the timeout is over
+	shared_ptr<CFrameSlot>	pop_wait(chrono::microseconds timeout);
+
+	// reader: readable when new frames were committed, call clear_notify()
+	// before taking the frames
+	int						get_notify_fd()			{ return notify_fd; };
+	void					clear_notify();
+
+	// statistics
+	uint64_t				get_written();
+	uint64_t				get_overwritten();
+	uint64_t				get_dropped();
+	int						get_slot_count()		{ return slot_count; };
+
+	private:
+	int						slot_count;
+	vector<CFrameSlot>		slots;
+
+	// indices of free slots and of filled slots (oldest first)
+	CMPMCQueue<int>			free_slots;
+	CMPMCQueue<int>			ready_slots;
+
+	atomic<uint64_t>		written;
+	atomic<uint64_t>		overwritten;
+	atomic<uint64_t>		dropped;
+
+	// wakes up the reader, only written once until it is cleared
+	int						notify_fd;
+	atomic<bool>			notify_pending;
+
+	int						slot_index(CFrameSlot* slot);
+	shared_ptr<CFrameSlot>	take(int index);
+	void					release(int index);
+};
+/*****************************************************************************/
+#endif
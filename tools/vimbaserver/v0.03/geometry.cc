@@ -0,0 +1,402 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include <string.h>
+
+#include "geometry.h"
+#include "encoding.h"
+#include "preview.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	GEOMETRY_X86
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define	GEOMETRY_NEON
+#endif
+
+/*
+ * The SIMD kernels handle the common 16 bit cases, decimation by 2 and 2x2
+ * binning, for the leading part of every row; the scalar code does the rest
+ * of the row and all other factors.
+ *
+ * x86 has no unsigned 32 -> 16 bit pack before SSE4.1: the 32-bit lanes
+ * (at most 0xFFFF) are sign-extended from bit 15 first, then the signed
+ * pack keeps their bit pattern.
+ */
+
+/*****************************************************************************/
+// scalar kernels
+/*****************************************************************************/
+// every n-th pixel of one row, starting at pixel "first" of the output
+template <typename T>
+static void	decimate_row(const T* src, T* dst, size_t first, size_t width, uint32_t n){
+	for(size_t x = first; x < width; x++){
+		dst[x]	= src[x * n];
+	}
+}
+
+// average of n x n blocks for one output row, starting at pixel "first"
+template <typename T>
+static void	bin_row(const T* src, size_t stride, T* dst, size_t first, size_t width, uint32_t n){
+	uint32_t	half	= n * n / 2;
+	for(size_t x = first; x < width; x++){
+		uint32_t	sum		= 0;
+		for(uint32_t dy = 0; dy < n; dy++){
+			const T*	row	= src + dy * stride + x * n;
+			for(uint32_t dx = 0; dx < n; dx++){
+				sum		+= row[dx];
+			}
+		}
+		dst[x]	= T((sum + half) / (n * n));
+	}
+}
+
+/*****************************************************************************/
+// x86 kernels
+/*****************************************************************************/
+#ifdef GEOMETRY_X86
+
+// 32-bit lanes (<= 0xFFFF) of a and b -> 8 x 16 bit
+static inline __m128i	pack_lanes_sse2(__m128i a, __m128i b){
+	a	= _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+	b	= _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+	return	_mm_packs_epi32(a, b);
+}
+
+// sum of the pixel pairs of a row in 32-bit lanes
+static inline __m128i	pair_sum_sse2(__m128i v){
+	return	_mm_add_epi32(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(v, 16));
+}
+
+// decimation by 2: 16 pixels -> 8
+static size_t	decimate2_sse2(const uint16_t* src, uint16_t* dst, size_t width){
+	size_t	x	= 0;
+	for(; x + 8 <= width; x += 8){
+		__m128i	a	= _mm_loadu_si128((const __m128i*)(src + 2*x));
+		__m128i	b	= _mm_loadu_si128((const __m128i*)(src + 2*x + 8));
+		_mm_storeu_si128((__m128i*)(dst + x), pack_lanes_sse2(a, b));
+	}
+	return	x;
+}
+
+// 2x2 binning: 2 rows of 16 pixels -> 8
+static size_t	bin2_sse2(const uint16_t* src, size_t stride, uint16_t* dst, size_t width){
+	const __m128i	round	= _mm_set1_epi32(2);
+	size_t	x	= 0;
+	for(; x + 8 <= width; x += 8){
+		const uint16_t*	top		= src + 2*x;
+		const uint16_t*	bottom	= top + stride;
+		__m128i	s0	= _mm_add_epi32(pair_sum_sse2(_mm_loadu_si128((const __m128i*)top)), pair_sum_sse2(_mm_loadu_si128((const __m128i*)bottom)));
+		__m128i	s1	= _mm_add_epi32(pair_sum_sse2(_mm_loadu_si128((const __m128i*)(top + 8))), pair_sum_sse2(_mm_loadu_si128((const __m128i*)(bottom + 8))));
+		s0			= _mm_srli_epi32(_mm_add_epi32(s0, round), 2);
+		s1			= _mm_srli_epi32(_mm_add_epi32(s1, round), 2);
+		_mm_storeu_si128((__m128i*)(dst + x), pack_lanes_sse2(s0, s1));
+	}
+	return	x;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i	pack_lanes_avx2(__m256i a, __m256i b){
+	a	= _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+	b	= _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+	// the pack works per 128-bit half
+	return	_mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i	pair_sum_avx2(__m256i v){
+	return	_mm256_add_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xFFFF)), _mm256_srli_epi32(v, 16));
+}
+
+// decimation by 2: 32 pixels -> 16
+__attribute__((target("avx2")))
+static size_t	decimate2_avx2(const uint16_t* src, uint16_t* dst, size_t width){
+	size_t	x	= 0;
+	for(; x + 16 <= width; x += 16){
+		__m256i	a	= _mm256_loadu_si256((const __m256i*)(src + 2*x));
+		__m256i	b	= _mm256_loadu_si256((const __m256i*)(src + 2*x + 16));
+		_mm256_storeu_si256((__m256i*)(dst + x), pack_lanes_avx2(a, b));
+	}
+	return	x;
+}
+
+// 2x2 binning: 2 rows of 32 pixels -> 16
+__attribute__((target("avx2")))
+static size_t	bin2_avx2(const uint16_t* src, size_t stride, uint16_t* dst, size_t width){
+	const __m256i	round	= _mm256_set1_epi32(2);
+	size_t	x	= 0;
+	for(; x + 16 <= width; x += 16){
+		const uint16_t*	top		= src + 2*x;
+		const uint16_t*	bottom	= top + stride;
+		__m256i	s0	= _mm256_add_epi32(pair_sum_avx2(_mm256_loadu_si256((const __m256i*)top)), pair_sum_avx2(_mm256_loadu_si256((const __m256i*)bottom)));
+		__m256i	s1	= _mm256_add_epi32(pair_sum_avx2(_mm256_loadu_si256((const __m256i*)(top + 16))), pair_sum_avx2(_mm256_loadu_si256((const __m256i*)(bottom + 16))));
+		s0			= _mm256_srli_epi32(_mm256_add_epi32(s0, round), 2);
+		s1			= _mm256_srli_epi32(_mm256_add_epi32(s1, round), 2);
+		_mm256_storeu_si256((__m256i*)(dst + x), pack_lanes_avx2(s0, s1));
+	}
+	return	x;
+}
+
+#endif
+
+/*****************************************************************************/
+// ARM kernels
+/*****************************************************************************/
+#ifdef GEOMETRY_NEON
+
+// decimation by 2: 16 pixels -> 8
+static size_t	decimate2_neon(const uint16_t* src, uint16_t* dst, size_t width){
+	size_t	x	= 0;
+	for(; x + 8 <= width; x += 8){
+		uint16x8x2_t	v	= vld2q_u16(src + 2*x);
+		vst1q_u16(dst + x, v.val[0]);
+	}
+	return	x;
+}
+
+// 2x2 binning: 2 rows of 16 pixels -> 8, rounding narrow (sum + 2) >> 2
+static size_t	bin2_neon(const uint16_t* src, size_t stride, uint16_t* dst, size_t width){
+	size_t	x	= 0;
+	for(; x + 8 <= width; x += 8){
+		const uint16_t*	top		= src + 2*x;
+		const uint16_t*	bottom	= top + stride;
+		uint32x4_t	s0	= vaddq_u32(vpaddlq_u16(vld1q_u16(top)), vpaddlq_u16(vld1q_u16(bottom)));
+		uint32x4_t	s1	= vaddq_u32(vpaddlq_u16(vld1q_u16(top + 8)), vpaddlq_u16(vld1q_u16(bottom + 8)));
+		vst1q_u16(dst + x, vcombine_u16(vrshrn_n_u32(s0, 2), vrshrn_n_u32(s1, 2)));
+	}
+	return	x;
+}
+
+#endif
+
+/*****************************************************************************/
+// one row, SIMD where available
+/*****************************************************************************/
+template <typename T>
+static void	decimate_row_fast(const T* src, T* dst, size_t width, uint32_t n){
+	decimate_row(src, dst, 0, width, n);
+}
+
+template <>
+void	decimate_row_fast(const uint16_t* src, uint16_t* dst, size_t width, uint32_t n){
+	// the kernels read pixel pairs, leave the last pixel of an odd row to
+	// the scalar code
+	size_t	done	= 0;
+	if(n == 2 and width > 1){
+#ifdef GEOMETRY_X86
+		static const bool	have_avx2	= __builtin_cpu_supports("avx2");
+		done	= have_avx2 ? decimate2_avx2(src, dst, width - 1) : decimate2_sse2(src, dst, width - 1);
+#endif
+#ifdef GEOMETRY_NEON
+		done	= decimate2_neon(src, dst, width - 1);
+#endif
+	}
+	decimate_row(src, dst, done, width, n);
+}
+
+template <typename T>
+static void	bin_row_fast(const T* src, size_t stride, T* dst, size_t width, uint32_t n){
+	bin_row(src, stride, dst, 0, width, n);
+}
+
+template <>
+void	bin_row_fast(const uint16_t* src, size_t stride, uint16_t* dst, size_t width, uint32_t n){
+	size_t	done	= 0;
+	if(n == 2){
+#ifdef GEOMETRY_X86
+		static const bool	have_avx2	= __builtin_cpu_supports("avx2");
+		done	= have_avx2 ? bin2_avx2(src, stride, dst, width) : bin2_sse2(src, stride, dst, width);
+#endif
+#ifdef GEOMETRY_NEON
+		done	= bin2_neon(src, stride, dst, width);
+#endif
+	}
+	bin_row(src, stride, dst, done, width, n);
+}
+
+/*****************************************************************************/
+// whole image
+/*****************************************************************************/
+//
+// src points to the first ROI pixel, stride in pixels. Decimation and
+// binning: dst is packed (stride = output width).
+//
+template <typename T>
+static void	transform(const T* src, size_t stride, size_t width, size_t height, uint32_t decimation, uint32_t binning, T* dst, vector<T>& scratch){
+
+	// decimation into scratch (or dst if there is no binning)
+	if(decimation > 1){
+		size_t	out_width	= (width + decimation - 1) / decimation;
+		size_t	out_height	= (height + decimation - 1) / decimation;
+		T*		out			= binning > 1 ? (scratch.resize(out_width * out_height), scratch.data()) : dst;
+		for(size_t y = 0; y < out_height; y++){
+			decimate_row_fast(src + y * decimation * stride, out + y * out_width, out_width, decimation);
+		}
+		src			= out;
+		stride		= out_width;
+		width		= out_width;
+		height		= out_height;
+	}
+
+	if(binning > 1){
+		size_t	out_width	= width / binning;
+		size_t	out_height	= height / binning;
+		for(size_t y = 0; y < out_height; y++){
+			bin_row_fast(src + y * binning * stride, stride, dst + y * out_width, out_width, binning);
+		}
+	}else if(decimation <= 1){
+		// ROI only
+		for(size_t y = 0; y < height; y++){
+			memcpy(dst + y * width, src + y * stride, width * sizeof(T));
+		}
+	}
+}
+
+/*****************************************************************************/
+// preview
+/*****************************************************************************/
+//
+// the kernel reads the ROI in place, decimated or binned frames are cut
+// first
+//
+static bool	apply_preview(const CFrameSlot& source, const CGeometry& geometry, CFrameSlot& target){
+
+	CGeometry		cut			= geometry;
+	cut.preview					= 0;
+	CFrameSlot		scaled;
+	const CFrameSlot*	frame	= &source;
+	bool			in_place	= cut.decimation <= 1 and cut.binning <= 1;
+	if(in_place == false){
+		if(apply_geometry(source, cut, scaled) == false){
+			return	false;
+		}
+		frame	= &scaled;
+	}else if(geometry.roi_x >= source.width or geometry.roi_y >= source.height){
+		return	false;
+	}
+
+	int		bits	= pixel_format_bits(frame->pixel_format);
+	if(bits == 0 or frame->pixel_format == PIXEL_FORMAT_MONO10P or frame->pixel_format == PIXEL_FORMAT_MONO12P){
+		return	false;
+	}
+	int		bytes_per_pixel		= bits > 8 ? 2 : 1;
+	if(frame->buffer_size < size_t(frame->width) * frame->height * bytes_per_pixel){
+		return	false;
+	}
+
+	// in place: ROI of the source frame, clipped
+	uint32_t	x			= in_place ? geometry.roi_x : 0;
+	uint32_t	y			= in_place ? geometry.roi_y : 0;
+	uint32_t	width		= frame->width - x;
+	uint32_t	height		= frame->height - y;
+	if(in_place and geometry.roi_width != 0 and geometry.roi_width < width){
+		width		= geometry.roi_width;
+	}
+	if(in_place and geometry.roi_height != 0 and geometry.roi_height < height){
+		height		= geometry.roi_height;
+	}
+
+	uint32_t	n			= min<uint32_t>(geometry.preview, PREVIEW_MAX_FACTOR);
+	uint32_t	out_width	= width / n;
+	uint32_t	out_height	= height / n;
+	if(out_width == 0 or out_height == 0){
+		return	false;
+	}
+
+	target.width			= out_width;
+	target.height			= out_height;
+	target.offset_x			= frame->offset_x + x;
+	target.offset_y			= frame->offset_y + y;
+	target.pixel_format		= PIXEL_FORMAT_MONO8;
+	target.time_stamp		= frame->time_stamp;
+	target.frame_id			= frame->frame_id;
+	target.settings			= frame->settings;
+	target.buffer_size		= size_t(out_width) * out_height;
+	target.data.resize(target.buffer_size);
+
+	size_t		first		= size_t(y) * frame->width + x;
+	if(bytes_per_pixel == 1){
+		return	preview_downscale(frame->data.data() + first, frame->width, width, height, n, bits, target.data.data());
+	}
+	return	preview_downscale((const uint16_t*)frame->data.data() + first, frame->width, width, height, n, bits, target.data.data());
+}
+
+/*****************************************************************************/
+// entry point
+/*****************************************************************************/
+bool	apply_geometry(const CFrameSlot& source, const CGeometry& geometry, CFrameSlot& target){
+
+	if(geometry.preview > 0){
+		return	apply_preview(source, geometry, target);
+	}
+
+	int		bits	= pixel_format_bits(source.pixel_format);
+	if(bits == 0 or source.pixel_format == PIXEL_FORMAT_MONO10P or source.pixel_format == PIXEL_FORMAT_MONO12P){
+		return	false;
+	}
+	int		bytes_per_pixel		= bits > 8 ? 2 : 1;
+	if(source.buffer_size < size_t(source.width) * source.height * bytes_per_pixel){
+		return	false;
+	}
+
+	// ROI, clipped to the frame
+	if(geometry.roi_x >= source.width or geometry.roi_y >= source.height){
+		return	false;
+	}
+	uint32_t	width		= source.width - geometry.roi_x;
+	uint32_t	height		= source.height - geometry.roi_y;
+	if(geometry.roi_width != 0 and geometry.roi_width < width){
+		width		= geometry.roi_width;
+	}
+	if(geometry.roi_height != 0 and geometry.roi_height < height){
+		height		= geometry.roi_height;
+	}
+
+	uint32_t	decimation		= geometry.decimation > 1 ? geometry.decimation : 1;
+	uint32_t	binning			= geometry.binning > 1 ? geometry.binning : 1;
+	uint32_t	out_width		= (width + decimation - 1) / decimation / binning;
+	uint32_t	out_height		= (height + decimation - 1) / decimation / binning;
+	if(out_width == 0 or out_height == 0){
+		return	false;
+	}
+
+	target.width			= out_width;
+	target.height			= out_height;
+	target.offset_x			= source.offset_x + geometry.roi_x;
+	target.offset_y			= source.offset_y + geometry.roi_y;
+	target.pixel_format		= source.pixel_format;
+	target.time_stamp		= source.time_stamp;
+	target.frame_id			= source.frame_id;
+	target.settings			= source.settings;
+	target.buffer_size		= size_t(out_width) * out_height * bytes_per_pixel;
+	target.data.resize(target.buffer_size);
+
+	size_t		first		= size_t(geometry.roi_y) * source.width + geometry.roi_x;
+	if(bytes_per_pixel == 1){
+		vector<uint8_t>		scratch;
+		transform(source.data.data() + first, source.width, width, height, decimation, binning, target.data.data(), scratch);
+	}else{
+		vector<uint16_t>	scratch;
+		transform((const uint16_t*)source.data.data() + first, source.width, width, height, decimation, binning, (uint16_t*)target.data.data(), scratch);
+	}
+	return	true;
+}
@@ -0,0 +1,71 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __GEOMETRY_H__
+#define __GEOMETRY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <tuple>
+
+// frame slot
+#include "frame_ring.h"
+
+/*****************************************************************************/
+// CGeometry
+/*****************************************************************************/
+//
+//	part of the frame a client wants to see, applied in this order:
+//
+//	- ROI: roi_width/roi_height 0 means up to the edge of the frame
+//	- decimation: every n-th pixel of every n-th row
+//	- binning: average of n x n pixels, the pixel format is kept
+//	- preview: average of n x n pixels mapped to Mono8 (see preview.h),
+//	  0: off
+//
+//	The header offsets stay in camera pixels: offset of the frame plus the
+//	ROI origin.
+//
+struct CGeometry{
+	uint32_t				roi_x;
+	uint32_t				roi_y;
+	uint32_t				roi_width;
+	uint32_t				roi_height;
+	uint32_t				decimation;
+	uint32_t				binning;
+	uint32_t				preview;
+
+	bool	is_full() const{
+		return	roi_x == 0 and roi_y == 0 and roi_width == 0 and roi_height == 0 and decimation <= 1 and binning <= 1 and preview == 0;
+	};
+
+	bool	operator<(const CGeometry& other) const{
+		return	tie(roi_x, roi_y, roi_width, roi_height, decimation, binning, preview) < tie(other.roi_x, other.roi_y, other.roi_width, other.roi_height, other.decimation, other.binning, other.preview);
+	};
+};
+
+// full frame
+#define	GEOMETRY_FULL				{0, 0, 0, 0, 1, 1, 0}
+
+// fills target with the part of source given by geometry (Mono8..Mono16),
+// false if the format isn't supported or nothing is left
+bool	apply_geometry(const CFrameSlot& source, const CGeometry& geometry, CFrameSlot& target);
+
+/*****************************************************************************/
+#endif
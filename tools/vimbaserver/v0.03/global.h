@@ -26,14 +26,108 @@
 // port numbers
 #define 	DEFAULT_SERVER_PORT				42000
 
+// control server: a camera thread has ... ms to answer a command; clients
+// with more than ... bytes waiting get no more snapshots; timeouts are
+// tested every ... ms
+#define		CONTROL_COMMAND_TIMEOUT_MS		5000
+#define		CONTROL_MAX_OUTPUT				(64*1024*1024)
+#define		CONTROL_POLL_TIMEOUT_MS			100
+
 // number of frames in the queue
 #define		NUMBER_OF_FRAMES_IN_BUFFER 		10
 // maximum attempts
 #define		CAMERA_MAX_ATTEMPTS				5
+// the camera thread waits this long (s) after an error
+#define		CAMERA_ERROR_TIMEOUT_S			3
 
 // cam server queue length
 #define		CAM_SERVER_QUEUE_LENGTH			1
 
+// slots of the server frame ring
+#define		SERVER_RING_SLOTS				8
+
+// the camera thread waits this long (ms) for returned frames
+#define		FRAME_QUEUE_TIMEOUT_MS			100
+
+// frames queued per lossless client, a slower client holds back the ring
+#define		CAM_CLIENT_QUEUE_LENGTH			3
+
+// frames a held stream keeps back for its lossless clients (CCamStream): the
+// ring slots also hold the clients' queues, the UDP queue, and the camera
+// needs a free one
+#define		CAM_STREAM_BACKLOG_LENGTH		2
+
+// delivery policy of new clients (DELIVERY_LOSSLESS or DELIVERY_LATEST)
+#define		CAM_CLIENT_DELIVERY				DELIVERY_LOSSLESS
+
+// a lossless client that holds back the ring without progress is closed
+#define		CAM_CLIENT_STALL_TIMEOUT_S		10
+
+// TRANSMIT_MODE_COPY or TRANSMIT_MODE_ZEROCOPY, see transmit.h
+#define		CAM_SERVER_TRANSMIT_MODE		TRANSMIT_MODE_COPY
+
+// zero-copy: a dropped client keeps its socket until the kernel is done with
+// the frames, tested every ... ms, reset after ... s
+#define		CAM_CLIENT_CLOSE_POLL_MS		10
+#define		CAM_CLIENT_CLOSE_TIMEOUT_S		5
+
+// worker threads of the tile compression (the server thread helps as well)
+#define		TILE_CODEC_WORKER_THREADS		3
+
+// sparse encoding: default threshold above the pedestal (counts)
+#define		SPARSE_DEFAULT_THRESHOLD		32
+
+// delta encoding: a key frame at least every ... frames, sent frames kept
+// per client until they are acknowledged
+#define		DELTA_KEY_FRAME_INTERVAL		50
+#define		DELTA_MAX_PENDING				8
+
+// largest decimation / binning factor a client can ask for
+#define		CAM_CLIENT_MAX_FACTOR			16
+
+// preview of a stream ("subscribe <id> preview"): 8 bits, average of n x n
+// pixels, at most ... frames per second (options preview / preview_fps)
+#define		PREVIEW_DEFAULT_FACTOR			4
+#define		PREVIEW_DEFAULT_FPS				5
+
+// encodings offered to protocol clients, the first one both sides support
+// is used (raw otherwise). Only the cheap ones: tile and delta cost more CPU
+// than they save on a fast link, a client asks for them ("encoding tile"),
+// or the adaptive quality switches to tile while the link is too slow
+#define		CAM_SERVER_ENCODING_PREFERENCE	{ENCODING_PACKED}
+
+// idle protocol clients get a heartbeat every ... seconds
+#define		CAM_SERVER_HEARTBEAT_S			2
+
+// the cam server prints its statistics every ... seconds
+#define		CAM_SERVER_STATS_INTERVAL_S		10
+
+// multiplexed stream server (all cameras over one connection) on the
+// control port + ...; frames handed on per camera before the oldest are
+// overwritten
+#define		MUX_SERVER_PORT_OFFSET			100
+#define		FRAME_FEED_LENGTH				2
+
+// multiplexed clients: the streams take turns, each turn adds ... bytes to
+// the stream's budget (deficit round robin); frames are handed to the
+// connection while less than ... bytes are queued there
+#define		CAM_CLIENT_QUANTUM				(256*1024)
+#define		CAM_CLIENT_WIRE_BYTES			(1024*1024)
+
+// adaptive quality of new clients (option "adaptive on|off"): the quality is
+// lowered while frames need longer than ... ms to reach the client (option
+// "latency <ms>")
+#define		CAM_CLIENT_ADAPTIVE				true
+#define		CAM_CLIENT_TARGET_LATENCY_MS	200
+
+// UDP transport of a camera (<udp> in config.xml) without port: camera port
+// + ...
+#define		UDP_PORT_OFFSET					1000
+
+// shared-memory ring of a camera (<shm> in config.xml): slots, i.e. frames a
+// local reader may fall behind
+#define		SHM_RING_SLOTS					8
+
 
 /*****************************************************************************/ 
 #endif
@@ -0,0 +1,71 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+
+#include	"latest_frame.h"
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CLatestFrame::CLatestFrame(){
+	this->updates		= 0;
+	this->requests		= 0;
+}
+
+/*****************************************************************************/
+// camera server: new frame
+/*****************************************************************************/
+void CLatestFrame::update(shared_ptr<CFrameSlot> slot){
+
+	{
+		lock_guard<mutex>	lock(access_mutex);
+		this->slot.swap(slot);
+		updates++;
+	}
+	// the replaced frame goes back to the ring outside the lock
+}
+
+void CLatestFrame::clear(){
+
+	shared_ptr<CFrameSlot>	old;
+	lock_guard<mutex>		lock(access_mutex);
+	this->slot.swap(old);
+}
+
+/*****************************************************************************/
+// control server: take a reference
+/*****************************************************************************/
+shared_ptr<CFrameSlot> CLatestFrame::get(){
+
+	lock_guard<mutex>	lock(access_mutex);
+	requests++;
+	return	slot;
+}
+
+/*****************************************************************************/
+// statistics
+/*****************************************************************************/
+uint64_t CLatestFrame::get_updates(){
+	lock_guard<mutex>	lock(access_mutex);
+	return	updates;
+}
+
+uint64_t CLatestFrame::get_requests(){
+	lock_guard<mutex>	lock(access_mutex);
+	return	requests;
+}
@@ -0,0 +1,72 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/ 
+#ifndef __LATEST_FRAME_H__
+#define __LATEST_FRAME_H__
+
+#include <stdint.h>
+
+// multi-threading
+#include <mutex>
+
+#include <memory>
+
+// frame slots
+#include "frame_ring.h"
+
+
+using namespace std;
+
+/*****************************************************************************/
+// CLatestFrame
+/*****************************************************************************/
+//
+//	newest frame of a camera for snapshot requests on the control port. The
+//	camera server hands over every slot it takes from the ring (a reference,
+//	no copy) and the previous one goes back to the ring; the image is only
+//	encoded and copied when somebody asks for it.
+//
+//	The cache keeps one slot of the camera ring busy at any time.
+//
+class	CLatestFrame{
+
+	public:
+	// constructor
+	CLatestFrame();
+
+	// camera server: the new frame replaces the cached one
+	void					update(shared_ptr<CFrameSlot> slot);
+	// the frame won't be valid any more (camera closed)
+	void					clear();
+
+	// control server: the newest frame, NULL if there is none
+	shared_ptr<CFrameSlot>	get();
+
+	// statistics
+	uint64_t				get_updates();
+	uint64_t				get_requests();
+
+	private:
+	mutex					access_mutex;
+	shared_ptr<CFrameSlot>	slot;
+
+	uint64_t				updates;
+	uint64_t				requests;
+};
+/*****************************************************************************/
+#endif
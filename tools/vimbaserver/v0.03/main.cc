@@ -89,8 +89,21 @@ mutex		CVimba::access_mutex;
 /*****************************************************************************/
 #include "server.h"
 #include "ctr_server.h"
+#include "camserver.h"
+
+// slots handed from the camera servers to the multiplexed server
+#include "frame_feed.h"
+// newest frame of each camera for snapshot requests
+#include "latest_frame.h"
+// commands from the control server to the camera threads
+#include "camera_control.h"
+
+// uplink shared by all camera servers, see config.xml
+#include "bandwidth.h"
+CBandwidthScheduler		global_bandwidth;
 
 using 		CMyControlServer	= CControlServer<10>;
+using 		CMyMuxServer		= CCamServer<CAM_SERVER_QUEUE_LENGTH>;
 
 
 
@@ -102,10 +115,69 @@ pugi::xml_document 			xmlconfig;
 mutex						xmlconfig_mutex;
 
 
+/*****************************************************************************/
+// camera sources
+/*****************************************************************************/
+#include "camera_source.h"
+#include "vimba_source.h"
+#include "synthetic_source.h"
+#include "v4l2_source.h"
+// pixel formats
+#include "encoding.h"
+
+// <camera source="..."> of config.xml: vimba (default), synthetic or v4l2
+CCameraSource*	create_camera_source(string cameraID, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log){
+
+	lock_guard<mutex>	lock(xmlconfig_mutex);
+	for (pugi::xml_node xmlcamera : xmlconfig.child("config").children("camera"))
+	{
+		if(cameraID != xmlcamera.attribute("id").as_string()){
+			continue;
+		}
+		string	source		= xmlcamera.attribute("source").as_string("vimba");
+		if(source == "vimba"){
+			return	new CVimbaSource(cameraID, framering, settings, control, log);
+		}
+		if(source == "synthetic"){
+			pugi::xml_node		xmlsynthetic	= xmlcamera.child("synthetic");
+			CSyntheticConfig	config;
+			string				format			= xmlsynthetic.attribute("format").as_string("Mono12");
+			config.width		= xmlsynthetic.attribute("width").as_uint(config.width);
+			config.height		= xmlsynthetic.attribute("height").as_uint(config.height);
+			config.pixel_format	= format == "Mono8" ? PIXEL_FORMAT_MONO8 : format == "Mono10" ? PIXEL_FORMAT_MONO10 : format == "Mono16" ? PIXEL_FORMAT_MONO16 : PIXEL_FORMAT_MONO12;
+			config.fps			= xmlsynthetic.attribute("fps").as_double(config.fps);
+			config.jitter_us	= xmlsynthetic.attribute("jitter_us").as_double(config.jitter_us);
+			config.drop			= xmlsynthetic.attribute("drop").as_double(config.drop);
+			config.spots		= xmlsynthetic.attribute("spots").as_int(config.spots);
+			config.sigma		= xmlsynthetic.attribute("sigma").as_double(config.sigma);
+			config.amplitude	= xmlsynthetic.attribute("amplitude").as_double(config.amplitude);
+			config.wander		= xmlsynthetic.attribute("wander").as_double(config.wander);
+			config.noise		= xmlsynthetic.attribute("noise").as_double(config.noise);
+			return	new CSyntheticSource(config, framering, settings, control, log);
+		}
+		if(source == "v4l2"){
+			pugi::xml_node		xmlv4l2			= xmlcamera.child("v4l2");
+			CV4L2Config			config;
+			config.device		= xmlv4l2.attribute("device").as_string(config.device.c_str());
+			config.usb_id		= xmlv4l2.attribute("usb_id").as_string(config.usb_id.c_str());
+			config.width		= xmlv4l2.attribute("width").as_uint(config.width);
+			config.height		= xmlv4l2.attribute("height").as_uint(config.height);
+			config.format		= xmlv4l2.attribute("format").as_string(config.format.c_str());
+			config.fps			= xmlv4l2.attribute("fps").as_double(config.fps);
+			config.buffers		= xmlv4l2.attribute("buffers").as_int(config.buffers);
+			return	new CV4L2Source(cameraID, config, framering, settings, control, log);
+		}
+		log << "unknown camera source: " << source << endl;
+		return	NULL;
+	}
+	// not in the config file (never happens, the camera list comes from it)
+	return	new CVimbaSource(cameraID, framering, settings, control, log);
+}
+
 /*****************************************************************************/
 // main
 /*****************************************************************************/
-void	camera_streaming_main(string cameraID, int server_port);
+void	camera_streaming_main(string cameraID, int server_port, int stream_id, CFrameFeed* feed, CLatestFrame* latest, CCameraControl* control);
 
 int main(int argc, char const *argv[]){
 	
@@ -170,9 +242,21 @@ int main(int argc, char const *argv[]){
 	{
 		string	camID		= camera.attribute("id").as_string();
 		camID_list.push_back(camID);
-		cout << i << " camera id: " << camID << endl;
+		cout << i << " camera id: " << camID << " (" << camera.attribute("source").as_string("vimba") << ")" << endl;
+
+		// share of the uplink: weight, minimum and maximum rate (Mbit/s)
+		pugi::xml_node	stream	= camera.child("stream");
+		double	weight		= stream.attribute("weight").as_double(1.0);
+		double	min_mbit	= stream.attribute("min_mbit").as_double(0.0);
+		double	max_mbit	= stream.attribute("max_mbit").as_double(0.0);
+		global_bandwidth.add_stream(i, camID, weight, min_mbit * 1e6 / 8, max_mbit * 1e6 / 8);
+		cout << "  weight " << weight << " min " << min_mbit << " Mbit/s max " << max_mbit << " Mbit/s" << endl;
 		i++;
 	}
+	// 0 or missing: measured only
+	double	link_mbit		= xmlconfig.child("config").child("link").attribute("rate_mbit").as_double(0.0);
+	global_bandwidth.set_link_rate(link_mbit * 1e6 / 8);
+	cout << "uplink: " << link_mbit << " Mbit/s" << endl;
 	cout << endl;	
 	xmlconfig_mutex.unlock();
 	/***********************************************/
@@ -194,12 +278,38 @@ int main(int argc, char const *argv[]){
 	// servers
 	const string			ctrlname			= "CTRL_SERV";
 	CMyControlServer*		ctrlserv			= new CMyControlServer(control_port, ctrlname);
+	// snapshots: the camera servers keep the newest frame; other requests
+	// go to the camera threads
+	vector<CLatestFrame*>	latest_list;
+	vector<CCameraControl*>	control_list;
+	for (int camera_index = 0; camera_index < camID_list.size(); camera_index++){
+		latest_list.push_back(new CLatestFrame());
+		control_list.push_back(new CCameraControl());
+		ctrlserv->add_camera(camera_index, camID_list[camera_index], latest_list[camera_index], control_list[camera_index]);
+	}
 	// start the thread
 	thread					ctrlserv_thread(&CMyControlServer::execute, ctrlserv);
 
 
 
 
+	/*****************************************************************/
+	// multiplexed server: all cameras over one connection
+	/*****************************************************************/	
+	cout << endl;
+	cout << "===== stream server =====" << endl;
+	int						mux_port			= control_port + MUX_SERVER_PORT_OFFSET;
+	CMyMuxServer*			muxserv				= new CMyMuxServer(mux_port, "MUX_SERV");
+	muxserv->set_bandwidth(&global_bandwidth);
+	vector<CFrameFeed*>		feed_list;
+	for (int camera_index = 0; camera_index < camID_list.size(); camera_index++){
+		feed_list.push_back(new CFrameFeed(FRAME_FEED_LENGTH));
+		muxserv->add_stream(camera_index, camID_list[camera_index], feed_list[camera_index]);
+	}
+	cout << "Stream server port: " << mux_port << endl;
+	thread					muxserv_thread(&CMyMuxServer::execute, muxserv);
+
+
 	/*****************************************************************/
 	// start the camera threads
 	/*****************************************************************/	
@@ -209,7 +319,7 @@ int main(int argc, char const *argv[]){
 	vector<thread>	thread_list;
 		
 	for (int camera_index = 0; camera_index < camID_list.size(); camera_index++){
-		thread		newthread(camera_streaming_main, camID_list[camera_index], control_port + camera_index + 1);
+		thread		newthread(camera_streaming_main, camID_list[camera_index], control_port + camera_index + 1, camera_index, feed_list[camera_index], latest_list[camera_index], control_list[camera_index]);
 		thread_list.push_back(move(newthread));
 	}
 
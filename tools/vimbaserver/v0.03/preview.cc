@@ -0,0 +1,186 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "preview.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	PREVIEW_X86
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define	PREVIEW_NEON
+#endif
+
+using namespace std;
+
+/*****************************************************************************/
+// lookup tables
+/*****************************************************************************/
+// all depths at once, on the first call
+struct	CPreviewTables{
+	vector<uint8_t>		tables[17];
+
+	CPreviewTables(){
+		for(int bits = 8; bits <= 16; bits++){
+			size_t		size	= size_t(1) << bits;
+			tables[bits].resize(size);
+			for(size_t value = 0; value < size; value++){
+				double	level	= pow(double(value) / (size - 1), 1.0 / PREVIEW_GAMMA);
+				tables[bits][value]	= uint8_t(level * 255 + 0.5);
+			}
+		}
+	};
+};
+
+const uint8_t*	preview_lut(int bits){
+	static const CPreviewTables		lut;
+	if(bits < 8 or bits > 16){
+		return	NULL;
+	}
+	return	lut.tables[bits].data();
+}
+
+/*****************************************************************************/
+// row sums
+/*****************************************************************************/
+// sum[x] += row[x], starting at pixel "first"
+template <typename T>
+static void	add_row(const T* row, uint32_t* sum, size_t first, size_t width){
+	for(size_t x = first; x < width; x++){
+		sum[x]	+= row[x];
+	}
+}
+
+#ifdef PREVIEW_X86
+
+// 8 pixels per step
+static size_t	add_row_sse2(const uint16_t* row, uint32_t* sum, size_t width){
+	const __m128i	zero	= _mm_setzero_si128();
+	size_t	x	= 0;
+	for(; x + 8 <= width; x += 8){
+		__m128i	v	= _mm_loadu_si128((const __m128i*)(row + x));
+		__m128i	lo	= _mm_loadu_si128((const __m128i*)(sum + x));
+		__m128i	hi	= _mm_loadu_si128((const __m128i*)(sum + x + 4));
+		_mm_storeu_si128((__m128i*)(sum + x), _mm_add_epi32(lo, _mm_unpacklo_epi16(v, zero)));
+		_mm_storeu_si128((__m128i*)(sum + x + 4), _mm_add_epi32(hi, _mm_unpackhi_epi16(v, zero)));
+	}
+	return	x;
+}
+
+// 16 pixels per step
+__attribute__((target("avx2")))
+static size_t	add_row_avx2(const uint16_t* row, uint32_t* sum, size_t width){
+	size_t	x	= 0;
+	for(; x + 16 <= width; x += 16){
+		__m256i	lo	= _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(row + x)));
+		__m256i	hi	= _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(row + x + 8)));
+		_mm256_storeu_si256((__m256i*)(sum + x), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum + x)), lo));
+		_mm256_storeu_si256((__m256i*)(sum + x + 8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum + x + 8)), hi));
+	}
+	return	x;
+}
+
+#endif
+
+#ifdef PREVIEW_NEON
+
+// 8 pixels per step, widening add
+static size_t	add_row_neon(const uint16_t* row, uint32_t* sum, size_t width){
+	size_t	x	= 0;
+	for(; x + 8 <= width; x += 8){
+		uint16x8_t	v	= vld1q_u16(row + x);
+		vst1q_u32(sum + x, vaddw_u16(vld1q_u32(sum + x), vget_low_u16(v)));
+		vst1q_u32(sum + x + 4, vaddw_u16(vld1q_u32(sum + x + 4), vget_high_u16(v)));
+	}
+	return	x;
+}
+
+#endif
+
+template <typename T>
+static void	add_row_fast(const T* row, uint32_t* sum, size_t width){
+	add_row(row, sum, 0, width);
+}
+
+template <>
+void	add_row_fast(const uint16_t* row, uint32_t* sum, size_t width){
+	size_t	done	= 0;
+#ifdef PREVIEW_X86
+	static const bool	have_avx2	= __builtin_cpu_supports("avx2");
+	done	= have_avx2 ? add_row_avx2(row, sum, width) : add_row_sse2(row, sum, width);
+#endif
+#ifdef PREVIEW_NEON
+	done	= add_row_neon(row, sum, width);
+#endif
+	add_row(row, sum, done, width);
+}
+
+/*****************************************************************************/
+// whole image
+/*****************************************************************************/
+template <typename T>
+static bool	downscale(const T* src, size_t stride, size_t width, size_t height, uint32_t n, int bits, uint8_t* dst){
+
+	const uint8_t*	lut		= preview_lut(bits);
+	if(lut == NULL or n == 0){
+		return	false;
+	}
+	// pixels beyond the depth are clipped
+	uint32_t	max_value	= (1u << bits) - 1;
+
+	size_t		out_width	= width / n;
+	size_t		out_height	= height / n;
+	size_t		used		= out_width * n;
+	uint32_t	count		= n * n;
+	uint32_t	half		= count / 2;
+	vector<uint32_t>	sum(used);
+
+	for(size_t y = 0; y < out_height; y++){
+		memset(sum.data(), 0, used * sizeof(uint32_t));
+		for(uint32_t dy = 0; dy < n; dy++){
+			add_row_fast(src + (y * n + dy) * stride, sum.data(), used);
+		}
+		uint8_t*		out		= dst + y * out_width;
+		const uint32_t*	block	= sum.data();
+		for(size_t x = 0; x < out_width; x++, block += n){
+			uint32_t	total	= 0;
+			for(uint32_t dx = 0; dx < n; dx++){
+				total	+= block[dx];
+			}
+			out[x]		= lut[min((total + half) / count, max_value)];
+		}
+	}
+	return	true;
+}
+
+bool	preview_downscale(const uint8_t* src, size_t stride, size_t width, size_t height, uint32_t n, int bits, uint8_t* dst){
+	return	downscale(src, stride, width, height, n, bits, dst);
+}
+
+bool	preview_downscale(const uint16_t* src, size_t stride, size_t width, size_t height, uint32_t n, int bits, uint8_t* dst){
+	return	downscale(src, stride, width, height, n, bits, dst);
+}
@@ -0,0 +1,52 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __PREVIEW_H__
+#define __PREVIEW_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*****************************************************************************/
+// Preview
+/*****************************************************************************/
+//
+//	a small 8-bit image for viewers: the average of n x n pixels, mapped to
+//	Mono8 by a lookup table of the source bit depth. The table applies a
+//	display gamma, such that faint parts of the beam stay visible.
+//
+//	The n rows of a block are summed up with SIMD (SSE2/AVX2, NEON) into one
+//	row of 32-bit sums, which is then reduced and looked up per output pixel.
+//
+
+// 1.0: linear
+#define	PREVIEW_GAMMA				2.2
+// largest factor
+#define	PREVIEW_MAX_FACTOR			32
+
+// table of 1 << bits entries (bits 8..16), NULL for other depths
+const uint8_t*	preview_lut(int bits);
+
+// src: first pixel, stride in pixels, bits: depth of the valid data; the
+// output is (width / n) x (height / n) pixels, packed. Incomplete blocks at
+// the edges are left out. False if the depth isn't supported.
+bool	preview_downscale(const uint8_t* src, size_t stride, size_t width, size_t height, uint32_t n, int bits, uint8_t* dst);
+bool	preview_downscale(const uint16_t* src, size_t stride, size_t width, size_t height, uint32_t n, int bits, uint8_t* dst);
+
+/*****************************************************************************/
+#endif
@@ -0,0 +1,178 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#include <stdint.h>
+
+#include "encoding.h"
+
+/*****************************************************************************/
+// Stream protocol
+/*****************************************************************************/
+//
+//	handshake: the client starts with the preamble "CAMS", version (u16),
+//	0 (u16) and a HELLO message. The server answers with its own preamble,
+//	WELCOME and METADATA, then streams FRAME messages.
+//
+//	Clients that don't send the preamble (option lines, or nothing within
+//	CAM_PROTOCOL_HANDSHAKE_TIMEOUT_MS) are legacy clients: they get the
+//	frame header and image only, no message header.
+//
+//	every message: payload length (u32), type (u16), stream (u16), payload.
+//	stream: camera of a FRAME message (multiplexed server), 0 otherwise
+//
+//	client -> server
+//		HELLO		capabilities of the client (u32)
+//		OPTION		option line, see camserver.h
+//		HEARTBEAT	-
+//	server -> client
+//		WELCOME		capabilities of the server, common capabilities,
+//					negotiated encoding, delivery policy (u32 each)
+//		METADATA	"<key> <value>" lines, "stream <id> <name>" per camera
+//		FRAME		frame header (see CCamFrame) + image data
+//		STATS		frames sent, frames conflated, send calls, zero-copy
+//					fallbacks, ring overwritten, ring dropped, quality
+//					level, estimated link rate (bytes/s), queue delay (us)
+//					(u64 each; older servers send the first six only)
+//		HEARTBEAT	-, sent to idle clients
+//		BANDWIDTH	uplink per camera, one line each: "<id> <name> rate <r>
+//					throughput <t> demand <d> level <n>" (Mbit/s, see
+//					bandwidth.h)
+//
+//	All numbers are little endian.
+//
+
+#define	CAM_PROTOCOL_MAGIC					"CAMS"
+#define	CAM_PROTOCOL_VERSION				1
+#define	CAM_PROTOCOL_PREAMBLE_LENGTH		8
+
+// protocol of a client: not known yet, legacy, CAM_PROTOCOL_VERSION
+#define	CAM_PROTOCOL_UNKNOWN				-1
+#define	CAM_PROTOCOL_LEGACY					0
+
+// a client without preamble is served as legacy client after ...
+#define	CAM_PROTOCOL_HANDSHAKE_TIMEOUT_MS	500
+
+// length of the message header and of the frame header
+#define	CAM_MESSAGE_HEADER_LENGTH			8
+#define	CAM_FRAME_HEADER_LENGTH				40
+
+// message types
+#define	CAM_MESSAGE_HELLO					1
+#define	CAM_MESSAGE_WELCOME					2
+#define	CAM_MESSAGE_OPTION					3
+#define	CAM_MESSAGE_METADATA				4
+#define	CAM_MESSAGE_FRAME					5
+#define	CAM_MESSAGE_STATS					6
+#define	CAM_MESSAGE_HEARTBEAT				7
+#define	CAM_MESSAGE_BANDWIDTH				8
+
+// length of the fixed size payloads
+#define	CAM_HELLO_LENGTH					4
+#define	CAM_WELCOME_LENGTH					16
+#define	CAM_STATS_LENGTH					72
+#define	CAM_STATS_MIN_LENGTH				48
+
+// capabilities: encodings a client decodes, options it uses
+#define	CAM_CAPABILITY_PACKED				(1 << 0)
+#define	CAM_CAPABILITY_TILE					(1 << 1)
+#define	CAM_CAPABILITY_SPARSE				(1 << 2)
+#define	CAM_CAPABILITY_DELTA				(1 << 3)
+#define	CAM_CAPABILITY_GEOMETRY				(1 << 4)
+#define	CAM_CAPABILITY_DELIVERY				(1 << 5)
+#define	CAM_CAPABILITY_ALL					0x3F
+
+
+// capability needed to decode an encoding, 0 for raw
+inline uint32_t	encoding_capability(int encoding){
+	switch(encoding){
+		case	ENCODING_PACKED:	return	CAM_CAPABILITY_PACKED;
+		case	ENCODING_TILE:		return	CAM_CAPABILITY_TILE;
+		case	ENCODING_SPARSE:	return	CAM_CAPABILITY_SPARSE;
+		case	ENCODING_DELTA:		return	CAM_CAPABILITY_DELTA;
+		default:					return	0;
+	}
+}
+
+/*****************************************************************************/
+// UDP transport
+/*****************************************************************************/
+//
+//	one-way, unicast or multicast: every FRAME message (message header,
+//	frame header, image) is cut into datagrams of at most the MTU. Each
+//	datagram starts with
+//
+//		magic "CAMU" (u32), stream (u16), fragment index (u16),
+//		frame id (u64), message length (u32), fragment count (u16),
+//		fragment length (u16), sequence (u32), fragment offset (u32)
+//
+//	followed by the fragment. The sequence counts the datagrams of a sender
+//	(one per camera), the receiver counts the gaps as lost datagrams. A frame
+//	with a missing fragment is dropped. There is no back channel: no delta
+//	encoding, no options.
+//
+#define	CAM_UDP_MAGIC						0x554D4143
+#define	CAM_UDP_HEADER_LENGTH				32
+// IPv4 + UDP header
+#define	CAM_UDP_IP_OVERHEAD					28
+#define	CAM_UDP_MIN_MTU						576
+#define	CAM_UDP_MAX_MTU						65535
+
+/*****************************************************************************/
+// Control port
+/*****************************************************************************/
+//
+//	text lines, see ctr_server.h for the requests. Answers are one line,
+//	"ok [<result>]" or "error <reason>"; a request that starts with
+//	"#<tag>" gets an answer that starts with the same tag. Requests to
+//	different cameras may be answered in any order.
+//
+//	A snapshot request
+//
+//		snapshot <camera> [raw|packed|tile] [preview <n>]
+//
+//	(camera: index or camera id) is answered with the newest frame of that
+//	camera:
+//
+//		snapshot <camera index> <length>
+//
+//	followed by <length> bytes: one FRAME message (message header, frame
+//	header, image) as on the stream ports, stream = camera index.
+//
+//	Subscribed clients get "event <camera index> <text>" lines in between:
+//	"state <name>" when a camera thread changes its state, "set <feature>
+//	<value> settings <n> [restarted]" when a client set a feature, and
+//	"settings <n> frame <frame id>" with the first frame acquired with the
+//	settings of generation n.
+//
+//	Features that can be written during the acquisition (ExposureTime,
+//	Gain, ...) are written between two frames; the camera locks others
+//	(binning, PixelFormat, ...), then the camera thread stops the
+//	acquisition, writes the feature, sets up new frames and starts again
+//	("restarted"). Frames are tagged with their settings generation in
+//	shared memory (camshm_frame) as well.
+//
+#define	CAM_CONTROL_SNAPSHOT				"snapshot"
+#define	CAM_CONTROL_ERROR					"error"
+#define	CAM_CONTROL_OK						"ok"
+#define	CAM_CONTROL_EVENT					"event"
+
+/*****************************************************************************/
+#endif
@@ -27,11 +27,18 @@
 // multi-threading
 #include <thread>
 #include <mutex>
+#include <atomic>
 
 //c++ queue
 #include <vector>
 #include <queue>
 
+// futex
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
 
 using namespace std;
 
@@ -147,5 +154,223 @@ void	CQueue<T>::push(T element){
 
 }
 
+/*****************************************************************************/
+// CQueueWait
+/*****************************************************************************/
+//
+//	wait/notify for the lock-free queue below: a consumer that finds the
+//	queue empty sleeps on a futex. The producer only makes a system call if
+//	somebody is actually sleeping.
+//
+
+class	CQueueWait{
+
+	public:
+	CQueueWait(){ sequence = 0; waiters = 0; };
+
+	// called by the producer after every push
+	void			notify();
+
+	// calls try_pop until it succeeds or the timeout is over
+	template <class F>
+	bool			wait(F try_pop, chrono::microseconds timeout);
+
+	private:
+		atomic<uint32_t>	sequence;
+		atomic<int>			waiters;
+};
+
+/*****************************************************************************/
+// notify
+/*****************************************************************************/
+inline
+void	CQueueWait::notify(){
+
+	sequence.fetch_add(1);
+	if(waiters.load() > 0){
+		syscall(SYS_futex, &sequence, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+/*****************************************************************************/
+// wait
+/*****************************************************************************/
+template <class F>
+bool	CQueueWait::wait(F try_pop, chrono::microseconds timeout){
+
+	auto	deadline	= chrono::steady_clock::now() + timeout;
+	while(true){
+		uint32_t	seen	= sequence.load();
+		waiters.fetch_add(1);
+		// a push between the first test and the increment of waiters
+		// would not wake us up: test again
+		if(try_pop() == true){
+			waiters.fetch_sub(1);
+			return	true;
+		}
+
+		auto	remaining	= chrono::duration_cast<chrono::nanoseconds>(deadline - chrono::steady_clock::now());
+		if(remaining.count() <= 0){
+			waiters.fetch_sub(1);
+			return	false;
+		}
+		struct	timespec	ts;
+		ts.tv_sec			= remaining.count() / 1000000000;
+		ts.tv_nsec			= remaining.count() % 1000000000;
+		syscall(SYS_futex, &sequence, FUTEX_WAIT_PRIVATE, seen, &ts, NULL, 0);
+		waiters.fetch_sub(1);
+
+		if(try_pop() == true){
+			return	true;
+		}
+	}
+}
+
+
+/*****************************************************************************/
+// CMPMCQueue
+/*****************************************************************************/
+//
+//	bounded lock-free queue for any number of producers and consumers
+//	(D. Vyukov's algorithm: every cell carries a sequence number)
+//
+
+template	<class T>
+class	CMPMCQueue{
+
+	public:
+	// constructor, capacity is rounded up to a power of two
+	CMPMCQueue(size_t capacity);
+
+	// get number of elements (approximate if other threads are active)
+	int				get_size();
+
+	// tests if empty
+	bool			is_empty(){ return get_size() == 0; };
+
+	// pushes a new element, false if the queue is full
+	bool			push(T element);
+
+	// gets the first element and removes it, false if empty
+	bool			try_pop(T& element);
+
+	// waits for an element until the timeout is over
+	bool			pop_wait(T& element, chrono::microseconds timeout);
+
+	private:
+		struct	cell_t{
+			atomic<size_t>		sequence;
+			T					data;
+		};
+
+		vector<cell_t>			buffer;
+		size_t					mask;
+
+		alignas(64) atomic<size_t>	enqueue_pos;
+		alignas(64) atomic<size_t>	dequeue_pos;
+
+		CQueueWait				waiter;
+};
+
+/*****************************************************************************/
+// Constructor
+/*****************************************************************************/
+template	<class T>
+CMPMCQueue<T>::CMPMCQueue(size_t capacity) : buffer(0){
+
+	size_t	size	= 2;
+	while(size < capacity){
+		size	<<= 1;
+	}
+	buffer	= vector<cell_t>(size);
+	for(size_t i = 0; i < size; i++){
+		buffer[i].sequence.store(i, memory_order_relaxed);
+	}
+	mask		= size - 1;
+	enqueue_pos	= 0;
+	dequeue_pos	= 0;
+}
+
+/*****************************************************************************/
+// get_size
+/*****************************************************************************/
+template	<class T>
+int	CMPMCQueue<T>::get_size(){
+	size_t	enqueued	= enqueue_pos.load(memory_order_acquire);
+	size_t	dequeued	= dequeue_pos.load(memory_order_acquire);
+	if(enqueued < dequeued){
+		return	0;
+	}
+	return	int(enqueued - dequeued);
+}
+
+/*****************************************************************************/
+// push
+/*****************************************************************************/
+template	<class T>
+bool	CMPMCQueue<T>::push(T element){
+
+	cell_t*	cell;
+	size_t	pos		= enqueue_pos.load(memory_order_relaxed);
+	while(true){
+		cell			= &buffer[pos & mask];
+		size_t		seq	= cell->sequence.load(memory_order_acquire);
+		intptr_t	dif	= intptr_t(seq) - intptr_t(pos);
+		if(dif == 0){
+			if(enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+				break;
+			}
+		}else if(dif < 0){
+			// full
+			return	false;
+		}else{
+			pos		= enqueue_pos.load(memory_order_relaxed);
+		}
+	}
+	cell->data		= move(element);
+	cell->sequence.store(pos + 1, memory_order_release);
+
+	waiter.notify();
+	return	true;
+}
+
+/*****************************************************************************/
+// try_pop
+/*****************************************************************************/
+template	<class T>
+bool	CMPMCQueue<T>::try_pop(T& element){
+
+	cell_t*	cell;
+	size_t	pos		= dequeue_pos.load(memory_order_relaxed);
+	while(true){
+		cell			= &buffer[pos & mask];
+		size_t		seq	= cell->sequence.load(memory_order_acquire);
+		intptr_t	dif	= intptr_t(seq) - intptr_t(pos + 1);
+		if(dif == 0){
+			if(dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+				break;
+			}
+		}else if(dif < 0){
+			// empty
+			return	false;
+		}else{
+			pos		= dequeue_pos.load(memory_order_relaxed);
+		}
+	}
+	element			= move(cell->data);
+	cell->data		= T();
+	cell->sequence.store(pos + mask + 1, memory_order_release);
+
+	return	true;
+}
+
+/*****************************************************************************/
+// pop_wait
+/*****************************************************************************/
+template	<class T>
+bool	CMPMCQueue<T>::pop_wait(T& element, chrono::microseconds timeout){
+	return	waiter.wait([this, &element](){ return this->try_pop(element); }, timeout);
+}
+
 /*****************************************************************************/
 #endif
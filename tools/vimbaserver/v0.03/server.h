@@ -26,12 +26,15 @@
 
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <fcntl.h>
 
 #include <thread>
 #include <mutex>
@@ -49,6 +52,12 @@ using namespace std;
 #define	SERVER_STATUS_STOPPED			30
 #define SERVER_STATUS_ERROR				-1
 
+// maximum number of events handled per epoll_wait call
+#define	SERVER_MAX_EVENTS				64
+
+// default epoll timeout (ms): the stop request is tested at least this often
+#define	SERVER_POLL_TIMEOUT				1000
+
 
 
 /*****************************************************************************/
@@ -74,6 +83,24 @@ class CServer{
 		int				get_client_socket();
 		int				get_server_socket();
 
+		// event hooks, overload in T to implement a multi-client server.
+		// The default on_connect runs main() inline for a single client.
+		void			on_start(){};
+		void			on_connect(int client_socket, const string client_ip);
+		void			on_readable(int client_socket){};
+		void			on_writable(int client_socket){};
+		void			on_hangup(int client_socket){};
+		void			on_error(int client_socket);
+		void			on_poll(){};
+
+	protected:
+		// (un)register a client socket with the event loop
+		void			watch_client(int client_socket, bool want_write);
+		void			unwatch_client(int client_socket);
+
+		// epoll timeout in ms
+		int				poll_timeout;
+
 	private:
 		string			servername;
 		int				port;
@@ -82,6 +109,7 @@ class CServer{
 		// sockets
 		int				server_socket;
 		int				client_socket;
+		int				epoll_fd;
 
 
 		// server control lock
@@ -164,6 +192,10 @@ CServer<T, queue_length>::CServer(int port, const string name){
 		// socket initialization (such that close will work)
 		this->server_socket		= 0;
 		this->client_socket		= 0;
+		this->epoll_fd			= -1;
+
+		// wake up at least once per second
+		this->poll_timeout		= SERVER_POLL_TIMEOUT;
 		
 		// set name
 		this->servername		= name;
@@ -232,48 +264,70 @@ void CServer<T, queue_length>::execute(){
 			}
 		this->control_mutex.unlock();
 
+		// event loop: listening socket plus all client sockets
+		this->epoll_fd			= epoll_create1(0);
+		if (this->epoll_fd < 0){
+			perror("creating epoll instance failed");
+			throw -1;
+		}
+		struct	epoll_event	listen_event;
+		listen_event.events		= EPOLLIN;
+		listen_event.data.fd	= this->server_socket;
+		if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->server_socket, &listen_event) < 0){
+			perror("adding server socket to epoll failed");
+			throw -1;
+		}
+		// the derived server can register its own file descriptors now
+		((T*)this)->on_start();
+
 		// Main loop
+		struct	epoll_event	events[SERVER_MAX_EVENTS];
 		while(true){
-			//cout << "while" << endl;
-			int				retval;
-			struct timeval	tv;
-			tv.tv_sec		= 1;
-			tv.tv_usec		= 0;
-
-			fd_set 			rfds;
-			FD_ZERO(&rfds);
-			FD_SET(this->server_socket, &rfds);
-			retval	 		= select(this->server_socket + 1, &rfds, NULL, NULL, &tv);
-			//cout << "select returned: " << retval << endl;
-			if(retval == 1){
-				// we accepted a connection
-				this->client_socket  = accept(this->server_socket, (struct sockaddr*)&address, (socklen_t*)&addrlen);
-				// get the IP of the client:
-				char ipstr[INET_ADDRSTRLEN];
-				inet_ntop(AF_INET, &address.sin_addr, ipstr, INET_ADDRSTRLEN);
-
-				//global.stdout_lock.lock();
-				cout << "=== " << this->servername << " accepted " << ipstr << " ===" << endl;
-				//global.stdout_lock.unlock();
-
-				// call the main function of the server
-
-				cout << "call main" << endl;
-				((T*)this)->main();
-				cout << "returned from main" << endl;
-
-				// close connection
-				//global.stdout_lock.lock();
-				cout << "=== " << this->servername << " closed " << ipstr << " ===" << endl;
-				//global.stdout_lock.unlock();
-				close(this->client_socket);			
-
+			int		event_count	= epoll_wait(this->epoll_fd, events, SERVER_MAX_EVENTS, this->poll_timeout);
+			if(event_count < 0 and errno != EINTR){
+				perror("epoll_wait failed");
+				throw -1;
 			}
-			// test if we should stop the server
+			for(int i = 0; i < event_count; i++){
+				int			fd			= events[i].data.fd;
+				uint32_t	flags		= events[i].events;
+
+				if(fd == this->server_socket){
+					// we accepted a connection
+					int	new_socket	= accept(this->server_socket, (struct sockaddr*)&address, (socklen_t*)&addrlen);
+					if(new_socket < 0){
+						perror("accept failed");
+						continue;
+					}
+					// get the IP of the client:
+					char ipstr[INET_ADDRSTRLEN];
+					inet_ntop(AF_INET, &address.sin_addr, ipstr, INET_ADDRSTRLEN);
+
+					cout << "=== " << this->servername << " accepted " << ipstr << " ===" << endl;
+					((T*)this)->on_connect(new_socket, string(ipstr));
+					continue;
+				}
+				// client sockets: errors first, the hooks close the socket
+				if(flags & EPOLLHUP){
+					((T*)this)->on_hangup(fd);
+					continue;
+				}
+				if(flags & EPOLLERR){
+					((T*)this)->on_error(fd);
+					continue;
+				}
+				if(flags & EPOLLIN){
+					((T*)this)->on_readable(fd);
+				}
+				if(flags & EPOLLOUT){
+					((T*)this)->on_writable(fd);
+				}
+			}
+			// periodic work of the derived server
+			((T*)this)->on_poll();
 
-			
+			// test if we should stop the server
 			int	server_status	= this->get_status();		
-			//cout << "status: " << server_status << endl;
 
 			if(server_status == SERVER_STATUS_STOP_REQUESTED){
 				cout << "stop server now" << endl;
@@ -289,11 +343,66 @@ void CServer<T, queue_length>::execute(){
 
 		close(this->client_socket);
 		close(this->server_socket);
+		close(this->epoll_fd);
 		return;
 	}
 
 }
 
+/*********************
+ * Default connect hook
+ *********************/
+// single client: run main() inline and close the connection afterwards
+template <class T, int queue_length>
+void CServer<T, queue_length>::on_connect(int client_socket, const string client_ip){
+
+	this->client_socket	= client_socket;
+
+	cout << "call main" << endl;
+	((T*)this)->main();
+	cout << "returned from main" << endl;
+
+	// close connection
+	cout << "=== " << this->servername << " closed " << client_ip << " ===" << endl;
+	close(this->client_socket);
+}
+
+/*********************
+ * Default error hook
+ *********************/
+// EPOLLERR: by default the same as a hangup
+template <class T, int queue_length>
+void CServer<T, queue_length>::on_error(int client_socket){
+	((T*)this)->on_hangup(client_socket);
+}
+
+/*********************
+ * Event loop registration
+ *********************/
+// client sockets are always watched for input (and hangup), output only
+// while there is data pending
+template <class T, int queue_length>
+void CServer<T, queue_length>::watch_client(int client_socket, bool want_write){
+
+	struct	epoll_event	event;
+	event.events		= EPOLLIN;
+	if(want_write == true){
+		event.events	|= EPOLLOUT;
+	}
+	event.data.fd		= client_socket;
+
+	if(epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, client_socket, &event) < 0){
+		if(epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, client_socket, &event) < 0){
+			perror("watch_client: epoll_ctl failed");
+		}
+	}
+}
+
+template <class T, int queue_length>
+void CServer<T, queue_length>::unwatch_client(int client_socket){
+	epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, client_socket, NULL);
+}
+
 /*********************
  * Main function
  *********************/
@@ -316,6 +425,7 @@ CServer<T, queue_length>::~CServer(void){
 	// clean up	
 	close(server_socket);
 	close(client_socket);
+	close(epoll_fd);
 
 	//global.stdout_lock.lock();
 	cout << "server " << this->servername << " deleted" << endl; 
@@ -0,0 +1,221 @@
+/********************************************************************************
+ * Test: shared-memory transport of the camera server
+ *
+ *	- a CShmRing publishes synthetic Mono12 frames, as the camera server does
+ *	- reader processes (libcamclient, camshm_open) wait for the frames, check
+ *	  every pixel in place and whether the frame was overwritten meanwhile
+ *	- halfway, the frames get larger: the writer replaces the segment and
+ *	  the readers have to follow
+ *
+ * Compile:
+ * make shm_loopback
+ *
+ * Run:
+ * ./shm_loopback [-n <frames>] [-f <fps>] [-s <width> <height>]
+ *				  [-c <readers>] [-k <slots>] [-d <ms>]
+ *
+ *	-d		time a reader spends per frame, e.g. 50 to see missed frames
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright Sebastian Meuren, 2022
+ *
+ ********************************************************************************/
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// time
+#include <chrono>
+#include <thread>
+
+#include "shm_ring.h"
+#include "frame_ring.h"
+#include "encoding.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/*****************************************************************************/
+// synthetic frames
+/*****************************************************************************/
+static inline uint16_t	test_pixel(uint64_t frame_id, size_t index){
+	return	(index * 7 + frame_id * 131) & 0xFFF;
+}
+
+void	make_test_frame(CFrameSlot& slot, uint64_t frame_id, uint32_t width, uint32_t height){
+
+	size_t		pixels		= size_t(width) * height;
+	slot.data.resize(pixels * 2);
+	uint16_t*	image		= (uint16_t*)slot.data.data();
+	for(size_t index = 0; index < pixels; index++){
+		image[index]	= test_pixel(frame_id, index);
+	}
+	slot.buffer_size	= pixels * 2;
+	slot.width			= width;
+	slot.height			= height;
+	slot.offset_x		= 0;
+	slot.offset_y		= 0;
+	slot.pixel_format	= PIXEL_FORMAT_MONO12;
+	slot.time_stamp		= duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	slot.frame_id		= frame_id;
+	slot.settings		= 0;
+}
+
+/*****************************************************************************/
+// reader process
+/*****************************************************************************/
+int		reader_main(int index, const string name, int frames, int delay_ms){
+
+	// the writer creates the segment with its first frame
+	void*	reader		= NULL;
+	for(int attempt = 0; attempt < 100 and reader == NULL; attempt++){
+		reader	= camshm_open(name.c_str());
+		if(reader == NULL){
+			this_thread::sleep_for(10ms);
+		}
+	}
+	if(reader == NULL){
+		cerr << "reader " << index << ": no segment " << name << endl;
+		return	1;
+	}
+
+	uint64_t	received	= 0;
+	uint64_t	bad			= 0;
+	uint64_t	overwritten	= 0;
+	double		latency_ms	= 0;
+	uint64_t	last_id		= 0;
+	struct camshm_frame		frame;
+	while(last_id < uint64_t(frames)){
+		if(camshm_receive(reader, &frame, 1000) != 1){
+			break;
+		}
+		// published before the readers started
+		if(frame.frame_id == 0){
+			continue;
+		}
+		uint64_t	now		= duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+		latency_ms	+= (now - frame.time_stamp) * 1e-6;
+		last_id		= frame.frame_id;
+
+		const uint16_t*	image	= (const uint16_t*)frame.data;
+		size_t			pixels	= size_t(frame.width) * frame.height;
+		bool			ok		= frame.size == pixels * 2 and frame.bytes_per_pixel == 2;
+		for(size_t i = 0; ok and i < pixels; i++){
+			ok	= image[i] == test_pixel(frame.frame_id, i);
+		}
+		this_thread::sleep_for(milliseconds(delay_ms));
+		// a wrong pixel only counts if the writer didn't overwrite the frame
+		if(camshm_valid(reader, &frame) == 0){
+			overwritten++;
+		}else if(ok == false){
+			bad++;
+		}
+		received++;
+	}
+
+	struct camshm_stats		stats;
+	camshm_get_stats(reader, &stats);
+	camshm_close(reader);
+
+	cout << fixed << setprecision(3);
+	cout << "reader " << index << ": frames " << received << " bad " << bad << " overwritten " << overwritten;
+	cout << " missed " << stats.frames_missed << " torn " << stats.frames_torn << " segments " << stats.segments;
+	cout << " latency " << (received > 0 ? latency_ms / received : 0) << " ms" << endl;
+
+	bool	ok		= bad == 0 and last_id == uint64_t(frames) and stats.segments == 2;
+	ok				= ok and (delay_ms > 0 or received == uint64_t(frames));
+	return	ok ? 0 : 1;
+}
+
+/*****************************************************************************/
+// main
+/*****************************************************************************/
+int main(int argc, char* argv[]){
+
+	int			frames		= 200;
+	double		fps			= 100;
+	uint32_t	width		= 1024;
+	uint32_t	height		= 768;
+	int			readers		= 2;
+	int			slots		= 8;
+	int			delay_ms	= 0;
+
+	for(int i = 1; i < argc; i++){
+		string	arg		= argv[i];
+		if(arg == "-n" and i + 1 < argc){
+			frames		= atoi(argv[++i]);
+		}else if(arg == "-f" and i + 1 < argc){
+			fps			= atof(argv[++i]);
+		}else if(arg == "-s" and i + 2 < argc){
+			width		= atoi(argv[++i]);
+			height		= atoi(argv[++i]);
+		}else if(arg == "-c" and i + 1 < argc){
+			readers		= atoi(argv[++i]);
+		}else if(arg == "-k" and i + 1 < argc){
+			slots		= atoi(argv[++i]);
+		}else if(arg == "-d" and i + 1 < argc){
+			delay_ms	= atoi(argv[++i]);
+		}else{
+			cerr << "usage: see shm_loopback.cc" << endl;
+			return	-1;
+		}
+	}
+	string		name		= string(SHM_NAME_PREFIX) + "loopback_" + to_string(getpid());
+
+	cout << "shm_loopback: " << frames << " frames " << width << "x" << height << " Mono12 at " << fps << " fps, ";
+	cout << readers << " reader(s), " << slots << " slots, " << name << endl;
+
+	CShmRing*		ring	= new CShmRing(name, slots);
+	CFrameSlot		slot;
+	make_test_frame(slot, 0, width, height);
+	ring->publish(slot);
+
+	vector<pid_t>	children;
+	for(int i = 0; i < readers; i++){
+		pid_t	pid		= fork();
+		if(pid == 0){
+			_exit(reader_main(i, name, frames, delay_ms));
+		}
+		children.push_back(pid);
+	}
+	// readers attached
+	this_thread::sleep_for(200ms);
+
+	auto	start_time	= steady_clock::now();
+	for(int frame_id = 1; frame_id <= frames; frame_id++){
+		// larger frames from halfway on: a new segment
+		uint32_t	rows	= frame_id > frames / 2 ? height + height / 2 : height;
+		make_test_frame(slot, frame_id, width, rows);
+		ring->publish(slot);
+		this_thread::sleep_until(start_time + duration<double>(frame_id / fps));
+	}
+	cout << ring->get_status() << endl;
+
+	bool	ok		= true;
+	for(pid_t pid : children){
+		int		status	= 0;
+		waitpid(pid, &status, 0);
+		ok		= ok and WIFEXITED(status) and WEXITSTATUS(status) == 0;
+	}
+	delete	ring;
+	cout << (ok ? "OK" : "FAILED") << endl;
+	return	ok ? 0 : 1;
+}
@@ -0,0 +1,436 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include	"shm_ring.h"
+#include	"frame_ring.h"
+#include	"encoding.h"
+
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<limits.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<unistd.h>
+
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+#include	<sys/syscall.h>
+#include	<linux/futex.h>
+
+#include	<iostream>
+#include	<sstream>
+#include	<iomanip>
+#include	<chrono>
+#include	<thread>
+
+using namespace std::chrono;
+
+/*****************************************************************************/
+// helpers
+/*****************************************************************************/
+// not FUTEX_PRIVATE: the word is shared between processes
+static long	futex(uint32_t* address, int operation, uint32_t value, const struct timespec* timeout){
+	return	syscall(SYS_futex, address, operation, value, timeout, NULL, 0);
+}
+
+static size_t	round_up(size_t value, size_t alignment){
+	return	(value + alignment - 1) / alignment * alignment;
+}
+
+/*****************************************************************************/
+// CShmRing: constructor
+/*****************************************************************************/
+CShmRing::CShmRing(const string name, int slot_count, mode_t mode){
+	this->name			= name;
+	this->slot_count	= max(slot_count, 2);
+	this->mode			= mode;
+	this->segment		= NULL;
+	this->segment_size	= 0;
+	this->header		= NULL;
+	this->slots			= NULL;
+	this->published		= 0;
+	this->slot_size		= 0;
+	this->slot_stride	= 0;
+	this->data_offset	= 0;
+	this->write_count	= 0;
+}
+
+/*****************************************************************************/
+// CShmRing: destructor
+/*****************************************************************************/
+CShmRing::~CShmRing(){
+	if(segment != NULL){
+		close_segment(segment, segment_size);
+		shm_unlink(name.c_str());
+	}
+}
+
+/*****************************************************************************/
+// CShmRing: new segment
+/*****************************************************************************/
+bool CShmRing::create(size_t frame_size){
+
+	if(segment != NULL){
+		close_segment(segment, segment_size);
+		segment		= NULL;
+		header		= NULL;
+		slots		= NULL;
+	}else{
+		// left behind by an earlier server: its readers move on as well
+		int		fd		= shm_open(name.c_str(), O_RDWR, 0);
+		struct stat		status;
+		if(fd >= 0){
+			if(fstat(fd, &status) == 0 and size_t(status.st_size) >= sizeof(CShmHeader)){
+				void*	stale	= mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if(stale != MAP_FAILED){
+					close_segment((uint8_t*)stale, status.st_size);
+				}
+			}
+			close(fd);
+		}
+	}
+	shm_unlink(name.c_str());
+
+	size_t		stride			= round_up(frame_size, SHM_ALIGNMENT);
+	size_t		offset			= round_up(sizeof(CShmHeader) + slot_count * sizeof(CShmSlot), SHM_ALIGNMENT);
+	size_t		size			= offset + slot_count * stride;
+
+	int		fd		= shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, mode);
+	if(fd < 0){
+		perror("CShmRing: shm_open failed");
+		return	false;
+	}
+	// the configured access, whatever the umask is
+	fchmod(fd, mode);
+	if(ftruncate(fd, size) != 0){
+		perror("CShmRing: ftruncate failed");
+		close(fd);
+		shm_unlink(name.c_str());
+		return	false;
+	}
+	void*	mapping		= mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED){
+		perror("CShmRing: mmap failed");
+		shm_unlink(name.c_str());
+		return	false;
+	}
+
+	segment				= (uint8_t*)mapping;
+	segment_size		= size;
+	header				= (CShmHeader*)segment;
+	slots				= (CShmSlot*)(segment + sizeof(CShmHeader));
+	slot_size			= stride;
+	slot_stride			= stride;
+	data_offset			= offset;
+	write_count			= 0;
+
+	// the new segment is zero
+	header->magic		= SHM_MAGIC;
+	header->version		= SHM_VERSION;
+	header->slot_count	= slot_count;
+	header->slot_size	= slot_size;
+	header->slot_stride	= slot_stride;
+	header->data_offset	= data_offset;
+	header->writer_pid	= getpid();
+	// readers check the state last
+	__atomic_store_n(&header->state, SHM_STATE_READY, __ATOMIC_RELEASE);
+	return	true;
+}
+
+/*****************************************************************************/
+// CShmRing: close a segment
+/*****************************************************************************/
+void CShmRing::close_segment(uint8_t* segment, size_t segment_size){
+
+	CShmHeader*		header	= (CShmHeader*)segment;
+	if(header->magic == SHM_MAGIC){
+		__atomic_store_n(&header->state, SHM_STATE_CLOSED, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&header->notify, 1, __ATOMIC_SEQ_CST);
+		futex(&header->notify, FUTEX_WAKE, INT_MAX, NULL);
+	}
+	munmap(segment, segment_size);
+}
+
+/*****************************************************************************/
+// CShmRing: publish a frame
+/*****************************************************************************/
+bool CShmRing::publish(const CFrameSlot& frame){
+
+	if(header == NULL or frame.buffer_size > slot_size){
+		if(create(frame.buffer_size) == false){
+			return	false;
+		}
+	}
+
+	// the private counter: the header is writable by the readers
+	uint64_t	n			= write_count;
+	int			index		= n % slot_count;
+	CShmSlot*	slot		= &slots[index];
+
+	__atomic_store_n(&slot->sequence, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->frame_id			= frame.frame_id;
+	slot->time_stamp		= frame.time_stamp;
+	slot->width				= frame.width;
+	slot->height			= frame.height;
+	slot->offset_x			= frame.offset_x;
+	slot->offset_y			= frame.offset_y;
+	slot->pixel_format		= frame.pixel_format;
+	slot->size				= frame.buffer_size;
+	slot->settings			= frame.settings;
+	memcpy(segment + data_offset + index * slot_stride, frame.data.data(), frame.buffer_size);
+
+	write_count				= n + 1;
+	__atomic_store_n(&slot->sequence, 2 * n + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->write_count, write_count, __ATOMIC_RELEASE);
+
+	// a reader either sees the new notify value or is counted as waiter
+	__atomic_add_fetch(&header->notify, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&header->waiters, __ATOMIC_SEQ_CST) > 0){
+		futex(&header->notify, FUTEX_WAKE, INT_MAX, NULL);
+	}
+	published++;
+	return	true;
+}
+
+string CShmRing::get_status(){
+	stringstream	status;
+	status << fixed << setprecision(1);
+	status << "shm " << name << " slots " << slot_count;
+	if(header != NULL){
+		status << " x " << slot_size / 1e6 << " MB";
+	}
+	status << " frames " << published;
+	return	status.str();
+}
+
+/*****************************************************************************/
+// CShmReader: constructor
+/*****************************************************************************/
+CShmReader::CShmReader(const string name){
+	this->name			= name;
+	this->segment		= NULL;
+	this->segment_size	= 0;
+	this->header		= NULL;
+	this->slots			= NULL;
+	this->slot_count	= 0;
+	this->slot_size		= 0;
+	this->slot_stride	= 0;
+	this->data_offset	= 0;
+	this->next			= 0;
+	memset(&stats, 0, sizeof(stats));
+
+	if(open_segment() == false){
+		throw	-1;
+	}
+}
+
+/*****************************************************************************/
+// CShmReader: destructor
+/*****************************************************************************/
+CShmReader::~CShmReader(){
+	close_segment();
+}
+
+/*****************************************************************************/
+// CShmReader: map the segment
+/*****************************************************************************/
+bool CShmReader::open_segment(){
+
+	int		fd		= shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0){
+		return	false;
+	}
+	struct stat		status;
+	if(fstat(fd, &status) != 0 or size_t(status.st_size) < sizeof(CShmHeader)){
+		close(fd);
+		return	false;
+	}
+	void*	mapping		= mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED){
+		return	false;
+	}
+
+	// not set up yet, closed, or of another version
+	CShmHeader*		mapped	= (CShmHeader*)mapping;
+	bool	usable	= __atomic_load_n(&mapped->state, __ATOMIC_ACQUIRE) == SHM_STATE_READY;
+	usable			= usable and mapped->magic == SHM_MAGIC and mapped->version == SHM_VERSION;
+	usable			= usable and mapped->slot_count > 1 and mapped->slot_size <= mapped->slot_stride;
+	usable			= usable and sizeof(CShmHeader) + mapped->slot_count * sizeof(CShmSlot) <= mapped->data_offset;
+	usable			= usable and mapped->data_offset + mapped->slot_count * mapped->slot_stride <= size_t(status.st_size);
+	if(usable == false){
+		munmap(mapping, status.st_size);
+		return	false;
+	}
+
+	segment			= (uint8_t*)mapping;
+	segment_size	= status.st_size;
+	header			= mapped;
+	slots			= (CShmSlot*)(segment + sizeof(CShmHeader));
+	slot_count		= mapped->slot_count;
+	slot_size		= mapped->slot_size;
+	slot_stride		= mapped->slot_stride;
+	data_offset		= mapped->data_offset;
+
+	// start with the newest frame, after a replaced segment with its first
+	uint64_t	count	= __atomic_load_n(&header->write_count, __ATOMIC_ACQUIRE);
+	next			= count > 0 and stats.segments == 0 ? count - 1 : 0;
+	stats.segments++;
+	return	true;
+}
+
+void CShmReader::close_segment(){
+	if(segment != NULL){
+		munmap(segment, segment_size);
+	}
+	segment		= NULL;
+	header		= NULL;
+	slots		= NULL;
+}
+
+/*****************************************************************************/
+// CShmReader: wait for a frame
+/*****************************************************************************/
+int CShmReader::receive(camshm_frame& frame, int timeout_ms){
+
+	auto	deadline	= steady_clock::now() + milliseconds(timeout_ms);
+	while(true){
+		int		remaining	= duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+
+		// the writer replaced the segment (or hasn't created it yet)
+		if(header == NULL and open_segment() == false){
+			if(remaining <= 0){
+				return	0;
+			}
+			this_thread::sleep_for(milliseconds(min(remaining, SHM_REOPEN_INTERVAL_MS)));
+			continue;
+		}
+
+		// taken first, such that a frame published meanwhile ends the wait
+		uint32_t	notify		= __atomic_load_n(&header->notify, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&header->state, __ATOMIC_ACQUIRE) != SHM_STATE_READY){
+			close_segment();
+			continue;
+		}
+		uint64_t	count		= __atomic_load_n(&header->write_count, __ATOMIC_ACQUIRE);
+		if(next < count){
+			// the older ones are being overwritten
+			uint64_t	oldest		= count - min<uint64_t>(count, slot_count - 1);
+			if(next < oldest){
+				stats.frames_missed	+= count - 1 - next;
+				next				= count - 1;
+			}
+			if(take(next++, frame) == true){
+				stats.frames++;
+				return	1;
+			}
+			continue;
+		}
+
+		if(remaining <= 0){
+			return	0;
+		}
+		wait_notify(notify, remaining);
+	}
+}
+
+void CShmReader::wait_notify(uint32_t value, int timeout_ms){
+
+	struct timespec		timeout;
+	timeout.tv_sec		= timeout_ms / 1000;
+	timeout.tv_nsec		= (timeout_ms % 1000) * 1000000L;
+
+	__atomic_add_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&header->notify, __ATOMIC_SEQ_CST) == value){
+		// EAGAIN: notify changed meanwhile, EINTR / ETIMEDOUT: checked by the caller
+		futex(&header->notify, FUTEX_WAIT, value, &timeout);
+	}
+	__atomic_sub_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/*****************************************************************************/
+// CShmReader: frame n
+/*****************************************************************************/
+bool CShmReader::take(uint64_t n, camshm_frame& frame){
+
+	int			index		= n % slot_count;
+	CShmSlot*	slot		= &slots[index];
+	uint64_t	sequence	= __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+	if(sequence != 2 * n + 2){
+		stats.frames_missed++;
+		return	false;
+	}
+
+	frame.width				= slot->width;
+	frame.height			= slot->height;
+	frame.offset_x			= slot->offset_x;
+	frame.offset_y			= slot->offset_y;
+	frame.pixel_format		= slot->pixel_format;
+	frame.time_stamp		= slot->time_stamp;
+	frame.frame_id			= slot->frame_id;
+	frame.settings			= slot->settings;
+	frame.size				= min<uint64_t>(slot->size, slot_size);
+	frame.data				= segment + data_offset + index * slot_stride;
+	frame.sequence			= sequence;
+	frame.slot				= slot;
+
+	frame.bytes_per_pixel	= pixel_format_bytes(frame.pixel_format);
+
+	// the descriptor was overwritten while it was copied
+	if(valid(frame) == false){
+		stats.frames_torn++;
+		return	false;
+	}
+	return	true;
+}
+
+bool CShmReader::valid(const camshm_frame& frame){
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return	__atomic_load_n(&((const CShmSlot*)frame.slot)->sequence, __ATOMIC_RELAXED) == frame.sequence;
+}
+
+/*****************************************************************************/
+// C interface
+/*****************************************************************************/
+void* camshm_open(const char* name){
+	try{
+		return	new CShmReader(name);
+	}catch(...){
+		return	NULL;
+	}
+}
+
+void camshm_close(void* reader){
+	delete	(CShmReader*)reader;
+}
+
+int camshm_receive(void* reader, struct camshm_frame* frame, int timeout_ms){
+	return	((CShmReader*)reader)->receive(*frame, timeout_ms);
+}
+
+int camshm_valid(void* reader, const struct camshm_frame* frame){
+	return	((CShmReader*)reader)->valid(*frame) ? 1 : 0;
+}
+
+void camshm_get_stats(void* reader, struct camshm_stats* stats){
+	*stats	= ((CShmReader*)reader)->get_stats();
+}
@@ -0,0 +1,261 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <string>
+
+using namespace std;
+
+/*****************************************************************************/
+// Shared-memory transport
+/*****************************************************************************/
+//
+//	The frames of a camera are published in a POSIX shared-memory segment
+//	(shm_open, /dev/shm/vimbaserver_<camera id>), processes on the camera
+//	host map it and read the frames in place, without a socket.
+//
+//	Layout: CShmHeader, slot_count CShmSlot descriptors, then slot_count
+//	image buffers of slot_size bytes (slot_stride apart, page aligned).
+//	Frame n goes to slot n % slot_count.
+//
+//	The writer never waits for readers (seqlock): the sequence of a slot is
+//	odd while frame n is written (2n+1) and 2n+2 once it is published, then
+//	write_count becomes n+1. A reader takes the sequence before and checks
+//	it again after it used the frame; if it changed, the writer overwrote
+//	the frame meanwhile.
+//
+//	Readers sleep on the notify word (futex shared between processes), the
+//	writer increments it for every frame and wakes them if waiters > 0.
+//
+//	If a frame doesn't fit into the slots, the writer marks the segment as
+//	closed, removes it and creates a larger one with the same name; readers
+//	map the new one. A server that starts removes a stale segment the same
+//	way.
+//
+
+#define	SHM_MAGIC					0x524D4143		// "CAMR"
+#define	SHM_VERSION					1
+
+#define	SHM_STATE_READY				1
+#define	SHM_STATE_CLOSED			2
+
+// image buffers start on a page
+#define	SHM_ALIGNMENT				4096
+
+// segment name: prefix + camera id
+#define	SHM_NAME_PREFIX				"/vimbaserver_"
+
+// access of the segment (readers need write access for the futex): the user
+// of the server, <shm mode="0660"> in config.xml opens it to its group
+#define	SHM_DEFAULT_MODE			0600
+
+// readers without a segment try to map it again every ... ms
+#define	SHM_REOPEN_INTERVAL_MS		10
+
+// in shared memory: fixed-size fields only, accessed with __atomic builtins
+struct	CShmHeader{
+	uint32_t		magic;
+	uint32_t		version;
+	uint32_t		state;
+	uint32_t		slot_count;
+	uint64_t		slot_size;
+	uint64_t		slot_stride;
+	// first image buffer, from the start of the segment
+	uint64_t		data_offset;
+	// frames published
+	uint64_t		write_count;
+	// futex: incremented for every frame and when the segment is closed
+	uint32_t		notify;
+	// readers sleeping on notify
+	uint32_t		waiters;
+	uint32_t		writer_pid;
+	uint32_t		reserved;
+};
+
+struct	CShmSlot{
+	// seqlock, see above
+	uint64_t		sequence;
+	uint64_t		frame_id;
+	uint64_t		time_stamp;
+	uint32_t		width;
+	uint32_t		height;
+	uint32_t		offset_x;
+	uint32_t		offset_y;
+	uint32_t		pixel_format;
+	// valid bytes of the image buffer
+	uint32_t		size;
+	// generation of the camera settings
+	uint32_t		settings;
+	uint8_t			reserved[12];
+};
+
+class	CFrameSlot;
+
+/*****************************************************************************/
+// CShmRing
+/*****************************************************************************/
+//
+//	writer side, owned by the camera thread and fed by its camera server.
+//	The segment is created with the first frame (its size isn't known
+//	before).
+//
+//	Every process with access can write to the segment: the writer keeps
+//	the geometry and the frame counter to itself and only copies them into
+//	the header for the readers, it never reads them back.
+//
+class	CShmRing{
+
+	public:
+	// name: "/..." as for shm_open, mode: access of the segment
+	CShmRing(const string name, int slot_count, mode_t mode = SHM_DEFAULT_MODE);
+	// the segment is closed and removed
+	~CShmRing();
+
+	// copies the frame into the next slot, false if the segment couldn't be
+	// created
+	bool					publish(const CFrameSlot& slot);
+
+	uint64_t				get_published()		{ return published; };
+	// one line: name, size, frames
+	string					get_status();
+
+	private:
+	string					name;
+	int						slot_count;
+	mode_t					mode;
+	uint8_t*				segment;
+	size_t					segment_size;
+	CShmHeader*				header;
+	CShmSlot*				slots;
+	uint64_t				published;
+
+	// geometry of the segment and frames written, private copies of the
+	// header fields
+	size_t					slot_size;
+	size_t					slot_stride;
+	size_t					data_offset;
+	uint64_t				write_count;
+
+	// new segment for frames of slot_size bytes
+	bool					create(size_t slot_size);
+	// marks a segment closed and wakes its readers
+	void					close_segment(uint8_t* segment, size_t segment_size);
+};
+
+/*****************************************************************************/
+// Reader interface (libcamclient)
+/*****************************************************************************/
+extern "C" {
+
+// a frame in the segment: data is read in place and valid until the next
+// camshm_receive call, provided camshm_valid still says so afterwards
+struct	camshm_frame{
+	uint32_t		width;
+	uint32_t		height;
+	uint32_t		offset_x;
+	uint32_t		offset_y;
+	uint32_t		pixel_format;
+	// 1 or 2, 0 for bit-packed and compressed formats (data isn't a pixel
+	// array)
+	uint32_t		bytes_per_pixel;
+	uint64_t		time_stamp;
+	uint64_t		frame_id;
+	const uint8_t*	data;
+	uint64_t		size;
+	// seqlock of the slot at the time the frame was taken
+	uint64_t		sequence;
+	const void*		slot;
+	// generation of the camera settings, it changes with the first frame
+	// acquired after a feature change
+	uint32_t		settings;
+};
+
+struct	camshm_stats{
+	uint64_t		frames;
+	// overwritten before they were read
+	uint64_t		frames_missed;
+	// overwritten while they were read
+	uint64_t		frames_torn;
+	// segments mapped (a new one whenever the writer replaced it)
+	uint64_t		segments;
+};
+
+// NULL if there is no segment of that name
+void*	camshm_open(const char* name);
+void	camshm_close(void* reader);
+
+// waits for the next frame, the newest one if the unread ones have been
+// overwritten: 1 frame, 0 timeout
+int		camshm_receive(void* reader, struct camshm_frame* frame, int timeout_ms);
+
+// 1 if the frame wasn't overwritten since camshm_receive returned it
+int		camshm_valid(void* reader, const struct camshm_frame* frame);
+
+void	camshm_get_stats(void* reader, struct camshm_stats* stats);
+
+}
+
+/*****************************************************************************/
+// CShmReader
+/*****************************************************************************/
+//
+//	reader side in another process, see the C interface above
+//
+class	CShmReader{
+
+	public:
+	// throws -1 if there is no segment of that name
+	CShmReader(const string name);
+	~CShmReader();
+
+	int						receive(camshm_frame& frame, int timeout_ms);
+	bool					valid(const camshm_frame& frame);
+	camshm_stats			get_stats()			{ return stats; };
+
+	private:
+	string					name;
+	uint8_t*				segment;
+	size_t					segment_size;
+	CShmHeader*				header;
+	CShmSlot*				slots;
+	// geometry checked against the mapping when it was opened
+	uint32_t				slot_count;
+	size_t					slot_size;
+	size_t					slot_stride;
+	size_t					data_offset;
+	// next frame to read
+	uint64_t				next;
+	camshm_stats			stats;
+
+	// maps the segment of that name, false if there is none (yet)
+	bool					open_segment();
+	void					close_segment();
+	// sleeps until notify changes or the timeout is over
+	void					wait_notify(uint32_t value, int timeout_ms);
+	// frame n if it is still there
+	bool					take(uint64_t n, camshm_frame& frame);
+};
+
+/*****************************************************************************/
+#endif
@@ -0,0 +1,211 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include	"sparse.h"
+#include	"encoding.h"
+
+#include	<string.h>
+#include	<algorithm>
+
+// every ...th pixel is used for the pedestal estimate
+#define	SPARSE_PEDESTAL_STRIDE		61
+
+/*****************************************************************************/
+// little endian helpers
+/*****************************************************************************/
+static inline void	put_uint32(uint8_t* buffer, uint32_t value){
+	buffer[0]	= value;
+	buffer[1]	= value >> 8;
+	buffer[2]	= value >> 16;
+	buffer[3]	= value >> 24;
+}
+
+static inline uint32_t	get_uint32(const uint8_t* buffer){
+	return	uint32_t(buffer[0]) | (uint32_t(buffer[1]) << 8) | (uint32_t(buffer[2]) << 16) | (uint32_t(buffer[3]) << 24);
+}
+
+/*****************************************************************************/
+// pedestal
+/*****************************************************************************/
+//
+// the stride is odd and not a multiple of typical image widths, such that the
+// samples are spread over all columns
+//
+template <typename T>
+static uint32_t	median_sample(const T* image, size_t pixel_count){
+	vector<T>	samples;
+	samples.reserve(pixel_count / SPARSE_PEDESTAL_STRIDE + 1);
+	for(size_t i = 0; i < pixel_count; i += SPARSE_PEDESTAL_STRIDE){
+		samples.push_back(image[i]);
+	}
+	if(samples.empty()){
+		return	0;
+	}
+	nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+	return	samples[samples.size() / 2];
+}
+
+uint32_t	sparse_pedestal(const uint8_t* image, int bytes_per_pixel, size_t pixel_count){
+	if(bytes_per_pixel == 1){
+		return	median_sample(image, pixel_count);
+	}
+	return	median_sample((const uint16_t*)image, pixel_count);
+}
+
+/*****************************************************************************/
+// encoder
+/*****************************************************************************/
+//
+// collects the runs, returns the number of pixels in all runs
+//
+template <typename T>
+static size_t	find_runs(const T* image, size_t pixel_count, uint32_t level, vector<uint32_t>& runs){
+
+	size_t	total	= 0;
+	size_t	i		= 0;
+
+	while(i < pixel_count){
+		// skip the background
+		while(i < pixel_count and image[i] <= level){
+			i++;
+		}
+		if(i == pixel_count){
+			break;
+		}
+		size_t	first	= i;
+		while(i < pixel_count and image[i] > level){
+			i++;
+		}
+
+		// merge with the last run if the gap is small
+		size_t	count	= runs.size();
+		if(count > 0 and first - (runs[count - 2] + runs[count - 1]) <= SPARSE_MERGE_GAP){
+			total				+= i - (runs[count - 2] + runs[count - 1]);
+			runs[count - 1]		= i - runs[count - 2];
+		}else{
+			runs.push_back(first);
+			runs.push_back(i - first);
+			total				+= i - first;
+		}
+	}
+	return	total;
+}
+
+bool	sparse_encode(const uint8_t* image, uint32_t pixel_format, uint32_t width, uint32_t height, uint32_t threshold, vector<uint8_t>& message){
+
+	int		bits	= pixel_format_bits(pixel_format);
+	if(bits == 0 or pixel_format == PIXEL_FORMAT_MONO10P or pixel_format == PIXEL_FORMAT_MONO12P){
+		return	false;
+	}
+	int			bytes_per_pixel	= bits > 8 ? 2 : 1;
+	size_t		pixel_count		= size_t(width) * height;
+	uint32_t	pedestal		= sparse_pedestal(image, bytes_per_pixel, pixel_count);
+
+	// runs as pairs (first, length)
+	vector<uint32_t>	runs;
+	size_t				total;
+	if(bytes_per_pixel == 1){
+		total	= find_runs(image, pixel_count, pedestal + threshold, runs);
+	}else{
+		total	= find_runs((const uint16_t*)image, pixel_count, pedestal + threshold, runs);
+	}
+
+	// dense is smaller
+	size_t		run_count		= runs.size() / 2;
+	size_t		message_size	= SPARSE_HEADER_LENGTH + run_count * SPARSE_RUN_LENGTH + total * bytes_per_pixel;
+	if(message_size >= pixel_count * bytes_per_pixel){
+		return	false;
+	}
+
+	message.resize(message_size);
+	uint8_t*	buffer		= message.data();
+	put_uint32(buffer, SPARSE_MAGIC);
+	put_uint32(buffer + 4, pixel_format);
+	put_uint32(buffer + 8, width);
+	put_uint32(buffer + 12, height);
+	put_uint32(buffer + 16, pedestal);
+	put_uint32(buffer + 20, threshold);
+	put_uint32(buffer + 24, run_count);
+
+	uint8_t*	run_buffer		= buffer + SPARSE_HEADER_LENGTH;
+	uint8_t*	value_buffer	= run_buffer + run_count * SPARSE_RUN_LENGTH;
+	for(size_t run = 0; run < run_count; run++){
+		uint32_t	first	= runs[2 * run];
+		uint32_t	length	= runs[2 * run + 1];
+		put_uint32(run_buffer, first);
+		put_uint32(run_buffer + 4, length);
+		run_buffer		+= SPARSE_RUN_LENGTH;
+
+		if(length == 0){
+			continue;
+		}
+		memcpy(value_buffer, image + size_t(first) * bytes_per_pixel, size_t(length) * bytes_per_pixel);
+		value_buffer	+= size_t(length) * bytes_per_pixel;
+	}
+	return	true;
+}
+
+/*****************************************************************************/
+// decoder
+/*****************************************************************************/
+bool	sparse_decode(const uint8_t* message, size_t message_size, vector<uint8_t>& image, uint32_t& pixel_format, uint32_t& width, uint32_t& height){
+
+	if(message_size < SPARSE_HEADER_LENGTH or get_uint32(message) != SPARSE_MAGIC){
+		return	false;
+	}
+	pixel_format				= get_uint32(message + 4);
+	width						= get_uint32(message + 8);
+	height						= get_uint32(message + 12);
+	uint32_t	pedestal		= get_uint32(message + 16);
+	size_t		run_count		= get_uint32(message + 24);
+
+	int			bits			= pixel_format_bits(pixel_format);
+	if(bits == 0 or width > 0xFFFF or height > 0xFFFF or SPARSE_HEADER_LENGTH + run_count * SPARSE_RUN_LENGTH > message_size){
+		return	false;
+	}
+	int			bytes_per_pixel	= bits > 8 ? 2 : 1;
+	size_t		pixel_count		= size_t(width) * height;
+
+	// background
+	image.resize(pixel_count * bytes_per_pixel);
+	if(bytes_per_pixel == 1){
+		memset(image.data(), pedestal, pixel_count);
+	}else{
+		fill((uint16_t*)image.data(), (uint16_t*)image.data() + pixel_count, uint16_t(pedestal));
+	}
+
+	const uint8_t*	run_buffer		= message + SPARSE_HEADER_LENGTH;
+	size_t			value_position	= SPARSE_HEADER_LENGTH + run_count * SPARSE_RUN_LENGTH;
+	for(size_t run = 0; run < run_count; run++){
+		size_t		first	= get_uint32(run_buffer);
+		size_t		length	= get_uint32(run_buffer + 4);
+		run_buffer			+= SPARSE_RUN_LENGTH;
+
+		if(first + length > pixel_count or value_position + length * bytes_per_pixel > message_size){
+			return	false;
+		}
+		// an empty run: the image may be empty as well (data() NULL)
+		if(length == 0){
+			continue;
+		}
+		memcpy(image.data() + first * bytes_per_pixel, message + value_position, length * bytes_per_pixel);
+		value_position		+= length * bytes_per_pixel;
+	}
+	return	true;
+}
@@ -0,0 +1,69 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __SPARSE_H__
+#define __SPARSE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// containers
+#include <vector>
+
+using namespace std;
+
+/*****************************************************************************/
+// Sparse frame message
+/*****************************************************************************/
+//
+//	sent as image data with pixel format PIXEL_FORMAT_SPARSE. Only runs of
+//	pixels above pedestal + threshold are sent, all other pixels are set to
+//	the pedestal by the decoder. All values little endian:
+//
+//	 0	uint32	SPARSE_MAGIC
+//	 4	uint32	pixel format of the decoded image
+//	 8	uint32	width
+//	12	uint32	height
+//	16	uint32	pedestal
+//	20	uint32	threshold
+//	24	uint32	number of runs
+//	28	runs:	uint32 first pixel (row by row), uint32 length
+//	..	values of all runs, 1 (Mono8) or 2 bytes per pixel
+//
+//	Runs closer than SPARSE_MERGE_GAP pixels are merged, the pixels in
+//	between are sent as they are.
+//
+#define	SPARSE_MAGIC				0x31525053		// "SPR1"
+#define	SPARSE_HEADER_LENGTH		28
+#define	SPARSE_RUN_LENGTH			8
+
+#define	SPARSE_MERGE_GAP			4
+
+// pedestal estimate: median of a subsample of the image
+uint32_t	sparse_pedestal(const uint8_t* image, int bytes_per_pixel, size_t pixel_count);
+
+// encodes a Mono8..Mono16 image, false if the format isn't supported or the
+// sparse form isn't smaller than the dense image
+bool	sparse_encode(const uint8_t* image, uint32_t pixel_format, uint32_t width, uint32_t height, uint32_t threshold, vector<uint8_t>& message);
+
+// decodes a sparse message, returns false if it is corrupt. The image is
+// stored with 1 (Mono8) or 2 bytes per pixel.
+bool	sparse_decode(const uint8_t* message, size_t message_size, vector<uint8_t>& image, uint32_t& pixel_format, uint32_t& width, uint32_t& height);
+
+/*****************************************************************************/
+#endif
@@ -0,0 +1,418 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include <sstream>
+#include <algorithm>
+
+#include "synthetic_source.h"
+// pixel formats
+#include "encoding.h"
+
+/*****************************************************************************/
+// configuration
+/*****************************************************************************/
+CSyntheticConfig::CSyntheticConfig(){
+	width			= 1024;
+	height			= 1024;
+	pixel_format	= PIXEL_FORMAT_MONO12;
+	fps				= 100;
+	jitter_us		= 0;
+	drop			= 0;
+	spots			= 1;
+	sigma			= 0;
+	amplitude		= 0.6;
+	wander			= 4;
+	pedestal		= 0.02;
+	noise			= 0.005;
+}
+
+// names of the pixel formats
+static const struct{ const char* name; uint32_t pixel_format; }	synthetic_formats[] = {
+	{"Mono8",	PIXEL_FORMAT_MONO8},
+	{"Mono10",	PIXEL_FORMAT_MONO10},
+	{"Mono12",	PIXEL_FORMAT_MONO12},
+	{"Mono16",	PIXEL_FORMAT_MONO16},
+};
+
+// name or number, throws -1 for other formats
+static uint32_t	parse_pixel_format(const string& text){
+	for(auto& item : synthetic_formats){
+		if(text == item.name or text == to_string(item.pixel_format)){
+			return	item.pixel_format;
+		}
+	}
+	throw	-1;
+}
+
+static string	pixel_format_name(uint32_t pixel_format){
+	for(auto& item : synthetic_formats){
+		if(pixel_format == item.pixel_format){
+			return	item.name;
+		}
+	}
+	return	to_string(pixel_format);
+}
+
+// number, throws -1 for text or values out of range
+static double	parse_number(const string& text, double low, double high){
+	size_t	used	= 0;
+	double	value;
+	try{
+		value	= stod(text, &used);
+	}catch(...){
+		throw	-1;
+	}
+	if(used != text.size() or value < low or value > high){
+		throw	-1;
+	}
+	return	value;
+}
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CSyntheticSource::CSyntheticSource(const CSyntheticConfig& config, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log)
+	: CCameraSource(framering, settings, control, log), config(config), random(random_device()()){
+
+	this->exposure_us		= 1e4;
+	this->gain_db			= 0;
+	this->payload_size		= 0;
+	this->next_frame_id		= 0;
+	this->wakeup_pending	= false;
+	running					= false;
+	delivered				= 0;
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CSyntheticSource::~CSyntheticSource(){
+	stop_acquisition();
+}
+
+/*****************************************************************************/
+// open / close
+/*****************************************************************************/
+void CSyntheticSource::open(function<void(steady_clock::duration)> rest){
+
+	control->set_state(CAMERA_STATE_OPENING);
+	auto	render_start	= steady_clock::now();
+	render();
+	log << endl;
+	log << "===== synthetic camera =====" << endl;
+	log << endl;
+	log << "size " << config.width << " x " << config.height << " " << pixel_format_name(config.pixel_format);
+	log << ", " << config.fps << " fps, jitter " << config.jitter_us << " us, drop " << config.drop << endl;
+	log << config.spots << " spots, sigma " << config.sigma << ", noise " << config.noise << endl;
+	log << "rendered " << SYNTHETIC_BANK_FRAMES << " frames in " << duration<double, milli>(steady_clock::now() - render_start).count() << " ms" << endl;
+	log << endl;
+}
+
+void CSyntheticSource::close(){
+	stop_acquisition();
+}
+
+/*****************************************************************************/
+// stream
+/*****************************************************************************/
+size_t CSyntheticSource::current_payload_size(){
+	size_t	bytes	= pixel_format_bits(config.pixel_format) > 8 ? 2 : 1;
+	return	size_t(config.width) * config.height * bytes;
+}
+
+void CSyntheticSource::start_stream(){
+	payload_size	= current_payload_size();
+	framering->allocate(payload_size);
+}
+
+void CSyntheticSource::stop_stream(){
+}
+
+bool CSyntheticSource::payload_changed(){
+	return	current_payload_size() != payload_size;
+}
+
+/*****************************************************************************/
+// acquisition: the generator thread
+/*****************************************************************************/
+void CSyntheticSource::start_acquisition(){
+	if(running == true){
+		return;
+	}
+	running		= true;
+	generator	= thread(&CSyntheticSource::generate, this);
+}
+
+void CSyntheticSource::stop_acquisition(){
+	running		= false;
+	if(generator.joinable() == true){
+		generator.join();
+	}
+}
+
+void CSyntheticSource::generate(){
+
+	normal_distribution<double>			jitter(0.0, 1.0);
+	uniform_real_distribution<double>	uniform(0.0, 1.0);
+	auto	trigger		= steady_clock::now();
+
+	while(running == true){
+		config_mutex.lock();
+		CSyntheticConfig						current		= config;
+		shared_ptr<vector<vector<uint8_t>>>		frames		= bank;
+		config_mutex.unlock();
+
+		// the trigger: frame rate plus jitter, the order stays
+		auto	period		= duration<double>(1.0 / current.fps);
+		trigger			+= duration_cast<steady_clock::duration>(period);
+		double	offset		= min(max(jitter(random) * current.jitter_us * 1e-6, -0.5 * period.count()), 0.5 * period.count());
+		auto	target		= trigger + duration_cast<steady_clock::duration>(duration<double>(offset));
+		// short steps: a stop doesn't wait for a slow frame rate
+		auto	now			= steady_clock::now();
+		while(running == true and now < target){
+			this_thread::sleep_for(min<steady_clock::duration>(target - now, 10ms));
+			now		= steady_clock::now();
+		}
+		if(running == false){
+			break;
+		}
+		// far behind (frame rate changed, machine too slow): no catching up
+		if(now - trigger > 1s){
+			trigger		= now;
+		}
+
+		// a lost frame skips its id
+		uint64_t	frame_id	= next_frame_id++;
+		if(current.drop > 0 and uniform(random) < current.drop){
+			continue;
+		}
+
+		uint64_t	time_stamp	= duration_cast<nanoseconds>(now.time_since_epoch()).count();
+		const vector<uint8_t>&	image	= (*frames)[frame_id % frames->size()];
+		CFrameSlot*	slot		= begin_frame(image.size(), time_stamp, frame_id);
+		if(slot != NULL){
+			slot->width			= current.width;
+			slot->height		= current.height;
+			slot->offset_x		= 0;
+			slot->offset_y		= 0;
+			slot->pixel_format	= current.pixel_format;
+			memcpy(slot->data.data(), image.data(), image.size());
+			commit_frame(slot);
+		}
+		delivered++;
+	}
+}
+
+/*****************************************************************************/
+// images
+/*****************************************************************************/
+void CSyntheticSource::render(){
+
+	int			bits		= pixel_format_bits(config.pixel_format);
+	double		full		= double((1u << bits) - 1);
+	size_t		width		= config.width;
+	size_t		height		= config.height;
+	double		sigma		= config.sigma > 0 ? config.sigma : height / 16.0;
+	// exposure and gain scale the spots, not the pedestal
+	double		peak		= config.amplitude * full * (exposure_us / 1e4) * pow(10.0, gain_db / 20);
+	double		pedestal	= config.pedestal * full;
+	double		noise		= config.noise * full;
+
+	auto		frames		= make_shared<vector<vector<uint8_t>>>(SYNTHETIC_BANK_FRAMES);
+	vector<double>		row(width);
+	vector<double>		profile_x(width);
+	vector<double>		profile_y(height);
+	// cheap noise: sum of four uniform numbers (xorshift), variance 1/3
+	uint64_t	state		= (uint64_t(random_device()()) << 32) | 1;
+	auto		gauss		= [&state](){
+		double	sum		= 0;
+		for(int i = 0; i < 4; i++){
+			state	^= state << 13;
+			state	^= state >> 7;
+			state	^= state << 17;
+			sum		+= double(state >> 11) * (1.0 / 9007199254740992.0);
+		}
+		return	(sum - 2.0) * 1.7320508;
+	};
+
+	for(int k = 0; k < SYNTHETIC_BANK_FRAMES; k++){
+		vector<uint8_t>&	image	= (*frames)[k];
+		image.resize(current_payload_size());
+		double		phase	= 2 * M_PI * k / SYNTHETIC_BANK_FRAMES;
+
+		// the spots are separable: sum over spots of profile_x * profile_y
+		vector<vector<double>>	spots_x(config.spots, vector<double>(width));
+		vector<vector<double>>	spots_y(config.spots, vector<double>(height));
+		for(int s = 0; s < config.spots; s++){
+			double	cx	= width * (s + 1.0) / (config.spots + 1) + config.wander * cos(phase + s);
+			double	cy	= height / 2.0 + config.wander * sin(2 * phase + s);
+			for(size_t x = 0; x < width; x++){
+				spots_x[s][x]	= peak * exp(-(x - cx) * (x - cx) / (2 * sigma * sigma));
+			}
+			for(size_t y = 0; y < height; y++){
+				spots_y[s][y]	= exp(-(y - cy) * (y - cy) / (2 * sigma * sigma));
+			}
+		}
+
+		for(size_t y = 0; y < height; y++){
+			for(size_t x = 0; x < width; x++){
+				row[x]	= pedestal + noise * gauss();
+			}
+			for(int s = 0; s < config.spots; s++){
+				double	fy	= spots_y[s][y];
+				if(fy * peak < 0.5){
+					continue;
+				}
+				for(size_t x = 0; x < width; x++){
+					row[x]	+= spots_x[s][x] * fy;
+				}
+			}
+			if(bits > 8){
+				uint16_t*	out		= (uint16_t*)image.data() + y * width;
+				for(size_t x = 0; x < width; x++){
+					out[x]	= uint16_t(min(max(row[x] + 0.5, 0.0), full));
+				}
+			}else{
+				uint8_t*	out		= image.data() + y * width;
+				for(size_t x = 0; x < width; x++){
+					out[x]	= uint8_t(min(max(row[x] + 0.5, 0.0), full));
+				}
+			}
+		}
+	}
+
+	config_mutex.lock();
+	bank	= frames;
+	config_mutex.unlock();
+}
+
+/*****************************************************************************/
+// process_frames: nothing to give back, waits for the timeout or a wakeup
+/*****************************************************************************/
+int CSyntheticSource::process_frames(microseconds timeout){
+	unique_lock<mutex>	lock(wakeup_mutex);
+	wakeup_condition.wait_for(lock, timeout, [this]{ return wakeup_pending; });
+	wakeup_pending	= false;
+	return	int(delivered.exchange(0));
+}
+
+void CSyntheticSource::wakeup(){
+	lock_guard<mutex>	lock(wakeup_mutex);
+	wakeup_pending	= true;
+	wakeup_condition.notify_one();
+}
+
+/*****************************************************************************/
+// features
+/*****************************************************************************/
+string CSyntheticSource::get_feature(const string& name){
+
+	lock_guard<mutex>	lock(config_mutex);
+	stringstream		value;
+	if(name == "Width"){
+		value << config.width;
+	}else if(name == "Height"){
+		value << config.height;
+	}else if(name == "PixelFormat"){
+		value << pixel_format_name(config.pixel_format);
+	}else if(name == "PayloadSize"){
+		value << current_payload_size();
+	}else if(name == "AcquisitionFrameRate"){
+		value << config.fps;
+	}else if(name == "ExposureTime"){
+		value << exposure_us;
+	}else if(name == "Gain"){
+		value << gain_db;
+	}else if(name == "TriggerJitter"){
+		value << config.jitter_us;
+	}else if(name == "FrameDropRate"){
+		value << config.drop;
+	}else if(name == "SpotSigma"){
+		value << config.sigma;
+	}else if(name == "NoiseLevel"){
+		value << config.noise;
+	}else{
+		throw	-1;
+	}
+	return	value.str();
+}
+
+void CSyntheticSource::set_feature(const string& name, const string& value){
+
+	if(is_feature_writable(name) == false){
+		throw	-1;
+	}
+	// the generator takes the new values with the next frame
+	bool	images	= true;
+	config_mutex.lock();
+	try{
+		if(name == "Width"){
+			config.width		= uint32_t(parse_number(value, 1, 16384));
+		}else if(name == "Height"){
+			config.height		= uint32_t(parse_number(value, 1, 16384));
+		}else if(name == "PixelFormat"){
+			config.pixel_format	= parse_pixel_format(value);
+		}else if(name == "AcquisitionFrameRate"){
+			config.fps			= parse_number(value, 0.01, 1e5);
+			images				= false;
+		}else if(name == "ExposureTime"){
+			exposure_us			= parse_number(value, 1, 1e7);
+		}else if(name == "Gain"){
+			gain_db				= parse_number(value, 0, 48);
+		}else if(name == "TriggerJitter"){
+			config.jitter_us	= parse_number(value, 0, 1e6);
+			images				= false;
+		}else if(name == "FrameDropRate"){
+			config.drop			= parse_number(value, 0, 1);
+			images				= false;
+		}else if(name == "SpotSigma"){
+			config.sigma		= parse_number(value, 0, 1e4);
+		}else if(name == "NoiseLevel"){
+			config.noise		= parse_number(value, 0, 1);
+		}else{
+			throw	-1;
+		}
+	}catch(...){
+		config_mutex.unlock();
+		throw	-1;
+	}
+	config_mutex.unlock();
+	if(images == true){
+		render();
+	}
+}
+
+// the size and format are fixed during the acquisition, as on a camera
+bool CSyntheticSource::is_feature_writable(const string& name){
+	if(name == "PayloadSize"){
+		return	false;
+	}
+	if(name == "Width" or name == "Height" or name == "PixelFormat"){
+		return	running == false;
+	}
+	return	true;
+}
+
+// the clock of the time stamps
+uint64_t CSyntheticSource::latch_timestamp(){
+	return	duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
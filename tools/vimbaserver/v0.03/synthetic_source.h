@@ -0,0 +1,142 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __SYNTHETIC_SOURCE_H__
+#define __SYNTHETIC_SOURCE_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+
+// multi-threading
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "camera_source.h"
+
+using namespace std;
+
+// pre-rendered frames, the generator copies them in turn
+#define	SYNTHETIC_BANK_FRAMES		16
+
+/*****************************************************************************/
+// CSyntheticConfig
+/*****************************************************************************/
+// <synthetic> in config.xml
+struct	CSyntheticConfig{
+	uint32_t			width;
+	uint32_t			height;
+	// PIXEL_FORMAT_MONO8 .. MONO16 (encoding.h)
+	uint32_t			pixel_format;
+	double				fps;
+	// trigger jitter (rms, us), probability of a lost frame
+	double				jitter_us;
+	double				drop;
+	// beam spots: number, rms size (pixels, 0: height / 16), peak (share of
+	// the full scale), motion between frames (pixels)
+	int					spots;
+	double				sigma;
+	double				amplitude;
+	double				wander;
+	// pedestal and noise (rms), share of the full scale
+	double				pedestal;
+	double				noise;
+
+	CSyntheticConfig();
+};
+
+/*****************************************************************************/
+// CSyntheticSource
+/*****************************************************************************/
+//
+//	a simulated camera for load tests without hardware: Gaussian beam spots
+//	on a pedestal with noise, in Mono8/10/12/16, at any size and frame rate
+//	(thousands of fps for small frames).
+//
+//	A generator thread triggers the frames at the frame rate plus a Gaussian
+//	jitter and copies one of SYNTHETIC_BANK_FRAMES pre-rendered images into
+//	the server ring, such that a frame costs a memcpy. A lost frame skips a
+//	frame id, as a lost trigger or transfer does on a camera. The time stamps
+//	are steady_clock ns, i.e. the latency can be measured on the same host.
+//
+//	Features: Width, Height, PixelFormat (not while acquiring), PayloadSize
+//	(read only), AcquisitionFrameRate, ExposureTime (scales the spots, 1e4 us
+//	is the configured amplitude), Gain (dB), TriggerJitter (us),
+//	FrameDropRate, SpotSigma, NoiseLevel.
+//
+class	CSyntheticSource : public CCameraSource{
+
+	public:
+	CSyntheticSource(const CSyntheticConfig& config, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log);
+	~CSyntheticSource();
+
+	void					open(function<void(steady_clock::duration)> rest);
+	void					close();
+
+	void					start_stream();
+	void					stop_stream();
+	bool					payload_changed();
+	void					start_acquisition();
+	void					stop_acquisition();
+
+	int						process_frames(microseconds timeout);
+	void					wakeup();
+
+	string					get_feature(const string& name);
+	void					set_feature(const string& name, const string& value);
+	bool					is_feature_writable(const string& name);
+	size_t					get_payload_size()		{ return payload_size; };
+	uint64_t				latch_timestamp();
+
+	private:
+	// settings, written by the camera thread while the generator reads them
+	mutex					config_mutex;
+	CSyntheticConfig		config;
+	double					exposure_us;
+	double					gain_db;
+	shared_ptr<vector<vector<uint8_t>>>		bank;
+
+	// buffer size of the stream
+	size_t					payload_size;
+
+	// generator
+	thread					generator;
+	atomic<bool>			running;
+	atomic<uint64_t>		delivered;
+	uint64_t				next_frame_id;
+	// jitter and lost frames, generator only
+	mt19937_64				random;
+
+	// process_frames sleeps here
+	mutex					wakeup_mutex;
+	condition_variable		wakeup_condition;
+	bool					wakeup_pending;
+
+	size_t					current_payload_size();
+	// draws the bank for the current settings
+	void					render();
+	void					generate();
+};
+
+/*****************************************************************************/
+#endif
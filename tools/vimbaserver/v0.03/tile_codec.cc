@@ -0,0 +1,561 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include	"tile_codec.h"
+#include	"encoding.h"
+
+#include	<string.h>
+#include	<chrono>
+
+using namespace std::chrono;
+
+// pixels per Rice block and special parameters
+#define	RICE_BLOCK					16
+#define	RICE_MAX_K					14
+#define	RICE_ZERO_BLOCK				15
+#define	RICE_ESCAPE					16
+
+/*****************************************************************************/
+// little endian helpers
+/*****************************************************************************/
+static inline void	put_uint32(uint8_t* buffer, uint32_t value){
+	buffer[0]	= value;
+	buffer[1]	= value >> 8;
+	buffer[2]	= value >> 16;
+	buffer[3]	= value >> 24;
+}
+
+static inline uint32_t	get_uint32(const uint8_t* buffer){
+	return	uint32_t(buffer[0]) | (uint32_t(buffer[1]) << 8) | (uint32_t(buffer[2]) << 16) | (uint32_t(buffer[3]) << 24);
+}
+
+/*****************************************************************************/
+// bit writer / reader (LSB first)
+/*****************************************************************************/
+//
+// at most 32 bits per put, the accumulator is flushed in 32 bit steps
+//
+class	CBitWriter{
+	public:
+	CBitWriter(uint8_t* buffer){ this->buffer = buffer; this->position = 0; this->accumulator = 0; this->bit_count = 0; };
+
+	inline void		put(uint64_t value, int length){
+		accumulator		|= value << bit_count;
+		bit_count		+= length;
+		if(bit_count >= 32){
+			put_uint32(buffer + position, uint32_t(accumulator));
+			position		+= 4;
+			accumulator		>>= 32;
+			bit_count		-= 32;
+		}
+	};
+
+	// flush, returns the number of bytes written
+	size_t			finish(){
+		while(bit_count > 0){
+			buffer[position++]	= uint8_t(accumulator);
+			accumulator			>>= 8;
+			bit_count			-= 8;
+		}
+		bit_count	= 0;
+		return	position;
+	};
+
+	private:
+	uint8_t*		buffer;
+	size_t			position;
+	uint64_t		accumulator;
+	int				bit_count;
+};
+
+class	CBitReader{
+	public:
+	CBitReader(const uint8_t* buffer, size_t size){ this->buffer = buffer; this->size = size; this->position = 0; this->accumulator = 0; this->bit_count = 0; };
+
+	// at most 32 bits
+	inline uint32_t	get(int length){
+		refill();
+		uint32_t	value	= uint32_t(accumulator) & ((uint64_t(1) << length) - 1);
+		accumulator		>>= length;
+		bit_count		-= length;
+		return	value;
+	};
+
+	// number of zero bits before the next one bit (which is consumed), up to
+	// RICE_ESCAPE zeros without a one bit
+	inline int		get_unary(){
+		refill();
+		uint32_t	bits	= uint32_t(accumulator) | (1u << RICE_ESCAPE);
+		int			zeros	= __builtin_ctz(bits);
+		int			length	= zeros < RICE_ESCAPE ? zeros + 1 : RICE_ESCAPE;
+		accumulator		>>= length;
+		bit_count		-= length;
+		return	zeros;
+	};
+
+	// true if more bits were read than available
+	bool			overrun(){ return position * 8 - bit_count > size * 8; };
+
+	private:
+	const uint8_t*	buffer;
+	size_t			size;
+	size_t			position;
+	uint64_t		accumulator;
+	int				bit_count;
+
+	// zeros after the end of the buffer
+	inline void		refill(){
+		while(bit_count <= 56){
+			uint64_t	byte	= position < size ? buffer[position] : 0;
+			position++;
+			accumulator		|= byte << bit_count;
+			bit_count		+= 8;
+		}
+	};
+};
+
+/*****************************************************************************/
+// prediction
+/*****************************************************************************/
+//
+// average of the left and upper neighbour inside the tile, the first row
+// uses the left, the first column the upper neighbour. Residuals are zigzag
+// mapped modulo 2^16.
+//
+static inline uint16_t	zigzag_encode(uint16_t delta){
+	return	uint16_t(delta << 1) ^ uint16_t(-(delta >> 15));
+}
+
+static inline uint16_t	zigzag_decode(uint16_t zigzag){
+	return	(zigzag >> 1) ^ uint16_t(-(zigzag & 1));
+}
+
+// residuals of one tile in coding order
+template <typename T>
+static void	tile_residuals(const T* tile, size_t stride, uint32_t tile_width, uint32_t tile_height, uint16_t* residuals){
+	for(uint32_t y = 0; y < tile_height; y++){
+		const T*	row		= tile + y * stride;
+		const T*	up		= row - stride;
+		if(y == 0){
+			residuals[0]	= zigzag_encode(row[0]);
+			for(uint32_t x = 1; x < tile_width; x++){
+				residuals[x]	= zigzag_encode(row[x] - row[x - 1]);
+			}
+		}else{
+			residuals[0]	= zigzag_encode(row[0] - up[0]);
+			for(uint32_t x = 1; x < tile_width; x++){
+				residuals[x]	= zigzag_encode(row[x] - ((uint32_t(row[x - 1]) + up[x] + 1) >> 1));
+			}
+		}
+		residuals	+= tile_width;
+	}
+}
+
+template <typename T>
+static void	tile_reconstruct(T* tile, size_t stride, uint32_t tile_width, uint32_t tile_height, const uint16_t* residuals){
+	for(uint32_t y = 0; y < tile_height; y++){
+		T*			row		= tile + y * stride;
+		const T*	up		= row - stride;
+		if(y == 0){
+			row[0]	= T(zigzag_decode(residuals[0]));
+			for(uint32_t x = 1; x < tile_width; x++){
+				row[x]	= T(row[x - 1] + zigzag_decode(residuals[x]));
+			}
+		}else{
+			row[0]	= T(up[0] + zigzag_decode(residuals[0]));
+			for(uint32_t x = 1; x < tile_width; x++){
+				row[x]	= T(((uint32_t(row[x - 1]) + up[x] + 1) >> 1) + zigzag_decode(residuals[x]));
+			}
+		}
+		residuals	+= tile_width;
+	}
+}
+
+// temporal: residuals against the reference frame
+template <typename T>
+static void	temporal_residuals(const T* tile, const T* reference, size_t stride, uint32_t tile_width, uint32_t tile_height, uint16_t* residuals){
+	for(uint32_t y = 0; y < tile_height; y++){
+		const T*	row		= tile + y * stride;
+		const T*	past	= reference + y * stride;
+		for(uint32_t x = 0; x < tile_width; x++){
+			residuals[x]	= zigzag_encode(row[x] - past[x]);
+		}
+		residuals	+= tile_width;
+	}
+}
+
+template <typename T>
+static void	temporal_reconstruct(T* tile, const T* reference, size_t stride, uint32_t tile_width, uint32_t tile_height, const uint16_t* residuals){
+	for(uint32_t y = 0; y < tile_height; y++){
+		T*			row		= tile + y * stride;
+		const T*	past	= reference + y * stride;
+		for(uint32_t x = 0; x < tile_width; x++){
+			row[x]	= T(past[x] + zigzag_decode(residuals[x]));
+		}
+		residuals	+= tile_width;
+	}
+}
+
+/*****************************************************************************/
+// Rice coding
+/*****************************************************************************/
+static size_t	rice_encode(const uint16_t* residuals, size_t count, uint8_t* output){
+
+	CBitWriter	writer(output);
+
+	for(size_t block = 0; block < count; block += RICE_BLOCK){
+		size_t		length	= count - block < RICE_BLOCK ? count - block : RICE_BLOCK;
+		const uint16_t*	values	= residuals + block;
+
+		// parameter from the mean of the block
+		uint32_t	sum		= 0;
+		for(size_t i = 0; i < length; i++){
+			sum		+= values[i];
+		}
+		if(sum == 0){
+			writer.put(RICE_ZERO_BLOCK, 4);
+			continue;
+		}
+		uint32_t	mean	= sum / length;
+		int			k		= mean == 0 ? 0 : 32 - __builtin_clz(mean);
+		if(k > RICE_MAX_K){
+			k	= RICE_MAX_K;
+		}
+		writer.put(k, 4);
+
+		for(size_t i = 0; i < length; i++){
+			uint32_t	quotient	= values[i] >> k;
+			if(quotient < RICE_ESCAPE){
+				// quotient zeros, a one, k low bits
+				writer.put((uint64_t(values[i] & ((1u << k) - 1)) << (quotient + 1)) | (1u << quotient), quotient + 1 + k);
+			}else{
+				writer.put(0, RICE_ESCAPE);
+				writer.put(values[i], 16);
+			}
+		}
+	}
+	return	writer.finish();
+}
+
+static bool	rice_decode(const uint8_t* input, size_t size, uint16_t* residuals, size_t count){
+
+	CBitReader	reader(input, size);
+
+	for(size_t block = 0; block < count; block += RICE_BLOCK){
+		size_t		length	= count - block < RICE_BLOCK ? count - block : RICE_BLOCK;
+		uint16_t*	values	= residuals + block;
+
+		int			k		= reader.get(4);
+		if(k == RICE_ZERO_BLOCK){
+			memset(values, 0, length * sizeof(uint16_t));
+			continue;
+		}
+		for(size_t i = 0; i < length; i++){
+			int		quotient	= reader.get_unary();
+			if(quotient < RICE_ESCAPE){
+				values[i]	= (quotient << k) | (k ? reader.get(k) : 0);
+			}else{
+				values[i]	= reader.get(16);
+			}
+		}
+		if(reader.overrun()){
+			return	false;
+		}
+	}
+	return	true;
+}
+
+// worst case: escape for every pixel plus the block parameters
+static size_t	rice_max_size(size_t count){
+	return	(count * (RICE_ESCAPE + 16) + (count / RICE_BLOCK + 1) * 4) / 8 + 8;
+}
+
+/*****************************************************************************/
+// decoder
+/*****************************************************************************/
+bool	tile_decompress(const uint8_t* message, size_t message_size, vector<uint8_t>& image, uint32_t& pixel_format, uint32_t& width, uint32_t& height, const uint8_t* reference, size_t reference_size){
+
+	if(message_size < TILE_CODEC_HEADER_LENGTH){
+		return	false;
+	}
+	uint32_t	magic			= get_uint32(message);
+	if(magic != TILE_CODEC_MAGIC and magic != TILE_CODEC_MAGIC_TEMPORAL){
+		return	false;
+	}
+	pixel_format				= get_uint32(message + 4);
+	width						= get_uint32(message + 8);
+	height						= get_uint32(message + 12);
+	uint32_t	tile_width		= message[16] | (message[17] << 8);
+	uint32_t	tile_height		= message[18] | (message[19] << 8);
+	uint32_t	tile_count		= get_uint32(message + 20);
+
+	int			bits			= pixel_format_bits(pixel_format);
+	if(bits == 0 or tile_width == 0 or tile_height == 0){
+		return	false;
+	}
+	uint32_t	tiles_x			= (width + tile_width - 1) / tile_width;
+	uint32_t	tiles_y			= (height + tile_height - 1) / tile_height;
+	// a zero block codes 16 pixels in 4 bits
+	if(tile_count != tiles_x * tiles_y or TILE_CODEC_HEADER_LENGTH + 4 * size_t(tile_count) > message_size or size_t(width) * height > message_size * 32){
+		return	false;
+	}
+
+	int			bytes_per_pixel	= bits > 8 ? 2 : 1;
+	if(magic == TILE_CODEC_MAGIC_TEMPORAL and (reference == NULL or reference_size != size_t(width) * height * bytes_per_pixel)){
+		return	false;
+	}
+	image.resize(size_t(width) * height * bytes_per_pixel);
+
+	vector<uint16_t>	residuals(tile_width * tile_height);
+	const uint8_t*		tile_sizes	= message + TILE_CODEC_HEADER_LENGTH;
+	size_t				position	= TILE_CODEC_HEADER_LENGTH + 4 * size_t(tile_count);
+
+	for(uint32_t tile = 0; tile < tile_count; tile++){
+		uint32_t	size	= get_uint32(tile_sizes + 4 * tile);
+		if(position + size > message_size){
+			return	false;
+		}
+		uint32_t	x0		= (tile % tiles_x) * tile_width;
+		uint32_t	y0		= (tile / tiles_x) * tile_height;
+		uint32_t	w		= min(tile_width, width - x0);
+		uint32_t	h		= min(tile_height, height - y0);
+
+		if(rice_decode(message + position, size, residuals.data(), size_t(w) * h) == false){
+			return	false;
+		}
+		size_t		offset	= size_t(y0) * width + x0;
+		if(magic == TILE_CODEC_MAGIC_TEMPORAL){
+			if(bytes_per_pixel == 1){
+				temporal_reconstruct(image.data() + offset, reference + offset, width, w, h, residuals.data());
+			}else{
+				temporal_reconstruct((uint16_t*)image.data() + offset, (const uint16_t*)reference + offset, width, w, h, residuals.data());
+			}
+		}else if(bytes_per_pixel == 1){
+			tile_reconstruct(image.data() + offset, width, w, h, residuals.data());
+		}else{
+			tile_reconstruct((uint16_t*)image.data() + offset, width, w, h, residuals.data());
+		}
+		position	+= size;
+	}
+	return	true;
+}
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CTileCodec::CTileCodec(int worker_threads){
+
+	this->image				= NULL;
+	this->reference			= NULL;
+	this->tile_count		= 0;
+	this->next_tile			= 0;
+	this->job_generation	= 0;
+	this->active_workers	= 0;
+	this->stopping			= false;
+
+	this->frames			= 0;
+	this->raw_bytes			= 0;
+	this->compressed_bytes	= 0;
+	this->busy_ns			= 0;
+	this->latency_ns		= 0;
+	this->max_latency_ns	= 0;
+
+	for(int i = 0; i < worker_threads; i++){
+		workers.push_back(thread(&CTileCodec::worker_thread, this));
+	}
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CTileCodec::~CTileCodec(){
+	{
+		lock_guard<mutex>	lock(job_mutex);
+		stopping	= true;
+	}
+	job_start.notify_all();
+	for(auto& worker : workers){
+		worker.join();
+	}
+}
+
+/*****************************************************************************/
+// compress a frame
+/*****************************************************************************/
+bool CTileCodec::compress(const uint8_t* image, uint32_t pixel_format, uint32_t width, uint32_t height, vector<uint8_t>& message, const uint8_t* reference){
+
+	int		bits	= pixel_format_bits(pixel_format);
+	if(bits == 0 or pixel_format == PIXEL_FORMAT_MONO10P or pixel_format == PIXEL_FORMAT_MONO12P or width == 0 or height == 0){
+		return	false;
+	}
+	auto	start_time	= steady_clock::now();
+
+	// hand out the tiles once the workers of the last frame are gone
+	{
+		unique_lock<mutex>	lock(job_mutex);
+		job_done.wait(lock, [this]{ return active_workers == 0; });
+
+		this->image				= image;
+		this->reference			= reference;
+		this->bytes_per_pixel	= bits > 8 ? 2 : 1;
+		this->width				= width;
+		this->height			= height;
+		this->tiles_x			= (width + TILE_CODEC_TILE_WIDTH - 1) / TILE_CODEC_TILE_WIDTH;
+		this->tile_count		= tiles_x * ((height + TILE_CODEC_TILE_HEIGHT - 1) / TILE_CODEC_TILE_HEIGHT);
+		if(tile_data.size() < tile_count){
+			tile_data.resize(tile_count);
+		}
+		tile_size.resize(tile_count);
+		next_tile				= 0;
+		job_generation++;
+	}
+	job_start.notify_all();
+
+	// help, then wait for the workers that picked up this frame
+	run_tiles();
+	{
+		unique_lock<mutex>	lock(job_mutex);
+		job_done.wait(lock, [this]{ return active_workers == 0; });
+	}
+
+	// assemble the message
+	size_t	raw_size		= size_t(width) * height * bytes_per_pixel;
+	size_t	message_size	= TILE_CODEC_HEADER_LENGTH + 4 * size_t(tile_count);
+	for(uint32_t tile = 0; tile < tile_count; tile++){
+		message_size	+= tile_size[tile];
+	}
+
+	// statistics, incompressible frames are sent raw
+	frames++;
+	raw_bytes				+= raw_size;
+	compressed_bytes		+= min(message_size, raw_size);
+	if(message_size >= raw_size){
+		return	false;
+	}
+	message.resize(message_size);
+	uint8_t*	buffer		= message.data();
+	put_uint32(buffer, reference != NULL ? TILE_CODEC_MAGIC_TEMPORAL : TILE_CODEC_MAGIC);
+	put_uint32(buffer + 4, pixel_format);
+	put_uint32(buffer + 8, width);
+	put_uint32(buffer + 12, height);
+	buffer[16]				= TILE_CODEC_TILE_WIDTH & 0xFF;
+	buffer[17]				= TILE_CODEC_TILE_WIDTH >> 8;
+	buffer[18]				= TILE_CODEC_TILE_HEIGHT & 0xFF;
+	buffer[19]				= TILE_CODEC_TILE_HEIGHT >> 8;
+	put_uint32(buffer + 20, tile_count);
+
+	size_t		position	= TILE_CODEC_HEADER_LENGTH + 4 * size_t(tile_count);
+	for(uint32_t tile = 0; tile < tile_count; tile++){
+		put_uint32(buffer + TILE_CODEC_HEADER_LENGTH + 4 * tile, tile_size[tile]);
+		memcpy(buffer + position, tile_data[tile].data(), tile_size[tile]);
+		position	+= tile_size[tile];
+	}
+	uint64_t	latency		= duration_cast<nanoseconds>(steady_clock::now() - start_time).count();
+	latency_ns				+= latency;
+	if(latency > max_latency_ns){
+		max_latency_ns		= latency;
+	}
+	return	true;
+}
+
+/*****************************************************************************/
+// worker pool
+/*****************************************************************************/
+void CTileCodec::worker_thread(){
+
+	uint64_t	generation	= 0;
+
+	while(true){
+		{
+			unique_lock<mutex>	lock(job_mutex);
+			job_start.wait(lock, [&]{ return stopping or job_generation != generation; });
+			if(stopping){
+				return;
+			}
+			generation	= job_generation;
+			active_workers++;
+		}
+		run_tiles();
+		{
+			lock_guard<mutex>	lock(job_mutex);
+			active_workers--;
+		}
+		job_done.notify_one();
+	}
+}
+
+// takes tiles until all are handed out, each thread has its own scratch
+void CTileCodec::run_tiles(){
+
+	thread_local vector<uint16_t>	residuals;
+	auto		start_time	= steady_clock::now();
+	uint32_t	tile;
+
+	while((tile = next_tile.fetch_add(1)) < tile_count){
+		tile_size[tile]		= compress_tile(tile, tile_data[tile], residuals);
+	}
+	busy_ns		+= duration_cast<nanoseconds>(steady_clock::now() - start_time).count();
+}
+
+size_t CTileCodec::compress_tile(uint32_t tile, vector<uint8_t>& output, vector<uint16_t>& residuals){
+
+	uint32_t	x0		= (tile % tiles_x) * TILE_CODEC_TILE_WIDTH;
+	uint32_t	y0		= (tile / tiles_x) * TILE_CODEC_TILE_HEIGHT;
+	uint32_t	w		= min<uint32_t>(TILE_CODEC_TILE_WIDTH, width - x0);
+	uint32_t	h		= min<uint32_t>(TILE_CODEC_TILE_HEIGHT, height - y0);
+	size_t		count	= size_t(w) * h;
+
+	size_t		offset	= size_t(y0) * width + x0;
+
+	residuals.resize(count);
+	if(reference != NULL){
+		if(bytes_per_pixel == 1){
+			temporal_residuals(image + offset, reference + offset, width, w, h, residuals.data());
+		}else{
+			temporal_residuals((const uint16_t*)image + offset, (const uint16_t*)reference + offset, width, w, h, residuals.data());
+		}
+	}else if(bytes_per_pixel == 1){
+		tile_residuals(image + offset, width, w, h, residuals.data());
+	}else{
+		tile_residuals((const uint16_t*)image + offset, width, w, h, residuals.data());
+	}
+
+	output.resize(rice_max_size(count));
+	return	rice_encode(residuals.data(), count, output.data());
+}
+
+/*****************************************************************************/
+// statistics
+/*****************************************************************************/
+double	CTileCodec::get_ratio(){
+	return	compressed_bytes ? double(raw_bytes) / double(compressed_bytes) : 0.0;
+}
+
+// raw MB compressed per second of worker time (all threads)
+double	CTileCodec::get_mb_per_core_second(){
+	return	busy_ns ? double(raw_bytes) * 1000.0 / double(busy_ns) : 0.0;
+}
+
+double	CTileCodec::get_mean_latency_ms(){
+	return	frames ? double(latency_ns) / double(frames) / 1e6 : 0.0;
+}
+
+double	CTileCodec::get_max_latency_ms(){
+	return	double(max_latency_ns) / 1e6;
+}
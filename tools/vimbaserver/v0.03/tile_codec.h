@@ -0,0 +1,153 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __TILE_CODEC_H__
+#define __TILE_CODEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// multi-threading
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// containers
+#include <vector>
+
+using namespace std;
+
+/*****************************************************************************/
+// Compressed frame message
+/*****************************************************************************/
+//
+//	sent as image data with pixel format PIXEL_FORMAT_TILE_CODEC, all values
+//	little endian:
+//
+//	 0	uint32	TILE_CODEC_MAGIC or TILE_CODEC_MAGIC_TEMPORAL
+//	 4	uint32	pixel format of the decoded image
+//	 8	uint32	width
+//	12	uint32	height
+//	16	uint16	tile width
+//	18	uint16	tile height
+//	20	uint32	number of tiles (row by row)
+//	24	uint32	compressed size of every tile
+//	..			tile data
+//
+//	Every tile is coded on its own: residuals of the prediction (average of
+//	left and upper pixel, only left/up at the tile border) are zigzag mapped
+//	and Rice coded in blocks of 16 pixels with a 4 bit parameter per block.
+//	Parameter 15 marks a block without residuals, a quotient of 16 escapes to
+//	the raw 16 bit residual.
+//
+//	Temporal messages predict every pixel from the same pixel of a reference
+//	frame instead, which the decoder needs to have.
+//
+#define	TILE_CODEC_MAGIC			0x315A4C54		// "TLZ1"
+#define	TILE_CODEC_MAGIC_TEMPORAL	0x31544C54		// "TLT1"
+#define	TILE_CODEC_HEADER_LENGTH	24
+
+#define	TILE_CODEC_TILE_WIDTH		256
+#define	TILE_CODEC_TILE_HEIGHT		64
+
+// decodes a compressed frame message, returns false if it is corrupt or a
+// temporal message comes without a matching reference. The image is stored
+// with 1 (Mono8) or 2 bytes per pixel, like the reference.
+bool	tile_decompress(const uint8_t* message, size_t message_size, vector<uint8_t>& image, uint32_t& pixel_format, uint32_t& width, uint32_t& height, const uint8_t* reference = NULL, size_t reference_size = 0);
+
+/*****************************************************************************/
+// Delta frame message
+/*****************************************************************************/
+//
+//	sent with pixel format PIXEL_FORMAT_DELTA: a temporal message against an
+//	earlier frame the client has acknowledged, little endian:
+//
+//	 0	uint32	DELTA_MAGIC
+//	 4	uint32	reserved
+//	 8	uint64	frame id of the reference
+//	16	temporal compressed frame message
+//
+#define	DELTA_MAGIC					0x31544C44		// "DLT1"
+#define	DELTA_HEADER_LENGTH			16
+
+/*****************************************************************************/
+// CTileCodec
+/*****************************************************************************/
+//
+//	compresses frames with a pool of worker threads: the tiles of a frame
+//	are handed out one by one to the workers and the calling thread, which
+//	waits until the frame is complete.
+//
+class	CTileCodec{
+
+	public:
+	// constructor: number of additional worker threads
+	CTileCodec(int worker_threads);
+	// destructor
+	~CTileCodec();
+
+	// compresses a Mono8..Mono16 image into a message, false if the format
+	// isn't supported or the image doesn't get smaller. With a reference
+	// image of the same format and size, a temporal message is created.
+	bool		compress(const uint8_t* image, uint32_t pixel_format, uint32_t width, uint32_t height, vector<uint8_t>& message, const uint8_t* reference = NULL);
+
+	// statistics
+	uint64_t	get_frames()				{ return frames; };
+	double		get_ratio();
+	double		get_mb_per_core_second();
+	double		get_mean_latency_ms();
+	double		get_max_latency_ms();
+
+	private:
+	vector<thread>			workers;
+
+	// current frame, valid while tiles are handed out
+	const uint8_t*			image;
+	const uint8_t*			reference;
+	int						bytes_per_pixel;
+	uint32_t				width;
+	uint32_t				height;
+	uint32_t				tiles_x;
+	uint32_t				tile_count;
+	vector<vector<uint8_t>>	tile_data;
+	vector<uint32_t>		tile_size;
+
+	// hand-out of the tiles
+	atomic<uint32_t>		next_tile;
+	mutex					job_mutex;
+	condition_variable		job_start;
+	condition_variable		job_done;
+	uint64_t				job_generation;
+	int						active_workers;
+	bool					stopping;
+
+	// statistics
+	uint64_t				frames;
+	uint64_t				raw_bytes;
+	uint64_t				compressed_bytes;
+	atomic<uint64_t>		busy_ns;
+	uint64_t				latency_ns;
+	uint64_t				max_latency_ns;
+
+	void		worker_thread();
+	void		run_tiles();
+	size_t		compress_tile(uint32_t tile, vector<uint8_t>& output, vector<uint16_t>& residuals);
+};
+/*****************************************************************************/
+#endif
@@ -37,6 +37,12 @@ string	get_current_date_time_string();
 // integer to buffer
 /*****************************************************************************/
 
+inline void	int16_to_buffer(uint8_t* buffer, int offset, uint16_t value)
+{
+	buffer[offset+0]	=	(value >> 0)  & 0xFF;
+	buffer[offset+1]	=	(value >> 8)  & 0xFF;
+}
+
 inline void	int32_to_buffer(uint8_t* buffer, int offset, uint32_t value)
 {
 	buffer[offset+0]	=	(value >> 0)  & 0xFF;
@@ -58,5 +64,19 @@ inline void	int64_to_buffer(uint8_t* buffer, int offset, uint64_t value)
 
 }
 
+/*****************************************************************************/
+// buffer to integer
+/*****************************************************************************/
+
+inline uint16_t	buffer_to_int16(const uint8_t* buffer, int offset)
+{
+	return	uint16_t(buffer[offset+0]) | (uint16_t(buffer[offset+1]) << 8);
+}
+
+inline uint32_t	buffer_to_int32(const uint8_t* buffer, int offset)
+{
+	return	uint32_t(buffer[offset+0]) | (uint32_t(buffer[offset+1]) << 8) | (uint32_t(buffer[offset+2]) << 16) | (uint32_t(buffer[offset+3]) << 24);
+}
+
 /*****************************************************************************/
 #endif
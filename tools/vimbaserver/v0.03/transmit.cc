@@ -0,0 +1,149 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+
+#include "transmit.h"
+
+// older headers
+#ifndef SO_ZEROCOPY
+#define	SO_ZEROCOPY					60
+#endif
+#ifndef MSG_ZEROCOPY
+#define	MSG_ZEROCOPY				0x4000000
+#endif
+
+
+/*****************************************************************************/
+// enable zero-copy transmission
+/*****************************************************************************/
+bool	enable_zerocopy(int socket){
+
+	int		one		= 1;
+	if(setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0){
+		perror("SO_ZEROCOPY not supported");
+		return	false;
+	}
+	return	true;
+}
+
+/*****************************************************************************/
+// gathered send
+/*****************************************************************************/
+ssize_t	send_iov(int socket, struct iovec* iov, int iovcnt, bool zerocopy){
+
+	struct	msghdr	msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov		= iov;
+	msg.msg_iovlen	= iovcnt;
+
+	int		flags	= MSG_DONTWAIT | MSG_NOSIGNAL;
+	if(zerocopy == true){
+		flags		|= MSG_ZEROCOPY;
+	}
+
+	ssize_t	sent_length;
+	do{
+		sent_length	= sendmsg(socket, &msg, flags);
+	}while(sent_length < 0 and errno == EINTR);
+
+	return	sent_length;
+}
+
+/*****************************************************************************/
+// partial write: skip the bytes that were sent
+/*****************************************************************************/
+int		advance_iov(struct iovec* iov, int iovcnt, size_t count){
+
+	int		first	= 0;
+	while(first < iovcnt and count >= iov[first].iov_len){
+		count	-= iov[first].iov_len;
+		first++;
+	}
+	if(first < iovcnt){
+		iov[first].iov_base	= (uint8_t*)iov[first].iov_base + count;
+		iov[first].iov_len	-= count;
+	}
+	// move the remaining entries to the front
+	for(int i = first; i < iovcnt; i++){
+		iov[i - first]	= iov[i];
+	}
+	return	iovcnt - first;
+}
+
+/*****************************************************************************/
+// zero-copy completion
+/*****************************************************************************/
+int		read_zerocopy_completion(int socket, uint32_t& first, uint32_t& last, bool& copied){
+
+	struct	msghdr	msg;
+	char			control[128];
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control		= control;
+	msg.msg_controllen	= sizeof(control);
+
+	if(recvmsg(socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0){
+		if(errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR){
+			return	0;
+		}
+		return	-1;
+	}
+
+	struct	cmsghdr*	cm	= CMSG_FIRSTHDR(&msg);
+	if(cm == NULL){
+		return	0;
+	}
+	if(not ((cm->cmsg_level == SOL_IP and cm->cmsg_type == IP_RECVERR) or (cm->cmsg_level == SOL_IPV6 and cm->cmsg_type == IPV6_RECVERR))){
+		return	0;
+	}
+
+	struct	sock_extended_err*	serr	= (struct sock_extended_err*)CMSG_DATA(cm);
+	if(serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY){
+		// a real error on the socket
+		errno	= serr->ee_errno;
+		return	-1;
+	}
+
+	first	= serr->ee_info;
+	last	= serr->ee_data;
+	copied	= (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+	return	1;
+}
+
+/*****************************************************************************/
+// socket send queue
+/*****************************************************************************/
+int		get_send_queue(int socket){
+
+	int		queued	= 0;
+	if(ioctl(socket, SIOCOUTQ, &queued) != 0){
+		return	-1;
+	}
+	return	queued;
+}
+
+/*****************************************************************************/
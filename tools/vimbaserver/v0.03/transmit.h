@@ -0,0 +1,67 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License 
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __TRANSMIT_H__
+#define __TRANSMIT_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*****************************************************************************/
+// Transmit modes
+/*****************************************************************************/
+//
+// TRANSMIT_MODE_COPY:		header and image in one sendmsg, the kernel copies
+//							the data into the socket buffer
+// TRANSMIT_MODE_ZEROCOPY:	sendmsg with MSG_ZEROCOPY, the kernel sends
+//							straight from our buffer. The buffer must not
+//							change until the completion was read from the
+//							socket error queue.
+//
+#define	TRANSMIT_MODE_COPY			0
+#define	TRANSMIT_MODE_ZEROCOPY		1
+
+// maximum number of buffers gathered in one sendmsg call
+#define	TRANSMIT_MAX_IOV			16
+
+
+// enables SO_ZEROCOPY on a socket, false if the kernel doesn't support it
+bool	enable_zerocopy(int socket);
+
+// gathers all buffers into one sendmsg call (MSG_DONTWAIT), returns the
+// number of bytes sent or -1 (see errno)
+ssize_t	send_iov(int socket, struct iovec* iov, int iovcnt, bool zerocopy);
+
+// removes "count" sent bytes from the front of the iovec array, returns the
+// new number of entries
+int		advance_iov(struct iovec* iov, int iovcnt, size_t count);
+
+// reads one zerocopy completion from the socket error queue:
+//  1	sendmsg calls first..last are done, "copied" is true if the kernel
+//		had to copy the data after all (e.g. on loopback)
+//  0	no completion pending
+// -1	socket error
+int		read_zerocopy_completion(int socket, uint32_t& first, uint32_t& last, bool& copied);
+
+// bytes in the socket send queue, not yet acknowledged by the peer
+// (SIOCOUTQ), -1 on error
+int		get_send_queue(int socket);
+
+/*****************************************************************************/
+#endif
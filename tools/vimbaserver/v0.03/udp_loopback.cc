@@ -0,0 +1,326 @@
+/********************************************************************************
+ * Test: UDP transport of the camera server on loopback
+ *
+ *	- a CUdpSender sends synthetic Mono12 frames to a multicast group (or
+ *	  to 127.0.0.1), paced at the given rate
+ *	- receivers (libcamclient, camclient_open_udp) put the frames together
+ *	  and check every pixel
+ *	- optionally a relay between sender and receivers drops datagrams at
+ *	  random, to see incomplete frames and the loss statistics
+ *
+ * Compile:
+ * make udp_loopback
+ *
+ * Run:
+ * ./udp_loopback [-g <group>] [-u] [-p <port>] [-r <Mbit/s>] [-m <mtu>]
+ *				  [-n <frames>] [-f <fps>] [-s <width> <height>]
+ *				  [-c <receivers>] [-l <loss>]
+ *
+ *	-u		unicast to 127.0.0.1 (one receiver)
+ *	-l		fraction of the datagrams the relay drops, e.g. 0.001
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright Sebastian Meuren, 2022
+ *
+ ********************************************************************************/
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+
+// time
+#include <chrono>
+
+// multi-threading
+#include <thread>
+#include <atomic>
+
+#include "udp_sender.h"
+#include "camclient.h"
+#include "protocol.h"
+#include "tools.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/*****************************************************************************/
+// synthetic frames
+/*****************************************************************************/
+static inline uint16_t	test_pixel(uint64_t frame_id, size_t index){
+	return	(index * 7 + frame_id * 131) & 0xFFF;
+}
+
+// FRAME message as the camera server sends it: message header, frame
+// header, raw Mono12 image (16 bits per pixel)
+struct	CTestFrame{
+	uint8_t				header[CAM_MESSAGE_HEADER_LENGTH + CAM_FRAME_HEADER_LENGTH];
+	vector<uint8_t>		data;
+};
+
+shared_ptr<CTestFrame>	make_test_frame(uint64_t frame_id, uint32_t width, uint32_t height){
+
+	auto		frame		= make_shared<CTestFrame>();
+	size_t		pixels		= size_t(width) * height;
+	frame->data.resize(pixels * 2);
+	uint16_t*	image		= (uint16_t*)frame->data.data();
+	for(size_t index = 0; index < pixels; index++){
+		image[index]	= test_pixel(frame_id, index);
+	}
+
+	uint8_t*	header		= frame->header;
+	int32_to_buffer(header, 0, CAM_FRAME_HEADER_LENGTH + frame->data.size());
+	int16_to_buffer(header, 4, CAM_MESSAGE_FRAME);
+	int16_to_buffer(header, 6, 0);
+	header		+= CAM_MESSAGE_HEADER_LENGTH;
+	int32_to_buffer(header, 0, frame->data.size());
+	int32_to_buffer(header, 4, width);
+	int32_to_buffer(header, 8, height);
+	int32_to_buffer(header, 12, 0);
+	int32_to_buffer(header, 16, 0);
+	int32_to_buffer(header, 20, PIXEL_FORMAT_MONO12);
+	int64_to_buffer(header, 24, duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+	int64_to_buffer(header, 32, frame_id);
+	return	frame;
+}
+
+/*****************************************************************************/
+// relay: drops datagrams at random
+/*****************************************************************************/
+void	relay_main(int in_port, string address, int out_port, double loss, atomic<bool>* running, atomic<uint64_t>* dropped){
+
+	int		in_socket	= socket(AF_INET, SOCK_DGRAM, 0);
+	int		out_socket	= socket(AF_INET, SOCK_DGRAM, 0);
+	int		buffer_size	= 8*1024*1024;
+	setsockopt(in_socket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+	struct	sockaddr_in	local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family			= AF_INET;
+	local.sin_addr.s_addr		= htonl(INADDR_LOOPBACK);
+	local.sin_port				= htons(in_port);
+	if(bind(in_socket, (struct sockaddr*)&local, sizeof(local)) < 0){
+		perror("relay: bind failed");
+		exit(-1);
+	}
+
+	struct	sockaddr_in	destination;
+	memset(&destination, 0, sizeof(destination));
+	destination.sin_family		= AF_INET;
+	destination.sin_port		= htons(out_port);
+	inet_pton(AF_INET, address.c_str(), &destination.sin_addr);
+	struct in_addr		interface;
+	interface.s_addr			= htonl(INADDR_LOOPBACK);
+	setsockopt(out_socket, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+
+	mt19937				random(1);
+	uniform_real_distribution<double>	uniform(0, 1);
+	vector<uint8_t>		datagram(CAM_UDP_MAX_MTU);
+	while(*running){
+		struct pollfd	poll_fd;
+		poll_fd.fd			= in_socket;
+		poll_fd.events		= POLLIN;
+		if(poll(&poll_fd, 1, 100) <= 0){
+			continue;
+		}
+		ssize_t		length	= recv(in_socket, datagram.data(), datagram.size(), 0);
+		if(length <= 0){
+			continue;
+		}
+		if(uniform(random) < loss){
+			(*dropped)++;
+			continue;
+		}
+		sendto(out_socket, datagram.data(), length, 0, (struct sockaddr*)&destination, sizeof(destination));
+	}
+	close(in_socket);
+	close(out_socket);
+}
+
+/*****************************************************************************/
+// receiver: checks every frame
+/*****************************************************************************/
+struct	CReceiverResult{
+	uint64_t						frames;
+	uint64_t						bad;
+	double							latency_ms;
+	struct camclient_udp_stats		stats;
+};
+
+void	receiver_main(void* client, atomic<bool>* running, CReceiverResult* result){
+
+	result->frames		= 0;
+	result->bad			= 0;
+	result->latency_ms	= 0;
+	struct camclient_frame	frame;
+	while(*running){
+		if(camclient_receive(client, &frame, 100) != 1){
+			continue;
+		}
+		uint64_t	now		= duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+		result->latency_ms	+= (now - frame.time_stamp) * 1e-6;
+		result->frames++;
+
+		const uint16_t*	image	= (const uint16_t*)frame.data;
+		size_t			pixels	= size_t(frame.width) * frame.height;
+		bool			ok		= frame.size == pixels * 2;
+		for(size_t index = 0; ok and index < pixels; index++){
+			ok	= image[index] == test_pixel(frame.frame_id, index);
+		}
+		if(ok == false){
+			result->bad++;
+		}
+	}
+	camclient_get_udp_stats(client, &result->stats);
+}
+
+/*****************************************************************************/
+// main
+/*****************************************************************************/
+int main(int argc, char* argv[]){
+
+	string		group		= "239.255.42.1";
+	bool		unicast		= false;
+	int			port		= 42900;
+	double		rate_mbit	= 500;
+	int			mtu			= 1500;
+	int			frames		= 200;
+	double		fps			= 50;
+	uint32_t	width		= 640;
+	uint32_t	height		= 480;
+	int			receivers	= 2;
+	double		loss		= 0;
+
+	for(int i = 1; i < argc; i++){
+		string	arg		= argv[i];
+		if(arg == "-g" and i + 1 < argc){
+			group		= argv[++i];
+		}else if(arg == "-u"){
+			unicast		= true;
+		}else if(arg == "-p" and i + 1 < argc){
+			port		= atoi(argv[++i]);
+		}else if(arg == "-r" and i + 1 < argc){
+			rate_mbit	= atof(argv[++i]);
+		}else if(arg == "-m" and i + 1 < argc){
+			mtu			= atoi(argv[++i]);
+		}else if(arg == "-n" and i + 1 < argc){
+			frames		= atoi(argv[++i]);
+		}else if(arg == "-f" and i + 1 < argc){
+			fps			= atof(argv[++i]);
+		}else if(arg == "-s" and i + 2 < argc){
+			width		= atoi(argv[++i]);
+			height		= atoi(argv[++i]);
+		}else if(arg == "-c" and i + 1 < argc){
+			receivers	= atoi(argv[++i]);
+		}else if(arg == "-l" and i + 1 < argc){
+			loss		= atof(argv[++i]);
+		}else{
+			cerr << "usage: see udp_loopback.cc" << endl;
+			return	-1;
+		}
+	}
+	string		address		= unicast ? "127.0.0.1" : group;
+	if(unicast == true){
+		receivers	= 1;
+	}
+
+	// receivers first, such that no frame is missed
+	vector<void*>		clients;
+	for(int i = 0; i < receivers; i++){
+		void*	client	= camclient_open_udp(unicast ? NULL : group.c_str(), port, unicast ? NULL : "127.0.0.1");
+		if(client == NULL){
+			perror("camclient_open_udp failed");
+			return	-1;
+		}
+		clients.push_back(client);
+	}
+	atomic<bool>				running(true);
+	vector<CReceiverResult>		results(receivers);
+	vector<thread>				receiver_threads;
+	for(int i = 0; i < receivers; i++){
+		receiver_threads.push_back(thread(receiver_main, clients[i], &running, &results[i]));
+	}
+
+	// with loss, the sender goes through the relay
+	atomic<uint64_t>	relay_dropped(0);
+	thread				relay;
+	if(loss > 0){
+		relay	= thread(relay_main, port + 1, address, port, loss, &running, &relay_dropped);
+	}
+
+	CUdpSender*		sender;
+	try{
+		sender	= loss > 0 ? new CUdpSender("127.0.0.1", port + 1, rate_mbit * 1e6 / 8, mtu, 1, "") : new CUdpSender(address, port, rate_mbit * 1e6 / 8, mtu, 1, "127.0.0.1");
+	}catch(...){
+		return	-1;
+	}
+
+	cout << "udp_loopback: " << frames << " frames " << width << "x" << height << " Mono12 at " << fps << " fps to " << address << ":" << port;
+	cout << ", " << rate_mbit << " Mbit/s, mtu " << mtu << ", " << receivers << " receiver(s), loss " << loss << endl;
+
+	auto	start_time	= steady_clock::now();
+	for(int frame_id = 1; frame_id <= frames; frame_id++){
+		shared_ptr<CTestFrame>	frame	= make_test_frame(frame_id, width, height);
+		CUdpFrame		udp_frame;
+		udp_frame.owner			= frame;
+		udp_frame.header		= frame->header;
+		udp_frame.header_length	= sizeof(frame->header);
+		udp_frame.data			= frame->data.data();
+		udp_frame.size			= frame->data.size();
+		udp_frame.stream_id		= 0;
+		udp_frame.frame_id		= frame_id;
+		sender->push(udp_frame);
+		this_thread::sleep_until(start_time + duration<double>(frame_id / fps));
+	}
+	// the last frames are still on their way
+	this_thread::sleep_for(500ms);
+	double	elapsed		= duration<double>(steady_clock::now() - start_time).count();
+	cout << sender->get_status() << endl;
+	delete	sender;
+
+	running		= false;
+	for(auto& receiver_thread : receiver_threads){
+		receiver_thread.join();
+	}
+	if(relay.joinable()){
+		relay.join();
+		cout << "relay dropped " << relay_dropped << " datagrams" << endl;
+	}
+
+	bool	ok		= true;
+	cout << fixed << setprecision(2);
+	for(int i = 0; i < receivers; i++){
+		CReceiverResult&	result	= results[i];
+		cout << "receiver " << i << ": frames " << result.frames << " bad " << result.bad;
+		cout << " incomplete " << result.stats.frames_incomplete << " datagrams " << result.stats.datagrams_received;
+		cout << " lost " << result.stats.datagrams_lost << " late " << result.stats.datagrams_late;
+		cout << " " << result.stats.bytes_received * 8e-6 / elapsed << " Mbit/s";
+		cout << " latency " << (result.frames > 0 ? result.latency_ms / result.frames : 0) << " ms" << endl;
+		ok		= ok and result.bad == 0 and (loss > 0 or result.frames == uint64_t(frames));
+		camclient_close(clients[i]);
+	}
+	cout << (ok ? "OK" : "FAILED") << endl;
+	return	ok ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include	"udp_sender.h"
+#include	"protocol.h"
+#include	"tools.h"
+
+#include	<errno.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<unistd.h>
+
+#include	<arpa/inet.h>
+#include	<sys/socket.h>
+
+#include	<iostream>
+#include	<sstream>
+#include	<iomanip>
+#include	<algorithm>
+
+using namespace std::chrono;
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CUdpSender::CUdpSender(const string address, int port, double rate, int mtu, int ttl, const string interface){
+
+	this->address			= address;
+	this->port				= port;
+	this->rate				= rate;
+	this->sequence			= 0;
+	this->stopping			= false;
+	this->tokens			= UDP_BURST_BYTES;
+	this->refill_time		= steady_clock::now();
+	this->frames_sent		= 0;
+	this->frames_dropped	= 0;
+	this->datagrams_sent	= 0;
+	this->send_errors		= 0;
+
+	mtu						= min(max(mtu, CAM_UDP_MIN_MTU), CAM_UDP_MAX_MTU);
+	this->fragment_length	= mtu - CAM_UDP_IP_OVERHEAD - CAM_UDP_HEADER_LENGTH;
+
+	udp_socket		= socket(AF_INET, SOCK_DGRAM, 0);
+	if(udp_socket < 0){
+		perror("CUdpSender: creating socket failed");
+		throw	-1;
+	}
+	memset(&destination, 0, sizeof(destination));
+	destination.sin_family		= AF_INET;
+	destination.sin_port		= htons(port);
+	if(inet_pton(AF_INET, address.c_str(), &destination.sin_addr) != 1){
+		cerr << "CUdpSender: invalid address " << address << endl;
+		close(udp_socket);
+		throw	-1;
+	}
+
+	// a frame fits in, the pacing keeps it from piling up
+	int		buffer_size		= UDP_SEND_BUFFER;
+	setsockopt(udp_socket, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+
+	if(IN_MULTICAST(ntohl(destination.sin_addr.s_addr))){
+		unsigned char	ttl_value	= ttl;
+		unsigned char	loop		= 1;
+		// receivers on this machine get the frames as well
+		if(setsockopt(udp_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl_value, sizeof(ttl_value)) != 0 or setsockopt(udp_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0){
+			perror("CUdpSender: multicast options failed");
+			close(udp_socket);
+			throw	-1;
+		}
+		if(interface.empty() == false){
+			struct in_addr	local;
+			if(inet_pton(AF_INET, interface.c_str(), &local) != 1 or setsockopt(udp_socket, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local)) != 0){
+				cerr << "CUdpSender: invalid interface " << interface << endl;
+				close(udp_socket);
+				throw	-1;
+			}
+		}
+	}
+
+	sender		= thread(&CUdpSender::sender_thread, this);
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CUdpSender::~CUdpSender(){
+	{
+		lock_guard<mutex>	lock(queue_mutex);
+		stopping	= true;
+	}
+	queue_ready.notify_all();
+	sender.join();
+	close(udp_socket);
+}
+
+/*****************************************************************************/
+// server thread
+/*****************************************************************************/
+void CUdpSender::push(const CUdpFrame& frame){
+	{
+		lock_guard<mutex>	lock(queue_mutex);
+		if(queue.size() >= UDP_QUEUE_LENGTH){
+			queue.pop_front();
+			frames_dropped++;
+		}
+		queue.push_back(frame);
+	}
+	queue_ready.notify_one();
+}
+
+string CUdpSender::get_status(){
+	stringstream	status;
+	status << fixed << setprecision(1);
+	status << "udp " << address << ":" << port << " rate " << rate * 8e-6 << " Mbit/s";
+	status << " frames " << frames_sent << " dropped " << frames_dropped;
+	status << " datagrams " << datagrams_sent << " errors " << send_errors;
+	return	status.str();
+}
+
+/*****************************************************************************/
+// sender thread
+/*****************************************************************************/
+void CUdpSender::sender_thread(){
+
+	while(true){
+		CUdpFrame	frame;
+		{
+			unique_lock<mutex>	lock(queue_mutex);
+			queue_ready.wait(lock, [this]{ return stopping or queue.empty() == false; });
+			if(stopping == true){
+				return;
+			}
+			frame	= queue.front();
+			queue.pop_front();
+		}
+		if(send_frame(frame) == true){
+			frames_sent++;
+		}
+	}
+}
+
+// fragments in batches of UDP_BATCH datagrams, one sendmmsg call each. A
+// fragment may span the message header and the image data.
+bool CUdpSender::send_frame(const CUdpFrame& frame){
+
+	uint32_t	total		= frame.header_length + frame.size;
+	uint32_t	count		= (total + fragment_length - 1) / fragment_length;
+	if(count > 0xFFFF){
+		cerr << "CUdpSender: frame " << frame.frame_id << " too large (" << total << " bytes)" << endl;
+		return	false;
+	}
+
+	uint8_t				headers[UDP_BATCH][CAM_UDP_HEADER_LENGTH];
+	struct iovec		iov[UDP_BATCH][3];
+	struct mmsghdr		messages[UDP_BATCH];
+	memset(messages, 0, sizeof(messages));
+
+	for(uint32_t first = 0; first < count; first += UDP_BATCH){
+		int			batch	= min<uint32_t>(UDP_BATCH, count - first);
+		size_t		bytes	= 0;
+		for(int i = 0; i < batch; i++){
+			uint32_t	index	= first + i;
+			uint32_t	offset	= index * fragment_length;
+			uint32_t	length	= min(fragment_length, total - offset);
+
+			uint8_t*	header	= headers[i];
+			int32_to_buffer(header, 0, CAM_UDP_MAGIC);
+			int16_to_buffer(header, 4, frame.stream_id);
+			int16_to_buffer(header, 6, index);
+			int64_to_buffer(header, 8, frame.frame_id);
+			int32_to_buffer(header, 16, total);
+			int16_to_buffer(header, 20, count);
+			int16_to_buffer(header, 22, length);
+			int32_to_buffer(header, 24, sequence++);
+			int32_to_buffer(header, 28, offset);
+
+			int		iovcnt		= 0;
+			iov[i][iovcnt].iov_base	= header;
+			iov[i][iovcnt].iov_len	= CAM_UDP_HEADER_LENGTH;
+			iovcnt++;
+			if(offset < frame.header_length){
+				iov[i][iovcnt].iov_base	= (void*)(frame.header + offset);
+				iov[i][iovcnt].iov_len	= min(length, frame.header_length - offset);
+				iovcnt++;
+			}
+			if(offset + length > frame.header_length){
+				uint32_t	start	= max(offset, frame.header_length) - frame.header_length;
+				iov[i][iovcnt].iov_base	= (void*)(frame.data + start);
+				iov[i][iovcnt].iov_len	= offset + length - frame.header_length - start;
+				iovcnt++;
+			}
+
+			messages[i].msg_hdr.msg_name		= &destination;
+			messages[i].msg_hdr.msg_namelen		= sizeof(destination);
+			messages[i].msg_hdr.msg_iov			= iov[i];
+			messages[i].msg_hdr.msg_iovlen		= iovcnt;
+			bytes	+= CAM_UDP_IP_OVERHEAD + CAM_UDP_HEADER_LENGTH + length;
+		}
+
+		pace(bytes);
+		int		sent_total	= 0;
+		while(sent_total < batch){
+			int		sent	= sendmmsg(udp_socket, messages + sent_total, batch - sent_total, 0);
+			if(sent < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				// e.g. nobody listening on a unicast port: reported once
+				if(send_errors++ == 0){
+					perror("CUdpSender: send failed");
+				}
+				return	false;
+			}
+			sent_total		+= sent;
+			datagrams_sent	+= sent;
+		}
+	}
+	return	true;
+}
+
+// token bucket: the batch may take the bucket into debt, which is paid off
+// before it is sent
+void CUdpSender::pace(size_t count){
+
+	if(rate <= 0){
+		return;
+	}
+	auto	current_time	= steady_clock::now();
+	tokens			= min(tokens + rate * duration<double>(current_time - refill_time).count(), double(UDP_BURST_BYTES));
+	refill_time		= current_time;
+	tokens			-= count;
+	if(tokens < 0){
+		this_thread::sleep_for(duration<double>(-tokens / rate));
+	}
+}
@@ -0,0 +1,131 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __UDP_SENDER_H__
+#define __UDP_SENDER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <netinet/in.h>
+
+// multi-threading
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// containers
+#include <deque>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+/*****************************************************************************/
+// CUdpSender
+/*****************************************************************************/
+//
+//	sends the frames of a camera as UDP datagrams (see protocol.h, UDP
+//	transport) to a unicast address or a multicast group, such that any
+//	number of receivers costs the uplink only once.
+//
+//	The server thread hands over encoded frames (push), a thread of the
+//	sender cuts them into fragments and sends them with sendmmsg, paced by a
+//	token bucket: at most UDP_BURST_BYTES at once, such that switches and
+//	receivers don't drop a whole frame sent at line rate. Frames that wait
+//	while UDP_QUEUE_LENGTH newer ones arrive are dropped.
+//
+
+// frames waiting to be sent
+#define	UDP_QUEUE_LENGTH			2
+// datagrams per sendmmsg call
+#define	UDP_BATCH					16
+// bucket size of the pacing
+#define	UDP_BURST_BYTES				(64*1024)
+// socket send buffer
+#define	UDP_SEND_BUFFER				(4*1024*1024)
+
+// a frame message: the owner keeps header and data alive until it is sent
+struct	CUdpFrame{
+	shared_ptr<void>			owner;
+	const uint8_t*				header;
+	uint32_t					header_length;
+	const uint8_t*				data;
+	uint32_t					size;
+	uint16_t					stream_id;
+	uint64_t					frame_id;
+};
+
+class	CUdpSender{
+
+	public:
+	// address: IPv4 unicast or multicast group; rate in bytes per second
+	// (0: not paced); ttl and interface (address of the local interface,
+	// empty: default route) for multicast. Throws -1 if the socket can't be
+	// set up.
+	CUdpSender(const string address, int port, double rate, int mtu, int ttl, const string interface);
+	~CUdpSender();
+
+	// server thread: queues a frame, drops the oldest waiting one if the
+	// queue is full
+	void					push(const CUdpFrame& frame);
+
+	// statistics
+	uint64_t				get_frames_sent()		{ return frames_sent; };
+	uint64_t				get_frames_dropped()	{ return frames_dropped; };
+	uint64_t				get_datagrams_sent()	{ return datagrams_sent; };
+	uint64_t				get_send_errors()		{ return send_errors; };
+	// one line: destination, rate, counters
+	string					get_status();
+
+	private:
+	int						udp_socket;
+	struct sockaddr_in		destination;
+	string					address;
+	int						port;
+	double					rate;
+	// fragment bytes per datagram
+	uint32_t				fragment_length;
+	// sequence number of the next datagram
+	uint32_t				sequence;
+
+	mutex					queue_mutex;
+	condition_variable		queue_ready;
+	deque<CUdpFrame>		queue;
+	bool					stopping;
+	thread					sender;
+
+	// pacing
+	double					tokens;
+	chrono::time_point<chrono::steady_clock>	refill_time;
+
+	atomic<uint64_t>		frames_sent;
+	atomic<uint64_t>		frames_dropped;
+	atomic<uint64_t>		datagrams_sent;
+	atomic<uint64_t>		send_errors;
+
+	void					sender_thread();
+	// false if the frame had to be given up
+	bool					send_frame(const CUdpFrame& frame);
+	// waits until count bytes may be sent
+	void					pace(size_t count);
+};
+
+/*****************************************************************************/
+#endif
@@ -0,0 +1,721 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include <sstream>
+#include <iostream>
+
+#include <libusb-1.0/libusb.h>
+
+#include "v4l2_source.h"
+// pixel formats
+#include "encoding.h"
+
+// small helper functions
+#include "tools.h"
+
+#include	"global.h"
+
+/*****************************************************************************/
+// xml parsing: config file
+/*****************************************************************************/
+#include "pugixml.hpp"
+extern pugi::xml_document 	xmlconfig;
+extern mutex				xmlconfig_mutex;
+
+/*****************************************************************************/
+// configuration
+/*****************************************************************************/
+CV4L2Config::CV4L2Config(){
+	device		= "/dev/video0";
+	usb_id		= "";
+	width		= 1920;
+	height		= 1080;
+	format		= "YUYV";
+	fps			= 0;
+	buffers		= 4;
+}
+
+/*****************************************************************************/
+// pixel formats
+/*****************************************************************************/
+// the formats passed on, fourcc and the pixel format of the frames
+static const struct{ const char* name; uint32_t fourcc; uint32_t pixel_format; }	v4l2_formats[] = {
+	{"YUYV",	V4L2_PIX_FMT_YUYV,		PIXEL_FORMAT_YUV422_8},
+	{"MJPG",	V4L2_PIX_FMT_MJPEG,		PIXEL_FORMAT_MJPEG},
+	{"GREY",	V4L2_PIX_FMT_GREY,		PIXEL_FORMAT_MONO8},
+	{"Y16",		V4L2_PIX_FMT_Y16,		PIXEL_FORMAT_MONO16},
+};
+
+// throws -1 for other formats
+static uint32_t	format_fourcc(const string& name){
+	for(auto& item : v4l2_formats){
+		if(name == item.name){
+			return	item.fourcc;
+		}
+	}
+	throw	-1;
+}
+
+static uint32_t	fourcc_pixel_format(uint32_t fourcc){
+	for(auto& item : v4l2_formats){
+		if(fourcc == item.fourcc){
+			return	item.pixel_format;
+		}
+	}
+	return	0;
+}
+
+static string	fourcc_name(uint32_t fourcc){
+	string	name;
+	for(int i = 0; i < 4; i++){
+		char	c	= (fourcc >> (8 * i)) & 0xFF;
+		if(c != ' '){
+			name	+= c;
+		}
+	}
+	return	name;
+}
+
+// "White Balance Temperature, Auto" -> "WhiteBalanceTemperatureAuto"
+static string	control_name(const uint8_t* name){
+	string	result;
+	for(const uint8_t* c = name; *c != 0; c++){
+		if(isalnum(*c)){
+			result	+= *c;
+		}
+	}
+	return	result;
+}
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CV4L2Source::CV4L2Source(string cameraID, const CV4L2Config& config, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log)
+	: CCameraSource(framering, settings, control, log), config(config){
+
+	this->cameraID			= cameraID;
+	this->fd				= -1;
+	this->payload_size		= 0;
+	this->streaming			= false;
+	this->monotonic			= false;
+	this->format_pending	= false;
+
+	wakeup_fd		= eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(wakeup_fd < 0){
+		perror("CV4L2Source: eventfd");
+		throw	-1;
+	}
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CV4L2Source::~CV4L2Source(){
+	try{
+		close();
+	}catch(...){
+	}
+	::close(wakeup_fd);
+}
+
+int CV4L2Source::xioctl(unsigned long request, void* arg){
+	int		result;
+	do{
+		result	= ioctl(fd, request, arg);
+	}while(result == -1 and errno == EINTR);
+	return	result;
+}
+
+/*****************************************************************************/
+// USB reset: the webcams hang now and then
+/*****************************************************************************/
+void CV4L2Source::reset_usb(){
+
+	libusb_context*		usb_ctx		= NULL;
+	if(libusb_init(&usb_ctx) < 0){
+		log << "libusb init error" << endl;
+		throw	-1;
+	}
+	libusb_device**		usb_dev_list;
+	ssize_t		devcount	= libusb_get_device_list(usb_ctx, &usb_dev_list);
+	bool		found		= false;
+	for(ssize_t i = 0; i < devcount; i++){
+		libusb_device_descriptor	usb_dev_desc;
+		if(libusb_get_device_descriptor(usb_dev_list[i], &usb_dev_desc) < 0){
+			continue;
+		}
+		char	dev_id_string[16];
+		snprintf(dev_id_string, sizeof(dev_id_string), "%04x:%04x", usb_dev_desc.idVendor, usb_dev_desc.idProduct);
+		if(config.usb_id != dev_id_string){
+			continue;
+		}
+		libusb_device_handle*	cam_device	= NULL;
+		if(libusb_open(usb_dev_list[i], &cam_device) == 0){
+			libusb_reset_device(cam_device);
+			libusb_close(cam_device);
+			found	= true;
+		}
+	}
+	if(devcount >= 0){
+		libusb_free_device_list(usb_dev_list, 1);
+	}
+	libusb_exit(usb_ctx);
+	log << (found ? "camera reset: " : "camera not found for the reset: ") << config.usb_id << endl;
+}
+
+/*****************************************************************************/
+// open: reset, device, format, default settings
+/*****************************************************************************/
+void CV4L2Source::open(function<void(steady_clock::duration)> rest){
+
+	close();
+	if(config.usb_id.empty() == false){
+		reset_usb();
+		rest(1s);
+	}
+
+	/***********************************************/
+	// find the device
+	/***********************************************/
+	while(true){
+		log << "trying to open camera: " << config.device << " " << get_current_date_time_string() << endl;
+		fd		= ::open(config.device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if(fd >= 0){
+			break;
+		}
+		log << "opening " << config.device << " failed: " << strerror(errno) << endl;
+		rest(seconds(CAMERA_ERROR_TIMEOUT_S));
+	}
+	control->set_state(CAMERA_STATE_OPENING);
+
+	v4l2_capability		capability;
+	memset(&capability, 0, sizeof(capability));
+	if(xioctl(VIDIOC_QUERYCAP, &capability) < 0 or (capability.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0 or (capability.capabilities & V4L2_CAP_STREAMING) == 0){
+		log << config.device << " is no streaming capture device" << endl;
+		throw	-1;
+	}
+	log << endl;
+	log << "===== camera " << cameraID << ": " << capability.card << " (" << capability.driver << ", " << capability.bus_info << ") =====" << endl;
+	log << endl;
+
+	// v4l2-ctl --list-formats-ext
+	v4l2_fmtdesc		fmtdesc;
+	memset(&fmtdesc, 0, sizeof(fmtdesc));
+	fmtdesc.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	while(xioctl(VIDIOC_ENUM_FMT, &fmtdesc) == 0){
+		log << "format " << fourcc_name(fmtdesc.pixelformat) << ": " << fmtdesc.description << (fourcc_pixel_format(fmtdesc.pixelformat) == 0 ? " (not supported)" : "") << endl;
+		fmtdesc.index++;
+	}
+
+	apply_format();
+	apply_frame_rate();
+	load_controls();
+
+	/***********************************************/
+	// default settings of the config file
+	/***********************************************/
+	auto	configure_start		= steady_clock::now();
+	vector<pair<string, string>>	default_settings;
+	xmlconfig_mutex.lock();
+	for (pugi::xml_node xmlcamera : xmlconfig.child("config").children("camera"))
+	{
+		if(cameraID == xmlcamera.attribute("id").as_string()){
+			for (pugi::xml_node default_setting : xmlcamera.children("default_setting"))
+			{
+				default_settings.push_back({default_setting.attribute("name").as_string(), default_setting.attribute("value").as_string()});
+			}
+		}
+	}
+	xmlconfig_mutex.unlock();
+	log << endl;
+	for(auto& item : default_settings){
+		string	attribute		= item.first;
+		attribute.resize(40,' ');
+		try{
+			set_feature(item.first, item.second);
+			log << "successful set " << attribute << " to " << item.second << endl;
+		}catch(...){
+			log << "ERROR setting  " << attribute << " to " << item.second << endl;
+		}
+	}
+	auto	configure_time		= steady_clock::now() - configure_start;
+
+	/***********************************************/
+	// current settings
+	/***********************************************/
+	log << endl;
+	vector<string>		featurelist		= {"Width", "Height", "PixelFormat", "AcquisitionFrameRate", "PayloadSize"};
+	for(auto& item : controls){
+		featurelist.push_back(item.first);
+	}
+	for(auto& name : featurelist){
+		string	printstring	= name + ":";
+		printstring.resize(40,' ');
+		log << printstring;
+		try{
+			log << get_feature(name) << endl;
+		}catch(...){
+			log << "error reading" << endl;
+		}
+	}
+	log << endl;
+	log << "configuration: " << default_settings.size() << " settings in " << duration<double, milli>(configure_time).count() << " ms" << endl;
+	log << endl;
+}
+
+/*****************************************************************************/
+// close
+/*****************************************************************************/
+void CV4L2Source::close(){
+	if(fd < 0){
+		return;
+	}
+	try{
+		stop_stream();
+	}catch(...){
+		log << "error releasing the buffers" << endl;
+	}
+	::close(fd);
+	fd		= -1;
+	controls.clear();
+}
+
+/*****************************************************************************/
+// image format and frame rate
+/*****************************************************************************/
+void CV4L2Source::apply_format(){
+
+	v4l2_format		format;
+	memset(&format, 0, sizeof(format));
+	format.type						= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	format.fmt.pix.width			= config.width;
+	format.fmt.pix.height			= config.height;
+	format.fmt.pix.pixelformat		= format_fourcc(config.format);
+	format.fmt.pix.field			= V4L2_FIELD_NONE;
+	if(xioctl(VIDIOC_S_FMT, &format) < 0){
+		log << "setting the image format failed: " << strerror(errno) << endl;
+		throw	-1;
+	}
+	// the driver takes the nearest size it has
+	config.width		= format.fmt.pix.width;
+	config.height		= format.fmt.pix.height;
+	if(format.fmt.pix.pixelformat != format_fourcc(config.format)){
+		log << "format " << config.format << " not available, got " << fourcc_name(format.fmt.pix.pixelformat) << endl;
+		config.format	= fourcc_name(format.fmt.pix.pixelformat);
+		if(fourcc_pixel_format(format.fmt.pix.pixelformat) == 0){
+			throw	-1;
+		}
+	}
+}
+
+void CV4L2Source::apply_frame_rate(){
+
+	if(config.fps <= 0){
+		return;
+	}
+	v4l2_streamparm		parm;
+	memset(&parm, 0, sizeof(parm));
+	parm.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(xioctl(VIDIOC_G_PARM, &parm) < 0 or (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME) == 0){
+		log << "the frame rate can't be set" << endl;
+		throw	-1;
+	}
+	parm.parm.capture.timeperframe.numerator	= 1000;
+	parm.parm.capture.timeperframe.denominator	= uint32_t(config.fps * 1000 + 0.5);
+	if(xioctl(VIDIOC_S_PARM, &parm) < 0){
+		log << "setting the frame rate failed: " << strerror(errno) << endl;
+		throw	-1;
+	}
+}
+
+/*****************************************************************************/
+// controls of the driver
+/*****************************************************************************/
+void CV4L2Source::load_controls(){
+
+	controls.clear();
+	v4l2_queryctrl		query;
+	memset(&query, 0, sizeof(query));
+	query.id		= V4L2_CTRL_FLAG_NEXT_CTRL;
+	while(xioctl(VIDIOC_QUERYCTRL, &query) == 0){
+		bool	usable	= (query.flags & V4L2_CTRL_FLAG_DISABLED) == 0 and query.type != V4L2_CTRL_TYPE_CTRL_CLASS;
+		// the control itself, or as a vimba feature name
+		if(usable == true){
+			controls[control_name(query.name)]	= query;
+		}
+		query.id		|= V4L2_CTRL_FLAG_NEXT_CTRL;
+	}
+}
+
+/*****************************************************************************/
+// stream: mmap buffers
+/*****************************************************************************/
+void CV4L2Source::start_stream(){
+
+	if(fd < 0){
+		throw	-1;
+	}
+	apply_format();
+	apply_frame_rate();
+	format_pending		= false;
+
+	v4l2_format		format;
+	memset(&format, 0, sizeof(format));
+	format.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(xioctl(VIDIOC_G_FMT, &format) < 0){
+		log << "reading the image format failed" << endl;
+		throw	-1;
+	}
+	payload_size	= format.fmt.pix.sizeimage;
+
+	v4l2_requestbuffers		request;
+	memset(&request, 0, sizeof(request));
+	request.count	= config.buffers;
+	request.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	request.memory	= V4L2_MEMORY_MMAP;
+	if(xioctl(VIDIOC_REQBUFS, &request) < 0 or request.count < 2){
+		log << "requesting image buffers failed" << endl;
+		throw	-1;
+	}
+
+	for(uint32_t i = 0; i < request.count; i++){
+		v4l2_buffer		buf;
+		memset(&buf, 0, sizeof(buf));
+		buf.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory		= V4L2_MEMORY_MMAP;
+		buf.index		= i;
+		if(xioctl(VIDIOC_QUERYBUF, &buf) < 0){
+			log << "VIDIOC_QUERYBUF failed" << endl;
+			throw	-1;
+		}
+		CBuffer		buffer;
+		buffer.length	= buf.length;
+		buffer.start	= mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+		if(buffer.start == MAP_FAILED){
+			log << "can not map buffer " << i << endl;
+			throw	-1;
+		}
+		buffers.push_back(buffer);
+		monotonic	= (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	}
+
+	// server ring: preallocate the image buffers
+	framering->allocate(payload_size);
+}
+
+void CV4L2Source::stop_stream(){
+
+	stop_acquisition();
+	for(auto& buffer : buffers){
+		munmap(buffer.start, buffer.length);
+	}
+	bool	allocated	= buffers.empty() == false;
+	buffers.clear();
+	if(allocated == true){
+		v4l2_requestbuffers		request;
+		memset(&request, 0, sizeof(request));
+		request.count	= 0;
+		request.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		request.memory	= V4L2_MEMORY_MMAP;
+		if(xioctl(VIDIOC_REQBUFS, &request) < 0){
+			log << "releasing image buffers failed" << endl;
+			throw	-1;
+		}
+	}
+}
+
+/*****************************************************************************/
+// acquisition: all buffers to the driver, streaming on
+/*****************************************************************************/
+void CV4L2Source::queue_buffer(uint32_t index){
+	v4l2_buffer		buf;
+	memset(&buf, 0, sizeof(buf));
+	buf.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory		= V4L2_MEMORY_MMAP;
+	buf.index		= index;
+	if(xioctl(VIDIOC_QBUF, &buf) < 0){
+		log << "buffer queuing failed" << endl;
+		throw	-1;
+	}
+}
+
+void CV4L2Source::start_acquisition(){
+
+	if(streaming == true){
+		return;
+	}
+	for(uint32_t i = 0; i < buffers.size(); i++){
+		queue_buffer(i);
+	}
+	v4l2_buf_type	type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(xioctl(VIDIOC_STREAMON, &type) < 0){
+		log << "starting the stream failed" << endl;
+		throw	-1;
+	}
+	streaming	= true;
+}
+
+// the driver takes all buffers back
+void CV4L2Source::stop_acquisition(){
+
+	if(streaming == false){
+		return;
+	}
+	streaming	= false;
+	v4l2_buf_type	type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(xioctl(VIDIOC_STREAMOFF, &type) < 0){
+		log << "stopping the stream failed" << endl;
+		throw	-1;
+	}
+}
+
+/*****************************************************************************/
+// process_frames: buffers into the ring, back to the driver
+/*****************************************************************************/
+int CV4L2Source::process_frames(microseconds timeout){
+
+	// a device that doesn't stream reports an error
+	pollfd		fds[2];
+	fds[0].fd		= streaming ? fd : -1;
+	fds[0].events	= POLLIN;
+	fds[0].revents	= 0;
+	fds[1].fd		= wakeup_fd;
+	fds[1].events	= POLLIN;
+	fds[1].revents	= 0;
+	int		result	= poll(fds, 2, int((timeout.count() + 999) / 1000));
+	if(result < 0 and errno != EINTR){
+		perror("CV4L2Source: poll");
+		throw	-1;
+	}
+	if(fds[1].revents & POLLIN){
+		uint64_t	value;
+		if(read(wakeup_fd, &value, sizeof(value)) < 0){
+			// already cleared
+		}
+	}
+	if(fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)){
+		log << "camera lost " << get_current_date_time_string() << endl;
+		throw	-1;
+	}
+	if((fds[0].revents & POLLIN) == 0){
+		return	0;
+	}
+
+	uint32_t	pixel_format	= fourcc_pixel_format(format_fourcc(config.format));
+	int			framecounter	= 0;
+	while(true){
+		v4l2_buffer		buf;
+		memset(&buf, 0, sizeof(buf));
+		buf.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory		= V4L2_MEMORY_MMAP;
+		if(xioctl(VIDIOC_DQBUF, &buf) < 0){
+			if(errno == EAGAIN){
+				break;
+			}
+			log << "dequeuing buffer failed: " << strerror(errno) << endl;
+			throw	-1;
+		}
+		// corrupt frames are lost, the buffer goes back
+		if((buf.flags & V4L2_BUF_FLAG_ERROR) == 0 and buf.bytesused > 0 and buf.index < buffers.size()){
+			uint64_t	time_stamp	= monotonic ? uint64_t(buf.timestamp.tv_sec) * 1000000000 + uint64_t(buf.timestamp.tv_usec) * 1000 : latch_timestamp();
+			// MJPEG: the size of the JPEG image
+			size_t		size		= min<size_t>(buf.bytesused, payload_size);
+			CFrameSlot*	slot		= begin_frame(size, time_stamp, buf.sequence);
+			if(slot != NULL){
+				slot->width			= config.width;
+				slot->height		= config.height;
+				slot->offset_x		= 0;
+				slot->offset_y		= 0;
+				slot->pixel_format	= pixel_format;
+				memcpy(slot->data.data(), buffers[buf.index].start, size);
+				commit_frame(slot);
+			}
+			framecounter++;
+		}
+		queue_buffer(buf.index);
+	}
+	return	framecounter;
+}
+
+void CV4L2Source::wakeup(){
+	uint64_t	value	= 1;
+	if(write(wakeup_fd, &value, sizeof(value)) < 0){
+		// counter full: a wakeup is pending anyway
+	}
+}
+
+/*****************************************************************************/
+// features
+/*****************************************************************************/
+// the vimba names of the controls
+static string	control_alias(const string& name){
+	if(name == "ExposureTime"){
+		return	"ExposureTimeAbsolute";
+	}
+	return	name;
+}
+
+string CV4L2Source::get_feature(const string& name){
+
+	stringstream	value;
+	if(name == "Width" or name == "Height" or name == "PixelFormat" or name == "PayloadSize"){
+		v4l2_format		format;
+		memset(&format, 0, sizeof(format));
+		format.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if(xioctl(VIDIOC_G_FMT, &format) < 0){
+			throw	-1;
+		}
+		if(name == "Width"){
+			value << format.fmt.pix.width;
+		}else if(name == "Height"){
+			value << format.fmt.pix.height;
+		}else if(name == "PixelFormat"){
+			value << fourcc_name(format.fmt.pix.pixelformat);
+		}else{
+			value << format.fmt.pix.sizeimage;
+		}
+		return	value.str();
+	}
+	if(name == "AcquisitionFrameRate"){
+		v4l2_streamparm		parm;
+		memset(&parm, 0, sizeof(parm));
+		parm.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if(xioctl(VIDIOC_G_PARM, &parm) < 0 or parm.parm.capture.timeperframe.numerator == 0){
+			throw	-1;
+		}
+		value << double(parm.parm.capture.timeperframe.denominator) / parm.parm.capture.timeperframe.numerator;
+		return	value.str();
+	}
+
+	auto	item	= controls.find(control_alias(name));
+	if(item == controls.end()){
+		throw	-1;
+	}
+	v4l2_control	ctrl;
+	ctrl.id			= item->second.id;
+	ctrl.value		= 0;
+	if(xioctl(VIDIOC_G_CTRL, &ctrl) < 0){
+		throw	-1;
+	}
+	// exposure: 100 us per step
+	if(name == "ExposureTime"){
+		value << ctrl.value * 100;
+	}else{
+		value << ctrl.value;
+	}
+	return	value.str();
+}
+
+void CV4L2Source::set_feature(const string& name, const string& value){
+
+	if(name == "Width" or name == "Height" or name == "PixelFormat"){
+		CV4L2Config		old		= config;
+		try{
+			if(name == "PixelFormat"){
+				format_fourcc(value);
+				config.format	= value;
+			}else{
+				int		pixels	= stoi(value);
+				if(pixels <= 0){
+					throw	-1;
+				}
+				(name == "Width" ? config.width : config.height)	= pixels;
+			}
+			// the driver refuses a new format while it has buffers
+			if(buffers.empty() == true){
+				apply_format();
+			}else{
+				format_pending	= true;
+			}
+		}catch(...){
+			config		= old;
+			throw	-1;
+		}
+		return;
+	}
+	if(name == "AcquisitionFrameRate"){
+		double	old		= config.fps;
+		try{
+			config.fps	= stod(value);
+			if(streaming == false){
+				apply_frame_rate();
+			}
+		}catch(...){
+			config.fps	= old;
+			throw	-1;
+		}
+		return;
+	}
+
+	auto	item	= controls.find(control_alias(name));
+	if(item == controls.end()){
+		throw	-1;
+	}
+	v4l2_control	ctrl;
+	ctrl.id			= item->second.id;
+	try{
+		double	number	= stod(value);
+		ctrl.value		= int32_t(name == "ExposureTime" ? number / 100 + 0.5 : number);
+	}catch(...){
+		throw	-1;
+	}
+	if(ctrl.value < item->second.minimum or ctrl.value > item->second.maximum or xioctl(VIDIOC_S_CTRL, &ctrl) < 0){
+		throw	-1;
+	}
+}
+
+bool CV4L2Source::is_feature_writable(const string& name){
+
+	if(name == "PayloadSize"){
+		return	false;
+	}
+	if(name == "Width" or name == "Height" or name == "PixelFormat" or name == "AcquisitionFrameRate"){
+		return	streaming == false;
+	}
+	auto	item	= controls.find(control_alias(name));
+	if(item == controls.end()){
+		return	true;
+	}
+	// the flags change, e.g. grabbed while streaming
+	v4l2_queryctrl		query;
+	memset(&query, 0, sizeof(query));
+	query.id		= item->second.id;
+	if(xioctl(VIDIOC_QUERYCTRL, &query) < 0){
+		return	true;
+	}
+	return	(query.flags & (V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_GRABBED)) == 0;
+}
+
+// the clock of the buffer time stamps
+uint64_t CV4L2Source::latch_timestamp(){
+	if(monotonic == false){
+		return	0;
+	}
+	return	duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,134 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __V4L2_SOURCE_H__
+#define __V4L2_SOURCE_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <linux/videodev2.h>
+
+#include "camera_source.h"
+
+using namespace std;
+
+/*****************************************************************************/
+// CV4L2Config
+/*****************************************************************************/
+// <v4l2> in config.xml
+struct	CV4L2Config{
+	// device file, USB id (vendor:product) for the reset, empty: no reset
+	string				device;
+	string				usb_id;
+	uint32_t			width;
+	uint32_t			height;
+	// fourcc: YUYV, MJPG, GREY, Y16
+	string				format;
+	// 0: as the driver has it
+	double				fps;
+	// mmap buffers of the driver
+	int					buffers;
+
+	CV4L2Config();
+};
+
+/*****************************************************************************/
+// CV4L2Source
+/*****************************************************************************/
+//
+//	a USB webcam via video4linux (the capture of tools/cameraserver/camserv),
+//	so that it gets the camera server, the control port and the statistics
+//	of the vimba cameras.
+//
+//	open resets the camera via libusb (if usb_id is set), opens the device
+//	and sets the image format and frame rate. The driver fills mmap buffers;
+//	process_frames waits for them (poll) in the camera thread itself, copies
+//	them into the server ring and queues them again. YUYV and MJPEG frames
+//	are passed on as they are (PIXEL_FORMAT_YUV422_8, PIXEL_FORMAT_MJPEG),
+//	the client converts them; GREY and Y16 are Mono8 and Mono16.
+//
+//	Features: Width, Height, PixelFormat, AcquisitionFrameRate (not while
+//	acquiring), PayloadSize (read only), ExposureTime (us), Gain, and every
+//	control of the driver by its name without spaces and punctuation (e.g.
+//	"Brightness", "WhiteBalanceTemperatureAuto").
+//
+class	CV4L2Source : public CCameraSource{
+
+	public:
+	CV4L2Source(string cameraID, const CV4L2Config& config, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log);
+	~CV4L2Source();
+
+	void					open(function<void(steady_clock::duration)> rest);
+	void					close();
+
+	void					start_stream();
+	void					stop_stream();
+	bool					payload_changed()		{ return format_pending; };
+	void					start_acquisition();
+	void					stop_acquisition();
+
+	int						process_frames(microseconds timeout);
+	void					wakeup();
+
+	string					get_feature(const string& name);
+	void					set_feature(const string& name, const string& value);
+	bool					is_feature_writable(const string& name);
+	size_t					get_payload_size()		{ return payload_size; };
+	uint64_t				latch_timestamp();
+
+	private:
+	// <default_setting> entries of config.xml
+	string					cameraID;
+	CV4L2Config				config;
+	int						fd;
+	// process_frames wakes up when it is written
+	int						wakeup_fd;
+
+	// mmap buffers
+	struct	CBuffer{
+		void*				start;
+		size_t				length;
+	};
+	vector<CBuffer>			buffers;
+	size_t					payload_size;
+	bool					streaming;
+	// buffer time stamps on CLOCK_MONOTONIC (steady_clock)
+	bool					monotonic;
+	// image format written while buffers are allocated
+	bool					format_pending;
+
+	// controls of the driver by name
+	map<string, v4l2_queryctrl>		controls;
+
+	// ioctl, retried while interrupted; -1 on errors
+	int						xioctl(unsigned long request, void* arg);
+	void					reset_usb();
+	// config.width / height / format / fps to the driver
+	void					apply_format();
+	void					apply_frame_rate();
+	void					load_controls();
+	// queues a buffer to the driver
+	void					queue_buffer(uint32_t index);
+};
+
+/*****************************************************************************/
+#endif
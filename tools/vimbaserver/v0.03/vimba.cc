@@ -226,9 +226,9 @@ void	CVimbaCamera::open(CameraPtr apicamera, VmbAccessModeType access_mode){
 	this->apicamera		= apicamera;
 
 	// open camera
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->Open(access_mode); 
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba camera open VmbAccessModeFull failed");
@@ -236,7 +236,9 @@ void	CVimbaCamera::open(CameraPtr apicamera, VmbAccessModeType access_mode){
 	}
 
 	this->camera_opened	= true;
-	
+
+	// feature handles for all later accesses
+	load_features();
 }
 
 
@@ -249,12 +251,13 @@ void	CVimbaCamera::close(){
 
 	if(camera_opened	== true){
 		camera_opened	= false;
+		features.clear();
 		// close the camera
 		cout	<< "close camera" << endl;
 
-		vimba->access_mutex.lock();
+		camera_mutex.lock();
 		err 				= apicamera->Close();; 
-		vimba->access_mutex.unlock();
+		camera_mutex.unlock();
 
 		if(err != VmbErrorSuccess){
 			perror ("vimba camera close failed");
@@ -287,9 +290,9 @@ void	CVimbaCamera::announce_frame(FramePtr frame){
 	assert_open_camera();
 
 	// execute command
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->AnnounceFrame(frame); 
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 	
 	if(err != VmbErrorSuccess){
 		perror ("vimba AnnounceFrame failed");
@@ -307,9 +310,9 @@ void	CVimbaCamera::start_capture(){
 	assert_open_camera();
 
 	// execute command
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->StartCapture(); 
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba StartCapture failed");
@@ -327,9 +330,9 @@ void	CVimbaCamera::queue_frame(FramePtr frame){
 	assert_open_camera();
 
 	// execute command
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->QueueFrame(frame); 
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba QueueFrame failed");
@@ -347,9 +350,9 @@ void	CVimbaCamera::end_capture(){
 	assert_open_camera();
 
 	// execute command
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->EndCapture(); 
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba EndCapture failed");
@@ -367,9 +370,9 @@ void	CVimbaCamera::flush_queue(){
 	assert_open_camera();
 
 	// execute command
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->FlushQueue(); 
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba FlushQueue failed");
@@ -387,9 +390,9 @@ void	CVimbaCamera::revoke_all_frames(){
 	assert_open_camera();
 
 	// execute command
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->RevokeAllFrames(); 
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba RevokeAllFrames failed");
@@ -409,9 +412,9 @@ void	CVimbaCamera::get_info(){
 	assert_open_camera();
 
 	// get camera ID
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 		= apicamera->GetID(camID);
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 
 	if(err != VmbErrorSuccess){
@@ -420,9 +423,9 @@ void	CVimbaCamera::get_info(){
 	}
 	
 	// get camera name
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 		= apicamera->GetName(camname);
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba camera GetName failed");
@@ -430,9 +433,9 @@ void	CVimbaCamera::get_info(){
 	}
 	
 	// get camera model
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 		= apicamera->GetModel(cammodel);
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba camera GetModel failed");
@@ -440,9 +443,9 @@ void	CVimbaCamera::get_info(){
 	}						
 
 	// get camera serial number
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 		= apicamera->GetSerialNumber(camserial);
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba camera GetSerialNumber failed");
@@ -450,9 +453,9 @@ void	CVimbaCamera::get_info(){
 	}	
 
 	// get camera model
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 		= apicamera->GetInterfaceID(camintID);
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba camera GetInterfaceID failed");
@@ -471,9 +474,9 @@ FeaturePtrVector	CVimbaCamera::get_feature_list(){
 	assert_open_camera();
 
 	FeaturePtrVector	feature_list;
-	vimba->access_mutex.lock();
+	camera_mutex.lock();
 	err 				= apicamera->GetFeatures(feature_list);
-	vimba->access_mutex.unlock();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
 		perror ("vimba camera GetFeatures failed");
@@ -484,38 +487,91 @@ FeaturePtrVector	CVimbaCamera::get_feature_list(){
 }
 
 /*********************************************************/
-// run a vimba command
+// feature handles of the open camera
 /*********************************************************/
+// once per open, all with one lock: name and type of every feature
 
-void	CVimbaCamera::run_command(string feature_name){
+void	CVimbaCamera::load_features(){
+
+	features.clear();
+
+	FeaturePtrVector	feature_list;
+	camera_mutex.lock();
+	err 				= apicamera->GetFeatures(feature_list);
+	for(FeaturePtr& vimba_feature : feature_list){
+		string			name;
+		CVimbaFeature	handle;
+		handle.feature	= vimba_feature;
+		if(vimba_feature->GetName(name) == VmbErrorSuccess and vimba_feature->GetDataType(handle.type) == VmbErrorSuccess){
+			features[name]	= handle;
+		}
+	}
+	camera_mutex.unlock();
+
+	if(err != VmbErrorSuccess){
+		perror ("vimba camera GetFeatures failed");
+		throw -1;
+	}
+}
+
+/*********************************************************/
+// cached feature handle
+/*********************************************************/
+// features that weren't in the list are looked up by name once, NULL if
+// the camera doesn't have it
+
+CVimbaFeature*	CVimbaCamera::lookup_feature(const string& feature_name){
 
 	assert_open_camera();
 
-	FeaturePtr		vimba_feature;
-	string			err_msg;
-	const char*		cfeature_name 	= feature_name.c_str();
-	
-	// get the feature
-	vimba->access_mutex.lock();
-	err 		= apicamera->GetFeatureByName(cfeature_name, vimba_feature);
-	vimba->access_mutex.unlock();
+	// the camera doesn't have it: empty handle
+	auto	item	= features.find(feature_name);
+	if(item != features.end()){
+		return	item->second.feature == NULL ? NULL : &item->second;
+	}
+
+	CVimbaFeature	handle;
+	camera_mutex.lock();
+	err 		= apicamera->GetFeatureByName(feature_name.c_str(), handle.feature);
+	if(err == VmbErrorSuccess){
+		err		= handle.feature->GetDataType(handle.type);
+	}
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg				= "vimba GetFeatureByName " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		features[feature_name]	= CVimbaFeature();
+		return	NULL;
+	}
+	return	&(features[feature_name] = handle);
+}
+
+CVimbaFeature&	CVimbaCamera::get_feature(const string& feature_name){
+
+	CVimbaFeature*	handle	= lookup_feature(feature_name);
+	if(handle == NULL){
+		string	err_msg		= "vimba GetFeatureByName " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
+	return	*handle;
+}
+
+/*********************************************************/
+// run a vimba command
+/*********************************************************/
+
+void	CVimbaCamera::run_command(string feature_name){
+
+	CVimbaFeature&	handle	= get_feature(feature_name);
+
 	// run command
-	VmbInt64_t 	value;
-	vimba->access_mutex.lock();
-	err			= vimba_feature->RunCommand();
-	vimba->access_mutex.unlock();
+	camera_mutex.lock();
+	err			= handle.feature->RunCommand();
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg	= "vimba RunCommand for " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		string	err_msg		= "vimba RunCommand for " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
 
@@ -527,75 +583,40 @@ void	CVimbaCamera::run_command(string feature_name){
 
 string	CVimbaCamera::get_feature_value_enum(string feature_name){
 
-	assert_open_camera();
-
-	FeaturePtr		vimba_feature;
-	string			err_msg;
-	const char*		cfeature_name 	= feature_name.c_str();
-	
-	// get the feature
-	vimba->access_mutex.lock();
-	err 		= apicamera->GetFeatureByName(cfeature_name, vimba_feature);
-	vimba->access_mutex.unlock();
+	CVimbaFeature&	handle	= get_feature(feature_name);
 
-	if(err != VmbErrorSuccess){
-		err_msg				= "vimba GetFeatureByName " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
-		throw -1;
-	}
 	// get the value of the feature
 	string 		value;
-	vimba->access_mutex.lock();
-	err			= vimba_feature->GetValue(value);
-	vimba->access_mutex.unlock();
-
+	camera_mutex.lock();
+	err			= handle.feature->GetValue(value);
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg	= "vimba GetValue of " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		string	err_msg		= "vimba GetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
 
 	return	value;
 }
 
-
 /*********************************************************/
 // get a vimba feature value: VmbInt64_t
 /*********************************************************/
 
 VmbInt64_t	CVimbaCamera::get_feature_value(string feature_name){
 
-	assert_open_camera();
+	CVimbaFeature&	handle	= get_feature(feature_name);
 
-	FeaturePtr		vimba_feature;
-	string			err_msg;
-	const char*		cfeature_name 	= feature_name.c_str();
-	
-	// get the feature
-	vimba->access_mutex.lock();
-	err 		= apicamera->GetFeatureByName(cfeature_name, vimba_feature);
-	vimba->access_mutex.unlock();
-
-	if(err != VmbErrorSuccess){
-		err_msg				= "vimba GetFeatureByName " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
-		throw -1;
-	}
 	// get the value of the feature
 	VmbInt64_t 	value;
-	vimba->access_mutex.lock();
-	err			= vimba_feature->GetValue(value);
-	vimba->access_mutex.unlock();
-
+	camera_mutex.lock();
+	err			= handle.feature->GetValue(value);
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg	= "vimba GetValue of " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		string	err_msg		= "vimba GetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
 
@@ -608,33 +629,17 @@ VmbInt64_t	CVimbaCamera::get_feature_value(string feature_name){
 
 double	CVimbaCamera::get_feature_value_double(string feature_name){
 
-	assert_open_camera();
-
-	FeaturePtr		vimba_feature;
-	string			err_msg;
-	const char*		cfeature_name 	= feature_name.c_str();
-	
-	// get the feature
-	vimba->access_mutex.lock();
-	err 		= apicamera->GetFeatureByName(cfeature_name, vimba_feature);
-	vimba->access_mutex.unlock();
+	CVimbaFeature&	handle	= get_feature(feature_name);
 
-	if(err != VmbErrorSuccess){
-		err_msg				= "vimba GetFeatureByName " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
-		throw -1;
-	}
 	// get the value of the feature
 	double 		value;
-	vimba->access_mutex.lock();
-	err			= vimba_feature->GetValue(value);
-	vimba->access_mutex.unlock();
+	camera_mutex.lock();
+	err			= handle.feature->GetValue(value);
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg	= "vimba GetValue of " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		string	err_msg		= "vimba GetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
 
@@ -647,32 +652,16 @@ double	CVimbaCamera::get_feature_value_double(string feature_name){
 
 void	CVimbaCamera::set_feature_value(string feature_name, VmbInt64_t value){
 
-	assert_open_camera();
-
-	FeaturePtr		vimba_feature;
-	string			err_msg;
-	const char*		cfeature_name 	= feature_name.c_str();
-	
-	// get the feature
-	vimba->access_mutex.lock();
-	err 		= apicamera->GetFeatureByName(cfeature_name, vimba_feature);
-	vimba->access_mutex.unlock();
+	CVimbaFeature&	handle	= get_feature(feature_name);
 
-	if(err != VmbErrorSuccess){
-		err_msg				= "vimba GetFeatureByName " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
-		throw -1;
-	}
 	// set the value of the feature
-	vimba->access_mutex.lock();
-	err			= vimba_feature->SetValue(value);
-	vimba->access_mutex.unlock();
+	camera_mutex.lock();
+	err			= handle.feature->SetValue(value);
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg	= "vimba SetValue of " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		string	err_msg		= "vimba SetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
 
@@ -684,74 +673,252 @@ void	CVimbaCamera::set_feature_value(string feature_name, VmbInt64_t value){
 
 void	CVimbaCamera::set_feature_value_enum(string feature_name, string value){
 
-	assert_open_camera();
+	CVimbaFeature&	handle	= get_feature(feature_name);
 
-	FeaturePtr		vimba_feature;
-	string			err_msg;
-	const char*		cfeature_name 	= feature_name.c_str();
-	
-	// get the feature
-	vimba->access_mutex.lock();
-	err 		= apicamera->GetFeatureByName(cfeature_name, vimba_feature);
-	vimba->access_mutex.unlock();
+	// set the value of the feature
+	camera_mutex.lock();
+	err			= handle.feature->SetValue(value.c_str());
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg				= "vimba GetFeatureByName " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		string	err_msg		= "vimba SetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
+
+}
+
+/*********************************************************/
+// set a vimba feature value: double
+/*********************************************************/
+
+void	CVimbaCamera::set_feature_value_double(string feature_name, double value){
+
+	CVimbaFeature&	handle	= get_feature(feature_name);
+
 	// set the value of the feature
-	vimba->access_mutex.lock();
-	err			= vimba_feature->SetValue(value.c_str());
-	vimba->access_mutex.unlock();
+	camera_mutex.lock();
+	err			= handle.feature->SetValue(value);
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg	= "vimba SetValue of " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
+		string	err_msg		= "vimba SetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
+		cout	<< "set_feature_value_double failed, SetValue " << err << endl;
 		throw -1;
 	}
 
 }
 
+
+
 /*********************************************************/
-// set a vimba feature value: double
+// data type of a vimba feature
 /*********************************************************/
 
-void	CVimbaCamera::set_feature_value_double(string feature_name, double value){
+VmbFeatureDataType	CVimbaCamera::get_feature_type(string feature_name){
+	return	get_feature(feature_name).type;
+}
 
-	assert_open_camera();
+/*********************************************************/
+// any feature as text, lock held by the caller
+/*********************************************************/
 
-	FeaturePtr		vimba_feature;
-	string			err_msg;
-	const char*		cfeature_name 	= feature_name.c_str();
-	
-	// get the feature
-	vimba->access_mutex.lock();
-	err 		= apicamera->GetFeatureByName(cfeature_name, vimba_feature);
-	vimba->access_mutex.unlock();
+VmbErrorType	CVimbaCamera::read_text(const CVimbaFeature& handle, string& text){
+
+	stringstream		value;
+	VmbErrorType		result;
+	switch(handle.type){
+		case	VmbFeatureDataInt:{
+			VmbInt64_t	intvalue	= 0;
+			result		= handle.feature->GetValue(intvalue);
+			value		<< intvalue;
+			break;
+		}
+		case	VmbFeatureDataFloat:{
+			double		doublevalue	= 0;
+			result		= handle.feature->GetValue(doublevalue);
+			value		<< doublevalue;
+			break;
+		}
+		case	VmbFeatureDataEnum:
+		case	VmbFeatureDataString:{
+			string		stringvalue;
+			result		= handle.feature->GetValue(stringvalue);
+			value		<< stringvalue;
+			break;
+		}
+		case	VmbFeatureDataBool:{
+			bool		flag		= false;
+			result		= handle.feature->GetValue(flag);
+			value		<< (flag ? "true" : "false");
+			break;
+		}
+		default:
+			// commands and the like have no value
+			return	VmbErrorWrongType;
+	}
+	text	= value.str();
+	return	result;
+}
+
+// commands are run, the value is ignored
+VmbErrorType	CVimbaCamera::write_text(const CVimbaFeature& handle, const string& text){
+
+	stringstream		convert(text);
+	switch(handle.type){
+		case	VmbFeatureDataInt:{
+			VmbInt64_t	intvalue;
+			if(!(convert >> intvalue)){
+				return	VmbErrorWrongType;
+			}
+			return	handle.feature->SetValue(intvalue);
+		}
+		case	VmbFeatureDataFloat:{
+			double		doublevalue;
+			if(!(convert >> doublevalue)){
+				return	VmbErrorWrongType;
+			}
+			return	handle.feature->SetValue(doublevalue);
+		}
+		case	VmbFeatureDataEnum:{
+			// enum entries by name or by value (config.xml: PixelFormat)
+			VmbInt64_t	intvalue;
+			if(convert >> intvalue and convert.peek() == EOF){
+				return	handle.feature->SetValue(intvalue);
+			}
+			return	handle.feature->SetValue(text.c_str());
+		}
+		case	VmbFeatureDataString:
+			return	handle.feature->SetValue(text.c_str());
+		case	VmbFeatureDataBool:
+			return	handle.feature->SetValue(text == "true" or text == "1" or text == "on");
+		case	VmbFeatureDataCommand:
+			return	handle.feature->RunCommand();
+		default:
+			return	VmbErrorWrongType;
+	}
+}
+
+/*********************************************************/
+// get a vimba feature of any type as text
+/*********************************************************/
+
+string	CVimbaCamera::get_feature_string(string feature_name){
+
+	CVimbaFeature&	handle	= get_feature(feature_name);
+
+	string		value;
+	camera_mutex.lock();
+	err			= read_text(handle, value);
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg				= "vimba GetFeatureByName " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
-		cout	<< "set_feature_value_double failed, GetFeatureByName " << err << endl;
+		string	err_msg		= "vimba GetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
 		throw -1;
 	}
-	// set the value of the feature
-	vimba->access_mutex.lock();
-	err			= vimba_feature->SetValue(value);
-	vimba->access_mutex.unlock();
+	return	value;
+}
+
+/*********************************************************/
+// set a vimba feature of any type from text
+/*********************************************************/
+
+void	CVimbaCamera::set_feature_string(string feature_name, string value){
+
+	CVimbaFeature&	handle	= get_feature(feature_name);
+
+	camera_mutex.lock();
+	err			= write_text(handle, value);
+	camera_mutex.unlock();
 
 	if(err != VmbErrorSuccess){
-		err_msg	= "vimba SetValue of " + feature_name + " failed";
-		const char*	errmsg 	= err_msg.c_str();
-		perror (errmsg);
-		cout	<< "set_feature_value_double failed, SetValue " << err << endl;
+		string	err_msg		= "vimba SetValue of " + feature_name + " failed";
+		perror (err_msg.c_str());
+		throw -1;
+	}
+}
+
+/*********************************************************/
+// batches: one lock for all features
+/*********************************************************/
+
+void	CVimbaCamera::get_features(vector<CFeatureValue>& batch){
+
+	vector<CVimbaFeature*>	handles;
+	for(CFeatureValue& item : batch){
+		handles.push_back(lookup_feature(item.name));
+	}
+
+	camera_mutex.lock();
+	for(size_t i = 0; i < batch.size(); i++){
+		batch[i].ok		= handles[i] != NULL and read_text(*handles[i], batch[i].value) == VmbErrorSuccess;
+	}
+	camera_mutex.unlock();
+}
+
+// in order: a feature may depend on the ones before (e.g. Width on binning)
+void	CVimbaCamera::set_features(vector<CFeatureValue>& batch){
+
+	vector<CVimbaFeature*>	handles;
+	for(CFeatureValue& item : batch){
+		handles.push_back(lookup_feature(item.name));
+	}
+
+	camera_mutex.lock();
+	for(size_t i = 0; i < batch.size(); i++){
+		batch[i].ok		= handles[i] != NULL and write_text(*handles[i], batch[i].value) == VmbErrorSuccess;
+	}
+	camera_mutex.unlock();
+}
+
+/*********************************************************/
+// can the feature be written right now
+/*********************************************************/
+
+bool	CVimbaCamera::is_feature_writable(string feature_name){
+
+	CVimbaFeature&	handle	= get_feature(feature_name);
+
+	bool			writable	= false;
+	camera_mutex.lock();
+	err			= handle.feature->IsWritable(writable);
+	camera_mutex.unlock();
+
+	if(err != VmbErrorSuccess){
+		perror (("vimba IsWritable of " + feature_name + " failed").c_str());
 		throw -1;
 	}
+	return	writable;
+}
+
+/*********************************************************/
+// latch the camera clock
+/*********************************************************/
+// SFNC names (USB, Alvium) first, then the GigE ones
+
+VmbUint64_t	CVimbaCamera::latch_timestamp(){
 
+	const char*		names[][2]	= {{"TimestampLatch", "TimestampLatchValue"}, {"GevTimestampControlLatch", "GevTimestampValue"}};
+	for(auto& name : names){
+		CVimbaFeature*	latch		= lookup_feature(name[0]);
+		CVimbaFeature*	latch_value	= lookup_feature(name[1]);
+		if(latch == NULL or latch_value == NULL){
+			continue;
+		}
+		VmbInt64_t		value		= 0;
+		camera_mutex.lock();
+		err		= latch->feature->RunCommand();
+		if(err == VmbErrorSuccess){
+			err		= latch_value->feature->GetValue(value);
+		}
+		camera_mutex.unlock();
+		if(err == VmbErrorSuccess){
+			return	value;
+		}
+	}
+	return	0;
 }
 
 
@@ -25,8 +25,13 @@
 // IMPORTANT: only one object of the CVimba class should exist which opens the 
 // vimba api. This object is thread-save and could be accessed by multiple
 // threads. The CVimbaCamera-objects aren't thread save, i.e., each object should
-// belong to a specific thread. Calling the vimba interface is made sequential
-// via the mutex of the global vimba class though.
+// belong to a specific thread.
+//
+// Locking: system-wide calls (startup, shutdown, camera list) are made
+// sequential via the mutex of the global vimba class, the calls on a camera
+// (features, frames, capture) via the mutex of its CVimbaCamera object only.
+// A slow feature write on one camera doesn't hold up the frames of another
+// (see bench_locking.cc).
 //
 // still, add this only once: mutex		CVimba::access_mutex;
 //
@@ -49,6 +54,8 @@
 #include <thread>
 #include <mutex>
 
+#include <map>
+
 
 // Vimba include files
 #include "VimbaCPP/Include/VimbaCPP.h"
@@ -98,6 +105,7 @@ class	CVimba{
 		friend class CVimbaCamera;
 		
 		// there should only be one object. but just in case, let's have it static 
+		// (system-wide calls only)
 		static mutex			access_mutex;
 
 
@@ -118,8 +126,25 @@ class	CVimba{
 /*  
  * provides high-level functionality for the vimba api
  *
+ * The features of the camera are looked up once when it is opened (handle
+ * and data type by name). Each access takes the camera_mutex of this camera
+ * once, so calls on other cameras are not held up; the batch calls take it
+ * once for all features of the batch.
  */
 
+// feature handle of an open camera
+struct	CVimbaFeature{
+	FeaturePtr			feature;
+	VmbFeatureDataType	type;
+};
+
+// batch entry: value as text, ok: it was read / written
+struct	CFeatureValue{
+	string				name;
+	string				value;
+	bool				ok;
+};
+
 class	CVimbaCamera {
 	public:
 		// constructor
@@ -151,6 +176,22 @@ class	CVimbaCamera {
 		void				set_feature_value_double(string feature_name, double value);
 		void				set_feature_value_enum(string feature_name, string value);
 
+		// any feature as text (int, float, enum, string, bool), setting a
+		// command feature runs it
+		VmbFeatureDataType	get_feature_type(string feature_name);
+		string				get_feature_string(string feature_name);
+		void				set_feature_string(string feature_name, string value);
+		// all features of the batch with one lock, in order (a feature
+		// may depend on the ones before); unknown features aren't ok
+		void				get_features(vector<CFeatureValue>& batch);
+		void				set_features(vector<CFeatureValue>& batch);
+
+		// false e.g. for PixelFormat or binning while the camera acquires
+		bool				is_feature_writable(string feature_name);
+		// current time of the camera clock (the clock of the frame time
+		// stamps), 0 if the camera can't latch it
+		VmbUint64_t			latch_timestamp();
+
 		// camere information, read out from the camera by the class constructor
 		string				get_camID()			{ return camID;};
 		string				get_camname()		{ return camname;};
@@ -176,8 +217,10 @@ class	CVimbaCamera {
 
 				
 	protected:
-		// pointer to the vimba object that is used for thread safety
+		// the vimba api
 		CVimba*					vimba;
+		// calls on this camera
+		mutex					camera_mutex;
 
 		// error return code (if available)
 		VmbErrorType 			err;	
@@ -193,6 +236,17 @@ class	CVimbaCamera {
 		bool					camera_opened;		
 		void					assert_open_camera();
 
+		// feature handles by name, loaded by open
+		map<string, CVimbaFeature>	features;
+		void					load_features();
+		// NULL if the camera has no such feature
+		CVimbaFeature*			lookup_feature(const string& feature_name);
+		// throws -1 if the camera has no such feature
+		CVimbaFeature&			get_feature(const string& feature_name);
+		// value as text, call with camera_mutex held
+		VmbErrorType			read_text(const CVimbaFeature& handle, string& text);
+		VmbErrorType			write_text(const CVimbaFeature& handle, const string& text);
+
 };
 
 /*****************************************************************************/
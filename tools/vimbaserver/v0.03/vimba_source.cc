@@ -0,0 +1,481 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+
+#include <cstring>
+#include <iostream>
+
+#include "vimba_source.h"
+
+// small helper functions
+#include "tools.h"
+
+#include	"global.h"
+extern	CVimba		global_vimba;
+
+/*****************************************************************************/
+// xml parsing: config file
+/*****************************************************************************/
+#include "pugixml.hpp"
+extern pugi::xml_document 	xmlconfig;
+extern mutex				xmlconfig_mutex;
+
+
+/*****************************************************************************/
+// callback: camera provides a new frame
+/*****************************************************************************/
+class FrameObserver : public IFrameObserver{
+	public:
+		// constructor
+		FrameObserver (CameraPtr apicamera, CVimbaSource* source) : IFrameObserver (apicamera){ this->source = source; };
+		// callback
+		void	FrameReceived (const FramePtr frame){ source->frame_received(frame); };
+
+	private:
+		// copies the frames into the server ring
+		CVimbaSource*		source;
+};
+
+/*****************************************************************************/
+// frame class: overloaded destructor to make sure frames get deleted
+/*****************************************************************************/
+class MyFrame : public Frame{
+	public:
+	MyFrame(VmbInt64_t framesize) : Frame(framesize){};
+	~MyFrame() {
+	//cout << "Frame deleted" << endl;
+	};
+};
+
+
+/*****************************************************************************/
+// constructor
+/*****************************************************************************/
+CVimbaSource::CVimbaSource(string cameraID, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log)
+	: CCameraSource(framering, settings, control, log), camera(&global_vimba), framequeue(NUMBER_OF_FRAMES_IN_BUFFER + 1){
+
+	this->cameraID		= cameraID;
+	this->payload_size	= 0;
+	wakeup_pending		= false;
+
+	for(const char* name : {"PixelFormat", "ExposureTime", "Gain", "DeviceLinkSpeed", "DeviceLinkThroughputLimit",
+							"AcquisitionFrameRate", "Height", "Width", "BinningHorizontal", "BinningVertical",
+							"PayloadSize", "LineSelector", "LineMode", "TriggerSource", "TriggerMode"}){
+		featurelist.push_back({name, "", false});
+	}
+}
+
+/*****************************************************************************/
+// destructor
+/*****************************************************************************/
+CVimbaSource::~CVimbaSource(){
+	try{
+		camera.close();
+	}catch(...){
+	}
+}
+
+/*****************************************************************************/
+// callback: copy the frame into the server ring
+/*****************************************************************************/
+void CVimbaSource::frame_received(const FramePtr frame){
+
+	VmbErrorType    err;
+	VmbUint32_t		buffer_size		= 0;
+	VmbUchar_t*		data			= NULL;
+
+	VmbUint64_t		frame_id		= 0;
+	frame->GetFrameID(frame_id);
+	cout	 << get_current_date_time_string() << " FrameObserver: new frame " << frame_id  << endl;
+
+	err					= frame->GetBufferSize(buffer_size);
+	if(err == VmbErrorSuccess){
+		err				= frame->GetImage(data);
+	}
+	if(err != VmbErrorSuccess or data == NULL){
+		perror("FrameObserver GetImage error");
+		// the camera gets the frame back anyway
+		framequeue.push(frame);
+		return;
+	}
+
+	VmbUint32_t		width			= 0;
+	VmbUint32_t		height			= 0;
+	VmbUint32_t		offset_x		= 0;
+	VmbUint32_t		offset_y		= 0;
+	VmbUint32_t		pixel_format	= 0;
+	VmbUint64_t		time_stamp		= 0;
+
+	frame->GetWidth(width);
+	frame->GetHeight(height);
+	frame->GetOffsetX(offset_x);
+	frame->GetOffsetY(offset_y);
+	frame->GetPixelFormat((VmbPixelFormatType&)pixel_format);
+	frame->GetTimestamp(time_stamp);
+
+	CFrameSlot*		slot	= begin_frame(buffer_size, time_stamp, frame_id);
+	if(slot != NULL){
+		slot->width			= width;
+		slot->height		= height;
+		slot->offset_x		= offset_x;
+		slot->offset_y		= offset_y;
+		slot->pixel_format	= pixel_format;
+		memcpy(slot->data.data(), data, buffer_size);
+		commit_frame(slot);
+	}
+
+	// the camera gets the frame back at once
+	framequeue.push(frame);
+}
+
+
+/*****************************************************************************/
+// find the camera
+/*****************************************************************************/
+CameraPtr CVimbaSource::find(function<void(steady_clock::duration)> rest){
+
+	while(true){
+		try{
+			log << "trying to open camera: " << cameraID << " " << get_current_date_time_string() << endl;
+			return	global_vimba.get_apicamera_by_id(cameraID);
+		}catch(...){
+			log << "vimba get_apicamera_by_id failed" << endl;
+			rest(seconds(CAMERA_ERROR_TIMEOUT_S));
+		}
+	}
+}
+
+/*****************************************************************************/
+// open: find, reset, configure
+/*****************************************************************************/
+void CVimbaSource::open(function<void(steady_clock::duration)> rest){
+
+	CameraPtr		apicamera	= find(rest);
+	control->set_state(CAMERA_STATE_OPENING);
+
+	/***********************************************/
+	// close camera
+	/***********************************************/
+	try{
+		camera.close();
+	}catch(...){
+		log << "error closing camera" << endl;
+		throw	-1;
+	}
+	/***********************************************/
+	// open camera
+	/***********************************************/
+	try{
+		camera.open(apicamera);
+	}catch(...){
+		log << "error opening camera" << endl;
+		throw	-1;
+	}
+	/***********************************************/
+	// reset camera
+	/***********************************************/
+	try{
+		camera.run_command("DeviceReset");
+	}catch(...){
+		log << "error reseting camera" << endl;
+		throw	-1;
+	}
+	rest(5s);
+
+	/***********************************************/
+	// open camera again
+	/***********************************************/
+	apicamera	= find(rest);
+	try{
+		camera.open(apicamera);
+	}catch(...){
+		log << "error opening camera" << endl;
+		throw	-1;
+	}
+	configure();
+}
+
+/*****************************************************************************/
+// default settings of the config file
+/*****************************************************************************/
+void CVimbaSource::configure(){
+
+	/***********************************************/
+	// xml parsing
+	/***********************************************/
+	auto	configure_start		= steady_clock::now();
+	log << endl;
+	log << "parse config file for camera default values" << endl;
+	vector<CFeatureValue>	default_settings;
+	vector<string>			comments;
+	xmlconfig_mutex.lock();
+	for (pugi::xml_node xmlcamera : xmlconfig.child("config").children("camera"))
+	{
+		if(cameraID == xmlcamera.attribute("id").as_string()){
+			log << "camera config information found: " << endl;
+			log << endl;
+			for (pugi::xml_node default_setting : xmlcamera.children("default_setting"))
+			{
+				string	attribute		= default_setting.attribute("name").as_string();
+				string	value			= default_setting.attribute("value").as_string();
+				string	method			= default_setting.attribute("method").as_string();
+				string	comment			= default_setting.attribute("comment").as_string();
+
+				// the type comes from the camera, the method is checked only
+				if(method == "VmbInt64_t" or method == "double" or method == "enum"){
+					default_settings.push_back({attribute, value, false});
+					comments.push_back(comment);
+				}else{
+					log << "method unknown: " << method << endl;
+				}
+			}
+		}
+	}
+	xmlconfig_mutex.unlock();
+
+	// one batch, in the order of the config file
+	camera.set_features(default_settings);
+	for(size_t i = 0; i < default_settings.size(); i++){
+		string	attribute		= default_settings[i].name;
+		attribute.resize(40,' ');
+		if(default_settings[i].ok == true){
+			log << "successful set " << attribute << " to " << default_settings[i].value << " " << comments[i] << endl;
+		}else{
+			log << "ERROR setting  " << attribute << " to " << default_settings[i].value << " " << comments[i] << endl;
+		}
+	}
+	auto	configure_time		= steady_clock::now() - configure_start;
+
+	/***********************************************/
+	// retrieve basic camera info
+	/***********************************************/
+	try{
+		camera.get_info();
+		log	<< endl;
+		log	<< "===== camera " << camera.get_camID() << " =====" << endl;
+		log << endl;
+	}catch(...){
+		log << "error get_info" << endl;
+		throw	-1;
+	}
+	/***********************************************/
+	// get & print current camera parameters
+	/***********************************************/
+	auto	dump_start			= steady_clock::now();
+	camera.get_features(featurelist);
+	auto	dump_time			= steady_clock::now() - dump_start;
+	for(auto& item : featurelist){
+		string	printstring	= item.name + ":";
+		printstring.resize(40,' ');
+		log << printstring;
+		if(item.ok == false){
+			log << "error reading" << endl;
+			throw	-1;
+		}
+		log << item.value << endl;
+	}
+	log << endl;
+	log << "configuration: " << default_settings.size() << " settings in " << duration<double, milli>(configure_time).count() << " ms, ";
+	log << featurelist.size() << " features read in " << duration<double, milli>(dump_time).count() << " ms" << endl;
+	log << endl;
+}
+
+/*****************************************************************************/
+// close
+/*****************************************************************************/
+void CVimbaSource::close(){
+	camera.close();
+}
+
+/*****************************************************************************/
+// start_stream: new frames
+/*****************************************************************************/
+void CVimbaSource::start_stream(){
+
+	// get current payload size
+	try{
+		payload_size	=	camera.get_feature_value("PayloadSize");
+	}catch(...){
+		log << "error reading PayloadSize" << endl;
+		throw	-1;
+	}
+
+	// frames of an earlier stream
+	drain();
+
+	// server ring: preallocate the image buffers
+	framering->allocate(payload_size);
+
+	// create new frames
+	try{
+		for (int i = 0; i < NUMBER_OF_FRAMES_IN_BUFFER; i++){
+			FramePtr			frame		= FramePtr(new MyFrame(payload_size));
+			IFrameObserverPtr	observer	= IFrameObserverPtr(new FrameObserver(camera.get_apicamera(), this));
+
+			frame_list.push_back(frame);
+			fobserver_list.push_back(observer);
+		}
+	}catch(...){
+		log << "error creating frames" << endl;
+		throw	-1;
+	}
+
+	// register observer, announce frames
+	try{
+		for (int i = 0; i < NUMBER_OF_FRAMES_IN_BUFFER; i++){
+			frame_list[i]->RegisterObserver(fobserver_list[i]);
+			camera.announce_frame(frame_list[i]);
+		}
+	}catch(...){
+		log << "error RegisterObserver / announce_frame" << endl;
+		throw	-1;
+	}
+
+	// start the capture engine
+	try{
+		camera.start_capture();
+	}catch(...){
+		log << "error start_capture" << endl;
+		throw	-1;
+	}
+
+	// queue frames
+	try{
+		for (int i = 0; i < NUMBER_OF_FRAMES_IN_BUFFER; i++){
+			camera.queue_frame(frame_list[i]);
+		}
+	}catch(...){
+		log << "error queue_frame" << endl;
+		throw	-1;
+	}
+}
+
+/*****************************************************************************/
+// stop_stream: frames revoked
+/*****************************************************************************/
+void CVimbaSource::stop_stream(){
+
+	// clean up after the acquisition
+	try{
+		camera.end_capture();
+		camera.flush_queue();
+		camera.revoke_all_frames();
+	}catch(...){
+		log << "error cleaning up after acquisition" << endl;
+		throw	-1;
+	}
+
+	// unregister observers
+	try{
+		for (auto& frame : frame_list){
+			frame->UnregisterObserver();
+		}
+	}catch(...){
+		log << "error UnregisterObserver" << endl;
+		throw	-1;
+	}
+
+	drain();
+	frame_list.clear();
+	fobserver_list.clear();
+}
+
+// frames returned meanwhile are gone, a wakeup (empty frame) stays
+void CVimbaSource::drain(){
+	FramePtr		old_frame;
+	int				wakeups		= 0;
+	while(framequeue.try_pop(old_frame) == true){
+		if(old_frame == NULL){
+			wakeups++;
+		}
+	}
+	for(int i = 0; i < wakeups; i++){
+		framequeue.push(FramePtr());
+	}
+}
+
+bool CVimbaSource::payload_changed(){
+	return	camera.get_feature_value("PayloadSize") != payload_size;
+}
+
+/*****************************************************************************/
+// acquisition
+/*****************************************************************************/
+void CVimbaSource::start_acquisition(){
+	camera.run_command("AcquisitionStart");
+}
+
+void CVimbaSource::stop_acquisition(){
+	camera.run_command("AcquisitionStop");
+}
+
+/*****************************************************************************/
+// process_frames: queue the returned frames again
+/*****************************************************************************/
+int CVimbaSource::process_frames(microseconds timeout){
+
+	int				framecounter	= 0;
+	FramePtr		frame;
+	// sleep until a frame is returned
+	if(framequeue.pop_wait(frame, timeout) == true){
+		do{
+			// empty: wakeup for a command
+			if(frame == NULL){
+				continue;
+			}
+			// re-queue the frame to the camera
+			VmbUint64_t		frameid;
+			frame->GetFrameID(frameid);
+			cout	 << get_current_date_time_string() << " camera_thread: queue frame again " << frameid  << endl;
+			camera.queue_frame(frame);
+			framecounter++;
+		}while(framequeue.try_pop(frame) == true);
+	}
+	wakeup_pending	= false;
+	return	framecounter;
+}
+
+// an empty frame, only one at a time
+void CVimbaSource::wakeup(){
+	if(wakeup_pending.exchange(true) == false){
+		framequeue.push(FramePtr());
+	}
+}
+
+/*****************************************************************************/
+// features
+/*****************************************************************************/
+string CVimbaSource::get_feature(const string& name){
+	return	camera.get_feature_string(name);
+}
+
+void CVimbaSource::set_feature(const string& name, const string& value){
+	camera.set_feature_string(name, value);
+}
+
+bool CVimbaSource::is_feature_writable(const string& name){
+	return	camera.is_feature_writable(name);
+}
+
+size_t CVimbaSource::get_payload_size(){
+	return	payload_size;
+}
+
+uint64_t CVimbaSource::latch_timestamp(){
+	return	camera.latch_timestamp();
+}
@@ -0,0 +1,97 @@
+/*****************************************************************************/
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+// Copyright Sebastian Meuren, 2022
+//
+/*****************************************************************************/
+#ifndef __VIMBA_SOURCE_H__
+#define __VIMBA_SOURCE_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+// thread-save queue
+#include "queue.h"
+
+#include "camera_source.h"
+#include "vimba.h"
+
+using namespace std;
+
+/*****************************************************************************/
+// CVimbaSource
+/*****************************************************************************/
+//
+//	an AVT camera via vimba (global_vimba). open finds the camera by its id,
+//	resets it and applies the default settings of config.xml.
+//
+//	The frame observers copy every frame into the server ring and return it
+//	to the camera thread through a queue, process_frames queues it to the
+//	camera again. An empty frame in the queue is a wakeup.
+//
+class	CVimbaSource : public CCameraSource{
+
+	public:
+	CVimbaSource(string cameraID, CFrameRing* framering, CSettingsGeneration* settings, CCameraControl* control, ostream& log);
+	~CVimbaSource();
+
+	void					open(function<void(steady_clock::duration)> rest);
+	void					close();
+
+	void					start_stream();
+	void					stop_stream();
+	bool					payload_changed();
+	void					start_acquisition();
+	void					stop_acquisition();
+
+	int						process_frames(microseconds timeout);
+	void					wakeup();
+
+	string					get_feature(const string& name);
+	void					set_feature(const string& name, const string& value);
+	bool					is_feature_writable(const string& name);
+	size_t					get_payload_size();
+	uint64_t				latch_timestamp();
+
+	// frame observer: the camera delivered a frame
+	void					frame_received(const FramePtr frame);
+
+	private:
+	string					cameraID;
+	CVimbaCamera			camera;
+
+	// frames back to the camera; one more entry: the wakeup
+	CMPMCQueue<FramePtr>	framequeue;
+	atomic<bool>			wakeup_pending;
+
+	// announced frames, for the payload they were announced with
+	VmbInt64_t				payload_size;
+	vector<IFrameObserverPtr>	fobserver_list;
+	vector<FramePtr>		frame_list;
+
+	// printed after the configuration, read as one batch
+	vector<CFeatureValue>	featurelist;
+
+	// empties the return queue, keeps a wakeup
+	void					drain();
+	// find the camera, retrying until vimba has it
+	CameraPtr				find(function<void(steady_clock::duration)> rest);
+	// default settings of config.xml, feature dump
+	void					configure();
+};
+
+/*****************************************************************************/
+#endif